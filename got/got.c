@@ -46,6 +46,8 @@
 #include "got_worktree.h"
 #include "got_diff.h"
 #include "got_commit_graph.h"
+#include "got_commit_graph_file.h"
+#include "got_commit_search.h"
 #include "got_blame.h"
 #include "got_privsep.h"
 #include "got_opentemp.h"
@@ -102,6 +104,7 @@ __dead static void	usage_integrate(void);
 __dead static void	usage_stage(void);
 __dead static void	usage_unstage(void);
 __dead static void	usage_cat(void);
+__dead static void	usage_commitgraph(void);
 
 static const struct got_error*		cmd_init(int, char *[]);
 static const struct got_error*		cmd_import(int, char *[]);
@@ -127,6 +130,7 @@ static const struct got_error*		cmd_integrate(int, char *[]);
 static const struct got_error*		cmd_stage(int, char *[]);
 static const struct got_error*		cmd_unstage(int, char *[]);
 static const struct got_error*		cmd_cat(int, char *[]);
+static const struct got_error*		cmd_commitgraph(int, char *[]);
 
 static struct got_cmd got_commands[] = {
 	{ "init",	cmd_init,	usage_init,	"in" },
@@ -153,6 +157,7 @@ static struct got_cmd got_commands[] = {
 	{ "stage",	cmd_stage,	usage_stage,	"sg" },
 	{ "unstage",	cmd_unstage,	usage_unstage,	"ug" },
 	{ "cat",	cmd_cat,	usage_cat,	"" },
+	{ "commitgraph", cmd_commitgraph, usage_commitgraph, "cg" },
 };
 
 static void
@@ -275,6 +280,22 @@ get_editor(char **abspath)
 	return NULL;
 }
 
+/* Allow blame results to be written to the repository's blame cache. */
+static const struct got_error *
+unveil_blame_cache(struct got_repository *repo)
+{
+	const struct got_error *err = NULL;
+	char *path;
+
+	path = got_repo_get_path_blame_cache(repo);
+	if (path == NULL)
+		return got_error_from_errno("got_repo_get_path_blame_cache");
+	if (unveil(path, "rwc") != 0)
+		err = got_error_from_errno2("unveil", path);
+	free(path);
+	return err;
+}
+
 static const struct got_error *
 apply_unveil(const char *repo_path, int repo_read_only,
     const char *worktree_path)
@@ -833,19 +854,12 @@ check_linear_ancestry(struct got_object_id *commit_id,
     struct got_repository *repo)
 {
 	const struct got_error *err = NULL;
-	struct got_object_id *yca_id;
-
-	err = got_commit_graph_find_youngest_common_ancestor(&yca_id,
-	    commit_id, base_commit_id, repo, check_cancelled, NULL);
-	if (err)
-		return err;
-
-	if (yca_id == NULL)
-		return got_error(GOT_ERR_ANCESTRY);
+	int is_ancestor;
 
 	/*
 	 * Require a straight line of history between the target commit
-	 * and the work tree's base commit.
+	 * and the work tree's base commit, i.e. one must be an ancestor
+	 * of the other.
 	 *
 	 * Non-linear situations such as this require a rebase:
 	 *
@@ -861,14 +875,19 @@ check_linear_ancestry(struct got_object_id *commit_id,
 	 * Update forwards in time:  A (base/yca) - B - C - D (commit)
 	 * Update backwards in time: D (base) - C - B - A (commit/yca)
 	 */
-	if (allow_forwards_in_time_only) {
-	    if (got_object_id_cmp(base_commit_id, yca_id) != 0)
-		return got_error(GOT_ERR_ANCESTRY);
-	} else if (got_object_id_cmp(commit_id, yca_id) != 0 &&
-	    got_object_id_cmp(base_commit_id, yca_id) != 0)
+	err = got_commit_graph_is_ancestor(&is_ancestor, base_commit_id,
+	    commit_id, repo, check_cancelled, NULL);
+	if (err || is_ancestor)
+		return err;
+	if (allow_forwards_in_time_only)
 		return got_error(GOT_ERR_ANCESTRY);
 
-	free(yca_id);
+	err = got_commit_graph_is_ancestor(&is_ancestor, commit_id,
+	    base_commit_id, repo, check_cancelled, NULL);
+	if (err)
+		return err;
+	if (!is_ancestor)
+		return got_error(GOT_ERR_ANCESTRY);
 	return NULL;
 }
 
@@ -895,7 +914,8 @@ check_same_branch(struct got_object_id *commit_id,
 		goto done;
 	}
 
-	err = got_commit_graph_open(&graph, head_commit_id, "/", 1, repo);
+	err = got_commit_graph_open(&graph, head_commit_id, "/",
+	    GOT_COMMIT_GRAPH_FIRST_PARENT, GOT_COMMIT_GRAPH_ORDER_DATE, repo);
 	if (err)
 		goto done;
 
@@ -1428,8 +1448,8 @@ done:
 
 static const struct got_error *
 diff_blobs(struct got_object_id *blob_id1, struct got_object_id *blob_id2,
-    const char *path, int diff_context, int ignore_whitespace,
-    struct got_repository *repo)
+    const char *path1, const char *path2, int diff_context,
+    int ignore_whitespace, struct got_repository *repo)
 {
 	const struct got_error *err = NULL;
 	struct got_blob_object *blob1 = NULL, *blob2 = NULL;
@@ -1444,9 +1464,11 @@ diff_blobs(struct got_object_id *blob_id1, struct got_object_id *blob_id2,
 	if (err)
 		goto done;
 
-	while (path[0] == '/')
-		path++;
-	err = got_diff_blob(blob1, blob2, path, path, diff_context,
+	while (path1[0] == '/')
+		path1++;
+	while (path2[0] == '/')
+		path2++;
+	err = got_diff_blob(blob1, blob2, path1, path2, diff_context,
 	    ignore_whitespace, stdout);
 done:
 	if (blob1)
@@ -1458,7 +1480,7 @@ done:
 static const struct got_error *
 diff_trees(struct got_object_id *tree_id1, struct got_object_id *tree_id2,
     const char *path, int diff_context, int ignore_whitespace,
-    struct got_repository *repo)
+    struct got_diff_session *diff_session, struct got_repository *repo)
 {
 	const struct got_error *err = NULL;
 	struct got_tree_object *tree1 = NULL, *tree2 = NULL;
@@ -1477,6 +1499,9 @@ diff_trees(struct got_object_id *tree_id1, struct got_object_id *tree_id2,
 	arg.diff_context = diff_context;
 	arg.ignore_whitespace = ignore_whitespace;
 	arg.outfile = stdout;
+	arg.session = diff_session;
+	arg.lines = NULL;
+	arg.nlines = NULL;
 	while (path[0] == '/')
 		path++;
 	err = got_diff_tree(tree1, tree2, path, path, repo,
@@ -1491,7 +1516,8 @@ done:
 
 static const struct got_error *
 print_patch(struct got_commit_object *commit, struct got_object_id *id,
-    const char *path, int diff_context, struct got_repository *repo)
+    const char *path, const char *parent_path, int diff_context,
+    struct got_diff_session *diff_session, struct got_repository *repo)
 {
 	const struct got_error *err = NULL;
 	struct got_commit_object *pcommit = NULL;
@@ -1519,7 +1545,7 @@ print_patch(struct got_commit_object *commit, struct got_object_id *id,
 		}
 		if (pcommit) {
 			err = got_object_id_by_path(&obj_id1, repo,
-			    qid->id, path);
+			    qid->id, parent_path);
 			if (err) {
 				free(obj_id2);
 				goto done;
@@ -1538,12 +1564,12 @@ print_patch(struct got_commit_object *commit, struct got_object_id *id,
 		printf("diff %s %s\n", id_str1 ? id_str1 : "/dev/null", id_str2);
 		switch (obj_type) {
 		case GOT_OBJ_TYPE_BLOB:
-			err = diff_blobs(obj_id1, obj_id2, path, diff_context,
-			    0, repo);
+			err = diff_blobs(obj_id1, obj_id2, parent_path, path,
+			    diff_context, 0, repo);
 			break;
 		case GOT_OBJ_TYPE_TREE:
 			err = diff_trees(obj_id1, obj_id2, path, diff_context,
-			    0, repo);
+			    0, diff_session, repo);
 			break;
 		default:
 			err = got_error(GOT_ERR_OBJ_TYPE);
@@ -1561,7 +1587,8 @@ print_patch(struct got_commit_object *commit, struct got_object_id *id,
 		if (err)
 			goto done;
 		printf("diff %s %s\n", id_str1 ? id_str1 : "/dev/null", id_str2);
-		err = diff_trees(obj_id1, obj_id2, "", diff_context, 0, repo);
+		err = diff_trees(obj_id1, obj_id2, "", diff_context, 0,
+		    diff_session, repo);
 	}
 
 done:
@@ -1590,38 +1617,13 @@ get_datestr(time_t *time, char *datebuf)
 	return s;
 }
 
-static const struct got_error *
-match_logmsg(int *have_match, struct got_object_id *id,
-    struct got_commit_object *commit, regex_t *regex)
-{
-	const struct got_error *err = NULL;
-	regmatch_t regmatch;
-	char *id_str = NULL, *logmsg = NULL;
-
-	*have_match = 0;
-
-	err = got_object_id_str(&id_str, id);
-	if (err)
-		return err;
-
-	err = got_object_commit_get_logmsg(&logmsg, commit);
-	if (err)
-		goto done;
-
-	if (regexec(regex, logmsg, 1, &regmatch, 0) == 0)
-		*have_match = 1;
-done:
-	free(id_str);
-	free(logmsg);
-	return err;
-}
-
 #define GOT_COMMIT_SEP_STR "-----------------------------------------------\n"
 
 static const struct got_error *
 print_commit(struct got_commit_object *commit, struct got_object_id *id,
-    struct got_repository *repo, const char *path, int show_patch,
-    int diff_context, struct got_reflist_head *refs)
+    struct got_repository *repo, const char *path, const char *parent_path,
+    int show_patch, int diff_context, struct got_diff_session *diff_session,
+    struct got_reflist_head *refs)
 {
 	const struct got_error *err = NULL;
 	char *id_str, *datestr, *logmsg0, *logmsg, *line;
@@ -1720,7 +1722,8 @@ print_commit(struct got_commit_object *commit, struct got_object_id *id,
 	free(logmsg0);
 
 	if (show_patch) {
-		err = print_patch(commit, id, path, diff_context, repo);
+		err = print_patch(commit, id, path, parent_path,
+		    diff_context, diff_session, repo);
 		if (err == 0)
 			printf("\n");
 	}
@@ -1730,31 +1733,107 @@ print_commit(struct got_commit_object *commit, struct got_object_id *id,
 	return err;
 }
 
+/*
+ * Print those commits of a batch which match the search, with the paths
+ * of interest in each commit and its parent. Set *done if the log limit
+ * was reached.
+ */
+static const struct got_error *
+print_matching_commits(int *done, struct got_commit_search *search,
+    struct got_object_id **ids, const char **paths,
+    const char **parent_paths, int nids, struct got_repository *repo,
+    int show_patch, int diff_context,
+    struct got_diff_session *diff_session, int *limit,
+    struct got_reflist_head *refs)
+{
+	const struct got_error *err;
+	struct got_commit_object *commits[GOT_COMMIT_SEARCH_BATCH_SIZE];
+	int matches[GOT_COMMIT_SEARCH_BATCH_SIZE];
+	int i;
+
+	*done = 0;
+
+	err = got_object_open_as_commits(commits, repo, ids, nids);
+	if (err)
+		goto done;
+
+	err = got_commit_search_match(matches, search, ids, commits, nids);
+	if (err)
+		goto done;
+
+	for (i = 0; i < nids; i++) {
+		if (sigint_received || sigpipe_received) {
+			*done = 1;
+			break;
+		}
+		if (!matches[i])
+			continue;
+		err = print_commit(commits[i], ids[i], repo, paths[i],
+		    parent_paths[i], show_patch, diff_context, diff_session,
+		    refs);
+		if (err)
+			break;
+		if (*limit && --(*limit) == 0) {
+			*done = 1;
+			break;
+		}
+	}
+done:
+	for (i = 0; i < nids; i++) {
+		if (commits[i])
+			got_object_commit_close(commits[i]);
+	}
+	return err;
+}
+
 static const struct got_error *
 print_commits(struct got_object_id *root_id, struct got_repository *repo,
     char *path, int show_patch, char *search_pattern, int diff_context,
-    int limit, int first_parent_traversal, struct got_reflist_head *refs)
+    int limit, int graph_flags, int order,
+    struct got_reflist_head *refs)
 {
 	const struct got_error *err;
-	struct got_commit_graph *graph;
+	struct got_commit_graph *graph = NULL;
+	struct got_commit_search *search = NULL;
+	struct got_diff_session *diff_session = NULL;
 	regex_t regex;
-	int have_match;
+	struct got_object_id *batch[GOT_COMMIT_SEARCH_BATCH_SIZE];
+	const char *batch_paths[GOT_COMMIT_SEARCH_BATCH_SIZE];
+	const char *batch_parent_paths[GOT_COMMIT_SEARCH_BATCH_SIZE];
+	int i, nbatch = 0, done = 0;
 
 	if (search_pattern &&
 	    regcomp(&regex, search_pattern, REG_EXTENDED | REG_NOSUB | REG_NEWLINE))
 		return got_error_msg(GOT_ERR_REGEX, search_pattern);
 
-	err = got_commit_graph_open(&graph, root_id, path,
-	    first_parent_traversal, repo);
+	err = got_commit_graph_open(&graph, root_id, path, graph_flags, order,
+	    repo);
 	if (err)
-		return err;
+		goto done;
+
 	err = got_commit_graph_iter_start(graph, root_id, repo,
 	    check_cancelled, NULL);
 	if (err)
 		goto done;
+	got_commit_graph_set_streaming(graph);
+
+	if (search_pattern) {
+		err = got_commit_search_open(&search, &regex,
+		    GOT_COMMIT_SEARCH_LOGMSG);
+		if (err)
+			goto done;
+	}
+
+	if (show_patch) {
+		err = got_diff_session_open(&diff_session);
+		if (err)
+			goto done;
+	}
+
 	for (;;) {
 		struct got_commit_object *commit;
 		struct got_object_id *id;
+		const char *commit_path, *parent_path;
 
 		if (sigint_received || sigpipe_received)
 			break;
@@ -1777,40 +1856,71 @@ print_commits(struct got_object_id *root_id, struct got_repository *repo,
 		if (id == NULL)
 			break;
 
-		err = got_object_open_as_commit(&commit, repo, id);
-		if (err)
-			break;
-
-		if (search_pattern) {
-			err = match_logmsg(&have_match, id, commit, &regex);
-			if (err) {
-				got_object_commit_close(commit);
+		if (search) {
+			/*
+			 * Copy the ID since the commit graph may free it
+			 * while more commits are being fetched.
+			 */
+			batch[nbatch] = got_object_id_dup(id);
+			if (batch[nbatch] == NULL) {
+				err = got_error_from_errno("got_object_id_dup");
 				break;
 			}
-			if (have_match == 0) {
-				got_object_commit_close(commit);
+			got_commit_graph_get_paths(&batch_paths[nbatch],
+			    &batch_parent_paths[nbatch], graph);
+			if (++nbatch < GOT_COMMIT_SEARCH_BATCH_SIZE)
 				continue;
-			}
+			err = print_matching_commits(&done, search, batch,
+			    batch_paths, batch_parent_paths, nbatch, repo,
+			    show_patch, diff_context, diff_session, &limit,
+			    refs);
+			for (i = 0; i < nbatch; i++)
+				free(batch[i]);
+			nbatch = 0;
+			if (err || done)
+				break;
+			continue;
 		}
 
-		err = print_commit(commit, id, repo, path, show_patch,
-		    diff_context, refs);
+		err = got_object_open_as_commit(&commit, repo, id);
+		if (err)
+			break;
+
+		/* Older commits may have the path a file was renamed from. */
+		got_commit_graph_get_paths(&commit_path, &parent_path, graph);
+		err = print_commit(commit, id, repo, commit_path, parent_path,
+		    show_patch, diff_context, diff_session, refs);
 		got_object_commit_close(commit);
 		if (err || (limit && --limit == 0))
 			break;
 	}
+
+	if (err == NULL && !done && nbatch > 0 &&
+	    !sigint_received && !sigpipe_received)
+		err = print_matching_commits(&done, search, batch,
+		    batch_paths, batch_parent_paths, nbatch, repo, show_patch,
+		    diff_context, diff_session, &limit, refs);
 done:
+	for (i = 0; i < nbatch; i++)
+		free(batch[i]);
+	if (search)
+		got_commit_search_close(search);
+	if (diff_session)
+		got_diff_session_close(diff_session);
 	if (search_pattern)
 		regfree(&regex);
-	got_commit_graph_close(graph);
+	if (graph)
+		got_commit_graph_close(graph);
 	return err;
 }
 
 __dead static void
 usage_log(void)
 {
-	fprintf(stderr, "usage: %s log [-c commit] [-C number] [-f] [ -l N ] [-p] "
-	    "[-s search-pattern] [-r repository-path] [path]\n", getprogname());
+	fprintf(stderr, "usage: %s log [-a | -t] [-c commit] [-C number] [-f] "
+	    "[-M] [ -l N ] [-p] [-s search-pattern] [-r repository-path] "
+	    "[path]\n",
+	    getprogname());
 	exit(1);
 }
 
@@ -1841,7 +1951,8 @@ cmd_log(int argc, char *argv[])
 	char *repo_path = NULL, *path = NULL, *cwd = NULL, *in_repo_path = NULL;
 	char *start_commit = NULL, *search_pattern = NULL;
 	int diff_context = -1, ch;
-	int show_patch = 0, limit = 0, first_parent_traversal = 0;
+	int show_patch = 0, limit = 0, graph_flags = 0;
+	int order = GOT_COMMIT_GRAPH_ORDER_DATE;
 	const char *errstr;
 	struct got_reflist_head refs;
 
@@ -1856,8 +1967,11 @@ cmd_log(int argc, char *argv[])
 
 	limit = get_default_log_limit();
 
-	while ((ch = getopt(argc, argv, "b:pc:C:l:fr:s:")) != -1) {
+	while ((ch = getopt(argc, argv, "ab:pc:C:l:fMr:s:t")) != -1) {
 		switch (ch) {
+		case 'a':
+			order = GOT_COMMIT_GRAPH_ORDER_AUTHOR_DATE;
+			break;
 		case 'p':
 			show_patch = 1;
 			break;
@@ -1876,7 +1990,11 @@ cmd_log(int argc, char *argv[])
 				err(1, "-l option %s", errstr);
 			break;
 		case 'f':
-			first_parent_traversal = 1;
+			graph_flags |= GOT_COMMIT_GRAPH_FIRST_PARENT;
+			break;
+		case 'M':
+			graph_flags |= GOT_COMMIT_GRAPH_FIRST_PARENT |
+			    GOT_COMMIT_GRAPH_FOLLOW_RENAMES;
 			break;
 		case 'r':
 			repo_path = realpath(optarg, NULL);
@@ -1888,6 +2006,9 @@ cmd_log(int argc, char *argv[])
 		case 's':
 			search_pattern = optarg;
 			break;
+		case 't':
+			order = GOT_COMMIT_GRAPH_ORDER_TOPO;
+			break;
 		default:
 			usage_log();
 			/* NOTREACHED */
@@ -2039,7 +2160,7 @@ cmd_log(int argc, char *argv[])
 		goto done;
 
 	error = print_commits(id, repo, path, show_patch, search_pattern,
-	    diff_context, limit, first_parent_traversal, &refs);
+	    diff_context, limit, graph_flags, order, &refs);
 done:
 	free(path);
 	free(repo_path);
@@ -2127,9 +2248,9 @@ print_diff(void *arg, unsigned char status, unsigned char staged_status,
 		default:
 			return got_error(GOT_ERR_FILE_STATUS);
 		}
-		return got_diff_objects_as_blobs(blob_id, staged_blob_id,
-		    label1, label2, a->diff_context, a->ignore_whitespace,
-		    a->repo, stdout);
+		return got_diff_objects_as_blobs(NULL, NULL, blob_id,
+		    staged_blob_id, label1, label2, a->diff_context,
+		    a->ignore_whitespace, a->repo, stdout);
 	}
 
 	if (staged_status == GOT_STATUS_ADD ||
@@ -2415,17 +2536,17 @@ cmd_diff(int argc, char *argv[])
 
 	switch (type1) {
 	case GOT_OBJ_TYPE_BLOB:
-		error = got_diff_objects_as_blobs(id1, id2, NULL, NULL,
-		    diff_context, ignore_whitespace, repo, stdout);
+		error = got_diff_objects_as_blobs(NULL, NULL, id1, id2,
+		    NULL, NULL, diff_context, ignore_whitespace, repo, stdout);
 		break;
 	case GOT_OBJ_TYPE_TREE:
-		error = got_diff_objects_as_trees(id1, id2, "", "",
+		error = got_diff_objects_as_trees(NULL, NULL, id1, id2, "", "",
 		    diff_context, ignore_whitespace, repo, stdout);
 		break;
 	case GOT_OBJ_TYPE_COMMIT:
 		printf("diff %s %s\n", label1, label2);
-		error = got_diff_objects_as_commits(id1, id2, diff_context,
-		    ignore_whitespace, repo, stdout);
+		error = got_diff_objects_as_commits(NULL, NULL, id1, id2,
+		    diff_context, ignore_whitespace, repo, stdout);
 		break;
 	default:
 		error = got_error(GOT_ERR_OBJ_TYPE);
@@ -2653,6 +2774,10 @@ cmd_blame(int argc, char *argv[])
 	if (error != NULL)
 		goto done;
 
+	error = unveil_blame_cache(repo);
+	if (error)
+		goto done;
+
 	error = apply_unveil(got_repo_get_path(repo), 1, NULL);
 	if (error)
 		goto done;
@@ -5271,7 +5396,8 @@ collect_commits(struct got_object_id_queue *commits,
 	struct got_object_qid *qid;
         struct got_object_id *commit_id = initial_commit_id;
 
-	err = got_commit_graph_open(&graph, initial_commit_id, "/", 1, repo);
+	err = got_commit_graph_open(&graph, initial_commit_id, "/",
+	    GOT_COMMIT_GRAPH_FIRST_PARENT, GOT_COMMIT_GRAPH_ORDER_DATE, repo);
 	if (err)
 		return err;
 
@@ -7327,3 +7453,104 @@ done:
 	}
 	return error;
 }
+
+__dead static void
+usage_commitgraph(void)
+{
+	fprintf(stderr, "usage: %s commitgraph [-b] [-r repository-path]\n",
+	    getprogname());
+	exit(1);
+}
+
+static const struct got_error *
+cmd_commitgraph(int argc, char *argv[])
+{
+	const struct got_error *error;
+	struct got_repository *repo = NULL;
+	struct got_worktree *worktree = NULL;
+	char *cwd = NULL, *repo_path = NULL;
+	int ch, bloom = 0, ncommits;
+
+#ifndef PROFILE
+	if (pledge("stdio rpath wpath cpath fattr flock proc exec sendfd "
+	    "unveil", NULL) == -1)
+		err(1, "pledge");
+#endif
+
+	while ((ch = getopt(argc, argv, "br:")) != -1) {
+		switch (ch) {
+		case 'b':
+			bloom = 1;
+			break;
+		case 'r':
+			repo_path = realpath(optarg, NULL);
+			if (repo_path == NULL)
+				return got_error_from_errno2("realpath",
+				    optarg);
+			got_path_strip_trailing_slashes(repo_path);
+			break;
+		default:
+			usage_commitgraph();
+			/* NOTREACHED */
+		}
+	}
+
+	argc -= optind;
+	argv += optind;
+
+	if (argc != 0)
+		usage_commitgraph();
+
+	cwd = getcwd(NULL, 0);
+	if (cwd == NULL) {
+		error = got_error_from_errno("getcwd");
+		goto done;
+	}
+	if (repo_path == NULL) {
+		error = got_worktree_open(&worktree, cwd);
+		if (error && error->code != GOT_ERR_NOT_WORKTREE)
+			goto done;
+		if (worktree) {
+			repo_path = strdup(
+			    got_worktree_get_repo_path(worktree));
+			if (repo_path == NULL) {
+				error = got_error_from_errno("strdup");
+				goto done;
+			}
+		} else {
+			repo_path = strdup(cwd);
+			if (repo_path == NULL) {
+				error = got_error_from_errno("strdup");
+				goto done;
+			}
+		}
+	}
+
+	error = got_repo_open(&repo, repo_path, NULL);
+	if (error != NULL)
+		goto done;
+
+	error = apply_unveil(got_repo_get_path(repo), 0, NULL);
+	if (error)
+		goto done;
+
+	error = got_commit_graph_file_write(&ncommits, repo, bloom,
+	    check_cancelled, NULL);
+	if (error)
+		goto done;
+
+	printf("Wrote commit-graph file with %d commit%s\n", ncommits,
+	    ncommits == 1 ? "" : "s");
+done:
+	free(cwd);
+	free(repo_path);
+	if (worktree)
+		got_worktree_close(worktree);
+	if (repo) {
+		const struct got_error *repo_error;
+		repo_error = got_repo_close(repo);
+		if (error == NULL)
+			error = repo_error;
+	}
+	return error;
+}
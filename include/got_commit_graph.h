@@ -16,8 +16,36 @@
 
 struct got_commit_graph;
 
+/*
+ * Open a commit graph for traversing history from the specified commit,
+ * considering only commits which changed the specified path. The flags
+ * argument may contain:
+ *
+ * GOT_COMMIT_GRAPH_FIRST_PARENT traverses only first-parent ancestry.
+ * GOT_COMMIT_GRAPH_FOLLOW_RENAMES follows history across commits which
+ * renamed or copied a file to the specified path. It has no effect unless
+ * GOT_COMMIT_GRAPH_FIRST_PARENT is set as well.
+ *
+ * The order argument specifies the order in which commits are returned
+ * during iteration:
+ *
+ * GOT_COMMIT_GRAPH_ORDER_DATE returns newer commits first, by committer time.
+ * GOT_COMMIT_GRAPH_ORDER_TOPO returns no commit before all of its children,
+ * and avoids interleaving commits from different lines of history.
+ * GOT_COMMIT_GRAPH_ORDER_AUTHOR_DATE returns no commit before all of its
+ * children, and newer commits first by author time otherwise.
+ *
+ * Orders other than GOT_COMMIT_GRAPH_ORDER_DATE return commits without
+ * traversing all of history first only if the repository has a
+ * commit-graph file which provides generation numbers.
+ */
+#define GOT_COMMIT_GRAPH_ORDER_DATE		0
+#define GOT_COMMIT_GRAPH_ORDER_TOPO		1
+#define GOT_COMMIT_GRAPH_ORDER_AUTHOR_DATE	2
+#define GOT_COMMIT_GRAPH_FIRST_PARENT		0x01
+#define GOT_COMMIT_GRAPH_FOLLOW_RENAMES		0x02
 const struct got_error *got_commit_graph_open(struct got_commit_graph **,
-    struct got_object_id *commit_id, const char *, int,
+    struct got_object_id *commit_id, const char *, int, int,
     struct got_repository *repo);
 void got_commit_graph_close(struct got_commit_graph *);
 
@@ -29,11 +57,47 @@ const struct got_error *got_commit_graph_iter_start(
     got_cancel_cb, void *);
 const struct got_error *got_commit_graph_iter_next(struct got_object_id **,
     struct got_commit_graph *);
+
+/*
+ * Return the path of interest in the commit most recently returned by
+ * got_commit_graph_iter_next(), and in its first parent. If renames are
+ * followed, these are the paths the file had in those commits, which
+ * differ if the commit renamed the file. The paths remain valid until
+ * the graph is closed.
+ */
+void got_commit_graph_get_paths(const char **, const char **,
+    struct got_commit_graph *);
+
+/*
+ * Free commits once they have been returned by got_commit_graph_iter_next()
+ * and can no longer be reached from open branches, such that memory use
+ * stays proportional to the width of the history being traversed rather
+ * than its length. Unless only first-parent ancestry is traversed, this
+ * requires generation numbers from a commit-graph file. Without them,
+ * the IDs of freed commits are still kept by GOT_COMMIT_GRAPH_ORDER_DATE
+ * iteration, and other orders keep all commits. Call this after
+ * got_commit_graph_iter_start(); iteration cannot be restarted afterwards.
+ */
+void got_commit_graph_set_streaming(struct got_commit_graph *);
 const struct got_error *got_commit_graph_intersect(struct got_object_id **,
     struct got_commit_graph *, struct got_commit_graph *,
     struct got_repository *);
 
-/* Find the youngest common ancestor of two commits. */
+/*
+ * Find the youngest common ancestor of two commits, considering only
+ * first-parent ancestry, i.e. a commit which is an ancestor of both
+ * commits and which is not an ancestor of any other such commit.
+ * Set the output ID to NULL if the commits share no common ancestry.
+ */
 const struct got_error *got_commit_graph_find_youngest_common_ancestor(
     struct got_object_id **, struct got_object_id *, struct got_object_id *,
     struct got_repository *, got_cancel_cb, void *);
+
+/*
+ * Determine whether the first commit is an ancestor of the second commit.
+ * A commit is considered an ancestor of itself. Reachability bitmaps are
+ * used if the repository has a bitmap file.
+ */
+const struct got_error *got_commit_graph_is_ancestor(int *,
+    struct got_object_id *, struct got_object_id *,
+    struct got_repository *, got_cancel_cb, void *);
@@ -0,0 +1,50 @@
+/*
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Match a regular expression against batches of commits, using a pool
+ * of threads. Commits are best opened in batches as well, with
+ * got_object_open_as_commits().
+ */
+struct got_commit_search;
+
+/* Parts of a commit which the regular expression is matched against. */
+#define GOT_COMMIT_SEARCH_LOGMSG	0x01
+#define GOT_COMMIT_SEARCH_AUTHOR	0x02	/* author and committer */
+#define GOT_COMMIT_SEARCH_ID		0x04
+
+/* A good number of commits to match at once. */
+#define GOT_COMMIT_SEARCH_BATCH_SIZE	128
+
+/*
+ * Prepare a search for commits which match the specified compiled regular
+ * expression in any of the parts selected by the integer flags argument.
+ * The regular expression must remain valid until the search is closed.
+ */
+const struct got_error *got_commit_search_open(struct got_commit_search **,
+    regex_t *, int);
+
+/*
+ * Match commits with the specified IDs. The integer array must provide
+ * room for the specified number of commits. For each commit, the
+ * corresponding array element is set to 1 if the commit matches, and
+ * to 0 otherwise.
+ */
+const struct got_error *got_commit_search_match(int *,
+    struct got_commit_search *, struct got_object_id **,
+    struct got_commit_object **, int);
+
+void got_commit_search_close(struct got_commit_search *);
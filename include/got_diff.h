@@ -14,6 +14,36 @@
  * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
  */
 
+/*
+ * Lines of diff output can be recorded while diff output is written, such
+ * that programs which display diff output can locate and classify lines
+ * without parsing text. Each line is recorded with its offset in the output
+ * file and one of the following types.
+ */
+#define GOT_DIFF_LINE_NONE	0	/* not written by the diff code */
+#define GOT_DIFF_LINE_META	1	/* "blob -", "blob +", "file -", ... */
+#define GOT_DIFF_LINE_INFO	2	/* other text, e.g. binary files */
+#define GOT_DIFF_LINE_LABEL1	3	/* "--- " label of old file */
+#define GOT_DIFF_LINE_LABEL2	4	/* "+++ " label of new file */
+#define GOT_DIFF_LINE_HUNK	5	/* "@@ ... @@" hunk header */
+#define GOT_DIFF_LINE_MINUS	6	/* line removed from old file */
+#define GOT_DIFF_LINE_PLUS	7	/* line added to new file */
+#define GOT_DIFF_LINE_CONTEXT	8	/* unchanged line */
+
+struct got_diff_output_line {
+	off_t offset;
+	uint8_t type;
+};
+
+/*
+ * Append a line to an array of diff output lines, growing the array as
+ * needed. Callers which write lines to diff output themselves can use this
+ * to record such lines. Arrays of output lines must only be grown with
+ * this function, starting with a NULL array and zero lines.
+ */
+const struct got_error *got_diff_add_line(struct got_diff_output_line **,
+    size_t *, off_t, uint8_t);
+
 /*
  * Compute the differences between two blobs and write unified diff text
  * to the provided output FILE. Two const char * diff header labels may
@@ -52,6 +82,15 @@ typedef const struct got_error *(*got_diff_blob_cb)(void *,
     struct got_object_id *, struct got_object_id *,
     const char *, const char *, mode_t, mode_t, struct got_repository *);
 
+/*
+ * A diff session keeps memory used for diffing allocated while many pairs
+ * of blobs are diffed, for instance by got_diff_tree(), instead of
+ * allocating and freeing this memory for every pair of blobs.
+ */
+struct got_diff_session;
+const struct got_error *got_diff_session_open(struct got_diff_session **);
+void got_diff_session_close(struct got_diff_session *);
+
 /*
  * A pre-defined implementation of got_diff_blob_cb() which appends unidiff
  * output to a file. The caller must allocate and fill in the argument
@@ -61,12 +100,40 @@ struct got_diff_blob_output_unidiff_arg {
 	FILE *outfile;		/* Unidiff text will be written here. */
 	int diff_context;	/* Sets the number of context lines. */
 	int ignore_whitespace;	/* Ignore whitespace differences. */
+	struct got_diff_session *session; /* Optional diff session. */
+
+	/* Optional array which output lines are appended to, and its size. */
+	struct got_diff_output_line **lines;
+	size_t *nlines;
 };
 const struct got_error *got_diff_blob_output_unidiff(void *,
     struct got_blob_object *, struct got_blob_object *,
     struct got_object_id *, struct got_object_id *,
     const char *, const char *, mode_t, mode_t, struct got_repository *);
 
+/*
+ * Diff pairs of blobs on a pool of threads. The output FILE, an optional
+ * array of output lines and its size, the number of context lines, and
+ * whether to ignore whitespace differences must be specified, as for
+ * got_diff_blob_output_unidiff().
+ */
+struct got_diff_parallel;
+const struct got_error *got_diff_parallel_open(struct got_diff_parallel **,
+    FILE *, struct got_diff_output_line **, size_t *, int, int);
+
+/*
+ * An implementation of got_diff_blob_cb() which expects a parallel diff
+ * as its argument. Blob contents are copied and diffed in the background,
+ * while unidiff output is written in the order in which blobs were passed.
+ */
+const struct got_error *got_diff_blob_output_unidiff_parallel(void *,
+    struct got_blob_object *, struct got_blob_object *,
+    struct got_object_id *, struct got_object_id *,
+    const char *, const char *, mode_t, mode_t, struct got_repository *);
+
+/* Wait for remaining diffs, write their output, and free a parallel diff. */
+const struct got_error *got_diff_parallel_close(struct got_diff_parallel *);
+
 /*
  * Compute the differences between two trees and invoke the provided
  * got_diff_blob_cb() callback when content differs.
@@ -78,14 +145,27 @@ const struct got_error *got_diff_tree(struct got_tree_object *,
     struct got_tree_object *, const char *, const char *,
     struct got_repository *, got_diff_blob_cb cb, void *cb_arg, int);
 
+/*
+ * Like got_diff_tree(), but detect files which were renamed or copied.
+ * Such files are passed to the callback as a single pair of blobs with
+ * differing labels, rather than as a deleted file and an added file.
+ * The callback is invoked once all changes between the trees are known.
+ */
+const struct got_error *got_diff_tree_renames(struct got_tree_object *,
+    struct got_tree_object *, const char *, const char *,
+    struct got_repository *, got_diff_blob_cb cb, void *cb_arg, int);
+
 /*
  * Diff two objects, assuming both objects are blobs. Two const char * diff
  * header labels may be provided which will be used to identify each blob in
  * the diff output. If a label is NULL, use the blob's SHA1 checksum instead.
  * The number of context lines to show in the diff must be specified as well.
  * Write unified diff text to the provided output FILE.
+ * If an array of output lines is passed, append each line written to it,
+ * growing it with got_diff_add_line(). The caller must free the array.
  */
-const struct got_error *got_diff_objects_as_blobs(struct got_object_id *,
+const struct got_error *got_diff_objects_as_blobs(
+    struct got_diff_output_line **, size_t *, struct got_object_id *,
     struct got_object_id *, const char *, const char *, int, int,
     struct got_repository *, FILE *);
 
@@ -94,18 +174,28 @@ const struct got_error *got_diff_objects_as_blobs(struct got_object_id *,
  * header labels may be provided which will be used to identify each blob in
  * the trees. If a label is NULL, use the blob's SHA1 checksum instead.
  * The number of context lines to show in diffs must be specified.
- * Write unified diff text to the provided output FILE.
+ * Write unified diff text to the provided output FILE, and optionally
+ * record output lines as got_diff_objects_as_blobs() does.
  */
-const struct got_error *got_diff_objects_as_trees(struct got_object_id *,
+const struct got_error *got_diff_objects_as_trees(
+    struct got_diff_output_line **, size_t *, struct got_object_id *,
     struct got_object_id *, char *, char *, int, int,
     struct got_repository *, FILE *);
 
 /*
  * Diff two objects, assuming both objects are commits.
  * The number of context lines to show in diffs must be specified.
- * Write unified diff text to the provided output FILE.
+ * Write unified diff text to the provided output FILE, and optionally
+ * record output lines as got_diff_objects_as_blobs() does.
  */
-const struct got_error *got_diff_objects_as_commits(struct got_object_id *,
+const struct got_error *got_diff_objects_as_commits(
+    struct got_diff_output_line **, size_t *, struct got_object_id *,
     struct got_object_id *, int, int, struct got_repository *, FILE *);
 
 #define GOT_DIFF_MAX_CONTEXT	64
+
+/*
+ * Blobs larger than this amount of bytes are summarized instead of diffed.
+ * The GOT_DIFF_MAX_BLOB_SIZE environment variable overrides this limit.
+ */
+#define GOT_DIFF_MAX_BLOB_SIZE	(16 * 1024 * 1024)
@@ -128,6 +128,9 @@
 #define GOT_ERR_REGEX		112
 #define GOT_ERR_REF_NAME_MINUS	113
 #define GOT_ERR_GITCONFIG_SYNTAX 114
+#define GOT_ERR_BAD_COMMIT_GRAPH 115
+#define GOT_ERR_BAD_BITMAP	116
+#define GOT_ERR_BLAME_CACHE_READONLY 117
 
 static const struct got_error {
 	int code;
@@ -262,6 +265,9 @@ static const struct got_error {
 	{ GOT_ERR_REGEX, "regular expression error" },
 	{ GOT_ERR_REF_NAME_MINUS, "reference name may not start with '-'" },
 	{ GOT_ERR_GITCONFIG_SYNTAX, "gitconfig syntax error" },
+	{ GOT_ERR_BAD_COMMIT_GRAPH, "bad commit-graph file" },
+	{ GOT_ERR_BAD_BITMAP, "bad pack bitmap file" },
+	{ GOT_ERR_BLAME_CACHE_READONLY, "blame cache cannot be written" },
 };
 
 /*
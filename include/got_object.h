@@ -113,6 +113,16 @@ const struct got_error *got_object_resolve_id_str(struct got_object_id **,
 const struct got_error *got_object_open_as_commit(struct got_commit_object **,
     struct got_repository *, struct got_object_id *);
 
+/*
+ * Attempt to open several commit objects in a repository at once.
+ * Loose commits are parsed concurrently by a pool of helper processes.
+ * The provided array must have room for the specified number of commits.
+ * The caller must dispose of each commit with got_object_commit_close().
+ */
+const struct got_error *got_object_open_as_commits(
+    struct got_commit_object **, struct got_repository *,
+    struct got_object_id **, int);
+
 /* Dispose of a commit object. */
 void got_object_commit_close(struct got_commit_object *);
 
@@ -162,6 +172,15 @@ const char *got_object_commit_get_logmsg_raw(struct got_commit_object *);
 const struct got_error *got_object_open_as_tree(struct got_tree_object **,
     struct got_repository *, struct got_object_id *);
 
+/*
+ * Attempt to open several tree objects in a repository at once.
+ * Loose trees are parsed concurrently by a pool of helper processes.
+ * The provided array must have room for the specified number of trees.
+ * The caller must dispose of each tree with got_object_tree_close().
+ */
+const struct got_error *got_object_open_as_trees(struct got_tree_object **,
+    struct got_repository *, struct got_object_id **, int);
+
 /* Dispose of a tree object. */
 void got_object_tree_close(struct got_tree_object *);
 
@@ -299,3 +318,55 @@ const struct got_error *got_object_commit_add_parent(struct got_commit_object *,
 const struct got_error *got_object_tag_create(struct got_object_id **,
     const char *, struct got_object_id *, const char *,
     time_t, const char *, struct got_repository *);
+
+/*
+ * An asynchronous object reader allows many commit and tree objects to be
+ * requested before any of them are read. Requests are served by helper
+ * processes which belong to the reader and run concurrently.
+ */
+struct got_object_async;
+
+/*
+ * Callbacks which receive objects read by an asynchronous object reader.
+ * The request ID is zero if the object was found in the object cache and
+ * the callback runs before the request function returns.
+ * The callback must dispose of the object with got_object_commit_close()
+ * or got_object_tree_close(), respectively.
+ */
+typedef const struct got_error *(*got_object_async_commit_cb)(void *,
+    uint32_t, struct got_object_id *, struct got_commit_object *);
+typedef const struct got_error *(*got_object_async_tree_cb)(void *,
+    uint32_t, struct got_object_id *, struct got_tree_object *);
+
+/* Create an asynchronous object reader for a repository. */
+const struct got_error *got_object_async_open(struct got_object_async **,
+    struct got_repository *);
+
+/*
+ * Dispose of an asynchronous object reader. Objects still in flight are
+ * read and cached but callbacks are not invoked for them.
+ */
+const struct got_error *got_object_async_close(struct got_object_async *);
+
+/*
+ * Request a commit or tree object. An ID for the request is returned in
+ * the first argument, unless it is NULL. This function only blocks if
+ * too many requests are in flight already.
+ */
+const struct got_error *got_object_async_request_commit(uint32_t *,
+    struct got_object_async *, struct got_object_id *,
+    got_object_async_commit_cb, void *);
+const struct got_error *got_object_async_request_tree(uint32_t *,
+    struct got_object_async *, struct got_object_id *,
+    got_object_async_tree_cb, void *);
+
+/*
+ * Invoke callbacks for objects which have been read by helpers.
+ * Wait at most the specified timeout in milliseconds, or forever if -1.
+ * Return the number of completed requests in the first argument.
+ */
+const struct got_error *got_object_async_dispatch(int *,
+    struct got_object_async *, int);
+
+/* Return the number of requests which have not completed yet. */
+int got_object_async_pending(struct got_object_async *);
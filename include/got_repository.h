@@ -62,6 +62,7 @@ char *got_repo_get_path_objects(struct got_repository *);
 char *got_repo_get_path_objects_pack(struct got_repository *);
 char *got_repo_get_path_refs(struct got_repository *);
 char *got_repo_get_path_packed_refs(struct got_repository *);
+char *got_repo_get_path_blame_cache(struct got_repository *);
 
 struct got_reference;
 
@@ -0,0 +1,490 @@
+/*
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/queue.h>
+#include <sys/mman.h>
+
+#include <fcntl.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <sha1.h>
+#include <endian.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "got_error.h"
+#include "got_object.h"
+
+#include "got_lib_delta.h"
+#include "got_lib_object.h"
+#include "got_lib_pack.h"
+#include "got_lib_bitmap.h"
+
+/*
+ * Like pack index files, bitmap files are read in the main process.
+ * Their contents are not trusted; every position and offset read from
+ * the file is checked before it is used.
+ */
+
+const struct got_error *
+got_bitmap_alloc(struct got_bitmap **bm, uint32_t nbits)
+{
+	*bm = malloc(sizeof(**bm));
+	if (*bm == NULL)
+		return got_error_from_errno("malloc");
+
+	(*bm)->nwords = ((size_t)nbits + 63) / 64;
+	(*bm)->words = calloc((*bm)->nwords, sizeof(*(*bm)->words));
+	if ((*bm)->words == NULL) {
+		free(*bm);
+		*bm = NULL;
+		return got_error_from_errno("calloc");
+	}
+
+	return NULL;
+}
+
+void
+got_bitmap_free(struct got_bitmap *bm)
+{
+	free(bm->words);
+	free(bm);
+}
+
+void
+got_bitmap_set(struct got_bitmap *bm, uint32_t bit)
+{
+	if (bit / 64 < bm->nwords)
+		bm->words[bit / 64] |= (1ULL << (bit % 64));
+}
+
+int
+got_bitmap_test(struct got_bitmap *bm, uint32_t bit)
+{
+	if (bit / 64 >= bm->nwords)
+		return 0;
+	return (bm->words[bit / 64] & (1ULL << (bit % 64))) != 0;
+}
+
+/*
+ * An EWAH bitmap consists of a 32-bit bit count, a 32-bit word count,
+ * the words, and the 32-bit position of the last run-length word.
+ * Each run-length word describes a run of identical words, followed by
+ * a number of literal words which are stored as-is.
+ */
+#define GOT_EWAH_RUN_BIT	0x1ULL
+#define GOT_EWAH_RUN_LEN_SHIFT	1
+#define GOT_EWAH_RUN_LEN_MASK	0xffffffffULL
+#define GOT_EWAH_LITERALS_SHIFT	33
+
+static const struct got_error *
+ewah_size(size_t *size, struct got_bitmap_index *bidx, size_t offset)
+{
+	size_t end = bidx->len - SHA1_DIGEST_LENGTH;
+	uint32_t nwords;
+
+	if (offset > end || end - offset < 2 * sizeof(uint32_t))
+		return got_error(GOT_ERR_BAD_BITMAP);
+	memcpy(&nwords, bidx->map + offset + sizeof(uint32_t),
+	    sizeof(nwords));
+	nwords = be32toh(nwords);
+
+	*size = 3 * sizeof(uint32_t) + (size_t)nwords * sizeof(uint64_t);
+	if (end - offset < *size)
+		return got_error(GOT_ERR_BAD_BITMAP);
+	return NULL;
+}
+
+/* Decompress an EWAH bitmap and XOR it into an uncompressed bitmap. */
+static const struct got_error *
+xor_ewah(struct got_bitmap *bm, struct got_bitmap_index *bidx,
+    size_t offset)
+{
+	const struct got_error *err;
+	uint8_t *p;
+	uint32_t nwords, i = 0;
+	uint64_t rlw, word, nrun, nlit, n;
+	size_t size, pos = 0;
+
+	err = ewah_size(&size, bidx, offset);
+	if (err)
+		return err;
+	nwords = (size - 3 * sizeof(uint32_t)) / sizeof(uint64_t);
+	p = bidx->map + offset + 2 * sizeof(uint32_t);
+
+	while (i < nwords) {
+		memcpy(&rlw, p + i * sizeof(rlw), sizeof(rlw));
+		rlw = be64toh(rlw);
+		i++;
+
+		nrun = (rlw >> GOT_EWAH_RUN_LEN_SHIFT) & GOT_EWAH_RUN_LEN_MASK;
+		nlit = rlw >> GOT_EWAH_LITERALS_SHIFT;
+		if (nrun > bm->nwords - pos || nlit > nwords - i ||
+		    nlit > bm->nwords - pos - nrun)
+			return got_error(GOT_ERR_BAD_BITMAP);
+
+		if (rlw & GOT_EWAH_RUN_BIT) {
+			for (n = 0; n < nrun; n++)
+				bm->words[pos++] ^= ~0ULL;
+		} else
+			pos += nrun;
+
+		for (n = 0; n < nlit; n++) {
+			memcpy(&word, p + i * sizeof(word), sizeof(word));
+			bm->words[pos++] ^= be64toh(word);
+			i++;
+		}
+	}
+
+	return NULL;
+}
+
+static int
+cmp_entries(const void *a, const void *b)
+{
+	const struct got_bitmap_entry *e1 = a, *e2 = b;
+
+	if (e1->idx < e2->idx)
+		return -1;
+	if (e1->idx > e2->idx)
+		return 1;
+	return 0;
+}
+
+static struct got_bitmap_entry *
+find_entry(struct got_bitmap_index *bidx, uint32_t idx)
+{
+	struct got_bitmap_entry key;
+
+	key.idx = idx;
+	return bsearch(&key, bidx->entries, bidx->nentries,
+	    sizeof(bidx->entries[0]), cmp_entries);
+}
+
+static const struct got_error *
+parse_entries(struct got_bitmap_index *bidx, size_t offset, int nentries)
+{
+	const struct got_error *err = NULL;
+	struct got_bitmap_file_entry fe;
+	struct got_bitmap_entry *e;
+	uint32_t *file_idx;
+	size_t size, end = bidx->len - SHA1_DIGEST_LENGTH;
+	int i;
+
+	if (nentries == 0)
+		return NULL;
+
+	bidx->entries = calloc(nentries, sizeof(*bidx->entries));
+	if (bidx->entries == NULL)
+		return got_error_from_errno("calloc");
+	file_idx = calloc(nentries, sizeof(*file_idx));
+	if (file_idx == NULL)
+		return got_error_from_errno("calloc");
+
+	for (i = 0; i < nentries; i++) {
+		if (offset > end || end - offset < sizeof(fe)) {
+			err = got_error(GOT_ERR_BAD_BITMAP);
+			goto done;
+		}
+		memcpy(&fe, bidx->map + offset, sizeof(fe));
+		offset += sizeof(fe);
+
+		e = &bidx->entries[i];
+		e->idx = be32toh(fe.idx);
+		if (e->idx >= bidx->nobjects ||
+		    fe.xor_offset > i ||
+		    fe.xor_offset > GOT_BITMAP_MAX_XOR_OFFSET) {
+			err = got_error(GOT_ERR_BAD_BITMAP);
+			goto done;
+		}
+		if (fe.xor_offset) {
+			e->has_xor = 1;
+			e->xor_idx = file_idx[i - fe.xor_offset];
+		}
+		file_idx[i] = e->idx;
+
+		e->ewah_offset = offset;
+		err = ewah_size(&size, bidx, offset);
+		if (err)
+			goto done;
+		offset += size;
+	}
+
+	qsort(bidx->entries, nentries, sizeof(bidx->entries[0]),
+	    cmp_entries);
+	bidx->nentries = nentries;
+
+	/*
+	 * Entries must be unique. Each entry is XORed with an entry which
+	 * appears earlier in the file, so chains of entries cannot loop.
+	 */
+	for (i = 1; i < nentries; i++) {
+		if (bidx->entries[i - 1].idx == bidx->entries[i].idx) {
+			err = got_error(GOT_ERR_BAD_BITMAP);
+			break;
+		}
+	}
+done:
+	free(file_idx);
+	return err;
+}
+
+struct got_bitmap_pack_pos {
+	off_t offset;
+	uint32_t idx;
+};
+
+static int
+cmp_pack_pos(const void *a, const void *b)
+{
+	const struct got_bitmap_pack_pos *p1 = a, *p2 = b;
+
+	if (p1->offset < p2->offset)
+		return -1;
+	if (p1->offset > p2->offset)
+		return 1;
+	return 0;
+}
+
+/* Bitmaps number objects by their order in the pack file. */
+static const struct got_error *
+compute_pack_order(struct got_bitmap_index *bidx)
+{
+	const struct got_error *err = NULL;
+	struct got_bitmap_pack_pos *pos;
+	uint32_t i;
+
+	pos = calloc(bidx->nobjects, sizeof(*pos));
+	if (pos == NULL)
+		return got_error_from_errno("calloc");
+
+	for (i = 0; i < bidx->nobjects; i++) {
+		pos[i].offset = got_packidx_get_object_offset(bidx->packidx,
+		    i);
+		if (pos[i].offset == -1) {
+			err = got_error(GOT_ERR_BAD_PACKIDX);
+			goto done;
+		}
+		pos[i].idx = i;
+	}
+	qsort(pos, bidx->nobjects, sizeof(pos[0]), cmp_pack_pos);
+
+	bidx->bits = calloc(bidx->nobjects, sizeof(*bidx->bits));
+	if (bidx->bits == NULL) {
+		err = got_error_from_errno("calloc");
+		goto done;
+	}
+	for (i = 0; i < bidx->nobjects; i++)
+		bidx->bits[pos[i].idx] = i;
+done:
+	free(pos);
+	return err;
+}
+
+static const struct got_error *
+map_bitmap(struct got_bitmap_index *bidx, int fd)
+{
+	const struct got_error *err = NULL;
+	struct stat sb;
+	ssize_t n;
+
+	if (fstat(fd, &sb) != 0)
+		return got_error_from_errno2("fstat", bidx->path);
+	if (sb.st_size < sizeof(struct got_bitmap_file_hdr) +
+	    SHA1_DIGEST_LENGTH || sb.st_size > SIZE_MAX)
+		return got_error(GOT_ERR_BAD_BITMAP);
+	bidx->len = sb.st_size;
+
+#ifndef GOT_PACK_NO_MMAP
+	bidx->map = mmap(NULL, bidx->len, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (bidx->map != MAP_FAILED) {
+		bidx->mapped = 1;
+		return NULL;
+	}
+	bidx->map = NULL;
+	if (errno != ENOMEM)
+		return got_error_from_errno("mmap");
+#endif
+	/* Fall back to read(2). */
+	bidx->map = malloc(bidx->len);
+	if (bidx->map == NULL)
+		return got_error_from_errno("malloc");
+	n = read(fd, bidx->map, bidx->len);
+	if (n < 0)
+		err = got_error_from_errno2("read", bidx->path);
+	else if (n != bidx->len)
+		err = got_error(GOT_ERR_BAD_BITMAP);
+	return err;
+}
+
+static const struct got_error *
+parse_bitmap(struct got_bitmap_index *bidx)
+{
+	const struct got_error *err;
+	struct got_bitmap_file_hdr hdr;
+	size_t offset, size;
+	int i;
+
+	memcpy(&hdr, bidx->map, sizeof(hdr));
+	if (be32toh(hdr.signature) != GOT_BITMAP_SIGNATURE ||
+	    be16toh(hdr.version) != GOT_BITMAP_VERSION)
+		return got_error(GOT_ERR_BAD_BITMAP);
+	if (memcmp(hdr.pack_sha1, bidx->packidx->hdr.trailer->packfile_sha1,
+	    SHA1_DIGEST_LENGTH) != 0)
+		return got_error(GOT_ERR_BAD_BITMAP);
+	if (be32toh(hdr.nentries) > INT_MAX)
+		return got_error(GOT_ERR_BAD_BITMAP);
+
+	/* Type bitmaps for commits, trees, blobs, and tags follow. */
+	offset = sizeof(hdr);
+	for (i = 0; i < 4; i++) {
+		err = ewah_size(&size, bidx, offset);
+		if (err)
+			return err;
+		offset += size;
+	}
+
+	return parse_entries(bidx, offset, be32toh(hdr.nentries));
+}
+
+const struct got_error *
+got_bitmap_index_open(struct got_bitmap_index **bidx,
+    const char *path_bitmap, const char *path_packidx)
+{
+	const struct got_error *err;
+	int fd;
+
+	*bidx = calloc(1, sizeof(**bidx));
+	if (*bidx == NULL)
+		return got_error_from_errno("calloc");
+
+	(*bidx)->path = strdup(path_bitmap);
+	if ((*bidx)->path == NULL) {
+		err = got_error_from_errno("strdup");
+		goto done;
+	}
+
+	err = got_packidx_open(&(*bidx)->packidx, path_packidx, 0);
+	if (err)
+		goto done;
+	(*bidx)->nobjects =
+	    be32toh((*bidx)->packidx->hdr.fanout_table[0xff]);
+
+	fd = open(path_bitmap, O_RDONLY | O_NOFOLLOW);
+	if (fd == -1) {
+		err = got_error_from_errno2("open", path_bitmap);
+		goto done;
+	}
+	err = map_bitmap(*bidx, fd);
+	if (close(fd) != 0 && err == NULL)
+		err = got_error_from_errno2("close", path_bitmap);
+	if (err)
+		goto done;
+
+	err = compute_pack_order(*bidx);
+	if (err)
+		goto done;
+
+	err = parse_bitmap(*bidx);
+done:
+	if (err) {
+		got_bitmap_index_close(*bidx);
+		*bidx = NULL;
+	}
+	return err;
+}
+
+void
+got_bitmap_index_close(struct got_bitmap_index *bidx)
+{
+	if (bidx->map) {
+		if (bidx->mapped)
+			munmap(bidx->map, bidx->len);
+		else
+			free(bidx->map);
+	}
+	if (bidx->packidx)
+		got_packidx_close(bidx->packidx);
+	free(bidx->bits);
+	free(bidx->entries);
+	free(bidx->path);
+	free(bidx);
+}
+
+int
+got_bitmap_index_get_bit(uint32_t *bit, struct got_bitmap_index *bidx,
+    struct got_object_id *id)
+{
+	int idx;
+
+	idx = got_packidx_get_object_idx(bidx->packidx, id);
+	if (idx == -1)
+		return 0;
+
+	*bit = bidx->bits[idx];
+	return 1;
+}
+
+const struct got_error *
+got_bitmap_index_add_reachable(int *found, struct got_bitmap *bm,
+    struct got_bitmap_index *bidx, struct got_object_id *id)
+{
+	const struct got_error *err = NULL;
+	struct got_bitmap_entry *e;
+	struct got_bitmap *reachable;
+	size_t i;
+	int idx;
+
+	*found = 0;
+
+	idx = got_packidx_get_object_idx(bidx->packidx, id);
+	if (idx == -1)
+		return NULL;
+	e = find_entry(bidx, idx);
+	if (e == NULL)
+		return NULL;
+
+	err = got_bitmap_alloc(&reachable, bidx->nobjects);
+	if (err)
+		return err;
+
+	/* XOR is commutative, so the order of entries does not matter. */
+	for (;;) {
+		err = xor_ewah(reachable, bidx, e->ewah_offset);
+		if (err)
+			goto done;
+		if (!e->has_xor)
+			break;
+		e = find_entry(bidx, e->xor_idx);
+		if (e == NULL) {
+			err = got_error(GOT_ERR_BAD_BITMAP);
+			goto done;
+		}
+	}
+
+	for (i = 0; i < bm->nwords && i < reachable->nwords; i++)
+		bm->words[i] |= reachable->words[i];
+	*found = 1;
+done:
+	got_bitmap_free(reachable);
+	return err;
+}
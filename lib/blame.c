@@ -31,26 +31,52 @@
 #include "got_cancel.h"
 #include "got_blame.h"
 #include "got_commit_graph.h"
-#include "got_opentemp.h"
+#include "got_diff.h"
 
 #include "got_lib_inflate.h"
 #include "got_lib_delta.h"
 #include "got_lib_object.h"
 #include "got_lib_diff.h"
+#include "got_lib_blame_cache.h"
 
 struct got_blame_line {
 	int annotated;
 	struct got_object_id id;
 };
 
+/*
+ * History is traversed from the blamed commit towards older commits.
+ * Each version of the file found along the way is compared with the
+ * version of the file in the next older commit which changed the file.
+ * Lines of the newer version which do not appear in the older version
+ * were introduced by the newer commit.
+ */
 struct got_blame {
-	FILE *f;
-	size_t filesize;
-	int nlines;
+	int nlines;		/* number of lines in the blamed file */
 	int nannotated;
 	struct got_blame_line *lines; /* one per line */
-	off_t *line_offsets;		/* one per line */
 	int ncommits;
+	struct got_diff_session *diff_session;
+
+	/* The version of the file currently compared with older versions. */
+	struct got_blob_object *blob;
+	struct got_object_id *blob_id;
+	const uint8_t *data;
+	size_t datalen;
+
+	/*
+	 * Line numbers in the blamed file of lines of the current version,
+	 * or zero for lines which do not appear in the blamed file.
+	 */
+	int *linemap;
+	int nlinemap;
+	size_t linemap_nalloc;
+	int *linemap_next;	/* the same for the next older version */
+	size_t linemap_next_nalloc;
+
+	/* The commit which introduced the blamed version of the file. */
+	struct got_object_id *version_id;
+	int cached;		/* the result was found in the blame cache */
 };
 
 static const struct got_error *
@@ -76,34 +102,184 @@ annotate_line(struct got_blame *blame, int lineno, struct got_object_id *id,
 	return err;
 }
 
+/* Annotate lines of the current version which the commit introduced. */
 static const struct got_error *
-blame_changes(struct got_blame *blame, struct got_diff_changes *changes,
-    struct got_object_id *commit_id,
+blame_changes(int *nannotated, struct got_blame *blame,
+    struct got_diff_changes *changes, struct got_object_id *commit_id,
     const struct got_error *(*cb)(void *, int, int, struct got_object_id *),
     void *arg)
 {
 	const struct got_error *err = NULL;
 	struct got_diff_change *change;
+	int ln;
+
+	*nannotated = 0;
 
 	SIMPLEQ_FOREACH(change, &changes->entries, entry) {
 		int c = change->cv.c;
 		int d = change->cv.d;
-		int new_lineno = (c < d ? c : d);
-		int new_length = (c < d ? d - c + 1 : (c == d ? 1 : 0));
-		int ln;
 
-		for (ln = new_lineno; ln < new_lineno + new_length; ln++) {
-			err = annotate_line(blame, ln, commit_id, cb, arg);
+		for (ln = c; ln <= d && ln <= blame->nlinemap; ln++) {
+			if (blame->linemap[ln - 1] == 0)
+				continue;
+			err = annotate_line(blame, blame->linemap[ln - 1],
+			    commit_id, cb, arg);
 			if (err)
 				return err;
+			(*nannotated)++;
 			if (blame->nlines == blame->nannotated)
-				break;
+				return NULL;
 		}
 	}
 
 	return NULL;
 }
 
+/*
+ * Carry line numbers of the blamed file over from lines of the current
+ * version to the matching lines of the older version it was compared with.
+ */
+static const struct got_error *
+map_lines(struct got_blame *blame, struct got_diff_changes *changes)
+{
+	struct got_diff_change *change;
+	int *map, n, p = 1, q = 1;
+	size_t nalloc;
+
+	n = blame->nlinemap;
+	SIMPLEQ_FOREACH(change, &changes->entries, entry) {
+		if (change->cv.a <= change->cv.b)
+			n += change->cv.b - change->cv.a + 1;
+		if (change->cv.c <= change->cv.d)
+			n -= change->cv.d - change->cv.c + 1;
+	}
+	if (n < 0)
+		return got_error(GOT_ERR_RANGE);
+
+	if (n > blame->linemap_next_nalloc) {
+		map = reallocarray(blame->linemap_next, n, sizeof(*map));
+		if (map == NULL)
+			return got_error_from_errno("reallocarray");
+		blame->linemap_next = map;
+		blame->linemap_next_nalloc = n;
+	}
+	map = blame->linemap_next;
+
+	SIMPLEQ_FOREACH(change, &changes->entries, entry) {
+		while (p < change->cv.a && p <= n && q <= blame->nlinemap)
+			map[p++ - 1] = blame->linemap[q++ - 1];
+		while (p <= change->cv.b && p <= n)
+			map[p++ - 1] = 0;
+		q = change->cv.d + 1;
+	}
+	while (p <= n && q <= blame->nlinemap)
+		map[p++ - 1] = blame->linemap[q++ - 1];
+	if (p <= n || q <= blame->nlinemap)
+		return got_error(GOT_ERR_RANGE);
+
+	blame->linemap_next = blame->linemap;
+	blame->linemap = map;
+	blame->nlinemap = n;
+	nalloc = blame->linemap_next_nalloc;
+	blame->linemap_next_nalloc = blame->linemap_nalloc;
+	blame->linemap_nalloc = nalloc;
+	return NULL;
+}
+
+/*
+ * Look up the current version of the file in the blame cache. A cached
+ * result annotates all lines of the version which are still unannotated.
+ */
+static const struct got_error *
+blame_cached(int *nannotated, struct got_blame *blame,
+    struct got_object_id *id, const char *path, struct got_repository *repo,
+    const struct got_error *(*cb)(void *, int, int, struct got_object_id *),
+    void *arg)
+{
+	const struct got_error *err;
+	struct got_object_id *ids;
+	int ln, nlines;
+
+	*nannotated = 0;
+
+	err = got_blame_cache_get(&ids, &nlines, repo, id, path,
+	    blame->blob_id);
+	if (err || ids == NULL)
+		return err;
+
+	/* A result which does not fit this version is a cache miss. */
+	if (nlines != blame->nlinemap)
+		goto done;
+
+	for (ln = 1; ln <= blame->nlinemap; ln++) {
+		if (blame->linemap[ln - 1] == 0)
+			continue;
+		err = annotate_line(blame, blame->linemap[ln - 1],
+		    &ids[ln - 1], cb, arg);
+		if (err)
+			break;
+		(*nannotated)++;
+	}
+done:
+	free(ids);
+	return err;
+}
+
+static const struct got_error *
+set_version_id(struct got_blame *blame, struct got_object_id *id)
+{
+	if (blame->version_id)
+		return NULL;
+	blame->version_id = got_object_id_dup(id);
+	if (blame->version_id == NULL)
+		return got_error_from_errno("got_object_id_dup");
+	return NULL;
+}
+
+/* Store the result of a complete blame in the blame cache. */
+static const struct got_error *
+blame_cache_put(struct got_blame *blame, const char *path,
+    struct got_object_id *blob_id, struct got_repository *repo)
+{
+	const struct got_error *err;
+	struct got_object_id *ids;
+	int i;
+
+	ids = calloc(blame->nlines, sizeof(*ids));
+	if (ids == NULL)
+		return got_error_from_errno("calloc");
+	for (i = 0; i < blame->nlines; i++)
+		memcpy(&ids[i], &blame->lines[i].id, sizeof(ids[i]));
+
+	err = got_blame_cache_put(repo, blame->version_id, path, blob_id,
+	    ids, blame->nlines);
+	free(ids);
+
+	/* The cache is an optimization; a read-only repository is fine. */
+	if (err && (err->code == GOT_ERR_BLAME_CACHE_READONLY ||
+	    err->code == GOT_ERR_LOCKFILE_TIMEOUT))
+		err = NULL;
+	return err;
+}
+
+/* Make the specified blob the version compared with older versions. */
+static const struct got_error *
+set_blob(struct got_blame *blame, struct got_blob_object *blob,
+    struct got_object_id *blob_id)
+{
+	const struct got_error *err;
+
+	err = got_object_blob_get_data(&blame->data, &blame->datalen, blob);
+	if (err)
+		return err;
+	if (blame->blob)
+		got_object_blob_close(blame->blob);
+	free(blame->blob_id);
+	blame->blob = blob;
+	blame->blob_id = blob_id;
+	return NULL;
+}
+
 static const struct got_error *
 blame_commit(struct got_blame *blame, struct got_object_id *parent_id,
     struct got_object_id *id, const char *path, struct got_repository *repo,
@@ -111,57 +287,74 @@ blame_commit(struct got_blame *blame, struct got_object_id *parent_id,
     void *arg)
 {
 	const struct got_error *err = NULL;
-	struct got_object *obj = NULL;
 	struct got_object_id *obj_id = NULL;
-	struct got_commit_object *commit = NULL;
 	struct got_blob_object *blob = NULL;
 	struct got_diff_changes *changes = NULL;
-
-	err = got_object_open_as_commit(&commit, repo, parent_id);
-	if (err)
-		return err;
+	int ln, first, nannotated = 0;
 
 	err = got_object_id_by_path(&obj_id, repo, parent_id, path);
 	if (err) {
-		if (err->code == GOT_ERR_NO_TREE_ENTRY)
-			err = NULL;
-		goto done;
+		if (err->code != GOT_ERR_NO_TREE_ENTRY)
+			return err;
+		/* The file was added in this commit. */
+		err = set_version_id(blame, id);
+		if (err)
+			return err;
+		for (ln = 1; ln <= blame->nlinemap; ln++) {
+			if (blame->linemap[ln - 1] == 0)
+				continue;
+			err = annotate_line(blame, blame->linemap[ln - 1], id,
+			    cb, arg);
+			if (err)
+				return err;
+		}
+		return NULL;
 	}
 
-	err = got_object_open(&obj, repo, obj_id);
-	if (err)
+	/* Nothing to do if the commit did not change the file. */
+	if (got_object_id_cmp(obj_id, blame->blob_id) == 0)
 		goto done;
 
-	if (obj->type != GOT_OBJ_TYPE_BLOB) {
-		err = got_error(GOT_ERR_OBJ_TYPE);
+	/* The current version of the file was introduced by this commit. */
+	first = (blame->version_id == NULL);
+	err = set_version_id(blame, id);
+	if (err)
+		goto done;
+	err = blame_cached(&nannotated, blame, id, path, repo, cb, arg);
+	if (err)
+		goto done;
+	if (blame->nannotated == blame->nlines) {
+		blame->cached = first;
 		goto done;
 	}
 
-	err = got_object_blob_open(&blob, repo, obj, 8192);
+	err = got_object_open_as_blob(&blob, repo, obj_id, 8192);
 	if (err)
 		goto done;
 
-	if (fseek(blame->f, 0L, SEEK_SET) == -1) {
-		err = got_ferror(blame->f, GOT_ERR_IO);
+	err = got_diff_blob_mem_lines_changed(&changes, blob, blame->data,
+	    blame->datalen, blame->diff_session);
+	if (err)
 		goto done;
-	}
 
-	err = got_diff_blob_file_lines_changed(&changes, blob, blame->f,
-	    blame->filesize);
-	if (err)
+	err = blame_changes(&nannotated, blame, changes, id, cb, arg);
+	if (err || blame->nannotated == blame->nlines)
 		goto done;
 
-	if (changes) {
-		err = blame_changes(blame, changes, id, cb, arg);
-		got_diff_free_changes(changes);
-	} else if (cb)
-		err = cb(arg, blame->nlines, -1, id);
+	err = map_lines(blame, changes);
+	if (err)
+		goto done;
+	err = set_blob(blame, blob, obj_id);
+	if (err)
+		goto done;
+	blob = NULL;
+	obj_id = NULL;
 done:
-	if (commit)
-		got_object_commit_close(commit);
+	if (err == NULL && nannotated == 0 && cb)
+		err = cb(arg, blame->nlines, -1, id);
+	if (changes)
+		got_diff_free_changes(changes);
 	free(obj_id);
-	if (obj)
-		got_object_close(obj);
 	if (blob)
 		got_object_blob_close(blob);
 	return err;
@@ -170,13 +363,17 @@ done:
 static const struct got_error *
 blame_close(struct got_blame *blame)
 {
-	const struct got_error *err = NULL;
-
-	if (blame->f && fclose(blame->f) != 0)
-		err = got_error_from_errno("fclose");
 	free(blame->lines);
+	free(blame->linemap);
+	free(blame->linemap_next);
+	if (blame->blob)
+		got_object_blob_close(blame->blob);
+	free(blame->blob_id);
+	free(blame->version_id);
+	if (blame->diff_session)
+		got_diff_session_close(blame->diff_session);
 	free(blame);
-	return err;
+	return NULL;
 }
 
 static const struct got_error *
@@ -187,11 +384,13 @@ blame_open(struct got_blame **blamep, const char *path,
 {
 	const struct got_error *err = NULL;
 	struct got_object *obj = NULL;
-	struct got_object_id *obj_id = NULL;
+	struct got_object_id *obj_id = NULL, *blob_id = NULL;
 	struct got_blob_object *blob = NULL;
 	struct got_blame *blame = NULL;
 	struct got_object_id *id = NULL, *pid = NULL;
-	int lineno;
+	struct got_diff_line *line_index = NULL;
+	int lineno, interrupted = 0;
+	size_t nalloc = 0;
 	struct got_commit_graph *graph = NULL;
 
 	*blamep = NULL;
@@ -214,32 +413,52 @@ blame_open(struct got_blame **blamep, const char *path,
 		goto done;
 
 	blame = calloc(1, sizeof(*blame));
-	if (blame == NULL)
-		return got_error_from_errno("calloc");
+	if (blame == NULL) {
+		err = got_error_from_errno("calloc");
+		goto done;
+	}
 
-	blame->f = got_opentemp();
-	if (blame->f == NULL) {
-		err = got_error_from_errno("got_opentemp");
+	blob_id = got_object_id_dup(obj_id);
+	if (blob_id == NULL) {
+		err = got_error_from_errno("got_object_id_dup");
 		goto done;
 	}
-	err = got_object_blob_dump_to_file(&blame->filesize, &blame->nlines,
-	   &blame->line_offsets, blame->f, blob);
+
+	/* The blob, and thus its data, stays open while lines are blamed. */
+	err = set_blob(blame, blob, obj_id);
+	if (err)
+		goto done;
+	blob = NULL;
+	obj_id = NULL;
+	err = got_diff_index_lines(&line_index, &nalloc, &blame->nlines,
+	    blame->data, blame->datalen);
+	free(line_index);
 	if (err || blame->nlines == 0)
 		goto done;
 
-	/* Don't include \n at EOF in the blame line count. */
-	if (blame->line_offsets[blame->nlines - 1] == blame->filesize)
-		blame->nlines--;
-
 	blame->lines = calloc(blame->nlines, sizeof(*blame->lines));
 	if (blame->lines == NULL) {
 		err = got_error_from_errno("calloc");
 		goto done;
 	}
+	blame->linemap = calloc(blame->nlines, sizeof(*blame->linemap));
+	if (blame->linemap == NULL) {
+		err = got_error_from_errno("calloc");
+		goto done;
+	}
+	blame->linemap_nalloc = blame->nlines;
+	for (lineno = 1; lineno <= blame->nlines; lineno++)
+		blame->linemap[lineno - 1] = lineno;
+	blame->nlinemap = blame->nlines;
 
-	err = got_commit_graph_open(&graph, start_commit_id, path, 1, repo);
+	err = got_diff_session_open(&blame->diff_session);
 	if (err)
-		return err;
+		goto done;
+
+	err = got_commit_graph_open(&graph, start_commit_id, path,
+	    GOT_COMMIT_GRAPH_FIRST_PARENT, GOT_COMMIT_GRAPH_ORDER_DATE, repo);
+	if (err)
+		goto done;
 	err = got_commit_graph_iter_start(graph, start_commit_id, repo,
 	    cancel_cb, cancel_arg);
 	if (err)
@@ -263,8 +482,10 @@ blame_open(struct got_blame **blamep, const char *path,
 		if (pid) {
 			err = blame_commit(blame, pid, id, path, repo, cb, arg);
 			if (err) {
-				if (err->code == GOT_ERR_ITER_COMPLETED)
+				if (err->code == GOT_ERR_ITER_COMPLETED) {
 					err = NULL;
+					interrupted = 1;
+				}
 				break;
 			}
 			if (blame->nannotated == blame->nlines)
@@ -272,6 +493,8 @@ blame_open(struct got_blame **blamep, const char *path,
 		}
 		id = pid;
 	}
+	if (err)
+		goto done;
 
 	if (id && blame->nannotated < blame->nlines) {
 		/* Annotate remaining non-annotated lines with last commit. */
@@ -280,12 +503,22 @@ blame_open(struct got_blame **blamep, const char *path,
 			if (err)
 				goto done;
 		}
+		if (!interrupted) {
+			err = set_version_id(blame, id);
+			if (err)
+				goto done;
+		}
 	}
 
+	if (!interrupted && !blame->cached && blame->version_id &&
+	    blame->nannotated == blame->nlines)
+		err = blame_cache_put(blame, path, blob_id, repo);
+
 done:
 	if (graph)
 		got_commit_graph_close(graph);
 	free(obj_id);
+	free(blob_id);
 	if (obj)
 		got_object_close(obj);
 	if (blob)
@@ -0,0 +1,388 @@
+/*
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/queue.h>
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <sha1.h>
+#include <endian.h>
+#include <unistd.h>
+
+#include "got_error.h"
+#include "got_object.h"
+#include "got_repository.h"
+#include "got_opentemp.h"
+#include "got_path.h"
+
+#include "got_lib_sha1.h"
+#include "got_lib_delta.h"
+#include "got_lib_object.h"
+#include "got_lib_object_idset.h"
+#include "got_lib_lockfile.h"
+#include "got_lib_blame_cache.h"
+
+/*
+ * Cache files are named after a SHA1 hash of the commit ID and path they
+ * are keyed by. The path and blob ID stored in the file tell apart files
+ * which share a name by accident, and stale files left behind by a file
+ * which was replaced in history.
+ */
+static const struct got_error *
+get_cache_path(char **path, struct got_repository *repo,
+    struct got_object_id *commit_id, const char *in_repo_path)
+{
+	SHA1_CTX ctx;
+	uint8_t digest[SHA1_DIGEST_LENGTH];
+	char hex[SHA1_DIGEST_STRING_LENGTH];
+	char *cache_dir;
+
+	*path = NULL;
+
+	SHA1Init(&ctx);
+	SHA1Update(&ctx, commit_id->sha1, sizeof(commit_id->sha1));
+	SHA1Update(&ctx, (const uint8_t *)in_repo_path, strlen(in_repo_path));
+	SHA1Final(digest, &ctx);
+	if (got_sha1_digest_to_str(digest, hex, sizeof(hex)) == NULL)
+		return got_error(GOT_ERR_BAD_OBJ_ID_STR);
+
+	cache_dir = got_repo_get_path_blame_cache(repo);
+	if (cache_dir == NULL)
+		return got_error_from_errno("got_repo_get_path_blame_cache");
+	if (asprintf(path, "%s/%s", cache_dir, hex) == -1) {
+		*path = NULL;
+		free(cache_dir);
+		return got_error_from_errno("asprintf");
+	}
+	free(cache_dir);
+	return NULL;
+}
+
+static size_t
+index_size(uint32_t nids)
+{
+	if (nids <= UINT8_MAX)
+		return sizeof(uint8_t);
+	if (nids <= UINT16_MAX)
+		return sizeof(uint16_t);
+	return sizeof(uint32_t);
+}
+
+static uint32_t
+get_index(const uint8_t *p, size_t size)
+{
+	uint16_t idx16;
+	uint32_t idx32;
+
+	switch (size) {
+	case sizeof(uint8_t):
+		return p[0];
+	case sizeof(uint16_t):
+		memcpy(&idx16, p, sizeof(idx16));
+		return be16toh(idx16);
+	default:
+		memcpy(&idx32, p, sizeof(idx32));
+		return be32toh(idx32);
+	}
+}
+
+/*
+ * Cache files are not trusted. Every count and index read from the file
+ * is checked before it is used. A file which fails these checks is a cache
+ * miss, and is replaced once the result has been computed again.
+ */
+const struct got_error *
+got_blame_cache_get(struct got_object_id **ids, int *nlines,
+    struct got_repository *repo, struct got_object_id *commit_id,
+    const char *in_repo_path, struct got_object_id *blob_id)
+{
+	const struct got_error *err = NULL;
+	struct got_blame_cache_hdr *hdr;
+	char *path = NULL;
+	uint8_t *buf = NULL, *p;
+	struct stat sb;
+	size_t pathlen = strlen(in_repo_path), isize, len;
+	uint32_t nids, n, i, idx;
+	ssize_t r;
+	int fd = -1;
+
+	*ids = NULL;
+	*nlines = 0;
+
+	err = get_cache_path(&path, repo, commit_id, in_repo_path);
+	if (err)
+		return err;
+
+	fd = open(path, O_RDONLY | O_NOFOLLOW);
+	if (fd == -1) {
+		if (errno != ENOENT)
+			err = got_error_from_errno2("open", path);
+		goto done;
+	}
+	if (fstat(fd, &sb) != 0) {
+		err = got_error_from_errno2("fstat", path);
+		goto done;
+	}
+	if (sb.st_size < sizeof(*hdr) || sb.st_size > SIZE_MAX)
+		goto done;
+	len = sb.st_size;
+
+	buf = malloc(len);
+	if (buf == NULL) {
+		err = got_error_from_errno("malloc");
+		goto done;
+	}
+	r = read(fd, buf, len);
+	if (r == -1) {
+		err = got_error_from_errno2("read", path);
+		goto done;
+	}
+	if (r != len)
+		goto done;
+
+	hdr = (struct got_blame_cache_hdr *)buf;
+	if (be32toh(hdr->signature) != GOT_BLAME_CACHE_SIGNATURE ||
+	    be32toh(hdr->version) != GOT_BLAME_CACHE_VERSION)
+		goto done;
+
+	/* A result for some other file or blob is a cache miss. */
+	if (be32toh(hdr->pathlen) != pathlen ||
+	    len - sizeof(*hdr) < pathlen ||
+	    memcmp(buf + sizeof(*hdr), in_repo_path, pathlen) != 0 ||
+	    memcmp(hdr->commit_id, commit_id->sha1, SHA1_DIGEST_LENGTH) != 0 ||
+	    memcmp(hdr->blob_id, blob_id->sha1, SHA1_DIGEST_LENGTH) != 0)
+		goto done;
+
+	nids = be32toh(hdr->nids);
+	n = be32toh(hdr->nlines);
+	isize = index_size(nids);
+	if (n > INT_MAX || nids > n ||
+	    nids > (len - sizeof(*hdr) - pathlen) / SHA1_DIGEST_LENGTH ||
+	    n > (len - sizeof(*hdr) - pathlen -
+	    nids * SHA1_DIGEST_LENGTH) / isize ||
+	    len != sizeof(*hdr) + pathlen + nids * SHA1_DIGEST_LENGTH +
+	    n * isize)
+		goto done;
+
+	*ids = calloc(n > 0 ? n : 1, sizeof(**ids));
+	if (*ids == NULL) {
+		err = got_error_from_errno("calloc");
+		goto done;
+	}
+	p = buf + sizeof(*hdr) + pathlen + nids * SHA1_DIGEST_LENGTH;
+	for (i = 0; i < n; i++) {
+		idx = get_index(p + i * isize, isize);
+		if (idx >= nids) {
+			free(*ids);
+			*ids = NULL;
+			goto done;
+		}
+		memcpy((*ids)[i].sha1, buf + sizeof(*hdr) + pathlen +
+		    idx * SHA1_DIGEST_LENGTH, SHA1_DIGEST_LENGTH);
+	}
+	*nlines = n;
+done:
+	if (err) {
+		free(*ids);
+		*ids = NULL;
+	}
+	if (fd != -1 && close(fd) != 0 && err == NULL)
+		err = got_error_from_errno2("close", path);
+	free(buf);
+	free(path);
+	return err;
+}
+
+/*
+ * Blame works in repositories which cannot be written to. Errors which
+ * indicate this are reported with a distinct error code, which callers
+ * can check after errno has been overwritten during cleanup.
+ */
+static const struct got_error *
+check_writable(const struct got_error *err)
+{
+	if (err && err->code == GOT_ERR_ERRNO &&
+	    (errno == EACCES || errno == EPERM || errno == EROFS))
+		return got_error(GOT_ERR_BLAME_CACHE_READONLY);
+	return err;
+}
+
+static const struct got_error *
+write_index(FILE *f, uint32_t idx, size_t size)
+{
+	uint8_t idx8;
+	uint16_t idx16;
+	uint32_t idx32;
+	void *p;
+
+	switch (size) {
+	case sizeof(uint8_t):
+		idx8 = idx;
+		p = &idx8;
+		break;
+	case sizeof(uint16_t):
+		idx16 = htobe16(idx);
+		p = &idx16;
+		break;
+	default:
+		idx32 = htobe32(idx);
+		p = &idx32;
+		break;
+	}
+	if (fwrite(p, size, 1, f) != 1)
+		return got_ferror(f, GOT_ERR_IO);
+	return NULL;
+}
+
+const struct got_error *
+got_blame_cache_put(struct got_repository *repo,
+    struct got_object_id *commit_id, const char *in_repo_path,
+    struct got_object_id *blob_id, struct got_object_id *ids, int nlines)
+{
+	const struct got_error *err = NULL, *unlock_err = NULL;
+	struct got_object_idset *idset = NULL;
+	struct got_blame_cache_hdr hdr;
+	struct got_lockfile *lf = NULL;
+	uint32_t *indices = NULL, nids = 0, idx;
+	char *path = NULL, *tmppath = NULL;
+	size_t pathlen = strlen(in_repo_path), isize;
+	FILE *f = NULL;
+	void *data;
+	int i;
+
+	if (pathlen > UINT32_MAX)
+		return got_error(GOT_ERR_NO_SPACE);
+
+	idset = got_object_idset_alloc();
+	if (idset == NULL)
+		return got_error_from_errno("got_object_idset_alloc");
+
+	/* Store each commit ID once and refer to it by index. */
+	indices = calloc(nlines > 0 ? nlines : 1, sizeof(*indices));
+	if (indices == NULL) {
+		err = got_error_from_errno("calloc");
+		goto done;
+	}
+	for (i = 0; i < nlines; i++) {
+		data = got_object_idset_get(idset, &ids[i]);
+		if (data) {
+			indices[i] = (uintptr_t)data - 1;
+			continue;
+		}
+		err = got_object_idset_add(idset, &ids[i],
+		    (void *)(uintptr_t)(nids + 1));
+		if (err)
+			goto done;
+		indices[i] = nids++;
+	}
+	isize = index_size(nids);
+
+	err = get_cache_path(&path, repo, commit_id, in_repo_path);
+	if (err)
+		goto done;
+
+	err = got_opentemp_named(&tmppath, &f, path);
+	if (err) {
+		char *parent_path;
+		if (!(err->code == GOT_ERR_ERRNO && errno == ENOENT)) {
+			err = check_writable(err);
+			goto done;
+		}
+		err = got_path_dirname(&parent_path, path);
+		if (err)
+			goto done;
+		err = check_writable(got_path_mkdir(parent_path));
+		free(parent_path);
+		if (err)
+			goto done;
+		err = check_writable(got_opentemp_named(&tmppath, &f, path));
+		if (err)
+			goto done;
+	}
+
+	memset(&hdr, 0, sizeof(hdr));
+	hdr.signature = htobe32(GOT_BLAME_CACHE_SIGNATURE);
+	hdr.version = htobe32(GOT_BLAME_CACHE_VERSION);
+	memcpy(hdr.commit_id, commit_id->sha1, SHA1_DIGEST_LENGTH);
+	memcpy(hdr.blob_id, blob_id->sha1, SHA1_DIGEST_LENGTH);
+	hdr.pathlen = htobe32(pathlen);
+	hdr.nids = htobe32(nids);
+	hdr.nlines = htobe32(nlines);
+	if (fwrite(&hdr, sizeof(hdr), 1, f) != 1 ||
+	    fwrite(in_repo_path, 1, pathlen, f) != pathlen) {
+		err = got_ferror(f, GOT_ERR_IO);
+		goto done;
+	}
+
+	/* Commit IDs are numbered in order of their first annotated line. */
+	for (i = 0, idx = 0; i < nlines && idx < nids; i++) {
+		if (indices[i] != idx)
+			continue;
+		if (fwrite(ids[i].sha1, SHA1_DIGEST_LENGTH, 1, f) != 1) {
+			err = got_ferror(f, GOT_ERR_IO);
+			goto done;
+		}
+		idx++;
+	}
+	for (i = 0; i < nlines; i++) {
+		err = write_index(f, indices[i], isize);
+		if (err)
+			goto done;
+	}
+	if (fflush(f) == EOF) {
+		err = got_error_from_errno2("fflush", tmppath);
+		goto done;
+	}
+
+	err = check_writable(got_lockfile_lock(&lf, path));
+	if (err)
+		goto done;
+
+	if (rename(tmppath, path) != 0) {
+		err = check_writable(got_error_from_errno3("rename", tmppath,
+		    path));
+		goto done;
+	}
+	free(tmppath);
+	tmppath = NULL;
+
+	if (chmod(path, GOT_DEFAULT_FILE_MODE) != 0) {
+		err = got_error_from_errno2("chmod", path);
+		goto done;
+	}
+done:
+	if (tmppath) {
+		if (unlink(tmppath) != 0 && err == NULL)
+			err = got_error_from_errno2("unlink", tmppath);
+		free(tmppath);
+	}
+	if (f && fclose(f) != 0 && err == NULL)
+		err = got_error_from_errno("fclose");
+	if (lf)
+		unlock_err = got_lockfile_unlock(lf);
+	free(path);
+	free(indices);
+	got_object_idset_free(idset);
+	return err ? err : unlock_err;
+}
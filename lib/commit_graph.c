@@ -18,6 +18,7 @@
 #include <sys/stat.h>
 #include <sys/queue.h>
 #include <sys/stdint.h>
+#include <sys/uio.h>
 
 #include <limits.h>
 #include <stdio.h>
@@ -26,32 +27,72 @@
 #include <sha1.h>
 #include <zlib.h>
 #include <ctype.h>
+#include <imsg.h>
 
 #include "got_error.h"
 #include "got_object.h"
 #include "got_cancel.h"
 #include "got_commit_graph.h"
+#include "got_diff.h"
 #include "got_path.h"
 
 #include "got_lib_delta.h"
 #include "got_lib_inflate.h"
 #include "got_lib_object.h"
 #include "got_lib_object_idset.h"
+#include "got_lib_object_cache.h"
+#include "got_lib_pack.h"
+#include "got_lib_privsep.h"
+#include "got_lib_commit_graph_file.h"
+#include "got_lib_repository.h"
+#include "got_lib_bitmap.h"
+#include "got_lib_diff.h"
+
+#ifndef nitems
+#define nitems(_a) (sizeof((_a)) / sizeof((_a)[0]))
+#endif
 
 struct got_commit_graph_node {
 	struct got_object_id id;
-	time_t timestamp;
+	time_t timestamp;	/* author time if ordered by author date */
+	uint32_t generation;	/* 0 if unknown */
+
+	/*
+	 * Path of interest in this commit and in its first parent. These
+	 * differ from the path given by the API user if renames are followed.
+	 */
+	const char *path;
+	const char *parent_path;
 
 	/* Used during graph iteration. */
-	TAILQ_ENTRY(got_commit_graph_node) entry;
+	unsigned int iter_seq;	/* order in which nodes were queued */
+	int flags;
+#define GOT_COMMIT_GRAPH_NODE_IN_ITER_HEAP	0x01
+#define GOT_COMMIT_GRAPH_NODE_WAITING		0x02
+#define GOT_COMMIT_GRAPH_NODE_CHANGED		0x04
+#define GOT_COMMIT_GRAPH_NODE_DONE		0x08
+
+	/*
+	 * Used during ordered iteration: The parents of this commit, and the
+	 * number of traversed children which have not been returned yet.
+	 */
+	struct got_object_id *parent_ids;
+	int nparents;
+	uint32_t indegree;
 };
 
-TAILQ_HEAD(got_commit_graph_iter_list, got_commit_graph_node);
+/* A binary heap which keeps the node which precedes all others on top. */
+struct got_commit_graph_heap {
+	struct got_commit_graph_node **nodes;
+	int len;
+	int size;
+	int (*precedes)(struct got_commit_graph_node *,
+	    struct got_commit_graph_node *);
+};
 
 struct got_commit_graph_branch_tip {
 	struct got_object_id *commit_id;
 	struct got_commit_object *commit;
-	struct got_commit_graph_node *new_node;
 	int changed;
 	int branch_done;
 };
@@ -63,8 +104,10 @@ struct got_commit_graph {
 	/* The commit at which traversal began (youngest commit in node_ids). */
 	struct got_commit_graph_node *head_node;
 
+	/* Flags passed to got_commit_graph_open(), and internal flags. */
 	int flags;
-#define GOT_COMMIT_GRAPH_FIRST_PARENT_TRAVERSAL		0x01
+#define GOT_COMMIT_GRAPH_HEADERS_ONLY			0x10
+#define GOT_COMMIT_GRAPH_STREAMING			0x20
 
 	/*
 	 * A set of object IDs of known parent commits which we have not yet
@@ -90,11 +133,52 @@ struct got_commit_graph {
 	/* Path of tree entry of interest to the API user. */
 	char *path;
 
+	/*
+	 * Paths which were replaced by the path a file was renamed from,
+	 * kept around since nodes added earlier still point to them.
+	 */
+	char **old_paths;
+	int nold_paths;
+
 	/* The next commit to return when the API user asks for one. */
 	struct got_commit_graph_node *iter_node;
 
-	/* The graph iteration list contains all nodes in sorted order. */
-	struct got_commit_graph_iter_list iter_list;
+	/* The commit which was returned to the API user most recently. */
+	struct got_commit_graph_node *prev_iter_node;
+
+	/*
+	 * Nodes to return after iter_node, with the node which should be
+	 * returned next at the top. During ordered iteration, iter_node is
+	 * not used and all nodes ready to be returned are kept here.
+	 */
+	struct got_commit_graph_heap iter_heap;
+	unsigned int iter_seq;
+
+	/*
+	 * Used during ordered iteration. A node becomes ready to be returned
+	 * once all of its children have been returned and no open branch can
+	 * lead to another child. Nodes without pending children which open
+	 * branches might still lead to wait in a heap ordered by generation.
+	 * Counts of pending children of commits not traversed yet are stored
+	 * in the indegrees set.
+	 */
+	int order;
+	struct got_commit_graph_heap waiting;
+	struct got_object_idset *indegrees;
+	uint32_t max_tip_generation;
+
+	/*
+	 * Used while streaming. Nodes which have been returned to the API
+	 * user, or never will be, are candidates for being freed. They wait
+	 * in a heap ordered by generation until no open branch can reach
+	 * them. During unordered iteration without generation numbers, they
+	 * are freed at once and only their IDs are remembered.
+	 */
+	struct got_commit_graph_heap retiring;
+	struct got_object_idset *retired_ids;
+
+	/* Reads trees ahead of path-limited traversal; opened on demand. */
+	struct got_object_async *async;
 };
 
 static struct got_commit_graph *
@@ -127,10 +211,52 @@ alloc_graph(const char *path)
 		return NULL;
 	}
 
-	TAILQ_INIT(&graph->iter_list);
+	graph->indegrees = got_object_idset_alloc();
+	if (graph->indegrees == NULL) {
+		got_object_idset_free(graph->open_branches);
+		got_object_idset_free(graph->node_ids);
+		free(graph->path);
+		free(graph);
+		return NULL;
+	}
+
 	return graph;
 }
 
+/*
+ * Most commits traversed while looking for changes to a path are never
+ * shown to the API user, so only their headers are read. Otherwise the
+ * API user will likely want the full commits anyway.
+ */
+static const struct got_error *
+open_commit(struct got_commit_object **commit, struct got_commit_graph *graph,
+    struct got_object_id *commit_id, struct got_repository *repo)
+{
+	if (graph->flags & GOT_COMMIT_GRAPH_HEADERS_ONLY)
+		return got_object_open_commit_header(commit, repo, commit_id);
+	return got_object_open_as_commit(commit, repo, commit_id);
+}
+
+/*
+ * Return zero if a commit's changed-path Bloom filter proves that the
+ * commit did not change the path. Most commits can be ruled out this way
+ * without opening any trees.
+ */
+static int
+path_maybe_changed(struct got_object_id *commit_id, const char *path,
+    struct got_repository *repo)
+{
+	struct got_commit_graph_file *cgf;
+	uint32_t pos;
+
+	cgf = got_repo_get_commit_graph_file(repo);
+	if (cgf && got_commit_graph_file_lookup(&pos, cgf, commit_id) &&
+	    got_commit_graph_file_bloom_check(cgf, pos, path) == 0)
+		return 0;
+
+	return 1;
+}
+
 static const struct got_error *
 detect_changed_path(int *changed, struct got_commit_object *commit,
     struct got_object_id *commit_id, const char *path,
@@ -138,7 +264,8 @@ detect_changed_path(int *changed, struct got_commit_object *commit,
 {
 	const struct got_error *err = NULL;
 	struct got_commit_object *pcommit = NULL;
-	struct got_tree_object *tree = NULL, *ptree = NULL;
+	struct got_tree_object *tree = NULL, *ptree = NULL, *trees[2];
+	struct got_object_id *tree_ids[2];
 	struct got_object_qid *pid;
 
 	if (got_path_is_root_dir(path)) {
@@ -148,6 +275,9 @@ detect_changed_path(int *changed, struct got_commit_object *commit,
 
 	*changed = 0;
 
+	if (!path_maybe_changed(commit_id, path, repo))
+		return NULL;
+
 	pid = SIMPLEQ_FIRST(&commit->parent_ids);
 	if (pid == NULL) {
 		struct got_object_id *obj_id;
@@ -161,17 +291,17 @@ detect_changed_path(int *changed, struct got_commit_object *commit,
 		return err;
 	}
 
-	err = got_object_open_as_tree(&tree, repo, commit->tree_id);
+	err = got_object_open_commit_header(&pcommit, repo, pid->id);
 	if (err)
 		return err;
 
-	err = got_object_open_as_commit(&pcommit, repo, pid->id);
-	if (err)
-		goto done;
-
-	err = got_object_open_as_tree(&ptree, repo, pcommit->tree_id);
+	tree_ids[0] = commit->tree_id;
+	tree_ids[1] = pcommit->tree_id;
+	err = got_object_open_as_trees(trees, repo, tree_ids, nitems(trees));
 	if (err)
 		goto done;
+	tree = trees[0];
+	ptree = trees[1];
 
 	err = got_object_tree_path_changed(changed, tree, ptree, path, repo);
 done:
@@ -184,30 +314,167 @@ done:
 	return err;
 }
 
-static void
-add_node_to_iter_list(struct got_commit_graph *graph,
-    struct got_commit_graph_node *node,
-    struct got_commit_graph_node *child_node)
+/*
+ * Return non-zero if node n1 should be returned before node n2 during
+ * iteration. Younger commits come first. If timestamps are equal, prefer
+ * the commit with the larger generation number, which cannot be a parent
+ * of the other commit. Commits missing from the commit-graph file are newer
+ * than the file, and are treated as having an infinite generation number.
+ * Otherwise prefer the commit which was added last.
+ */
+static int
+iter_node_precedes(struct got_commit_graph_node *n1,
+    struct got_commit_graph_node *n2)
 {
-	struct got_commit_graph_node *n, *next;
+	uint32_t gen1 = n1->generation ? n1->generation : UINT32_MAX;
+	uint32_t gen2 = n2->generation ? n2->generation : UINT32_MAX;
+
+	if (n1->timestamp != n2->timestamp)
+		return n1->timestamp > n2->timestamp;
+	if (gen1 != gen2)
+		return gen1 > gen2;
+	return n1->iter_seq > n2->iter_seq;
+}
 
-	if (TAILQ_EMPTY(&graph->iter_list)) {
-		TAILQ_INSERT_HEAD(&graph->iter_list, node, entry);
-		graph->iter_node = node;
-		return;
+/* Return nodes in the reverse order in which they became ready. */
+static int
+topo_node_precedes(struct got_commit_graph_node *n1,
+    struct got_commit_graph_node *n2)
+{
+	return n1->iter_seq > n2->iter_seq;
+}
+
+/* Waiting nodes with larger generation numbers become ready first. */
+static int
+generation_precedes(struct got_commit_graph_node *n1,
+    struct got_commit_graph_node *n2)
+{
+	uint32_t gen1 = n1->generation ? n1->generation : UINT32_MAX;
+	uint32_t gen2 = n2->generation ? n2->generation : UINT32_MAX;
+
+	return gen1 > gen2;
+}
+
+static struct got_commit_graph_node *
+pop_heap(struct got_commit_graph_heap *heap)
+{
+	struct got_commit_graph_node **nodes = heap->nodes;
+	struct got_commit_graph_node *top, *last;
+	int i = 0, child;
+
+	if (heap->len == 0)
+		return NULL;
+
+	top = nodes[0];
+	last = nodes[--heap->len];
+	if (heap->len == 0)
+		return top;
+
+	for (;;) {
+		child = 2 * i + 1;
+		if (child >= heap->len)
+			break;
+		if (child + 1 < heap->len &&
+		    heap->precedes(nodes[child + 1], nodes[child]))
+			child++;
+		if (!heap->precedes(nodes[child], last))
+			break;
+		nodes[i] = nodes[child];
+		i = child;
 	}
+	nodes[i] = last;
+	return top;
+}
 
-	n = graph->iter_node;
-	/* Ensure that an iteration in progress will see this new commit. */
-	while (n) {
-		next = TAILQ_NEXT(n, entry);
-		if (next && node->timestamp >= next->timestamp) {
-			TAILQ_INSERT_BEFORE(next, node, entry);
-			return;
-		}
-		n = next;
+static const struct got_error *
+push_heap(struct got_commit_graph_heap *heap,
+    struct got_commit_graph_node *node)
+{
+	struct got_commit_graph_node **nodes;
+	int i, parent;
+
+	if (heap->len == heap->size) {
+		int size = heap->size ? heap->size * 2 : 64;
+		nodes = reallocarray(heap->nodes, size, sizeof(*nodes));
+		if (nodes == NULL)
+			return got_error_from_errno("reallocarray");
+		heap->nodes = nodes;
+		heap->size = size;
+	}
+
+	nodes = heap->nodes;
+	i = heap->len++;
+	while (i > 0) {
+		parent = (i - 1) / 2;
+		if (!heap->precedes(node, nodes[parent]))
+			break;
+		nodes[i] = nodes[parent];
+		i = parent;
+	}
+	nodes[i] = node;
+	return NULL;
+}
+
+/*
+ * Queue a node which has been returned to the API user, or never will be,
+ * for being freed once no open branch can reach it.
+ */
+static const struct got_error *
+add_retire_candidate(struct got_commit_graph *graph,
+    struct got_commit_graph_node *node)
+{
+	if (!(graph->flags & GOT_COMMIT_GRAPH_STREAMING) ||
+	    node == graph->head_node)
+		return NULL;
+	return push_heap(&graph->retiring, node);
+}
+
+/* Remember the node returned to the API user most recently. */
+static const struct got_error *
+set_prev_iter_node(struct got_commit_graph *graph,
+    struct got_commit_graph_node *node)
+{
+	struct got_commit_graph_node *prev = graph->prev_iter_node;
+
+	graph->prev_iter_node = node;
+	if (prev)
+		return add_retire_candidate(graph, prev);
+	return NULL;
+}
+
+static struct got_commit_graph_node *
+pop_iter_heap(struct got_commit_graph *graph)
+{
+	struct got_commit_graph_node *node;
+
+	node = pop_heap(&graph->iter_heap);
+	if (node)
+		node->flags &= ~GOT_COMMIT_GRAPH_NODE_IN_ITER_HEAP;
+	return node;
+}
+
+static const struct got_error *
+add_node_to_iter_heap(struct got_commit_graph *graph,
+    struct got_commit_graph_node *node)
+{
+	const struct got_error *err;
+
+	node->iter_seq = graph->iter_seq++;
+	if (node->iter_seq == 0 &&
+	    graph->order == GOT_COMMIT_GRAPH_ORDER_DATE) {
+		graph->iter_node = node;
+		return NULL;
 	}
-	TAILQ_INSERT_TAIL(&graph->iter_list, node, entry);
+
+	/*
+	 * New nodes are always returned after iter_node. This ensures
+	 * that an iteration in progress will see this new commit.
+	 */
+	err = push_heap(&graph->iter_heap, node);
+	if (err)
+		return err;
+	node->flags |= GOT_COMMIT_GRAPH_NODE_IN_ITER_HEAP;
+	return NULL;
 }
 
 static const struct got_error *
@@ -221,11 +488,80 @@ close_branch(struct got_commit_graph *graph, struct got_object_id *commit_id)
 	return NULL;
 }
 
+/*
+ * If the path does not exist in the first parent of a commit, look for
+ * a file the commit renamed or copied to the path, and keep following the
+ * history of that file in the parent and its ancestors.
+ */
 static const struct got_error *
-advance_branch(struct got_commit_graph *graph,
-    struct got_commit_graph_node *node,
-    struct got_object_id *commit_id, struct got_commit_object *commit,
+follow_rename(struct got_commit_graph *graph,
+    struct got_commit_object *commit, struct got_object_id *parent_id,
     struct got_repository *repo)
+{
+	const struct got_error *err;
+	struct got_commit_object *pcommit = NULL;
+	struct got_tree_object *trees[2] = { NULL, NULL };
+	struct got_object_id *tree_ids[2], *id;
+	char *old_path = NULL;
+
+	if (got_path_is_root_dir(graph->path))
+		return NULL;
+
+	err = got_object_id_by_path(&id, repo, parent_id, graph->path);
+	if (err == NULL) {
+		free(id);
+		return NULL;
+	}
+	if (err->code != GOT_ERR_NO_TREE_ENTRY)
+		return err;
+
+	err = got_object_open_commit_header(&pcommit, repo, parent_id);
+	if (err)
+		return err;
+
+	tree_ids[0] = pcommit->tree_id;
+	tree_ids[1] = commit->tree_id;
+	err = got_object_open_as_trees(trees, repo, tree_ids, nitems(trees));
+	if (err)
+		goto done;
+
+	err = got_diff_find_rename_source(&old_path, trees[0], trees[1],
+	    graph->path, repo);
+	if (err == NULL && old_path) {
+		char **p;
+
+		p = recallocarray(graph->old_paths, graph->nold_paths,
+		    graph->nold_paths + 1, sizeof(*p));
+		if (p == NULL) {
+			err = got_error_from_errno("recallocarray");
+			free(old_path);
+			goto done;
+		}
+		graph->old_paths = p;
+		graph->old_paths[graph->nold_paths++] = graph->path;
+		graph->path = old_path;
+	}
+done:
+	if (trees[0])
+		got_object_tree_close(trees[0]);
+	if (trees[1])
+		got_object_tree_close(trees[1]);
+	got_object_commit_close(pcommit);
+	return err;
+}
+
+static int
+is_traversed(struct got_commit_graph *graph, struct got_object_id *id)
+{
+	if (got_object_idset_get(graph->node_ids, id))
+		return 1;
+	return graph->retired_ids &&
+	    got_object_idset_contains(graph->retired_ids, id);
+}
+
+static const struct got_error *
+advance_branch(struct got_commit_graph *graph, struct got_object_id *commit_id,
+    struct got_commit_object *commit, struct got_repository *repo)
 {
 	const struct got_error *err;
 	struct got_object_qid *qid;
@@ -234,13 +570,24 @@ advance_branch(struct got_commit_graph *graph,
 	if (err)
 		return err;
 
-	if (graph->flags & GOT_COMMIT_GRAPH_FIRST_PARENT_TRAVERSAL) {
+	if (graph->flags & GOT_COMMIT_GRAPH_FIRST_PARENT) {
 		qid = SIMPLEQ_FIRST(&commit->parent_ids);
 		if (qid == NULL ||
-		    got_object_idset_get(graph->open_branches, qid->id))
+		    got_object_idset_contains(graph->open_branches, qid->id))
 			return NULL;
+		if (graph->flags & GOT_COMMIT_GRAPH_FOLLOW_RENAMES) {
+			struct got_commit_graph_node *node;
+
+			err = follow_rename(graph, commit, qid->id, repo);
+			if (err)
+				return err;
+			node = got_object_idset_get(graph->node_ids,
+			    commit_id);
+			if (node)
+				node->parent_path = graph->path;
+		}
 		return got_object_idset_add(graph->open_branches,
-		    qid->id, node);
+		    qid->id, NULL);
 	}
 
 	/*
@@ -259,7 +606,8 @@ advance_branch(struct got_commit_graph *graph,
 		SIMPLEQ_FOREACH(qid, &commit->parent_ids, entry) {
 			struct got_object_id *id;
 
-			if (got_object_idset_get(graph->open_branches, qid->id))
+			if (got_object_idset_contains(graph->open_branches,
+			    qid->id))
 				continue;
 
 			err = got_object_id_by_path(&id, repo, qid->id,
@@ -288,7 +636,7 @@ advance_branch(struct got_commit_graph *graph,
 			 */
 			if (got_object_id_cmp(merged_id, id) == 0) {
 				err = got_object_idset_add(graph->open_branches,
-				    qid->id, node);
+				    qid->id, NULL);
 				free(merged_id);
 				free(id);
 				return err;
@@ -308,21 +656,22 @@ advance_branch(struct got_commit_graph *graph,
 			qid = SIMPLEQ_FIRST(&commit->parent_ids);
 			if (qid == NULL)
 				return NULL;
-			if (got_object_idset_get(graph->open_branches, qid->id))
+			if (got_object_idset_contains(graph->open_branches,
+			    qid->id))
+				return NULL;
+			if (is_traversed(graph, qid->id))
 				return NULL;
-			if (got_object_idset_get(graph->node_ids, qid->id))
-				return NULL; /* parent already traversed */
 			return got_object_idset_add(graph->open_branches,
-			    qid->id, node);
+			    qid->id, NULL);
 		}
 	}
 
 	SIMPLEQ_FOREACH(qid, &commit->parent_ids, entry) {
-		if (got_object_idset_get(graph->open_branches, qid->id))
+		if (got_object_idset_contains(graph->open_branches, qid->id))
+			continue;
+		if (is_traversed(graph, qid->id))
 			continue;
-		if (got_object_idset_get(graph->node_ids, qid->id))
-			continue; /* parent already traversed */
-		err = got_object_idset_add(graph->open_branches, qid->id, node);
+		err = got_object_idset_add(graph->open_branches, qid->id, NULL);
 		if (err)
 			return err;
 	}
@@ -330,150 +679,709 @@ advance_branch(struct got_commit_graph *graph,
 	return NULL;
 }
 
+struct max_generation_arg {
+	struct got_commit_graph_file *cgf;
+	uint32_t generation;
+};
+
 static const struct got_error *
-add_node(struct got_commit_graph_node **new_node, int *changed,
-    int *branch_done, struct got_commit_graph *graph,
-    struct got_object_id *commit_id, struct got_commit_object *commit,
-    struct got_commit_graph_node *child_node, struct got_repository *repo)
+find_max_generation(struct got_object_id *id, void *data, void *arg)
 {
-	const struct got_error *err = NULL;
-	struct got_commit_graph_node *node;
-
-	*new_node = NULL;
-	*changed = 0;
-	*branch_done = 0;
-
-	node = calloc(1, sizeof(*node));
-	if (node == NULL)
-		return got_error_from_errno("calloc");
-
-	memcpy(&node->id, commit_id, sizeof(node->id));
-	node->timestamp = commit->committer_time;
-
-	err = got_object_idset_add(graph->node_ids, &node->id, node);
-	if (err) {
-		free(node);
-		return err;
-	}
+	const struct got_error *err;
+	struct max_generation_arg *a = arg;
+	struct got_commit_graph_file_commit commit;
+	uint32_t pos;
 
-	err = detect_changed_path(changed, commit, commit_id, graph->path,
-	    repo);
-	if (err) {
-		if (err->code == GOT_ERR_NO_OBJ) {
-			/*
-			 * History of the path stops here on the current
-			 * branch. Keep going on other branches.
-			 */
-			err = NULL;
-			*branch_done = 1;
-		} else {
-			got_object_idset_remove(NULL, graph->node_ids,
-			    &node->id);
-			free(node);
-			return err;
-		}
+	if (a->generation == UINT32_MAX)
+		return NULL;
+	if (!got_commit_graph_file_lookup(&pos, a->cgf, id)) {
+		a->generation = UINT32_MAX;
+		return NULL;
 	}
-
-	if (*changed)
-		add_node_to_iter_list(graph, node, child_node);
-	*new_node = node;
+	err = got_commit_graph_file_get_commit(&commit, a->cgf, pos);
+	if (err)
+		return err;
+	if (commit.generation == 0)
+		a->generation = UINT32_MAX;
+	else if (commit.generation > a->generation)
+		a->generation = commit.generation;
 	return NULL;
 }
 
-const struct got_error *
-got_commit_graph_open(struct got_commit_graph **graph,
-    struct got_object_id *commit_id, const char *path,
-    int first_parent_traversal, struct got_repository *repo)
+/*
+ * Get the largest generation number among tips of open branches.
+ * UINT32_MAX means that a tip has no known generation number.
+ */
+static const struct got_error *
+get_max_tip_generation(uint32_t *generation, struct got_commit_graph *graph,
+    struct got_repository *repo)
 {
-	const struct got_error *err = NULL;
-	struct got_commit_object *commit;
-	int changed, branch_done;
-
-	*graph = NULL;
-
-	err = got_object_open_as_commit(&commit, repo, commit_id);
-	if (err)
-		return err;
-
-	/* The path must exist in our initial commit. */
-	if (!got_path_is_root_dir(path)) {
-		struct got_object_id *obj_id;
-		err = got_object_id_by_path(&obj_id, repo, commit_id, path);
-		if (err)
-			return err;
-		free(obj_id);
-	}
-
-	*graph = alloc_graph(path);
-	if (*graph == NULL) {
-		err = got_error_from_errno("alloc_graph");
-		got_object_commit_close(commit);
-		return err;
-	}
+	const struct got_error *err;
+	struct max_generation_arg arg;
 
-	if (first_parent_traversal)
-		(*graph)->flags |= GOT_COMMIT_GRAPH_FIRST_PARENT_TRAVERSAL;
+	*generation = 0;
+	if (got_object_idset_num_elements(graph->open_branches) == 0)
+		return NULL;
 
-	err = add_node(&(*graph)->head_node, &changed, &branch_done, *graph,
-	    commit_id, commit, NULL, repo);
-	if (err == NULL) {
-		err = advance_branch(*graph, (*graph)->head_node, commit_id,
-		    commit, repo);
+	arg.cgf = got_repo_get_commit_graph_file(repo);
+	if (arg.cgf == NULL) {
+		*generation = UINT32_MAX;
+		return NULL;
 	}
-	got_object_commit_close(commit);
-	if (err) {
-		got_commit_graph_close(*graph);
-		*graph = NULL;
+	arg.generation = 0;
+	err = got_object_idset_for_each(graph->open_branches,
+	    find_max_generation, &arg);
+	if (err)
 		return err;
-	}
-	
+	*generation = arg.generation;
 	return NULL;
 }
 
-struct add_branch_tip_arg {
-	struct got_commit_graph_branch_tip *tips;
-	int ntips;
-	struct got_repository *repo;
-	struct got_commit_graph *graph;
-};
+/*
+ * Determine whether a node without pending children is ready to be
+ * returned. Children of the node which have not been traversed yet would
+ * have a larger generation number than the node itself, and must be
+ * reachable from an open branch. Without generation numbers, all of
+ * history must be traversed first.
+ */
+static int
+node_is_ready(struct got_commit_graph *graph,
+    struct got_commit_graph_node *node)
+{
+	uint32_t gen = node->generation ? node->generation : UINT32_MAX;
+
+	if (got_object_idset_num_elements(graph->open_branches) == 0)
+		return 1;
+	return graph->max_tip_generation != UINT32_MAX &&
+	    gen >= graph->max_tip_generation;
+}
 
 static const struct got_error *
-add_branch_tip(struct got_object_id *commit_id, void *data, void *arg)
+release_node(struct got_commit_graph *graph,
+    struct got_commit_graph_node *node)
 {
 	const struct got_error *err;
-	struct got_commit_graph_node *child_node = data;
-	struct add_branch_tip_arg *a = arg;
-	struct got_commit_graph_node *new_node;
-	struct got_commit_object *commit;
-	int changed, branch_done;
-
-	err = got_object_open_as_commit(&commit, a->repo, commit_id);
-	if (err)
-		return err;
 
-	err = add_node(&new_node, &changed, &branch_done, a->graph,
-	    commit_id, commit, child_node, a->repo);
+	if (node_is_ready(graph, node))
+		return add_node_to_iter_heap(graph, node);
+	if (node->flags & GOT_COMMIT_GRAPH_NODE_WAITING)
+		return NULL;
+	err = push_heap(&graph->waiting, node);
 	if (err)
 		return err;
-
-	a->tips[a->ntips].commit_id = new_node ? &new_node->id : NULL;
-	a->tips[a->ntips].commit = commit;
-	a->tips[a->ntips].new_node = new_node;
-	a->tips[a->ntips].changed = changed;
-	a->tips[a->ntips].branch_done = branch_done;
-	a->ntips++;
-
+	node->flags |= GOT_COMMIT_GRAPH_NODE_WAITING;
 	return NULL;
 }
 
+/* Move waiting nodes to the iteration heap once they become ready. */
 static const struct got_error *
-fetch_commits_from_open_branches(int *nfetched,
-    struct got_object_id **changed_id, struct got_commit_graph *graph,
-    struct got_repository *repo, got_cancel_cb cancel_cb, void *cancel_arg)
+update_ready_nodes(struct got_commit_graph *graph,
+    struct got_repository *repo)
 {
 	const struct got_error *err;
-	struct add_branch_tip_arg arg;
-	int i, ntips;
+	struct got_commit_graph_node *node;
+
+	err = get_max_tip_generation(&graph->max_tip_generation, graph, repo);
+	if (err)
+		return err;
+
+	while (graph->waiting.len > 0) {
+		node = graph->waiting.nodes[0];
+		if (node->indegree == 0 && !node_is_ready(graph, node))
+			break;
+		pop_heap(&graph->waiting);
+		node->flags &= ~GOT_COMMIT_GRAPH_NODE_WAITING;
+		/* Nodes which gained a child are released again later. */
+		if (node->indegree > 0)
+			continue;
+		err = add_node_to_iter_heap(graph, node);
+		if (err)
+			return err;
+	}
+
+	return NULL;
+}
+
+static const struct got_error *
+add_child(struct got_commit_graph *graph, struct got_object_id *id)
+{
+	const struct got_error *err;
+	struct got_commit_graph_node *node;
+	uint32_t *count;
+
+	node = got_object_idset_get(graph->node_ids, id);
+	if (node) {
+		node->indegree++;
+		return NULL;
+	}
+
+	count = got_object_idset_get(graph->indegrees, id);
+	if (count == NULL) {
+		count = calloc(1, sizeof(*count));
+		if (count == NULL)
+			return got_error_from_errno("calloc");
+		err = got_object_idset_add(graph->indegrees, id, count);
+		if (err) {
+			free(count);
+			return err;
+		}
+	}
+	(*count)++;
+	return NULL;
+}
+
+static const struct got_error *
+remove_child(struct got_commit_graph *graph, struct got_object_id *id)
+{
+	struct got_commit_graph_node *node;
+	uint32_t *count;
+
+	node = got_object_idset_get(graph->node_ids, id);
+	if (node) {
+		if (--node->indegree == 0)
+			return release_node(graph, node);
+		return NULL;
+	}
+
+	count = got_object_idset_get(graph->indegrees, id);
+	if (count && --(*count) == 0) {
+		got_object_idset_remove(NULL, graph->indegrees, id);
+		free(count);
+	}
+	return NULL;
+}
+
+/*
+ * Record the parents of a newly traversed node, and count the node as
+ * a pending child of each parent.
+ */
+static const struct got_error *
+add_ordered_node(struct got_commit_graph *graph,
+    struct got_commit_graph_node *node, struct got_commit_object *commit)
+{
+	const struct got_error *err;
+	struct got_object_qid *qid;
+	uint32_t *count;
+	int i = 0;
+
+	node->nparents = commit->nparents;
+	if (node->nparents > 1 &&
+	    (graph->flags & GOT_COMMIT_GRAPH_FIRST_PARENT))
+		node->nparents = 1;
+	if (node->nparents > 0) {
+		node->parent_ids = calloc(node->nparents,
+		    sizeof(*node->parent_ids));
+		if (node->parent_ids == NULL)
+			return got_error_from_errno("calloc");
+	}
+	SIMPLEQ_FOREACH(qid, &commit->parent_ids, entry) {
+		if (i >= node->nparents)
+			break;
+		memcpy(&node->parent_ids[i++], qid->id, sizeof(*qid->id));
+	}
+
+	/* Children traversed earlier have already been counted. */
+	err = got_object_idset_remove((void **)&count, graph->indegrees,
+	    &node->id);
+	if (err == NULL) {
+		node->indegree = *count;
+		free(count);
+	} else if (err->code != GOT_ERR_NO_OBJ)
+		return err;
+
+	for (i = 0; i < node->nparents; i++) {
+		err = add_child(graph, &node->parent_ids[i]);
+		if (err)
+			return err;
+	}
+
+	if (node->indegree == 0)
+		return release_node(graph, node);
+	return NULL;
+}
+
+static void
+free_node(struct got_commit_graph_node *node)
+{
+	free(node->parent_ids);
+	free(node);
+}
+
+static const struct got_error *
+add_node(struct got_commit_graph_node **new_node, int *changed,
+    int *branch_done, struct got_commit_graph *graph,
+    struct got_object_id *commit_id, struct got_commit_object *commit,
+    struct got_repository *repo)
+{
+	const struct got_error *err = NULL;
+	struct got_commit_graph_node *node;
+
+	*new_node = NULL;
+	*changed = 0;
+	*branch_done = 0;
+
+	node = calloc(1, sizeof(*node));
+	if (node == NULL)
+		return got_error_from_errno("calloc");
+
+	memcpy(&node->id, commit_id, sizeof(node->id));
+	if (graph->order == GOT_COMMIT_GRAPH_ORDER_AUTHOR_DATE)
+		node->timestamp = commit->author_time;
+	else
+		node->timestamp = commit->committer_time;
+	node->generation = commit->generation;
+	node->path = graph->path;
+	node->parent_path = graph->path;
+
+	err = got_object_idset_add(graph->node_ids, &node->id, node);
+	if (err) {
+		free(node);
+		return err;
+	}
+
+	err = detect_changed_path(changed, commit, commit_id, graph->path,
+	    repo);
+	if (err) {
+		if (err->code == GOT_ERR_NO_OBJ) {
+			/*
+			 * History of the path stops here on the current
+			 * branch. Keep going on other branches.
+			 */
+			err = NULL;
+			*branch_done = 1;
+		} else {
+			got_object_idset_remove(NULL, graph->node_ids,
+			    &node->id);
+			free(node);
+			return err;
+		}
+	}
+
+	if (*changed)
+		node->flags |= GOT_COMMIT_GRAPH_NODE_CHANGED;
+
+	/*
+	 * During ordered iteration, all nodes are queued once their
+	 * children have been returned, and nodes which did not change
+	 * the path are skipped when they are dequeued.
+	 */
+	if (graph->order != GOT_COMMIT_GRAPH_ORDER_DATE)
+		err = add_ordered_node(graph, node, commit);
+	else if (*changed)
+		err = add_node_to_iter_heap(graph, node);
+	else
+		err = add_retire_candidate(graph, node);
+	if (err) {
+		got_object_idset_remove(NULL, graph->node_ids, &node->id);
+		free_node(node);
+		return err;
+	}
+	*new_node = node;
+	return NULL;
+}
+
+const struct got_error *
+got_commit_graph_open(struct got_commit_graph **graph,
+    struct got_object_id *commit_id, const char *path, int flags, int order,
+    struct got_repository *repo)
+{
+	const struct got_error *err = NULL;
+	struct got_commit_object *commit;
+	int changed, branch_done, headers_only;
+
+	*graph = NULL;
+
+	/*
+	 * Reading commit headers from a commit-graph file is cheap enough
+	 * to justify reading full commits separately if needed. Author
+	 * times are not stored in commit-graph files.
+	 */
+	headers_only = (!got_path_is_root_dir(path) ||
+	    got_repo_get_commit_graph_file(repo) != NULL) &&
+	    order != GOT_COMMIT_GRAPH_ORDER_AUTHOR_DATE;
+
+	if (headers_only)
+		err = got_object_open_commit_header(&commit, repo, commit_id);
+	else
+		err = got_object_open_as_commit(&commit, repo, commit_id);
+	if (err)
+		return err;
+
+	/* The path must exist in our initial commit. */
+	if (!got_path_is_root_dir(path)) {
+		struct got_object_id *obj_id;
+		err = got_object_id_by_path(&obj_id, repo, commit_id, path);
+		if (err)
+			return err;
+		free(obj_id);
+	}
+
+	*graph = alloc_graph(path);
+	if (*graph == NULL) {
+		err = got_error_from_errno("alloc_graph");
+		got_object_commit_close(commit);
+		return err;
+	}
+
+	/* Renames are only followed along first-parent ancestry. */
+	if (!(flags & GOT_COMMIT_GRAPH_FIRST_PARENT))
+		flags &= ~GOT_COMMIT_GRAPH_FOLLOW_RENAMES;
+	(*graph)->flags = flags &
+	    (GOT_COMMIT_GRAPH_FIRST_PARENT | GOT_COMMIT_GRAPH_FOLLOW_RENAMES);
+	if (headers_only)
+		(*graph)->flags |= GOT_COMMIT_GRAPH_HEADERS_ONLY;
+
+	(*graph)->order = order;
+	if (order == GOT_COMMIT_GRAPH_ORDER_TOPO)
+		(*graph)->iter_heap.precedes = topo_node_precedes;
+	else
+		(*graph)->iter_heap.precedes = iter_node_precedes;
+	(*graph)->waiting.precedes = generation_precedes;
+	(*graph)->retiring.precedes = generation_precedes;
+
+	err = add_node(&(*graph)->head_node, &changed, &branch_done, *graph,
+	    commit_id, commit, repo);
+	if (err == NULL)
+		err = advance_branch(*graph, commit_id, commit, repo);
+	if (err == NULL && order != GOT_COMMIT_GRAPH_ORDER_DATE)
+		err = update_ready_nodes(*graph, repo);
+	got_object_commit_close(commit);
+	if (err) {
+		got_commit_graph_close(*graph);
+		*graph = NULL;
+		return err;
+	}
+	
+	return NULL;
+}
+
+struct collect_branch_tip_arg {
+	struct got_object_id **ids;
+	int ntips;
+};
+
+static const struct got_error *
+collect_branch_tip(struct got_object_id *commit_id, void *data, void *arg)
+{
+	struct collect_branch_tip_arg *a = arg;
+
+	a->ids[a->ntips] = commit_id;
+	a->ntips++;
+	return NULL;
+}
+
+/*
+ * A tree of a commit and the corresponding tree of the commit's first parent,
+ * which detect_changed_path() will compare.
+ */
+struct changed_path_trees {
+	TAILQ_ENTRY(changed_path_trees) entry;
+	struct got_object_id ids[2];
+	struct got_tree_object *trees[2];
+	int ntrees;		/* number of trees read so far */
+	int level;		/* index of path component to look up */
+	struct changed_path_prefetch *prefetch;
+};
+TAILQ_HEAD(changed_path_trees_list, changed_path_trees);
+
+struct changed_path_prefetch {
+	char **segs;	/* components of the path of interest */
+	int nsegs;
+	struct changed_path_trees_list unread;	/* trees not requested yet */
+	struct changed_path_trees_list reading;	/* trees requested */
+	struct changed_path_trees_list ready;	/* both trees have been read */
+};
+
+static void
+free_changed_path_trees(struct changed_path_trees *ct)
+{
+	if (ct->trees[0])
+		got_object_tree_close(ct->trees[0]);
+	if (ct->trees[1])
+		got_object_tree_close(ct->trees[1]);
+	free(ct);
+}
+
+static void
+free_changed_path_trees_list(struct changed_path_trees_list *list)
+{
+	struct changed_path_trees *ct;
+
+	while ((ct = TAILQ_FIRST(list))) {
+		TAILQ_REMOVE(list, ct, entry);
+		free_changed_path_trees(ct);
+	}
+}
+
+static const struct got_error *
+prefetch_parent_cb(void *arg, uint32_t id, struct got_object_id *commit_id,
+    struct got_commit_object *commit)
+{
+	struct changed_path_trees *ct = arg;
+	struct changed_path_prefetch *p = ct->prefetch;
+
+	TAILQ_REMOVE(&p->reading, ct, entry);
+	memcpy(&ct->ids[1], commit->tree_id, sizeof(ct->ids[1]));
+	got_object_commit_close(commit);
+
+	/* The path cannot have changed if the trees are equal. */
+	if (got_object_id_cmp(&ct->ids[0], &ct->ids[1]) == 0) {
+		free_changed_path_trees(ct);
+		return NULL;
+	}
+
+	TAILQ_INSERT_TAIL(&p->unread, ct, entry);
+	return NULL;
+}
+
+static const struct got_error *
+prefetch_tree_cb(void *arg, uint32_t id, struct got_object_id *tree_id,
+    struct got_tree_object *tree)
+{
+	struct changed_path_trees *ct = arg;
+	struct changed_path_prefetch *p = ct->prefetch;
+
+	if (got_object_id_cmp(tree_id, &ct->ids[0]) == 0)
+		ct->trees[0] = tree;
+	else
+		ct->trees[1] = tree;
+
+	if (++ct->ntrees == 2) {
+		TAILQ_REMOVE(&p->reading, ct, entry);
+		TAILQ_INSERT_TAIL(&p->ready, ct, entry);
+	}
+	return NULL;
+}
+
+/*
+ * Queue the subtrees on the path of interest if both trees contain
+ * a different directory there.
+ */
+static const struct got_error *
+prefetch_subtrees(struct changed_path_trees *ct)
+{
+	struct changed_path_prefetch *p = ct->prefetch;
+	struct changed_path_trees *sub;
+	struct got_tree_entry *te1, *te2;
+	const char *seg = p->segs[ct->level];
+
+	/* Trees for the final path component are never read. */
+	if (ct->level + 1 >= p->nsegs)
+		return NULL;
+
+	te1 = got_object_tree_find_entry(ct->trees[0], seg);
+	te2 = got_object_tree_find_entry(ct->trees[1], seg);
+	if (te1 == NULL || te2 == NULL || te1->mode != te2->mode ||
+	    !S_ISDIR(te1->mode) || got_object_id_cmp(&te1->id, &te2->id) == 0)
+		return NULL;
+
+	sub = calloc(1, sizeof(*sub));
+	if (sub == NULL)
+		return got_error_from_errno("calloc");
+	memcpy(&sub->ids[0], &te1->id, sizeof(sub->ids[0]));
+	memcpy(&sub->ids[1], &te2->id, sizeof(sub->ids[1]));
+	sub->level = ct->level + 1;
+	sub->prefetch = p;
+	TAILQ_INSERT_TAIL(&p->unread, sub, entry);
+	return NULL;
+}
+
+/*
+ * detect_changed_path() compares a commit's trees with those of its first
+ * parent, one path component at a time. Read the same trees for all tips
+ * of open branches ahead of time, so that the comparisons find them in the
+ * tree cache instead of reading them one by one. Trees are requested from
+ * the graph's asynchronous object reader as soon as the trees above them
+ * have been read, while other trees are still being read.
+ */
+static const struct got_error *
+prefetch_changed_path_trees(struct got_commit_graph *graph,
+    struct got_commit_object **commits, struct got_object_id **ids,
+    int ncommits, struct got_repository *repo)
+{
+	const struct got_error *err = NULL;
+	struct changed_path_prefetch p;
+	struct changed_path_trees *ct;
+	struct got_object_qid *pid;
+	char *pathcpy = NULL, *s, *seg;
+	int i, ndone;
+
+	/* Reading trees of a single branch ahead would not save any time. */
+	if (ncommits < 2)
+		return NULL;
+
+	memset(&p, 0, sizeof(p));
+	TAILQ_INIT(&p.unread);
+	TAILQ_INIT(&p.reading);
+	TAILQ_INIT(&p.ready);
+
+	pathcpy = strdup(graph->path + 1); /* skip leading '/' */
+	if (pathcpy == NULL)
+		return got_error_from_errno("strdup");
+	p.nsegs = 1;
+	for (s = pathcpy; *s; s++) {
+		if (*s == '/')
+			p.nsegs++;
+	}
+	p.segs = calloc(p.nsegs, sizeof(*p.segs));
+	if (p.segs == NULL) {
+		err = got_error_from_errno("calloc");
+		goto done;
+	}
+	s = pathcpy;
+	for (i = 0; (seg = strsep(&s, "/")) != NULL; i++)
+		p.segs[i] = seg;
+
+	if (graph->async == NULL) {
+		err = got_object_async_open(&graph->async, repo);
+		if (err)
+			goto done;
+	}
+
+	for (i = 0; i < ncommits; i++) {
+		if (!path_maybe_changed(ids[i], graph->path, repo))
+			continue;
+		pid = SIMPLEQ_FIRST(&commits[i]->parent_ids);
+		if (pid == NULL)
+			continue;
+		ct = calloc(1, sizeof(*ct));
+		if (ct == NULL) {
+			err = got_error_from_errno("calloc");
+			goto done;
+		}
+		memcpy(&ct->ids[0], commits[i]->tree_id, sizeof(ct->ids[0]));
+		ct->prefetch = &p;
+		TAILQ_INSERT_TAIL(&p.reading, ct, entry);
+		err = got_object_async_request_commit_header(NULL,
+		    graph->async, pid->id, prefetch_parent_cb, ct);
+		if (err)
+			goto done;
+	}
+
+	for (;;) {
+		ct = TAILQ_FIRST(&p.unread);
+		if (ct) {
+			TAILQ_REMOVE(&p.unread, ct, entry);
+			TAILQ_INSERT_TAIL(&p.reading, ct, entry);
+			for (i = 0; i < 2; i++) {
+				err = got_object_async_request_tree(NULL,
+				    graph->async, &ct->ids[i],
+				    prefetch_tree_cb, ct);
+				if (err)
+					goto done;
+			}
+			continue;
+		}
+
+		ct = TAILQ_FIRST(&p.ready);
+		if (ct) {
+			TAILQ_REMOVE(&p.ready, ct, entry);
+			err = prefetch_subtrees(ct);
+			/* The trees remain in the tree cache. */
+			free_changed_path_trees(ct);
+			if (err)
+				goto done;
+			continue;
+		}
+
+		if (got_object_async_pending(graph->async) == 0)
+			break;
+		err = got_object_async_dispatch(&ndone, graph->async, INFTIM);
+		if (err)
+			goto done;
+	}
+done:
+	if (err && graph->async) {
+		/* Callbacks of requests in flight must not run anymore. */
+		got_object_async_close(graph->async);
+		graph->async = NULL;
+	}
+	free_changed_path_trees_list(&p.unread);
+	free_changed_path_trees_list(&p.reading);
+	free_changed_path_trees_list(&p.ready);
+	free(p.segs);
+	free(pathcpy);
+	return err;
+}
+
+static const struct got_error *
+add_branch_tips(struct got_commit_graph_branch_tip *tips, int *ntips,
+    struct got_commit_graph *graph, struct got_repository *repo)
+{
+	const struct got_error *err = NULL;
+	struct collect_branch_tip_arg arg;
+	struct got_commit_object **commits = NULL;
+	int i, n;
+
+	*ntips = 0;
+
+	n = got_object_idset_num_elements(graph->open_branches);
+	arg.ids = calloc(n, sizeof(*arg.ids));
+	if (arg.ids == NULL)
+		return got_error_from_errno("calloc");
+	commits = calloc(n, sizeof(*commits));
+	if (commits == NULL) {
+		err = got_error_from_errno("calloc");
+		goto done;
+	}
+	arg.ntips = 0;
+	err = got_object_idset_for_each(graph->open_branches,
+	    collect_branch_tip, &arg);
+	if (err)
+		goto done;
+
+	/* Open all tip commits at once so loose commits are read in bulk. */
+	if (graph->flags & GOT_COMMIT_GRAPH_HEADERS_ONLY)
+		err = got_object_open_commit_headers(commits, repo, arg.ids,
+		    arg.ntips);
+	else
+		err = got_object_open_as_commits(commits, repo, arg.ids,
+		    arg.ntips);
+	if (err)
+		goto done;
+
+	if (!got_path_is_root_dir(graph->path)) {
+		err = prefetch_changed_path_trees(graph, commits, arg.ids,
+		    arg.ntips, repo);
+		if (err)
+			goto done;
+	}
+
+	for (i = 0; i < arg.ntips; i++) {
+		struct got_commit_graph_node *new_node;
+		int changed, branch_done;
+
+		err = add_node(&new_node, &changed, &branch_done, graph,
+		    arg.ids[i], commits[i], repo);
+		if (err)
+			break;
+
+		tips[i].commit_id = new_node ? &new_node->id : NULL;
+		tips[i].commit = commits[i];
+		tips[i].changed = changed;
+		tips[i].branch_done = branch_done;
+		commits[i] = NULL;
+		(*ntips)++;
+	}
+done:
+	if (commits) {
+		for (i = 0; i < arg.ntips; i++) {
+			if (commits[i])
+				got_object_commit_close(commits[i]);
+		}
+	}
+	free(commits);
+	free(arg.ids);
+	return err;
+}
+
+static const struct got_error *
+fetch_commits_from_open_branches(int *nfetched,
+    struct got_object_id **changed_id, struct got_commit_graph *graph,
+    struct got_repository *repo, got_cancel_cb cancel_cb, void *cancel_arg)
+{
+	const struct got_error *err;
+	int i, ntips, nadded = 0;
 
 	*nfetched = 0;
 	if (changed_id)
@@ -493,19 +1401,13 @@ fetch_commits_from_open_branches(int *nfetched,
 		graph->tips = tips;
 		graph->ntips = ntips;
 	}
-	arg.tips = graph->tips;
-	arg.ntips = 0; /* add_branch_tip() will increment */
-	arg.repo = repo;
-	arg.graph = graph;
-	err = got_object_idset_for_each(graph->open_branches, add_branch_tip,
-	    &arg);
+	err = add_branch_tips(graph->tips, &nadded, graph, repo);
 	if (err)
 		goto done;
 
-	for (i = 0; i < arg.ntips; i++) {
+	for (i = 0; i < nadded; i++) {
 		struct got_object_id *commit_id;
 		struct got_commit_object *commit;
-		struct got_commit_graph_node *new_node;
 		int branch_done, changed;
 
 		if (cancel_cb) {
@@ -514,29 +1416,80 @@ fetch_commits_from_open_branches(int *nfetched,
 				break;
 		}
 
-		commit_id = arg.tips[i].commit_id;
-		commit = arg.tips[i].commit;
-		new_node = arg.tips[i].new_node;
-		branch_done = arg.tips[i].branch_done;
-		changed = arg.tips[i].changed;
+		commit_id = graph->tips[i].commit_id;
+		commit = graph->tips[i].commit;
+		branch_done = graph->tips[i].branch_done;
+		changed = graph->tips[i].changed;
 
 		if (branch_done)
 			err = close_branch(graph, commit_id);
 		else
-			err = advance_branch(graph, new_node, commit_id,
-			    commit, repo);
+			err = advance_branch(graph, commit_id, commit, repo);
 		if (err)
 			break;
 		if (changed && changed_id && *changed_id == NULL)
 			*changed_id = commit_id;
 	}
+	if (err == NULL && graph->order != GOT_COMMIT_GRAPH_ORDER_DATE)
+		err = update_ready_nodes(graph, repo);
 done:
-	for (i = 0; i < arg.ntips; i++)
-		got_object_commit_close(arg.tips[i].commit);
-	(*nfetched) = arg.ntips;
+	for (i = 0; i < nadded; i++)
+		got_object_commit_close(graph->tips[i].commit);
+	(*nfetched) = nadded;
 	return err;
 }
 
+/*
+ * Free nodes which have already been returned to the API user, or which
+ * never will be, and which cannot be reached again from open branches.
+ */
+static const struct got_error *
+retire_nodes(struct got_commit_graph *graph, struct got_repository *repo)
+{
+	const struct got_error *err;
+	struct got_commit_graph_node *node;
+	uint32_t max_generation = 0, gen;
+	int reachable;
+
+	/*
+	 * Commits are reached again via other branches only if history
+	 * contains merges. A generation number greater than that of every
+	 * open branch proves that no open branch can reach the commit.
+	 */
+	if (!(graph->flags & GOT_COMMIT_GRAPH_FIRST_PARENT)) {
+		err = get_max_tip_generation(&max_generation, graph, repo);
+		if (err)
+			return err;
+	}
+
+	while (graph->retiring.len > 0) {
+		node = graph->retiring.nodes[0];
+		gen = node->generation ? node->generation : UINT32_MAX;
+		reachable = !(graph->flags & GOT_COMMIT_GRAPH_FIRST_PARENT) &&
+		    (max_generation == UINT32_MAX || gen <= max_generation);
+		if (reachable) {
+			/* Ordered iteration needs generation numbers. */
+			if (graph->order != GOT_COMMIT_GRAPH_ORDER_DATE)
+				break;
+			if (graph->retired_ids == NULL) {
+				graph->retired_ids = got_object_idset_alloc();
+				if (graph->retired_ids == NULL)
+					return got_error_from_errno(
+					    "got_object_idset_alloc");
+			}
+			err = got_object_idset_add(graph->retired_ids,
+			    &node->id, NULL);
+			if (err)
+				return err;
+		}
+		pop_heap(&graph->retiring);
+		got_object_idset_remove(NULL, graph->node_ids, &node->id);
+		free_node(node);
+	}
+
+	return NULL;
+}
+
 const struct got_error *
 got_commit_graph_fetch_commits(struct got_commit_graph *graph, int limit,
     struct got_repository *repo, got_cancel_cb cancel_cb, void *cancel_arg)
@@ -561,6 +1514,8 @@ got_commit_graph_fetch_commits(struct got_commit_graph *graph, int limit,
 			nfetched += ncommits;
 	}
 
+	if (graph->flags & GOT_COMMIT_GRAPH_STREAMING)
+		return retire_nodes(graph, repo);
 	return NULL;
 }
 
@@ -568,18 +1523,39 @@ static const struct got_error *
 free_node_iter(struct got_object_id *id, void *data, void *arg)
 {
 	struct got_commit_graph_node *node = data;
-	free(node);
+	free_node(node);
+	return NULL;
+}
+
+static const struct got_error *
+free_indegree_iter(struct got_object_id *id, void *data, void *arg)
+{
+	free(data);
 	return NULL;
 }
 
 void
 got_commit_graph_close(struct got_commit_graph *graph)
 {
+	int i;
+
 	got_object_idset_free(graph->open_branches);
 	got_object_idset_for_each(graph->node_ids, free_node_iter, NULL);
 	got_object_idset_free(graph->node_ids);
+	got_object_idset_for_each(graph->indegrees, free_indegree_iter, NULL);
+	got_object_idset_free(graph->indegrees);
+	free(graph->iter_heap.nodes);
+	free(graph->waiting.nodes);
+	free(graph->retiring.nodes);
+	if (graph->retired_ids)
+		got_object_idset_free(graph->retired_ids);
 	free(graph->tips);
 	free(graph->path);
+	for (i = 0; i < graph->nold_paths; i++)
+		free(graph->old_paths[i]);
+	free(graph->old_paths);
+	if (graph->async)
+		got_object_async_close(graph->async);
 	free(graph);
 }
 
@@ -593,6 +1569,13 @@ got_commit_graph_iter_start(struct got_commit_graph *graph,
 	struct got_commit_object *commit;
 	int changed;
 
+	/* Ordered iteration always begins at the head commit. */
+	if (graph->order != GOT_COMMIT_GRAPH_ORDER_DATE) {
+		if (got_object_id_cmp(id, &graph->head_node->id) != 0)
+			return got_error(GOT_ERR_NOT_IMPL);
+		return NULL;
+	}
+
 	start_node = got_object_idset_get(graph->node_ids, id);
 	while (start_node == NULL) {
 		int ncommits;
@@ -605,7 +1588,7 @@ got_commit_graph_iter_start(struct got_commit_graph *graph,
 		start_node = got_object_idset_get(graph->node_ids, id);
 	}
 
-	err = got_object_open_as_commit(&commit, repo, &start_node->id);
+	err = open_commit(&commit, graph, &start_node->id, repo);
 	if (err)
 		return err;
 
@@ -632,147 +1615,521 @@ got_commit_graph_iter_start(struct got_commit_graph *graph,
 	}
 	got_object_commit_close(commit);
 
+	/* Skip nodes which would be returned before the start node. */
+	if (graph->iter_node != start_node) {
+		while (graph->iter_heap.len > 0 &&
+		    graph->iter_heap.nodes[0] != start_node &&
+		    iter_node_precedes(graph->iter_heap.nodes[0], start_node))
+			pop_iter_heap(graph);
+		if (graph->iter_heap.len > 0 &&
+		    graph->iter_heap.nodes[0] == start_node)
+			pop_iter_heap(graph);
+	}
 	graph->iter_node = start_node;
 	return NULL;
 }
 
+void
+got_commit_graph_set_streaming(struct got_commit_graph *graph)
+{
+	graph->flags |= GOT_COMMIT_GRAPH_STREAMING;
+}
+
+/*
+ * Return the next node which is ready, and release its parents. Nodes
+ * which did not change the path are passed over silently.
+ */
+static const struct got_error *
+iter_next_ordered(struct got_object_id **id, struct got_commit_graph *graph)
+{
+	const struct got_error *err;
+	struct got_commit_graph_node *node;
+	int i;
+
+	for (;;) {
+		node = pop_iter_heap(graph);
+		if (node == NULL) {
+			if (got_object_idset_num_elements(
+			    graph->open_branches) > 0)
+				return got_error(GOT_ERR_ITER_NEED_MORE);
+			return got_error(GOT_ERR_ITER_COMPLETED);
+		}
+		node->flags |= GOT_COMMIT_GRAPH_NODE_DONE;
+
+		/*
+		 * Parents released last are returned first in topological
+		 * order, so release the first parent last.
+		 */
+		for (i = node->nparents - 1; i >= 0; i--) {
+			err = remove_child(graph, &node->parent_ids[i]);
+			if (err)
+				return err;
+		}
+
+		if (node->flags & GOT_COMMIT_GRAPH_NODE_CHANGED) {
+			*id = &node->id;
+			return set_prev_iter_node(graph, node);
+		}
+		err = add_retire_candidate(graph, node);
+		if (err)
+			return err;
+	}
+}
+
 const struct got_error *
 got_commit_graph_iter_next(struct got_object_id **id,
     struct got_commit_graph *graph)
 {
+	struct got_commit_graph_node *node;
+
 	*id = NULL;
 
+	if (graph->order != GOT_COMMIT_GRAPH_ORDER_DATE)
+		return iter_next_ordered(id, graph);
+
 	if (graph->iter_node == NULL) {
 		/* We are done iterating, or iteration was not started. */
 		return got_error(GOT_ERR_ITER_COMPLETED);
 	}
 
-	if (graph->iter_node ==
-	    TAILQ_LAST(&graph->iter_list, got_commit_graph_iter_list) &&
-	    got_object_idset_num_elements(graph->open_branches) == 0) {
+	if (graph->iter_heap.len == 0) {
+		if (got_object_idset_num_elements(graph->open_branches) > 0)
+			return got_error(GOT_ERR_ITER_NEED_MORE);
 		/* We are done iterating. */
 		*id = &graph->iter_node->id;
+		node = graph->iter_node;
 		graph->iter_node = NULL;
+		return set_prev_iter_node(graph, node);
+	}
+
+	*id = &graph->iter_node->id;
+	node = graph->iter_node;
+	graph->iter_node = pop_iter_heap(graph);
+	return set_prev_iter_node(graph, node);
+}
+
+void
+got_commit_graph_get_paths(const char **path, const char **parent_path,
+    struct got_commit_graph *graph)
+{
+	if (graph->prev_iter_node == NULL) {
+		*path = graph->path;
+		*parent_path = graph->path;
+		return;
+	}
+	*path = graph->prev_iter_node->path;
+	*parent_path = graph->prev_iter_node->parent_path;
+}
+
+/*
+ * A commit visited while searching for a merge base. The flags record
+ * which of the two input commits can reach this commit.
+ */
+struct merge_base_node {
+	struct got_object_id id;
+	time_t timestamp;
+	uint32_t generation;	/* 0 if not in commit-graph file */
+	unsigned int seq;	/* order in which commits were found */
+	uint32_t flags;
+#define GOT_MERGE_BASE_COMMIT1	0x01
+#define GOT_MERGE_BASE_COMMIT2	0x02
+#define GOT_MERGE_BASE_BOTH	(GOT_MERGE_BASE_COMMIT1 | GOT_MERGE_BASE_COMMIT2)
+#define GOT_MERGE_BASE_STALE	0x04
+#define GOT_MERGE_BASE_RESULT	0x08
+	int queued;
+};
+
+/*
+ * Commits waiting to be visited, in a binary heap. The number of
+ * queued commits which are not yet known to be ancestors of a common
+ * ancestor is tracked because the search ends when none are left.
+ */
+struct merge_base_queue {
+	struct merge_base_node **heap;
+	int len;
+	int size;
+	int nonstale;
+	unsigned int seq;
+};
+
+/*
+ * Return non-zero if node n1 should be visited before node n2.
+ * Commits are visited in order of decreasing generation number, which
+ * guarantees that all descendants of a commit are visited before the
+ * commit itself. Commits missing from the commit-graph file are treated
+ * as having an infinite generation number. Commit timestamps are used
+ * to order commits with equal generation numbers. If timestamps are equal
+ * as well, prefer the commit which was found first; a commit is usually
+ * found via one of its children.
+ */
+static int
+merge_base_node_precedes(struct merge_base_node *n1,
+    struct merge_base_node *n2)
+{
+	uint32_t gen1 = n1->generation ? n1->generation : UINT32_MAX;
+	uint32_t gen2 = n2->generation ? n2->generation : UINT32_MAX;
+
+	if (gen1 != gen2)
+		return gen1 > gen2;
+	if (n1->timestamp != n2->timestamp)
+		return n1->timestamp > n2->timestamp;
+	return n1->seq < n2->seq;
+}
+
+static struct merge_base_node *
+pop_merge_base_queue(struct merge_base_queue *queue)
+{
+	struct merge_base_node **heap = queue->heap;
+	struct merge_base_node *top, *last;
+	int i = 0, child;
+
+	if (queue->len == 0)
 		return NULL;
+
+	top = heap[0];
+	top->queued = 0;
+	if ((top->flags & GOT_MERGE_BASE_STALE) == 0)
+		queue->nonstale--;
+
+	last = heap[--queue->len];
+	if (queue->len == 0)
+		return top;
+
+	for (;;) {
+		child = 2 * i + 1;
+		if (child >= queue->len)
+			break;
+		if (child + 1 < queue->len &&
+		    merge_base_node_precedes(heap[child + 1], heap[child]))
+			child++;
+		if (!merge_base_node_precedes(heap[child], last))
+			break;
+		heap[i] = heap[child];
+		i = child;
 	}
+	heap[i] = last;
+	return top;
+}
 
-	if (TAILQ_NEXT(graph->iter_node, entry) == NULL)
-		return got_error(GOT_ERR_ITER_NEED_MORE);
+static const struct got_error *
+add_to_merge_base_queue(struct merge_base_queue *queue,
+    struct merge_base_node *node)
+{
+	struct merge_base_node **heap;
+	int i, parent;
+
+	if (queue->len == queue->size) {
+		int size = queue->size ? queue->size * 2 : 64;
+		heap = reallocarray(queue->heap, size, sizeof(*heap));
+		if (heap == NULL)
+			return got_error_from_errno("reallocarray");
+		queue->heap = heap;
+		queue->size = size;
+	}
 
-	*id = &graph->iter_node->id;
-	graph->iter_node = TAILQ_NEXT(graph->iter_node, entry);
+	heap = queue->heap;
+	i = queue->len++;
+	while (i > 0) {
+		parent = (i - 1) / 2;
+		if (!merge_base_node_precedes(node, heap[parent]))
+			break;
+		heap[i] = heap[parent];
+		i = parent;
+	}
+	heap[i] = node;
+
+	node->queued = 1;
+	if ((node->flags & GOT_MERGE_BASE_STALE) == 0)
+		queue->nonstale++;
 	return NULL;
 }
 
-const struct got_error *
-got_commit_graph_find_youngest_common_ancestor(struct got_object_id **yca_id,
+/*
+ * Propagate flags to the specified commit and queue it for a visit
+ * unless it has already seen all of these flags.
+ */
+static const struct got_error *
+paint_merge_base_node(struct merge_base_queue *queue,
+    struct got_object_idset *nodes, struct got_object_id *id,
+    uint32_t flags, struct got_repository *repo)
+{
+	const struct got_error *err;
+	struct merge_base_node *node;
+	struct got_commit_object *commit;
+
+	node = got_object_idset_get(nodes, id);
+	if (node == NULL) {
+		err = got_object_open_commit_header(&commit, repo, id);
+		if (err)
+			return err;
+		node = calloc(1, sizeof(*node));
+		if (node == NULL) {
+			err = got_error_from_errno("calloc");
+			got_object_commit_close(commit);
+			return err;
+		}
+		memcpy(&node->id, id, sizeof(node->id));
+		node->timestamp = commit->committer_time;
+		node->generation = commit->generation;
+		node->seq = queue->seq++;
+		got_object_commit_close(commit);
+		err = got_object_idset_add(nodes, &node->id, node);
+		if (err) {
+			free(node);
+			return err;
+		}
+	} else if ((node->flags & flags) == flags)
+		return NULL;
+
+	if (node->queued) {
+		if ((node->flags & GOT_MERGE_BASE_STALE) == 0 &&
+		    (flags & GOT_MERGE_BASE_STALE))
+			queue->nonstale--;
+		node->flags |= flags;
+		return NULL;
+	}
+
+	node->flags |= flags;
+	return add_to_merge_base_queue(queue, node);
+}
+
+static const struct got_error *
+free_merge_base_node(struct got_object_id *id, void *data, void *arg)
+{
+	free(data);
+	return NULL;
+}
+
+/*
+ * Find the youngest common ancestor of two commits. If first-parent
+ * traversal is requested, only first-parent ancestry is considered.
+ */
+static const struct got_error *
+find_merge_base(struct got_object_id **base_id,
     struct got_object_id *commit_id, struct got_object_id *commit_id2,
-    struct got_repository *repo, got_cancel_cb cancel_cb, void *cancel_arg)
+    int first_parent_traversal, struct got_repository *repo,
+    got_cancel_cb cancel_cb, void *cancel_arg)
 {
 	const struct got_error *err = NULL;
-	struct got_commit_graph *graph = NULL, *graph2 = NULL;
-	int completed = 0, completed2 = 0;
-	struct got_object_idset *commit_ids;
+	struct got_object_idset *nodes;
+	struct merge_base_queue queue;
+	struct merge_base_node *node, *best = NULL;
+	struct got_commit_object *commit = NULL;
+	struct got_object_qid *qid;
+	uint32_t flags;
+
+	*base_id = NULL;
 
-	*yca_id = NULL;
+	memset(&queue, 0, sizeof(queue));
 
-	commit_ids = got_object_idset_alloc();
-	if (commit_ids == NULL)
+	nodes = got_object_idset_alloc();
+	if (nodes == NULL)
 		return got_error_from_errno("got_object_idset_alloc");
 
-	err = got_commit_graph_open(&graph, commit_id, "/", 1, repo);
+	err = paint_merge_base_node(&queue, nodes, commit_id,
+	    GOT_MERGE_BASE_COMMIT1, repo);
 	if (err)
 		goto done;
-
-	err = got_commit_graph_open(&graph2, commit_id2, "/", 1, repo);
+	err = paint_merge_base_node(&queue, nodes, commit_id2,
+	    GOT_MERGE_BASE_COMMIT2, repo);
 	if (err)
 		goto done;
 
-	err = got_commit_graph_iter_start(graph, commit_id, repo,
+	/*
+	 * Walk down from both input commits at once, propagating to each
+	 * commit the set of input commits which can reach it. A commit
+	 * reachable from both input commits is a common ancestor. Its own
+	 * ancestors cannot be the youngest common ancestor, so they are
+	 * marked stale and the walk ends once only stale commits remain.
+	 */
+	while (queue.nonstale > 0) {
+		if (cancel_cb) {
+			err = (*cancel_cb)(cancel_arg);
+			if (err)
+				break;
+		}
+
+		node = pop_merge_base_queue(&queue);
+		flags = node->flags &
+		    (GOT_MERGE_BASE_BOTH | GOT_MERGE_BASE_STALE);
+		if (flags == GOT_MERGE_BASE_BOTH) {
+			node->flags |= GOT_MERGE_BASE_RESULT;
+			if (best == NULL || node->timestamp > best->timestamp)
+				best = node;
+			/*
+			 * All commits yet to be visited have a generation
+			 * number no larger than this commit's, so none of
+			 * them can be a younger common ancestor.
+			 */
+			if (node->generation != 0)
+				break;
+			flags |= GOT_MERGE_BASE_STALE;
+		}
+
+		err = got_object_open_commit_header(&commit, repo, &node->id);
+		if (err)
+			break;
+		SIMPLEQ_FOREACH(qid, &commit->parent_ids, entry) {
+			err = paint_merge_base_node(&queue, nodes, qid->id,
+			    flags, repo);
+			if (err || first_parent_traversal)
+				break;
+		}
+		got_object_commit_close(commit);
+		if (err)
+			break;
+	}
+
+	if (err == NULL && best) {
+		*base_id = got_object_id_dup(&best->id);
+		if (*base_id == NULL)
+			err = got_error_from_errno("got_object_id_dup");
+	}
+done:
+	got_object_idset_for_each(nodes, free_merge_base_node, NULL);
+	got_object_idset_free(nodes);
+	free(queue.heap);
+	return err;
+}
+
+const struct got_error *
+got_commit_graph_find_youngest_common_ancestor(struct got_object_id **yca_id,
+    struct got_object_id *commit_id, struct got_object_id *commit_id2,
+    struct got_repository *repo, got_cancel_cb cancel_cb, void *cancel_arg)
+{
+	return find_merge_base(yca_id, commit_id, commit_id2, 1, repo,
 	    cancel_cb, cancel_arg);
+}
+
+/*
+ * Find the set of objects reachable from a commit with the help of
+ * reachability bitmaps. The walk stops at commits which have a bitmap.
+ * Commits which are missing from the bitmapped pack file cannot be
+ * represented in a bitmap and are added to an ID set instead.
+ */
+static const struct got_error *
+bitmap_find_reachable(struct got_bitmap **bm, struct got_object_idset *extra,
+    struct got_object_id *commit_id, struct got_bitmap_index *bidx,
+    struct got_repository *repo, got_cancel_cb cancel_cb, void *cancel_arg)
+{
+	const struct got_error *err;
+	struct got_object_id_queue ids;
+	struct got_object_qid *qid, *pid;
+	struct got_commit_object *commit;
+	uint32_t bit;
+	int found, traverse;
+
+	SIMPLEQ_INIT(&ids);
+
+	err = got_bitmap_alloc(bm, bidx->nobjects);
 	if (err)
-		goto done;
+		return err;
 
-	err = got_commit_graph_iter_start(graph2, commit_id2, repo,
-	    cancel_cb, cancel_arg);
+	err = got_object_qid_alloc(&qid, commit_id);
 	if (err)
 		goto done;
+	SIMPLEQ_INSERT_TAIL(&ids, qid, entry);
 
-	for (;;) {
-		struct got_object_id *id, *id2;
-
+	while (!SIMPLEQ_EMPTY(&ids)) {
 		if (cancel_cb) {
 			err = (*cancel_cb)(cancel_arg);
 			if (err)
 				break;
 		}
 
-		if (!completed) {
-			err = got_commit_graph_iter_next(&id, graph);
-			if (err) {
-				if (err->code == GOT_ERR_ITER_COMPLETED)
-					completed = 1;
-				else if (err->code != GOT_ERR_ITER_NEED_MORE)
-					break;
-				err = got_commit_graph_fetch_commits(graph, 1,
-				    repo, cancel_cb, cancel_arg);
-				if (err)
-					break;
+		qid = SIMPLEQ_FIRST(&ids);
+		SIMPLEQ_REMOVE_HEAD(&ids, entry);
+
+		traverse = 0;
+		if (got_bitmap_index_get_bit(&bit, bidx, qid->id)) {
+			if (!got_bitmap_test(*bm, bit)) {
+				err = got_bitmap_index_add_reachable(&found,
+				    *bm, bidx, qid->id);
+				if (err == NULL && !found) {
+					got_bitmap_set(*bm, bit);
+					traverse = 1;
+				}
 			}
+		} else if (!got_object_idset_contains(extra, qid->id)) {
+			err = got_object_idset_add(extra, qid->id, NULL);
+			traverse = 1;
 		}
-
-		if (!completed2) {
-			err = got_commit_graph_iter_next(&id2, graph2);
-			if (err) {
-				if (err->code == GOT_ERR_ITER_COMPLETED)
-					completed2 = 1;
-				else if (err->code != GOT_ERR_ITER_NEED_MORE)
-					break;
-				err = got_commit_graph_fetch_commits(graph2, 1,
-				    repo, cancel_cb, cancel_arg);
-				if (err)
-					break;
+		if (err == NULL && traverse) {
+			err = got_object_open_commit_header(&commit, repo,
+			    qid->id);
+			if (err == NULL) {
+				SIMPLEQ_FOREACH(pid, &commit->parent_ids,
+				    entry) {
+					struct got_object_qid *new;
+					err = got_object_qid_alloc(&new,
+					    pid->id);
+					if (err)
+						break;
+					SIMPLEQ_INSERT_TAIL(&ids, new, entry);
+				}
+				got_object_commit_close(commit);
 			}
 		}
+		got_object_qid_free(qid);
+		if (err)
+			break;
+	}
+done:
+	got_object_id_queue_free(&ids);
+	if (err) {
+		got_bitmap_free(*bm);
+		*bm = NULL;
+	}
+	return err;
+}
 
-		if (id) {
-			if (got_object_idset_get(commit_ids, id)) {
-				*yca_id = got_object_id_dup(id);
-				if (*yca_id)
-					break;
-				err = got_error_from_errno("got_object_id_dup");
-				break;
-
-			}
-			err = got_object_idset_add(commit_ids, id, id);
-			if (err)
-				break;
-		}
-		if (id2) {
-			if (got_object_idset_get(commit_ids, id2)) {
-				*yca_id = got_object_id_dup(id2);
-				if (*yca_id)
-					break;
-				err = got_error_from_errno("got_object_id_dup");
-				break;
+const struct got_error *
+got_commit_graph_is_ancestor(int *is_ancestor,
+    struct got_object_id *ancestor_id, struct got_object_id *commit_id,
+    struct got_repository *repo, got_cancel_cb cancel_cb, void *cancel_arg)
+{
+	const struct got_error *err;
+	struct got_bitmap_index *bidx;
+	struct got_bitmap *bm = NULL;
+	struct got_object_idset *extra;
+	struct got_object_id *base_id;
+	uint32_t bit;
 
-			}
-			err = got_object_idset_add(commit_ids, id2, id2);
-			if (err)
-				break;
-		}
+	*is_ancestor = 0;
 
-		if (completed && completed2) {
-			err = got_error(GOT_ERR_ANCESTRY);
-			break;
-		}
+	if (got_object_id_cmp(ancestor_id, commit_id) == 0) {
+		*is_ancestor = 1;
+		return NULL;
+	}
 
+	bidx = got_repo_get_bitmap_index(repo);
+	if (bidx == NULL) {
+		err = find_merge_base(&base_id, ancestor_id, commit_id, 0,
+		    repo, cancel_cb, cancel_arg);
+		if (err)
+			return err;
+		*is_ancestor = (base_id &&
+		    got_object_id_cmp(base_id, ancestor_id) == 0);
+		free(base_id);
+		return NULL;
 	}
+
+	extra = got_object_idset_alloc();
+	if (extra == NULL)
+		return got_error_from_errno("got_object_idset_alloc");
+
+	err = bitmap_find_reachable(&bm, extra, commit_id, bidx, repo,
+	    cancel_cb, cancel_arg);
+	if (err)
+		goto done;
+
+	if (got_bitmap_index_get_bit(&bit, bidx, ancestor_id))
+		*is_ancestor = got_bitmap_test(bm, bit);
+	else
+		*is_ancestor = got_object_idset_contains(extra, ancestor_id);
 done:
-	got_object_idset_free(commit_ids);
-	if (graph)
-		got_commit_graph_close(graph);
-	if (graph2)
-		got_commit_graph_close(graph2);
+	if (bm)
+		got_bitmap_free(bm);
+	got_object_idset_free(extra);
 	return err;
 }
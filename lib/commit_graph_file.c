@@ -0,0 +1,772 @@
+/*
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/queue.h>
+#include <sys/mman.h>
+
+#include <fcntl.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <sha1.h>
+#include <endian.h>
+#include <unistd.h>
+
+#include "got_error.h"
+#include "got_object.h"
+
+#include "got_lib_sha1.h"
+#include "got_lib_delta.h"
+#include "got_lib_object.h"
+#include "got_lib_commit_graph_file.h"
+
+#ifndef nitems
+#define nitems(_a) (sizeof(_a) / sizeof((_a)[0]))
+#endif
+
+/*
+ * A commit-graph file is read in the main process, like pack index files.
+ * Its contents are not trusted; every position and offset read from the
+ * file is checked before it is used.
+ */
+
+static const struct got_error *
+map_layer(struct got_commit_graph_layer *layer, int fd)
+{
+	const struct got_error *err = NULL;
+	struct stat sb;
+	ssize_t n;
+
+	if (fstat(fd, &sb) != 0)
+		return got_error_from_errno2("fstat", layer->path);
+	if (sb.st_size < sizeof(struct got_commit_graph_file_hdr) +
+	    SHA1_DIGEST_LENGTH || sb.st_size > SIZE_MAX)
+		return got_error(GOT_ERR_BAD_COMMIT_GRAPH);
+	layer->len = sb.st_size;
+
+#ifndef GOT_PACK_NO_MMAP
+	layer->map = mmap(NULL, layer->len, PROT_READ, MAP_PRIVATE, fd, 0);
+	if (layer->map != MAP_FAILED) {
+		layer->mapped = 1;
+		return NULL;
+	}
+	layer->map = NULL;
+	if (errno != ENOMEM)
+		return got_error_from_errno("mmap");
+#endif
+	/* Fall back to read(2). */
+	layer->map = malloc(layer->len);
+	if (layer->map == NULL)
+		return got_error_from_errno("malloc");
+	n = read(fd, layer->map, layer->len);
+	if (n < 0)
+		err = got_error_from_errno2("read", layer->path);
+	else if (n != layer->len)
+		err = got_error(GOT_ERR_BAD_COMMIT_GRAPH);
+	return err;
+}
+
+/*
+ * Bloom filters are optional. Filters written with settings we cannot use
+ * are ignored rather than treated as an error.
+ */
+static void
+parse_bloom(struct got_commit_graph_layer *layer, size_t bidx_len,
+    uint8_t *bdat, size_t bdat_len)
+{
+	struct got_commit_graph_bloom_hdr *bhdr;
+	uint32_t version;
+
+	if (layer->bloom_idx == NULL || bdat == NULL ||
+	    bidx_len != layer->ncommits * sizeof(*layer->bloom_idx) ||
+	    bdat_len < sizeof(*bhdr))
+		goto bad;
+
+	bhdr = (struct got_commit_graph_bloom_hdr *)bdat;
+	version = be32toh(bhdr->version);
+	if ((version != 1 && version != GOT_COMMIT_GRAPH_BLOOM_VERSION) ||
+	    be32toh(bhdr->nhashes) != GOT_COMMIT_GRAPH_BLOOM_NHASHES ||
+	    be32toh(bhdr->bits_per_entry) == 0)
+		goto bad;
+
+	layer->bloom_version = version;
+	layer->bloom_data = bdat + sizeof(*bhdr);
+	layer->bloom_len = bdat_len - sizeof(*bhdr);
+	return;
+bad:
+	layer->bloom_idx = NULL;
+	layer->bloom_data = NULL;
+	layer->bloom_len = 0;
+}
+
+/*
+ * A commit-graph file ends with the SHA1 checksum of its contents. For
+ * files in a chain, this checksum is also the hash which names the file.
+ */
+static const struct got_error *
+verify_checksum(struct got_commit_graph_layer *layer)
+{
+	SHA1_CTX ctx;
+	uint8_t sha1[SHA1_DIGEST_LENGTH];
+	size_t len = layer->len - SHA1_DIGEST_LENGTH;
+
+	SHA1Init(&ctx);
+	SHA1Update(&ctx, layer->map, len);
+	SHA1Final(sha1, &ctx);
+	if (memcmp(layer->map + len, sha1, SHA1_DIGEST_LENGTH) != 0)
+		return got_error(GOT_ERR_BAD_COMMIT_GRAPH);
+	return NULL;
+}
+
+static const struct got_error *
+parse_layer(struct got_commit_graph_layer *layer, int nbase_graphs,
+    uint8_t **base_ids)
+{
+	const struct got_error *err;
+	struct got_commit_graph_file_hdr *hdr;
+	struct got_commit_graph_file_chunk *chunks;
+	uint8_t *base = NULL;
+	size_t table_len, end;
+	uint64_t offset, next;
+	uint8_t *bdat = NULL;
+	size_t bidx_len = 0, bdat_len = 0;
+	uint32_t id;
+	int i;
+
+	*base_ids = NULL;
+
+	err = verify_checksum(layer);
+	if (err)
+		return err;
+
+	hdr = (struct got_commit_graph_file_hdr *)layer->map;
+	if (be32toh(hdr->signature) != GOT_COMMIT_GRAPH_SIGNATURE ||
+	    hdr->version != GOT_COMMIT_GRAPH_VERSION ||
+	    hdr->hash_version != GOT_COMMIT_GRAPH_HASH_SHA1 ||
+	    hdr->nbase_graphs != nbase_graphs)
+		return got_error(GOT_ERR_BAD_COMMIT_GRAPH);
+
+	/* The chunk table has an extra entry which marks the end. */
+	end = layer->len - SHA1_DIGEST_LENGTH;
+	table_len = (hdr->nchunks + 1) * sizeof(*chunks);
+	if (sizeof(*hdr) + table_len > end)
+		return got_error(GOT_ERR_BAD_COMMIT_GRAPH);
+	chunks = (struct got_commit_graph_file_chunk *)(hdr + 1);
+
+	for (i = 0; i < hdr->nchunks; i++) {
+		id = be32toh(chunks[i].id);
+		offset = be64toh(chunks[i].offset);
+		next = be64toh(chunks[i + 1].offset);
+		if (offset < sizeof(*hdr) + table_len || next < offset ||
+		    next > end)
+			return got_error(GOT_ERR_BAD_COMMIT_GRAPH);
+
+		switch (id) {
+		case GOT_COMMIT_GRAPH_CHUNK_OIDF:
+			if (next - offset != 256 * sizeof(*layer->fanout) ||
+			    offset % sizeof(*layer->fanout) != 0)
+				return got_error(GOT_ERR_BAD_COMMIT_GRAPH);
+			layer->fanout = (uint32_t *)(layer->map + offset);
+			break;
+		case GOT_COMMIT_GRAPH_CHUNK_OIDL:
+			layer->oids = (struct got_object_id *)
+			    (layer->map + offset);
+			layer->oids_len = next - offset;
+			break;
+		case GOT_COMMIT_GRAPH_CHUNK_CDAT:
+			layer->cdat = (struct got_commit_graph_file_cdat *)
+			    (layer->map + offset);
+			layer->cdat_len = next - offset;
+			break;
+		case GOT_COMMIT_GRAPH_CHUNK_EDGE:
+			if ((next - offset) % sizeof(*layer->edges) != 0 ||
+			    offset % sizeof(*layer->edges) != 0)
+				return got_error(GOT_ERR_BAD_COMMIT_GRAPH);
+			layer->edges = (uint32_t *)(layer->map + offset);
+			layer->nedges = (next - offset) /
+			    sizeof(*layer->edges);
+			break;
+		case GOT_COMMIT_GRAPH_CHUNK_BIDX:
+			if (offset % sizeof(*layer->bloom_idx) != 0)
+				break;
+			layer->bloom_idx = (uint32_t *)(layer->map + offset);
+			bidx_len = next - offset;
+			break;
+		case GOT_COMMIT_GRAPH_CHUNK_BDAT:
+			bdat = layer->map + offset;
+			bdat_len = next - offset;
+			break;
+		case GOT_COMMIT_GRAPH_CHUNK_BASE:
+			if (next - offset !=
+			    nbase_graphs * SHA1_DIGEST_LENGTH)
+				return got_error(GOT_ERR_BAD_COMMIT_GRAPH);
+			base = layer->map + offset;
+			break;
+		default:
+			/* Ignore chunks we do not know about. */
+			break;
+		}
+	}
+
+	if (layer->fanout == NULL || layer->oids == NULL ||
+	    layer->cdat == NULL)
+		return got_error(GOT_ERR_BAD_COMMIT_GRAPH);
+	if (nbase_graphs > 0 && base == NULL)
+		return got_error(GOT_ERR_BAD_COMMIT_GRAPH);
+
+	for (i = 0; i < 255; i++) {
+		if (be32toh(layer->fanout[i]) > be32toh(layer->fanout[i + 1]))
+			return got_error(GOT_ERR_BAD_COMMIT_GRAPH);
+	}
+	layer->ncommits = be32toh(layer->fanout[255]);
+	if (layer->ncommits > GOT_COMMIT_GRAPH_POS_MASK ||
+	    layer->oids_len / SHA1_DIGEST_LENGTH < layer->ncommits ||
+	    layer->cdat_len / sizeof(*layer->cdat) < layer->ncommits)
+		return got_error(GOT_ERR_BAD_COMMIT_GRAPH);
+
+	parse_bloom(layer, bidx_len, bdat, bdat_len);
+
+	*base_ids = base;
+	return NULL;
+}
+
+static const struct got_error *
+open_layer(struct got_commit_graph_layer *layer, const char *path,
+    int nbase_graphs, uint8_t **base_ids)
+{
+	const struct got_error *err;
+	int fd;
+
+	layer->path = strdup(path);
+	if (layer->path == NULL)
+		return got_error_from_errno("strdup");
+
+	fd = open(path, O_RDONLY | O_NOFOLLOW);
+	if (fd == -1)
+		return got_error_from_errno2("open", path);
+
+	err = map_layer(layer, fd);
+	if (close(fd) != 0 && err == NULL)
+		err = got_error_from_errno2("close", path);
+	if (err)
+		return err;
+
+	return parse_layer(layer, nbase_graphs, base_ids);
+}
+
+static void
+close_layer(struct got_commit_graph_layer *layer)
+{
+	if (layer->map) {
+		if (layer->mapped)
+			munmap(layer->map, layer->len);
+		else
+			free(layer->map);
+	}
+	free(layer->path);
+}
+
+static const struct got_error *
+add_layer(struct got_commit_graph_file *cgf, const char *path,
+    uint8_t **base_ids)
+{
+	const struct got_error *err;
+	struct got_commit_graph_layer *layers, *layer;
+
+	layers = recallocarray(cgf->layers, cgf->nlayers, cgf->nlayers + 1,
+	    sizeof(*layers));
+	if (layers == NULL)
+		return got_error_from_errno("recallocarray");
+	cgf->layers = layers;
+	layer = &cgf->layers[cgf->nlayers];
+	cgf->nlayers++;
+
+	err = open_layer(layer, path, cgf->nlayers - 1, base_ids);
+	if (err)
+		return err;
+
+	if (layer->ncommits > GOT_COMMIT_GRAPH_POS_MASK - cgf->ncommits)
+		return got_error(GOT_ERR_BAD_COMMIT_GRAPH);
+	layer->base_pos = cgf->ncommits;
+	cgf->ncommits += layer->ncommits;
+	return NULL;
+}
+
+/*
+ * Open the layers listed in a commit-graph-chain file, which lists the
+ * hashes of commit-graph files one per line, starting with the base layer.
+ */
+static const struct got_error *
+open_chain(struct got_commit_graph_file *cgf, const char *path_chain_dir,
+    FILE *f)
+{
+	const struct got_error *err = NULL;
+	struct got_commit_graph_layer *layer;
+	uint8_t (*hashes)[SHA1_DIGEST_LENGTH] = NULL, *base_ids;
+	char *line = NULL, *path = NULL;
+	size_t linesize = 0;
+	ssize_t linelen;
+	int i, nhashes = 0;
+
+	while ((linelen = getline(&line, &linesize, f)) != -1) {
+		void *p;
+
+		if (linelen > 0 && line[linelen - 1] == '\n')
+			line[--linelen] = '\0';
+		if (linelen != SHA1_DIGEST_STRING_LENGTH - 1) {
+			err = got_error(GOT_ERR_BAD_COMMIT_GRAPH);
+			goto done;
+		}
+
+		p = recallocarray(hashes, nhashes, nhashes + 1,
+		    sizeof(*hashes));
+		if (p == NULL) {
+			err = got_error_from_errno("recallocarray");
+			goto done;
+		}
+		hashes = p;
+		if (!got_parse_sha1_digest(hashes[nhashes], line)) {
+			err = got_error(GOT_ERR_BAD_COMMIT_GRAPH);
+			goto done;
+		}
+
+		if (asprintf(&path, "%s/%s%s%s", path_chain_dir,
+		    GOT_COMMIT_GRAPH_LAYER_PREFIX, line,
+		    GOT_COMMIT_GRAPH_LAYER_SUFFIX) == -1) {
+			err = got_error_from_errno("asprintf");
+			path = NULL;
+			goto done;
+		}
+		err = add_layer(cgf, path, &base_ids);
+		if (err)
+			goto done;
+		free(path);
+		path = NULL;
+
+		/* The layer's file name must match its checksum. */
+		layer = &cgf->layers[cgf->nlayers - 1];
+		if (memcmp(layer->map + layer->len - SHA1_DIGEST_LENGTH,
+		    hashes[nhashes], SHA1_DIGEST_LENGTH) != 0) {
+			err = got_error(GOT_ERR_BAD_COMMIT_GRAPH);
+			goto done;
+		}
+
+		/* Each layer lists the hashes of all layers below it. */
+		for (i = 0; i < nhashes; i++) {
+			if (memcmp(base_ids + i * SHA1_DIGEST_LENGTH,
+			    hashes[i], SHA1_DIGEST_LENGTH) != 0) {
+				err = got_error(GOT_ERR_BAD_COMMIT_GRAPH);
+				goto done;
+			}
+		}
+		nhashes++;
+	}
+	if (ferror(f))
+		err = got_error_from_errno("getline");
+	else if (nhashes == 0)
+		err = got_error(GOT_ERR_BAD_COMMIT_GRAPH);
+done:
+	free(path);
+	free(line);
+	free(hashes);
+	return err;
+}
+
+const struct got_error *
+got_commit_graph_file_open(struct got_commit_graph_file **cgf,
+    const char *path_git_dir)
+{
+	const struct got_error *err = NULL;
+	char *path = NULL, *path_chain_dir = NULL;
+	uint8_t *base_ids;
+	FILE *f = NULL;
+
+	*cgf = calloc(1, sizeof(**cgf));
+	if (*cgf == NULL)
+		return got_error_from_errno("calloc");
+
+	if (asprintf(&path, "%s/%s", path_git_dir,
+	    GOT_COMMIT_GRAPH_FILE) == -1) {
+		err = got_error_from_errno("asprintf");
+		path = NULL;
+		goto done;
+	}
+	if (access(path, R_OK) == 0) {
+		err = add_layer(*cgf, path, &base_ids);
+		goto done;
+	}
+	if (errno != ENOENT) {
+		err = got_error_from_errno2("access", path);
+		goto done;
+	}
+	free(path);
+	path = NULL;
+
+	if (asprintf(&path_chain_dir, "%s/%s", path_git_dir,
+	    GOT_COMMIT_GRAPH_CHAIN_DIR) == -1) {
+		err = got_error_from_errno("asprintf");
+		path_chain_dir = NULL;
+		goto done;
+	}
+	if (asprintf(&path, "%s/%s", path_chain_dir,
+	    GOT_COMMIT_GRAPH_CHAIN_FILE) == -1) {
+		err = got_error_from_errno("asprintf");
+		path = NULL;
+		goto done;
+	}
+	f = fopen(path, "r");
+	if (f == NULL) {
+		if (errno != ENOENT)
+			err = got_error_from_errno2("fopen", path);
+		goto done;
+	}
+	err = open_chain(*cgf, path_chain_dir, f);
+done:
+	if (f && fclose(f) != 0 && err == NULL)
+		err = got_error_from_errno("fclose");
+	free(path);
+	free(path_chain_dir);
+	if (err || (*cgf)->nlayers == 0) {
+		got_commit_graph_file_close(*cgf);
+		*cgf = NULL;
+	}
+	return err;
+}
+
+void
+got_commit_graph_file_close(struct got_commit_graph_file *cgf)
+{
+	int i;
+
+	for (i = 0; i < cgf->nlayers; i++)
+		close_layer(&cgf->layers[i]);
+	free(cgf->layers);
+	free(cgf);
+}
+
+static int
+lookup_layer(uint32_t *idx, struct got_commit_graph_layer *layer,
+    struct got_object_id *id)
+{
+	uint8_t id0 = id->sha1[0];
+	int left = 0, right = layer->ncommits - 1;
+
+	if (id0 > 0)
+		left = be32toh(layer->fanout[id0 - 1]);
+
+	while (left <= right) {
+		int i, cmp;
+
+		i = ((left + right) / 2);
+		cmp = memcmp(id->sha1, layer->oids[i].sha1,
+		    SHA1_DIGEST_LENGTH);
+		if (cmp == 0) {
+			*idx = i;
+			return 1;
+		} else if (cmp > 0)
+			left = i + 1;
+		else
+			right = i - 1;
+	}
+
+	return 0;
+}
+
+/*
+ * Look up the global position of a commit. Return 1 if the commit was
+ * found, else return 0.
+ */
+int
+got_commit_graph_file_lookup(uint32_t *pos, struct got_commit_graph_file *cgf,
+    struct got_object_id *id)
+{
+	uint32_t idx;
+	int i;
+
+	for (i = cgf->nlayers - 1; i >= 0; i--) {
+		struct got_commit_graph_layer *layer = &cgf->layers[i];
+		if (lookup_layer(&idx, layer, id)) {
+			*pos = layer->base_pos + idx;
+			return 1;
+		}
+	}
+
+	return 0;
+}
+
+static struct got_commit_graph_layer *
+get_layer(struct got_commit_graph_file *cgf, uint32_t pos)
+{
+	int i;
+
+	for (i = cgf->nlayers - 1; i >= 0; i--) {
+		if (pos >= cgf->layers[i].base_pos)
+			break;
+	}
+	if (i < 0 || pos - cgf->layers[i].base_pos >= cgf->layers[i].ncommits)
+		return NULL;
+	return &cgf->layers[i];
+}
+
+/* A parent must be stored in the same layer or in a layer below. */
+static int
+parent_is_valid(struct got_commit_graph_layer *layer, uint32_t ppos)
+{
+	return (ppos < layer->base_pos + layer->ncommits);
+}
+
+struct got_object_id *
+got_commit_graph_file_get_id(struct got_commit_graph_file *cgf, uint32_t pos)
+{
+	struct got_commit_graph_layer *layer;
+
+	layer = get_layer(cgf, pos);
+	if (layer == NULL)
+		return NULL;
+	return &layer->oids[pos - layer->base_pos];
+}
+
+const struct got_error *
+got_commit_graph_file_get_commit(struct got_commit_graph_file_commit *commit,
+    struct got_commit_graph_file *cgf, uint32_t pos)
+{
+	struct got_commit_graph_layer *layer;
+	struct got_commit_graph_file_cdat *cdat;
+	uint32_t generation_time, edge;
+	int i;
+
+	memset(commit, 0, sizeof(*commit));
+
+	layer = get_layer(cgf, pos);
+	if (layer == NULL)
+		return got_error(GOT_ERR_BAD_COMMIT_GRAPH);
+
+	commit->pos = pos;
+	commit->layer = layer;
+	commit->id = &layer->oids[pos - layer->base_pos];
+	cdat = &layer->cdat[pos - layer->base_pos];
+	commit->tree_id = (struct got_object_id *)cdat->tree_id;
+
+	generation_time = be32toh(cdat->generation_time);
+	commit->generation = generation_time >> 2;
+	commit->committer_time = ((uint64_t)(generation_time & 0x3) << 32) |
+	    be32toh(cdat->time);
+
+	commit->parent1 = be32toh(cdat->parent1);
+	commit->parent2 = be32toh(cdat->parent2);
+	if (commit->parent1 == GOT_COMMIT_GRAPH_PARENT_NONE)
+		return NULL;
+	if (!parent_is_valid(layer, commit->parent1))
+		return got_error(GOT_ERR_BAD_COMMIT_GRAPH);
+	commit->nparents = 1;
+
+	if (commit->parent2 == GOT_COMMIT_GRAPH_PARENT_NONE)
+		return NULL;
+	if ((commit->parent2 & GOT_COMMIT_GRAPH_PARENT_EDGE) == 0) {
+		if (!parent_is_valid(layer, commit->parent2))
+			return got_error(GOT_ERR_BAD_COMMIT_GRAPH);
+		commit->nparents = 2;
+		return NULL;
+	}
+
+	/* Parents of octopus merges continue in the extra edge list. */
+	edge = commit->parent2 & GOT_COMMIT_GRAPH_POS_MASK;
+	for (i = edge; i < layer->nedges; i++) {
+		uint32_t ppos = be32toh(layer->edges[i]);
+		if (!parent_is_valid(layer, ppos & GOT_COMMIT_GRAPH_POS_MASK))
+			return got_error(GOT_ERR_BAD_COMMIT_GRAPH);
+		commit->nparents++;
+		if (ppos & GOT_COMMIT_GRAPH_EDGE_LAST)
+			return NULL;
+	}
+
+	return got_error(GOT_ERR_BAD_COMMIT_GRAPH);
+}
+
+/* Get the global position of the commit's n-th parent, starting at 0. */
+const struct got_error *
+got_commit_graph_file_get_parent(uint32_t *ppos,
+    struct got_commit_graph_file *cgf,
+    struct got_commit_graph_file_commit *commit, int n)
+{
+	struct got_commit_graph_layer *layer = commit->layer;
+
+	if (n < 0 || n >= commit->nparents)
+		return got_error(GOT_ERR_RANGE);
+
+	if (n == 0)
+		*ppos = commit->parent1;
+	else if ((commit->parent2 & GOT_COMMIT_GRAPH_PARENT_EDGE) == 0)
+		*ppos = commit->parent2;
+	else {
+		/* Bounds were checked by got_commit_graph_file_get_commit(). */
+		*ppos = be32toh(layer->edges[(commit->parent2 &
+		    GOT_COMMIT_GRAPH_POS_MASK) + n - 1]) &
+		    GOT_COMMIT_GRAPH_POS_MASK;
+	}
+
+	return NULL;
+}
+
+static uint32_t
+rotl32(uint32_t x, int r)
+{
+	return (x << r) | (x >> (32 - r));
+}
+
+/* Murmur3 32-bit hash, as used by Git's Bloom filters (version 2). */
+static uint32_t
+murmur3_seeded(uint32_t seed, const char *data, size_t len)
+{
+	const uint32_t c1 = 0xcc9e2d51, c2 = 0x1b873593;
+	const unsigned char *p = (const unsigned char *)data;
+	uint32_t h = seed, k;
+	size_t i, nblocks = len / 4;
+
+	for (i = 0; i < nblocks; i++, p += 4) {
+		k = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t)p[3] << 24);
+		k *= c1;
+		k = rotl32(k, 15);
+		k *= c2;
+		h ^= k;
+		h = rotl32(h, 13);
+		h = h * 5 + 0xe6546b64;
+	}
+
+	k = 0;
+	switch (len & 3) {
+	case 3:
+		k ^= p[2] << 16;
+		/* FALLTHROUGH */
+	case 2:
+		k ^= p[1] << 8;
+		/* FALLTHROUGH */
+	case 1:
+		k ^= p[0];
+		k *= c1;
+		k = rotl32(k, 15);
+		k *= c2;
+		h ^= k;
+		break;
+	}
+
+	h ^= (uint32_t)len;
+	h ^= h >> 16;
+	h *= 0x85ebca6b;
+	h ^= h >> 13;
+	h *= 0xc2b2ae35;
+	h ^= h >> 16;
+	return h;
+}
+
+void
+got_commit_graph_bloom_key(struct got_commit_graph_bloom_key *key,
+    const char *path, size_t len)
+{
+	uint32_t h0, h1;
+	int i;
+
+	h0 = murmur3_seeded(0x293ae76f, path, len);
+	h1 = murmur3_seeded(0x7e646e2c, path, len);
+	for (i = 0; i < nitems(key->hashes); i++)
+		key->hashes[i] = h0 + i * h1;
+}
+
+void
+got_commit_graph_bloom_add(uint8_t *filter, size_t len,
+    struct got_commit_graph_bloom_key *key)
+{
+	uint64_t nbits = (uint64_t)len * 8, bit;
+	int i;
+
+	for (i = 0; i < nitems(key->hashes); i++) {
+		bit = key->hashes[i] % nbits;
+		filter[bit / 8] |= 1 << (bit % 8);
+	}
+}
+
+static int
+bloom_contains(uint8_t *filter, size_t len,
+    struct got_commit_graph_bloom_key *key)
+{
+	uint64_t nbits = (uint64_t)len * 8, bit;
+	int i;
+
+	for (i = 0; i < nitems(key->hashes); i++) {
+		bit = key->hashes[i] % nbits;
+		if ((filter[bit / 8] & (1 << (bit % 8))) == 0)
+			return 0;
+	}
+
+	return 1;
+}
+
+int
+got_commit_graph_file_bloom_check(struct got_commit_graph_file *cgf,
+    uint32_t pos, const char *path)
+{
+	struct got_commit_graph_layer *layer;
+	struct got_commit_graph_bloom_key key;
+	uint32_t idx, start, end;
+	size_t len, i;
+
+	layer = get_layer(cgf, pos);
+	if (layer == NULL || layer->bloom_idx == NULL)
+		return -1;
+
+	idx = pos - layer->base_pos;
+	end = be32toh(layer->bloom_idx[idx]);
+	start = (idx > 0 ? be32toh(layer->bloom_idx[idx - 1]) : 0);
+	/* Git writes empty filters for commits which change many paths. */
+	if (end <= start || end > layer->bloom_len)
+		return -1;
+
+	while (path[0] == '/')
+		path++;
+	len = strlen(path);
+	while (len > 0 && path[len - 1] == '/')
+		len--;
+	if (len == 0)
+		return 1;
+
+	/* Version 1 filters were hashed with sign-extended bytes. */
+	if (layer->bloom_version == 1) {
+		for (i = 0; i < len; i++) {
+			if ((unsigned char)path[i] & 0x80)
+				return -1;
+		}
+	}
+
+	/* The path and each of its leading directories must be present. */
+	for (;;) {
+		got_commit_graph_bloom_key(&key, path, len);
+		if (!bloom_contains(layer->bloom_data + start, end - start,
+		    &key))
+			return 0;
+		while (len > 0 && path[len - 1] != '/')
+			len--;
+		if (len <= 1)
+			break;
+		len--;
+	}
+
+	return 1;
+}
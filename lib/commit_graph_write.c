@@ -0,0 +1,852 @@
+/*
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/queue.h>
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <limits.h>
+#include <sha1.h>
+#include <endian.h>
+#include <unistd.h>
+
+#include "got_error.h"
+#include "got_object.h"
+#include "got_cancel.h"
+#include "got_repository.h"
+#include "got_reference.h"
+#include "got_opentemp.h"
+#include "got_path.h"
+#include "got_commit_graph_file.h"
+
+#include "got_lib_delta.h"
+#include "got_lib_object.h"
+#include "got_lib_object_idset.h"
+#include "got_lib_lockfile.h"
+#include "got_lib_commit_graph_file.h"
+
+#ifndef nitems
+#define nitems(_a) (sizeof(_a) / sizeof((_a)[0]))
+#endif
+
+#ifndef MIN
+#define	MIN(_a,_b) ((_a) < (_b) ? (_a) : (_b))
+#endif
+
+/* Number of commits passed to got_object_open_commit_headers() at once. */
+#define GOT_COMMIT_GRAPH_WRITE_BATCH	64
+
+struct cg_commit {
+	struct got_object_id id;
+	struct got_object_id tree_id;
+	time_t committer_time;
+	uint32_t generation;
+	int nparents;		/* -1 until the commit has been read */
+	size_t parent_idx;	/* index of first parent in cg_writer's list */
+};
+
+struct cg_writer {
+	struct cg_commit *commits;
+	size_t ncommits;
+	size_t nalloc;
+
+	struct got_object_id *parents;
+	uint32_t *parent_pos;	/* commit positions of parents, once sorted */
+	size_t nparents;
+	size_t nparents_alloc;
+
+	struct got_object_idset *idset;
+	uint32_t nedges;
+
+	uint32_t *bloom_idx;
+	uint8_t *bloom_data;
+	size_t bloom_len;
+	size_t bloom_alloc;
+
+	got_cancel_cb cancel_cb;
+	void *cancel_arg;
+};
+
+/* Changed paths of a commit which are added to its Bloom filter. */
+struct cg_changed_paths {
+	struct got_commit_graph_bloom_key
+	    keys[GOT_COMMIT_GRAPH_BLOOM_MAX_PATHS];
+	int nkeys;
+	int too_many;
+};
+
+static const struct got_error *
+add_commit(struct cg_writer *w, struct got_object_id *id)
+{
+	const struct got_error *err;
+	struct cg_commit *c;
+
+	if (got_object_idset_contains(w->idset, id))
+		return NULL;
+
+	if (w->ncommits >= GOT_COMMIT_GRAPH_PARENT_NONE)
+		return got_error(GOT_ERR_NO_SPACE);
+
+	if (w->ncommits == w->nalloc) {
+		size_t n = w->nalloc ? w->nalloc * 2 : 1024;
+		c = reallocarray(w->commits, n, sizeof(*c));
+		if (c == NULL)
+			return got_error_from_errno("reallocarray");
+		w->commits = c;
+		w->nalloc = n;
+	}
+
+	err = got_object_idset_add(w->idset, id, NULL);
+	if (err)
+		return err;
+
+	c = &w->commits[w->ncommits++];
+	memset(c, 0, sizeof(*c));
+	memcpy(&c->id, id, sizeof(c->id));
+	c->nparents = -1;
+	return NULL;
+}
+
+static const struct got_error *
+add_parents(struct cg_writer *w, struct cg_commit *c,
+    struct got_commit_object *commit)
+{
+	const struct got_object_id_queue *parent_ids;
+	struct got_object_qid *qid;
+	int nparents;
+
+	nparents = got_object_commit_get_nparents(commit);
+	if (w->nparents + nparents > w->nparents_alloc) {
+		struct got_object_id *p;
+		size_t n = w->nparents_alloc ? w->nparents_alloc * 2 : 1024;
+		while (n < w->nparents + nparents)
+			n *= 2;
+		p = reallocarray(w->parents, n, sizeof(*p));
+		if (p == NULL)
+			return got_error_from_errno("reallocarray");
+		w->parents = p;
+		w->nparents_alloc = n;
+	}
+
+	c->parent_idx = w->nparents;
+	c->nparents = nparents;
+	parent_ids = got_object_commit_get_parent_ids(commit);
+	SIMPLEQ_FOREACH(qid, parent_ids, entry)
+		memcpy(&w->parents[w->nparents++], qid->id, sizeof(*qid->id));
+
+	if (nparents > 2)
+		w->nedges += nparents - 1;
+	return NULL;
+}
+
+/*
+ * Read commits breadth-first, starting at commits which were added for
+ * references. Commits are read in batches to keep helpers busy.
+ */
+static const struct got_error *
+read_commits(struct cg_writer *w, struct got_repository *repo)
+{
+	const struct got_error *err = NULL;
+	struct got_object_id *ids[GOT_COMMIT_GRAPH_WRITE_BATCH];
+	struct got_commit_object *commits[GOT_COMMIT_GRAPH_WRITE_BATCH];
+	size_t next = 0, i, n;
+
+	while (next < w->ncommits) {
+		if (w->cancel_cb) {
+			err = w->cancel_cb(w->cancel_arg);
+			if (err)
+				return err;
+		}
+
+		n = MIN(w->ncommits - next, nitems(ids));
+		for (i = 0; i < n; i++)
+			ids[i] = &w->commits[next + i].id;
+
+		err = got_object_open_commit_headers(commits, repo, ids, n);
+		if (err)
+			return err;
+
+		/* Adding parents may move commits; don't use ids[] below. */
+		for (i = 0; i < n; i++) {
+			struct cg_commit *c = &w->commits[next + i];
+			const struct got_object_id_queue *parent_ids;
+			struct got_object_qid *qid;
+			time_t t;
+
+			memcpy(&c->tree_id,
+			    got_object_commit_get_tree_id(commits[i]),
+			    sizeof(c->tree_id));
+			t = got_object_commit_get_committer_time(commits[i]);
+			c->committer_time = t < 0 ? 0 : t;
+			err = add_parents(w, c, commits[i]);
+			if (err)
+				break;
+
+			parent_ids = got_object_commit_get_parent_ids(
+			    commits[i]);
+			SIMPLEQ_FOREACH(qid, parent_ids, entry) {
+				err = add_commit(w, qid->id);
+				if (err)
+					break;
+			}
+			if (err)
+				break;
+		}
+		for (i = 0; i < n; i++)
+			got_object_commit_close(commits[i]);
+		if (err)
+			return err;
+		next += n;
+	}
+
+	return NULL;
+}
+
+static const struct got_error *
+add_ref_targets(struct cg_writer *w, struct got_repository *repo)
+{
+	const struct got_error *err;
+	struct got_reflist_head refs;
+	struct got_reflist_entry *re;
+	struct got_object_id *id = NULL;
+	struct got_tag_object *tag = NULL;
+	int obj_type;
+
+	SIMPLEQ_INIT(&refs);
+	err = got_ref_list(&refs, repo, NULL, got_ref_cmp_by_name, NULL);
+	if (err)
+		return err;
+
+	SIMPLEQ_FOREACH(re, &refs, entry) {
+		err = got_ref_resolve(&id, repo, re->ref);
+		if (err)
+			goto done;
+
+		/* Peel tags. */
+		for (;;) {
+			err = got_object_get_type(&obj_type, repo, id);
+			if (err)
+				goto done;
+			if (obj_type != GOT_OBJ_TYPE_TAG)
+				break;
+			err = got_object_open_as_tag(&tag, repo, id);
+			if (err)
+				goto done;
+			free(id);
+			id = got_object_id_dup(
+			    got_object_tag_get_object_id(tag));
+			got_object_tag_close(tag);
+			if (id == NULL) {
+				err = got_error_from_errno(
+				    "got_object_id_dup");
+				goto done;
+			}
+		}
+
+		if (obj_type == GOT_OBJ_TYPE_COMMIT) {
+			err = add_commit(w, id);
+			if (err)
+				goto done;
+		}
+		free(id);
+		id = NULL;
+	}
+done:
+	free(id);
+	got_ref_list_free(&refs);
+	return err;
+}
+
+static int
+cmp_commits(const void *a, const void *b)
+{
+	const struct cg_commit *c1 = a, *c2 = b;
+
+	return got_object_id_cmp(&c1->id, &c2->id);
+}
+
+static const struct got_error *
+find_commit(uint32_t *pos, struct cg_writer *w, struct got_object_id *id)
+{
+	struct cg_commit key, *c;
+
+	memcpy(&key.id, id, sizeof(key.id));
+	c = bsearch(&key, w->commits, w->ncommits, sizeof(w->commits[0]),
+	    cmp_commits);
+	if (c == NULL)
+		return got_error_no_obj(id);
+	*pos = c - w->commits;
+	return NULL;
+}
+
+static const struct got_error *
+resolve_parents(struct cg_writer *w)
+{
+	const struct got_error *err;
+	size_t i;
+
+	if (w->nparents == 0)
+		return NULL;
+
+	w->parent_pos = calloc(w->nparents, sizeof(w->parent_pos[0]));
+	if (w->parent_pos == NULL)
+		return got_error_from_errno("calloc");
+
+	for (i = 0; i < w->nparents; i++) {
+		err = find_commit(&w->parent_pos[i], w, &w->parents[i]);
+		if (err)
+			return err;
+	}
+
+	return NULL;
+}
+
+/*
+ * Compute generation numbers. A commit's generation is one more than the
+ * largest generation among its parents. Histories can be very deep, so
+ * an explicit stack is used instead of recursion.
+ */
+static const struct got_error *
+compute_generations(struct cg_writer *w)
+{
+	uint32_t *stack, pos, gen, pgen, max;
+	size_t i, depth;
+	int j, done;
+
+	if (w->ncommits == 0)
+		return NULL;
+
+	stack = calloc(w->ncommits, sizeof(*stack));
+	if (stack == NULL)
+		return got_error_from_errno("calloc");
+
+	for (i = 0; i < w->ncommits; i++) {
+		if (w->commits[i].generation != 0)
+			continue;
+		depth = 0;
+		stack[depth++] = i;
+		while (depth > 0) {
+			struct cg_commit *c = &w->commits[stack[depth - 1]];
+
+			done = 1;
+			max = 0;
+			for (j = 0; j < c->nparents; j++) {
+				pos = w->parent_pos[c->parent_idx + j];
+				pgen = w->commits[pos].generation;
+				if (pgen == 0) {
+					/* A commit is on the stack once. */
+					stack[depth++] = pos;
+					done = 0;
+					break;
+				}
+				if (pgen > max)
+					max = pgen;
+			}
+			if (!done)
+				continue;
+			gen = max + 1;
+			if (gen > GOT_COMMIT_GRAPH_GENERATION_MAX)
+				gen = GOT_COMMIT_GRAPH_GENERATION_MAX;
+			c->generation = gen;
+			depth--;
+		}
+	}
+
+	free(stack);
+	return NULL;
+}
+
+static void
+add_changed_path(struct cg_changed_paths *paths, const char *path)
+{
+	if (paths->nkeys >= nitems(paths->keys)) {
+		paths->too_many = 1;
+		return;
+	}
+	got_commit_graph_bloom_key(&paths->keys[paths->nkeys++], path,
+	    strlen(path));
+}
+
+static int
+entry_is_tree(struct got_tree_entry *te)
+{
+	return te != NULL && S_ISDIR(got_tree_entry_get_mode(te)) &&
+	    !got_object_tree_entry_is_submodule(te);
+}
+
+static const struct got_error *collect_changed_paths(
+    struct cg_changed_paths *, struct got_object_id *,
+    struct got_object_id *, const char *, struct got_repository *);
+
+static const struct got_error *
+changed_entry(struct cg_changed_paths *paths, struct got_tree_entry *te1,
+    struct got_tree_entry *te2, const char *parent_path,
+    struct got_repository *repo)
+{
+	const struct got_error *err = NULL;
+	const char *name;
+	char *path;
+
+	name = got_tree_entry_get_name(te1 ? te1 : te2);
+	if (asprintf(&path, "%s%s%s", parent_path,
+	    parent_path[0] ? "/" : "", name) == -1)
+		return got_error_from_errno("asprintf");
+
+	add_changed_path(paths, path);
+	if (!paths->too_many && (entry_is_tree(te1) || entry_is_tree(te2)))
+		err = collect_changed_paths(paths,
+		    entry_is_tree(te1) ? got_tree_entry_get_id(te1) : NULL,
+		    entry_is_tree(te2) ? got_tree_entry_get_id(te2) : NULL,
+		    path, repo);
+	free(path);
+	return err;
+}
+
+/*
+ * Collect paths which differ between two trees, either of which may be
+ * missing. Any path whose object ID differs between the trees is included,
+ * such that a filter never rules out a commit which changed a path.
+ */
+static const struct got_error *
+collect_changed_paths(struct cg_changed_paths *paths,
+    struct got_object_id *tree_id1, struct got_object_id *tree_id2,
+    const char *parent_path, struct got_repository *repo)
+{
+	const struct got_error *err = NULL;
+	struct got_tree_object *tree1 = NULL, *tree2 = NULL;
+	struct got_tree_entry *te1, *te2;
+	int i, n;
+
+	if (tree_id1 && tree_id2 && got_object_id_cmp(tree_id1, tree_id2) == 0)
+		return NULL;
+
+	if (tree_id1) {
+		err = got_object_open_as_tree(&tree1, repo, tree_id1);
+		if (err)
+			goto done;
+	}
+	if (tree_id2) {
+		err = got_object_open_as_tree(&tree2, repo, tree_id2);
+		if (err)
+			goto done;
+	}
+
+	n = tree1 ? got_object_tree_get_nentries(tree1) : 0;
+	for (i = 0; i < n && !paths->too_many; i++) {
+		te1 = got_object_tree_get_entry(tree1, i);
+		te2 = tree2 ? got_object_tree_find_entry(tree2,
+		    got_tree_entry_get_name(te1)) : NULL;
+		if (te2 && got_tree_entry_get_mode(te1) ==
+		    got_tree_entry_get_mode(te2) &&
+		    got_object_id_cmp(got_tree_entry_get_id(te1),
+		    got_tree_entry_get_id(te2)) == 0)
+			continue;
+		err = changed_entry(paths, te1, te2, parent_path, repo);
+		if (err)
+			goto done;
+	}
+
+	n = tree2 ? got_object_tree_get_nentries(tree2) : 0;
+	for (i = 0; i < n && !paths->too_many; i++) {
+		te2 = got_object_tree_get_entry(tree2, i);
+		if (tree1 && got_object_tree_find_entry(tree1,
+		    got_tree_entry_get_name(te2)))
+			continue; /* handled above */
+		err = changed_entry(paths, NULL, te2, parent_path, repo);
+		if (err)
+			goto done;
+	}
+done:
+	if (tree1)
+		got_object_tree_close(tree1);
+	if (tree2)
+		got_object_tree_close(tree2);
+	return err;
+}
+
+/*
+ * Compute a Bloom filter for the paths changed between a commit and its
+ * first parent, and append it to the Bloom filter data.
+ */
+static const struct got_error *
+add_bloom_filter(struct cg_writer *w, uint32_t pos,
+    struct cg_changed_paths *paths, struct got_repository *repo)
+{
+	const struct got_error *err;
+	struct cg_commit *c = &w->commits[pos];
+	struct got_object_id *ptree_id = NULL;
+	uint8_t *filter;
+	size_t len;
+	int i;
+
+	if (c->nparents > 0) {
+		uint32_t ppos = w->parent_pos[c->parent_idx];
+		ptree_id = &w->commits[ppos].tree_id;
+	}
+
+	memset(paths, 0, sizeof(*paths));
+	err = collect_changed_paths(paths, ptree_id, &c->tree_id, "", repo);
+	if (err)
+		return err;
+
+	if (paths->too_many)
+		len = 1;
+	else {
+		len = (paths->nkeys *
+		    GOT_COMMIT_GRAPH_BLOOM_BITS_PER_ENTRY + 7) / 8;
+		if (len == 0)
+			len = 1;
+	}
+
+	if (w->bloom_len + len > UINT32_MAX)
+		return got_error(GOT_ERR_NO_SPACE);
+
+	if (w->bloom_len + len > w->bloom_alloc) {
+		uint8_t *p;
+		size_t n = w->bloom_alloc ? w->bloom_alloc * 2 : 65536;
+		while (n < w->bloom_len + len)
+			n *= 2;
+		p = realloc(w->bloom_data, n);
+		if (p == NULL)
+			return got_error_from_errno("realloc");
+		w->bloom_data = p;
+		w->bloom_alloc = n;
+	}
+
+	filter = w->bloom_data + w->bloom_len;
+	memset(filter, 0, len);
+	if (paths->too_many)
+		filter[0] = 0xff; /* matches any path */
+	else {
+		for (i = 0; i < paths->nkeys; i++)
+			got_commit_graph_bloom_add(filter, len,
+			    &paths->keys[i]);
+	}
+	w->bloom_len += len;
+	w->bloom_idx[pos] = w->bloom_len;
+	return NULL;
+}
+
+static const struct got_error *
+compute_bloom_filters(struct cg_writer *w, struct got_repository *repo)
+{
+	const struct got_error *err = NULL;
+	struct cg_changed_paths *paths;
+	size_t i;
+
+	w->bloom_idx = calloc(w->ncommits, sizeof(w->bloom_idx[0]));
+	if (w->ncommits > 0 && w->bloom_idx == NULL)
+		return got_error_from_errno("calloc");
+
+	paths = malloc(sizeof(*paths));
+	if (paths == NULL)
+		return got_error_from_errno("malloc");
+
+	for (i = 0; i < w->ncommits; i++) {
+		if (w->cancel_cb) {
+			err = w->cancel_cb(w->cancel_arg);
+			if (err)
+				break;
+		}
+		err = add_bloom_filter(w, i, paths, repo);
+		if (err)
+			break;
+	}
+
+	free(paths);
+	return err;
+}
+
+static const struct got_error *
+hwrite(FILE *f, SHA1_CTX *ctx, const void *buf, size_t len)
+{
+	size_t n;
+
+	SHA1Update(ctx, buf, len);
+	n = fwrite(buf, 1, len, f);
+	if (n != len)
+		return got_ferror(f, GOT_ERR_IO);
+	return NULL;
+}
+
+static const struct got_error *
+hwrite_be32(FILE *f, SHA1_CTX *ctx, uint32_t val)
+{
+	val = htobe32(val);
+	return hwrite(f, ctx, &val, sizeof(val));
+}
+
+static const struct got_error *
+write_chunks(FILE *f, struct cg_writer *w)
+{
+	const struct got_error *err;
+	struct got_commit_graph_file_hdr hdr;
+	struct got_commit_graph_file_chunk chunks[7];
+	struct got_commit_graph_bloom_hdr bhdr;
+	uint8_t digest[SHA1_DIGEST_LENGTH];
+	SHA1_CTX ctx;
+	uint64_t offset;
+	uint32_t fanout, edge;
+	size_t i, nchunks = 0;
+	int j;
+
+	/* Chunk table, terminated by an entry with ID zero. */
+	chunks[nchunks].id = GOT_COMMIT_GRAPH_CHUNK_OIDF;
+	chunks[nchunks++].offset = 256 * sizeof(uint32_t);
+	chunks[nchunks].id = GOT_COMMIT_GRAPH_CHUNK_OIDL;
+	chunks[nchunks++].offset = w->ncommits * SHA1_DIGEST_LENGTH;
+	chunks[nchunks].id = GOT_COMMIT_GRAPH_CHUNK_CDAT;
+	chunks[nchunks++].offset = w->ncommits *
+	    sizeof(struct got_commit_graph_file_cdat);
+	if (w->nedges > 0) {
+		chunks[nchunks].id = GOT_COMMIT_GRAPH_CHUNK_EDGE;
+		chunks[nchunks++].offset = w->nedges * sizeof(uint32_t);
+	}
+	if (w->bloom_idx) {
+		chunks[nchunks].id = GOT_COMMIT_GRAPH_CHUNK_BIDX;
+		chunks[nchunks++].offset = w->ncommits * sizeof(uint32_t);
+		chunks[nchunks].id = GOT_COMMIT_GRAPH_CHUNK_BDAT;
+		chunks[nchunks++].offset = sizeof(bhdr) + w->bloom_len;
+	}
+	chunks[nchunks].id = 0;
+	chunks[nchunks].offset = 0;
+
+	/* Convert chunk sizes into offsets. */
+	offset = sizeof(hdr) + (nchunks + 1) * sizeof(chunks[0]);
+	for (i = 0; i <= nchunks; i++) {
+		uint64_t size = chunks[i].offset;
+		chunks[i].id = htobe32(chunks[i].id);
+		chunks[i].offset = htobe64(offset);
+		offset += size;
+	}
+
+	SHA1Init(&ctx);
+
+	hdr.signature = htobe32(GOT_COMMIT_GRAPH_SIGNATURE);
+	hdr.version = GOT_COMMIT_GRAPH_VERSION;
+	hdr.hash_version = GOT_COMMIT_GRAPH_HASH_SHA1;
+	hdr.nchunks = nchunks;
+	hdr.nbase_graphs = 0;
+	err = hwrite(f, &ctx, &hdr, sizeof(hdr));
+	if (err)
+		return err;
+	err = hwrite(f, &ctx, chunks, (nchunks + 1) * sizeof(chunks[0]));
+	if (err)
+		return err;
+
+	/* OIDF */
+	fanout = 0;
+	for (j = 0; j < 256; j++) {
+		while (fanout < w->ncommits &&
+		    w->commits[fanout].id.sha1[0] <= j)
+			fanout++;
+		err = hwrite_be32(f, &ctx, fanout);
+		if (err)
+			return err;
+	}
+
+	/* OIDL */
+	for (i = 0; i < w->ncommits; i++) {
+		err = hwrite(f, &ctx, w->commits[i].id.sha1,
+		    SHA1_DIGEST_LENGTH);
+		if (err)
+			return err;
+	}
+
+	/* CDAT */
+	edge = 0;
+	for (i = 0; i < w->ncommits; i++) {
+		struct cg_commit *c = &w->commits[i];
+		struct got_commit_graph_file_cdat cdat;
+		uint32_t *ppos = w->parent_pos ?
+		    &w->parent_pos[c->parent_idx] : NULL;
+		uint64_t t = c->committer_time;
+
+		memcpy(cdat.tree_id, c->tree_id.sha1, sizeof(cdat.tree_id));
+		cdat.parent1 = htobe32(c->nparents > 0 ? ppos[0] :
+		    GOT_COMMIT_GRAPH_PARENT_NONE);
+		if (c->nparents > 2) {
+			cdat.parent2 = htobe32(GOT_COMMIT_GRAPH_PARENT_EDGE |
+			    edge);
+			edge += c->nparents - 1;
+		} else
+			cdat.parent2 = htobe32(c->nparents > 1 ? ppos[1] :
+			    GOT_COMMIT_GRAPH_PARENT_NONE);
+		cdat.generation_time = htobe32((c->generation << 2) |
+		    ((t >> 32) & 0x3));
+		cdat.time = htobe32(t & 0xffffffff);
+		err = hwrite(f, &ctx, &cdat, sizeof(cdat));
+		if (err)
+			return err;
+	}
+
+	/* EDGE */
+	for (i = 0; i < w->ncommits; i++) {
+		struct cg_commit *c = &w->commits[i];
+
+		if (c->nparents <= 2)
+			continue;
+		for (j = 1; j < c->nparents; j++) {
+			uint32_t pos = w->parent_pos[c->parent_idx + j];
+			if (j == c->nparents - 1)
+				pos |= GOT_COMMIT_GRAPH_EDGE_LAST;
+			err = hwrite_be32(f, &ctx, pos);
+			if (err)
+				return err;
+		}
+	}
+
+	if (w->bloom_idx) {
+		/* BIDX */
+		for (i = 0; i < w->ncommits; i++) {
+			err = hwrite_be32(f, &ctx, w->bloom_idx[i]);
+			if (err)
+				return err;
+		}
+
+		/* BDAT */
+		bhdr.version = htobe32(GOT_COMMIT_GRAPH_BLOOM_VERSION);
+		bhdr.nhashes = htobe32(GOT_COMMIT_GRAPH_BLOOM_NHASHES);
+		bhdr.bits_per_entry =
+		    htobe32(GOT_COMMIT_GRAPH_BLOOM_BITS_PER_ENTRY);
+		err = hwrite(f, &ctx, &bhdr, sizeof(bhdr));
+		if (err)
+			return err;
+		if (w->bloom_len > 0) {
+			err = hwrite(f, &ctx, w->bloom_data, w->bloom_len);
+			if (err)
+				return err;
+		}
+	}
+
+	SHA1Final(digest, &ctx);
+	if (fwrite(digest, 1, sizeof(digest), f) != sizeof(digest))
+		return got_ferror(f, GOT_ERR_IO);
+
+	if (fflush(f) != 0)
+		return got_error_from_errno("fflush");
+
+	return NULL;
+}
+
+const struct got_error *
+got_commit_graph_file_write(int *ncommits, struct got_repository *repo,
+    int bloom, got_cancel_cb cancel_cb, void *cancel_arg)
+{
+	const struct got_error *err = NULL, *unlock_err = NULL;
+	struct cg_writer w;
+	struct got_lockfile *lf = NULL;
+	char *path = NULL, *tmppath = NULL;
+	FILE *f = NULL;
+
+	*ncommits = 0;
+
+	memset(&w, 0, sizeof(w));
+	w.cancel_cb = cancel_cb;
+	w.cancel_arg = cancel_arg;
+	w.idset = got_object_idset_alloc();
+	if (w.idset == NULL)
+		return got_error_from_errno("got_object_idset_alloc");
+
+	err = add_ref_targets(&w, repo);
+	if (err)
+		goto done;
+	err = read_commits(&w, repo);
+	if (err)
+		goto done;
+
+	/* Parent positions refer to commits sorted by ID. */
+	qsort(w.commits, w.ncommits, sizeof(w.commits[0]), cmp_commits);
+	err = resolve_parents(&w);
+	if (err)
+		goto done;
+	err = compute_generations(&w);
+	if (err)
+		goto done;
+	if (bloom) {
+		err = compute_bloom_filters(&w, repo);
+		if (err)
+			goto done;
+	}
+
+	if (asprintf(&path, "%s/%s", got_repo_get_path_git_dir(repo),
+	    GOT_COMMIT_GRAPH_FILE) == -1) {
+		err = got_error_from_errno("asprintf");
+		goto done;
+	}
+
+	err = got_opentemp_named(&tmppath, &f, path);
+	if (err) {
+		char *parent_path;
+		if (!(err->code == GOT_ERR_ERRNO && errno == ENOENT))
+			goto done;
+		err = got_path_dirname(&parent_path, path);
+		if (err)
+			goto done;
+		err = got_path_mkdir(parent_path);
+		free(parent_path);
+		if (err)
+			goto done;
+		err = got_opentemp_named(&tmppath, &f, path);
+		if (err)
+			goto done;
+	}
+
+	err = write_chunks(f, &w);
+	if (err)
+		goto done;
+
+	err = got_lockfile_lock(&lf, path);
+	if (err)
+		goto done;
+
+	if (rename(tmppath, path) != 0) {
+		err = got_error_from_errno3("rename", tmppath, path);
+		goto done;
+	}
+	free(tmppath);
+	tmppath = NULL;
+
+	if (chmod(path, GOT_DEFAULT_FILE_MODE) != 0) {
+		err = got_error_from_errno2("chmod", path);
+		goto done;
+	}
+
+	*ncommits = w.ncommits;
+done:
+	if (tmppath) {
+		if (unlink(tmppath) != 0 && err == NULL)
+			err = got_error_from_errno2("unlink", tmppath);
+		free(tmppath);
+	}
+	if (f && fclose(f) != 0 && err == NULL)
+		err = got_error_from_errno("fclose");
+	if (lf)
+		unlock_err = got_lockfile_unlock(lf);
+	free(path);
+	got_object_idset_free(w.idset);
+	free(w.commits);
+	free(w.parents);
+	free(w.parent_pos);
+	free(w.bloom_idx);
+	free(w.bloom_data);
+	return err ? err : unlock_err;
+}
@@ -0,0 +1,271 @@
+/*
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <sys/queue.h>
+
+#include <pthread.h>
+#include <regex.h>
+#include <sha1.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "got_error.h"
+#include "got_object.h"
+#include "got_commit_search.h"
+
+#include "got_lib_delta.h"
+#include "got_lib_object.h"
+#include "got_lib_sha1.h"
+
+#define GOT_COMMIT_SEARCH_MAX_THREADS	8
+
+/* Number of commits a thread claims at a time. */
+#define GOT_COMMIT_SEARCH_CHUNK_SIZE	8
+
+struct got_commit_search {
+	regex_t *regex;
+	int flags;
+
+	pthread_t *threads;
+	int nthreads;
+	pthread_mutex_t mutex;
+	pthread_cond_t work_cond;
+	pthread_cond_t done_cond;
+	int quit;
+
+	/* The batch of commits being matched. */
+	struct got_object_id **ids;
+	struct got_commit_object **commits;
+	int *matches;
+	int ncommits;
+	int next;	/* next commit to be claimed by a thread */
+	int ndone;	/* number of commits matched so far */
+	const struct got_error *err;
+};
+
+static const struct got_error *
+match_commit(int *match, struct got_commit_search *search,
+    struct got_object_id *id, struct got_commit_object *commit)
+{
+	const struct got_error *err;
+	regmatch_t regmatch;
+	char id_str[SHA1_DIGEST_STRING_LENGTH];
+	char *logmsg;
+
+	*match = 0;
+
+	if ((search->flags & GOT_COMMIT_SEARCH_ID) &&
+	    got_sha1_digest_to_str(id->sha1, id_str, sizeof(id_str)) &&
+	    regexec(search->regex, id_str, 1, &regmatch, 0) == 0) {
+		*match = 1;
+		return NULL;
+	}
+
+	if ((search->flags & GOT_COMMIT_SEARCH_AUTHOR) &&
+	    (regexec(search->regex, got_object_commit_get_author(commit), 1,
+	    &regmatch, 0) == 0 ||
+	    regexec(search->regex, got_object_commit_get_committer(commit), 1,
+	    &regmatch, 0) == 0)) {
+		*match = 1;
+		return NULL;
+	}
+
+	if (search->flags & GOT_COMMIT_SEARCH_LOGMSG) {
+		err = got_object_commit_get_logmsg(&logmsg, commit);
+		if (err)
+			return err;
+		if (regexec(search->regex, logmsg, 1, &regmatch, 0) == 0)
+			*match = 1;
+		free(logmsg);
+	}
+
+	return NULL;
+}
+
+static void *
+search_thread(void *arg)
+{
+	const struct got_error *err;
+	struct got_commit_search *search = arg;
+	int i, start, end;
+
+	pthread_mutex_lock(&search->mutex);
+	for (;;) {
+		while (!search->quit && search->next >= search->ncommits)
+			pthread_cond_wait(&search->work_cond, &search->mutex);
+		if (search->quit)
+			break;
+
+		start = search->next;
+		end = start + GOT_COMMIT_SEARCH_CHUNK_SIZE;
+		if (end > search->ncommits)
+			end = search->ncommits;
+		search->next = end;
+		pthread_mutex_unlock(&search->mutex);
+
+		err = NULL;
+		for (i = start; i < end && err == NULL; i++) {
+			err = match_commit(&search->matches[i], search,
+			    search->ids[i], search->commits[i]);
+		}
+
+		pthread_mutex_lock(&search->mutex);
+		if (err && search->err == NULL)
+			search->err = err;
+		search->ndone += end - start;
+		if (search->ndone == search->ncommits)
+			pthread_cond_signal(&search->done_cond);
+	}
+	pthread_mutex_unlock(&search->mutex);
+
+	return NULL;
+}
+
+static void
+stop_threads(struct got_commit_search *search)
+{
+	int i;
+
+	pthread_mutex_lock(&search->mutex);
+	search->quit = 1;
+	pthread_cond_broadcast(&search->work_cond);
+	pthread_mutex_unlock(&search->mutex);
+
+	for (i = 0; i < search->nthreads; i++)
+		pthread_join(search->threads[i], NULL);
+	search->nthreads = 0;
+}
+
+const struct got_error *
+got_commit_search_open(struct got_commit_search **search, regex_t *regex,
+    int flags)
+{
+	const struct got_error *err = NULL;
+	long ncpu;
+	int errcode, nthreads;
+
+	*search = calloc(1, sizeof(**search));
+	if (*search == NULL)
+		return got_error_from_errno("calloc");
+
+	(*search)->regex = regex;
+	(*search)->flags = flags;
+
+	ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	if (ncpu <= 1)
+		return NULL; /* match commits in the calling thread */
+	nthreads = ncpu < GOT_COMMIT_SEARCH_MAX_THREADS ?
+	    ncpu : GOT_COMMIT_SEARCH_MAX_THREADS;
+
+	(*search)->threads = calloc(nthreads, sizeof(*(*search)->threads));
+	if ((*search)->threads == NULL) {
+		err = got_error_from_errno("calloc");
+		free(*search);
+		*search = NULL;
+		return err;
+	}
+
+	errcode = pthread_mutex_init(&(*search)->mutex, NULL);
+	if (errcode) {
+		err = got_error_set_errno(errcode, "pthread_mutex_init");
+		goto done;
+	}
+	errcode = pthread_cond_init(&(*search)->work_cond, NULL);
+	if (errcode) {
+		pthread_mutex_destroy(&(*search)->mutex);
+		err = got_error_set_errno(errcode, "pthread_cond_init");
+		goto done;
+	}
+	errcode = pthread_cond_init(&(*search)->done_cond, NULL);
+	if (errcode) {
+		pthread_cond_destroy(&(*search)->work_cond);
+		pthread_mutex_destroy(&(*search)->mutex);
+		err = got_error_set_errno(errcode, "pthread_cond_init");
+		goto done;
+	}
+
+	while ((*search)->nthreads < nthreads) {
+		errcode = pthread_create(
+		    &(*search)->threads[(*search)->nthreads], NULL,
+		    search_thread, *search);
+		if (errcode) {
+			err = got_error_set_errno(errcode, "pthread_create");
+			got_commit_search_close(*search);
+			*search = NULL;
+			return err;
+		}
+		(*search)->nthreads++;
+	}
+done:
+	if (err) {
+		free((*search)->threads);
+		free(*search);
+		*search = NULL;
+	}
+	return err;
+}
+
+const struct got_error *
+got_commit_search_match(int *matches, struct got_commit_search *search,
+    struct got_object_id **ids, struct got_commit_object **commits,
+    int ncommits)
+{
+	const struct got_error *err = NULL;
+	int i;
+
+	if (search->nthreads == 0) {
+		for (i = 0; i < ncommits && err == NULL; i++)
+			err = match_commit(&matches[i], search, ids[i],
+			    commits[i]);
+		return err;
+	}
+
+	pthread_mutex_lock(&search->mutex);
+	search->ids = ids;
+	search->commits = commits;
+	search->matches = matches;
+	search->ncommits = ncommits;
+	search->next = 0;
+	search->ndone = 0;
+	search->err = NULL;
+	pthread_cond_broadcast(&search->work_cond);
+	while (search->ndone < ncommits)
+		pthread_cond_wait(&search->done_cond, &search->mutex);
+	err = search->err;
+	search->ids = NULL;
+	search->commits = NULL;
+	search->matches = NULL;
+	search->ncommits = 0;
+	search->next = 0;
+	pthread_mutex_unlock(&search->mutex);
+
+	return err;
+}
+
+void
+got_commit_search_close(struct got_commit_search *search)
+{
+	if (search->threads) {
+		stop_threads(search);
+		pthread_cond_destroy(&search->done_cond);
+		pthread_cond_destroy(&search->work_cond);
+		pthread_mutex_destroy(&search->mutex);
+		free(search->threads);
+	}
+	free(search);
+}
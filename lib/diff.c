@@ -17,6 +17,7 @@
 #include <sys/queue.h>
 #include <sys/stat.h>
 
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -36,113 +37,299 @@
 #include "got_lib_inflate.h"
 #include "got_lib_object.h"
 
+const struct got_error *
+got_diff_session_open(struct got_diff_session **session)
+{
+	*session = calloc(1, sizeof(**session));
+	if (*session == NULL)
+		return got_error_from_errno("calloc");
+	return NULL;
+}
+
+void
+got_diff_session_close(struct got_diff_session *session)
+{
+	got_diff_state_free(&session->ds);
+	free(session);
+}
+
+/* Record a line about to be written to the output file, if requested. */
 static const struct got_error *
-diff_blobs(struct got_blob_object *blob1, struct got_blob_object *blob2,
-    const char *label1, const char *label2, mode_t mode1, mode_t mode2,
-    int diff_context, int ignore_whitespace, FILE *outfile,
-    struct got_diff_changes *changes)
+record_line(struct got_diff_output_line **lines, size_t *nlines,
+    FILE *outfile, uint8_t type)
 {
-	struct got_diff_state ds;
-	struct got_diff_args args;
-	const struct got_error *err = NULL;
-	FILE *f1 = NULL, *f2 = NULL;
-	char hex1[SHA1_DIGEST_STRING_LENGTH];
-	char hex2[SHA1_DIGEST_STRING_LENGTH];
-	char *idstr1 = NULL, *idstr2 = NULL;
-	size_t size1, size2;
-	int res, flags = 0;
+	off_t off;
 
-	if (blob1) {
-		f1 = got_opentemp();
-		if (f1 == NULL)
-			return got_error_from_errno("got_opentemp");
-	} else
-		flags |= D_EMPTY1;
+	if (lines == NULL)
+		return NULL;
 
-	if (blob2) {
-		f2 = got_opentemp();
-		if (f2 == NULL) {
-			err = got_error_from_errno("got_opentemp");
-			fclose(f1);
-			return err;
+	off = ftello(outfile);
+	if (off == -1)
+		return got_error_from_errno("ftello");
+	return got_diff_add_line(lines, nlines, off, type);
+}
+
+static const struct got_error *
+print_blob_header(const char *idstr1, const char *idstr2, mode_t mode1,
+    mode_t mode2, FILE *outfile, struct got_diff_output_line **lines,
+    size_t *nlines)
+{
+	const struct got_error *err;
+	char *modestr1 = NULL, *modestr2 = NULL;
+
+	if (mode1 && mode1 != mode2) {
+		if (asprintf(&modestr1, " (mode %o)",
+		    mode1 & (S_IRWXU | S_IRWXG | S_IRWXO)) == -1)
+			return got_error_from_errno("asprintf");
+	}
+	if (mode2 && mode1 != mode2) {
+		if (asprintf(&modestr2, " (mode %o)",
+		    mode2 & (S_IRWXU | S_IRWXG | S_IRWXO)) == -1) {
+			free(modestr1);
+			return got_error_from_errno("asprintf");
 		}
-	} else
-		flags |= D_EMPTY2;
+	}
+	err = record_line(lines, nlines, outfile, GOT_DIFF_LINE_META);
+	if (err)
+		goto done;
+	fprintf(outfile, "blob - %s%s\n", idstr1, modestr1 ? modestr1 : "");
+	err = record_line(lines, nlines, outfile, GOT_DIFF_LINE_META);
+	if (err)
+		goto done;
+	fprintf(outfile, "blob + %s%s\n", idstr2, modestr2 ? modestr2 : "");
+done:
+	free(modestr1);
+	free(modestr2);
+	return err;
+}
 
-	size1 = 0;
+size_t
+got_diff_max_blob_size(void)
+{
+	const char *max_blob_size;
+	long long n;
+	const char *errstr;
+
+	max_blob_size = getenv("GOT_DIFF_MAX_BLOB_SIZE");
+	if (max_blob_size == NULL)
+		return GOT_DIFF_MAX_BLOB_SIZE;
+	n = strtonum(max_blob_size, 0, LLONG_MAX, &errstr);
+	if (errstr != NULL)
+		return GOT_DIFF_MAX_BLOB_SIZE;
+	if (n == 0 || n > SIZE_MAX)
+		return SIZE_MAX;
+	return n;
+}
+
+const struct got_error *
+got_diff_blob_check(int *kind, size_t *size1, size_t *size2,
+    struct got_blob_object *blob1, struct got_blob_object *blob2)
+{
+	const struct got_error *err;
+	const uint8_t *buf1 = NULL, *buf2 = NULL;
+	size_t len1 = 0, len2 = 0, max_size;
+
+	*kind = GOT_DIFF_BLOBS_TEXT;
+	*size1 = 0;
+	*size2 = 0;
+
+	/* Neither blob is read into memory yet; only look at its head. */
 	if (blob1) {
-		idstr1 = got_object_blob_id_str(blob1, hex1, sizeof(hex1));
-		err = got_object_blob_dump_to_file(&size1, NULL, NULL, f1,
-		    blob1);
+		err = got_object_blob_peek(&buf1, &len1, size1, blob1);
 		if (err)
-			goto done;
-	} else
-		idstr1 = "/dev/null";
-
-	size2 = 0;
+			return err;
+	}
 	if (blob2) {
-		idstr2 = got_object_blob_id_str(blob2, hex2, sizeof(hex2));
-		err = got_object_blob_dump_to_file(&size2, NULL, NULL, f2,
-		    blob2);
+		err = got_object_blob_peek(&buf2, &len2, size2, blob2);
 		if (err)
-			goto done;
-	} else
+			return err;
+	}
+
+	if ((buf1 && got_diff_is_binary(buf1, len1)) ||
+	    (buf2 && got_diff_is_binary(buf2, len2))) {
+		*kind = GOT_DIFF_BLOBS_BINARY;
+		return NULL;
+	}
+
+	max_size = got_diff_max_blob_size();
+	if (*size1 > max_size || *size2 > max_size)
+		*kind = GOT_DIFF_BLOBS_LARGE;
+	return NULL;
+}
+
+const struct got_error *
+got_diff_blob_summary(int kind, const char *idstr1, size_t size1,
+    const char *idstr2, size_t size2, const char *label1, const char *label2,
+    mode_t mode1, mode_t mode2, FILE *outfile,
+    struct got_diff_output_line **lines, size_t *nlines)
+{
+	const struct got_error *err;
+
+	if (idstr1 == NULL)
+		idstr1 = "/dev/null";
+	if (idstr2 == NULL)
 		idstr2 = "/dev/null";
+	if (label1 == NULL)
+		label1 = idstr1;
+	if (label2 == NULL)
+		label2 = idstr2;
 
-	memset(&ds, 0, sizeof(ds));
+	err = print_blob_header(idstr1, idstr2, mode1, mode2, outfile,
+	    lines, nlines);
+	if (err)
+		return err;
+	err = record_line(lines, nlines, outfile, GOT_DIFF_LINE_INFO);
+	if (err)
+		return err;
+
+	switch (kind) {
+	case GOT_DIFF_BLOBS_BINARY:
+		fprintf(outfile, "Binary files %s and %s differ\n",
+		    label1, label2);
+		break;
+	case GOT_DIFF_BLOBS_LARGE:
+		fprintf(outfile, "Large files %s and %s differ "
+		    "(%zu and %zu bytes)\n", label1, label2, size1, size2);
+		break;
+	default:
+		return got_error(GOT_ERR_BAD_OBJ_DATA);
+	}
+	return NULL;
+}
+
+const struct got_error *
+got_diff_blob_data(const uint8_t *data1, size_t size1, const char *idstr1,
+    const uint8_t *data2, size_t size2, const char *idstr2,
+    const char *label1, const char *label2, mode_t mode1, mode_t mode2,
+    int diff_context, int ignore_whitespace, FILE *outfile,
+    struct got_diff_output_line **lines, size_t *nlines,
+    struct got_diff_changes *changes, struct got_diff_session *session)
+{
+	struct got_diff_state ds0, *ds;
+	struct got_diff_args args;
+	const struct got_error *err = NULL;
+	int res, flags = 0;
+
+	if (data1 == NULL) {
+		flags |= D_EMPTY1;
+		size1 = 0;
+		idstr1 = "/dev/null";
+	}
+	if (data2 == NULL) {
+		flags |= D_EMPTY2;
+		size2 = 0;
+		idstr2 = "/dev/null";
+	}
+
+	if (session)
+		ds = &session->ds;
+	else {
+		memset(&ds0, 0, sizeof(ds0));
+		ds = &ds0;
+	}
 	/* XXX should stat buffers be passed in args instead of ds? */
-	ds.stb1.st_mode = S_IFREG;
-	if (blob1)
-		ds.stb1.st_size = size1;
-	ds.stb1.st_mtime = 0; /* XXX */
+	ds->stb1.st_mode = S_IFREG;
+	ds->stb1.st_size = size1;
+	ds->stb1.st_mtime = 0; /* XXX */
 
-	ds.stb2.st_mode = S_IFREG;
-	if (blob2)
-		ds.stb2.st_size = size2;
-	ds.stb2.st_mtime = 0; /* XXX */
+	ds->stb2.st_mode = S_IFREG;
+	ds->stb2.st_size = size2;
+	ds->stb2.st_mtime = 0; /* XXX */
 
 	memset(&args, 0, sizeof(args));
 	args.diff_format = D_UNIFIED;
 	args.label[0] = label1 ? label1 : idstr1;
 	args.label[1] = label2 ? label2 : idstr2;
 	args.diff_context = diff_context;
-	flags |= D_PROTOTYPE;
+	args.lines = lines;
+	args.nlines = nlines;
+	flags |= D_PROTOTYPE | D_HISTOGRAM;
 	if (ignore_whitespace)
 		flags |= D_IGNOREBLANKS;
 
 	if (outfile) {
-		char *modestr1 = NULL, *modestr2 = NULL;
-		if (mode1 && mode1 != mode2) {
-			if (asprintf(&modestr1, " (mode %o)",
-			    mode1 & (S_IRWXU | S_IRWXG | S_IRWXO)) == -1) {
-				err = got_error_from_errno("asprintf");
-				goto done;
-			}
-		}
-		if (mode2 && mode1 != mode2) {
-			if (asprintf(&modestr2, " (mode %o)",
-			    mode2 & (S_IRWXU | S_IRWXG | S_IRWXO)) == -1) {
-				err = got_error_from_errno("asprintf");
-				goto done;
-			}
-		}
-		fprintf(outfile, "blob - %s%s\n", idstr1,
-		    modestr1 ? modestr1 : "");
-		fprintf(outfile, "blob + %s%s\n", idstr2,
-		    modestr2 ? modestr2 : "");
-		free(modestr1);
-		free(modestr2);
-	}
-	err = got_diffreg(&res, f1, f2, flags, &args, &ds, outfile, changes);
-	got_diff_state_free(&ds);
+		err = print_blob_header(idstr1, idstr2, mode1, mode2, outfile,
+		    lines, nlines);
+		if (err)
+			goto done;
+	}
+	err = got_diffreg_mem(&res, data1, size1, data2, size2, flags, &args,
+	    ds, outfile, changes);
+	if (err || outfile == NULL)
+		goto done;
+	if (res == D_BINARY) {
+		err = record_line(lines, nlines, outfile, GOT_DIFF_LINE_INFO);
+		if (err)
+			goto done;
+		fprintf(outfile, "Binary files %s and %s differ\n",
+		    args.label[0], args.label[1]);
+	} else if (res == D_SAME && data1 && data2 &&
+	    strcmp(args.label[0], args.label[1]) != 0) {
+		/* Show where a file was renamed or copied to. */
+		err = record_line(lines, nlines, outfile,
+		    GOT_DIFF_LINE_LABEL1);
+		if (err)
+			goto done;
+		fprintf(outfile, "--- %s\n", args.label[0]);
+		err = record_line(lines, nlines, outfile,
+		    GOT_DIFF_LINE_LABEL2);
+		if (err)
+			goto done;
+		fprintf(outfile, "+++ %s\n", args.label[1]);
+	}
 done:
-	if (f1 && fclose(f1) != 0 && err == NULL)
-		err = got_error_from_errno("fclose");
-	if (f2 && fclose(f2) != 0 && err == NULL)
-		err = got_error_from_errno("fclose");
+	if (session == NULL)
+		got_diff_state_free(ds);
 	return err;
 }
 
+static const struct got_error *
+diff_blobs(struct got_blob_object *blob1, struct got_blob_object *blob2,
+    const char *label1, const char *label2, mode_t mode1, mode_t mode2,
+    int diff_context, int ignore_whitespace, FILE *outfile,
+    struct got_diff_output_line **lines, size_t *nlines,
+    struct got_diff_changes *changes, struct got_diff_session *session)
+{
+	const struct got_error *err = NULL;
+	const uint8_t *data1 = NULL, *data2 = NULL;
+	char hex1[SHA1_DIGEST_STRING_LENGTH];
+	char hex2[SHA1_DIGEST_STRING_LENGTH];
+	char *idstr1 = NULL, *idstr2 = NULL;
+	size_t size1 = 0, size2 = 0;
+	int kind;
+
+	if (blob1)
+		idstr1 = got_object_blob_id_str(blob1, hex1, sizeof(hex1));
+	if (blob2)
+		idstr2 = got_object_blob_id_str(blob2, hex2, sizeof(hex2));
+
+	/* Avoid loading blobs which will not be diffed. */
+	if (outfile) {
+		err = got_diff_blob_check(&kind, &size1, &size2, blob1, blob2);
+		if (err)
+			return err;
+		if (kind != GOT_DIFF_BLOBS_TEXT)
+			return got_diff_blob_summary(kind, idstr1, size1,
+			    idstr2, size2, label1, label2, mode1, mode2,
+			    outfile, lines, nlines);
+	}
+
+	if (blob1) {
+		err = got_object_blob_get_data(&data1, &size1, blob1);
+		if (err)
+			return err;
+	}
+	if (blob2) {
+		err = got_object_blob_get_data(&data2, &size2, blob2);
+		if (err)
+			return err;
+	}
+
+	return got_diff_blob_data(data1, size1, idstr1, data2, size2, idstr2,
+	    label1, label2, mode1, mode2, diff_context, ignore_whitespace,
+	    outfile, lines, nlines, changes, session);
+}
+
 const struct got_error *
 got_diff_blob_output_unidiff(void *arg, struct got_blob_object *blob1,
     struct got_blob_object *blob2, struct got_object_id *id1,
@@ -152,7 +339,8 @@ got_diff_blob_output_unidiff(void *arg, struct got_blob_object *blob1,
 	struct got_diff_blob_output_unidiff_arg *a = arg;
 
 	return diff_blobs(blob1, blob2, label1, label2, mode1, mode2,
-	    a->diff_context, a->ignore_whitespace, a->outfile, NULL);
+	    a->diff_context, a->ignore_whitespace, a->outfile, a->lines,
+	    a->nlines, NULL, a->session);
 }
 
 const struct got_error *
@@ -161,7 +349,7 @@ got_diff_blob(struct got_blob_object *blob1, struct got_blob_object *blob2,
     int ignore_whitespace, FILE *outfile)
 {
 	return diff_blobs(blob1, blob2, label1, label2, 0, 0, diff_context,
-	    ignore_whitespace, outfile, NULL);
+	    ignore_whitespace, outfile, NULL, NULL, NULL, NULL);
 }
 
 static const struct got_error *
@@ -175,14 +363,15 @@ alloc_changes(struct got_diff_changes **changes)
 }
 
 static const struct got_error *
-diff_blob_file(struct got_diff_changes **changes,
-    struct got_blob_object *blob1, const char *label1, FILE *f2, size_t size2,
-    const char *label2, int diff_context, int ignore_whitespace, FILE *outfile)
+diff_blob_mem(struct got_diff_changes **changes,
+    struct got_blob_object *blob1, const char *label1, const uint8_t *data2,
+    size_t size2, const char *label2, int diff_context, int ignore_whitespace,
+    FILE *outfile, struct got_diff_session *session)
 {
-	struct got_diff_state ds;
+	struct got_diff_state ds0, *ds;
 	struct got_diff_args args;
 	const struct got_error *err = NULL;
-	FILE *f1 = NULL;
+	const uint8_t *data1 = NULL;
 	char hex1[SHA1_DIGEST_STRING_LENGTH];
 	char *idstr1 = NULL;
 	size_t size1;
@@ -191,60 +380,63 @@ diff_blob_file(struct got_diff_changes **changes,
 	if (changes)
 		*changes = NULL;
 
+	if (session)
+		ds = &session->ds;
+	else {
+		memset(&ds0, 0, sizeof(ds0));
+		ds = &ds0;
+	}
+
 	size1 = 0;
 	if (blob1) {
-		f1 = got_opentemp();
-		if (f1 == NULL)
-			return got_error_from_errno("got_opentemp");
 		idstr1 = got_object_blob_id_str(blob1, hex1, sizeof(hex1));
-		err = got_object_blob_dump_to_file(&size1, NULL, NULL, f1,
-		    blob1);
+		err = got_object_blob_get_data(&data1, &size1, blob1);
 		if (err)
-			goto done;
+			return err;
 	} else {
 		flags |= D_EMPTY1;
 		idstr1 = "/dev/null";
 	}
 
-	if (f2 == NULL)
+	if (data2 == NULL)
 		flags |= D_EMPTY2;
 
-	memset(&ds, 0, sizeof(ds));
 	/* XXX should stat buffers be passed in args instead of ds? */
-	ds.stb1.st_mode = S_IFREG;
-	if (blob1)
-		ds.stb1.st_size = size1;
-	ds.stb1.st_mtime = 0; /* XXX */
+	ds->stb1.st_mode = S_IFREG;
+	ds->stb1.st_size = size1;
+	ds->stb1.st_mtime = 0; /* XXX */
 
-	ds.stb2.st_mode = S_IFREG;
-	ds.stb2.st_size = size2;
-	ds.stb2.st_mtime = 0; /* XXX */
+	ds->stb2.st_mode = S_IFREG;
+	ds->stb2.st_size = size2;
+	ds->stb2.st_mtime = 0; /* XXX */
 
 	memset(&args, 0, sizeof(args));
 	args.diff_format = D_UNIFIED;
 	args.label[0] = label2;
 	args.label[1] = label2;
 	args.diff_context = diff_context;
-	flags |= D_PROTOTYPE;
+	flags |= D_PROTOTYPE | D_HISTOGRAM;
 	if (ignore_whitespace)
 		flags |= D_IGNOREBLANKS;
 
 	if (outfile) {
 		fprintf(outfile, "blob - %s\n", label1 ? label1 : idstr1);
 		fprintf(outfile, "file + %s\n",
-		    f2 == NULL ? "/dev/null" : label2);
+		    data2 == NULL ? "/dev/null" : label2);
 	}
 	if (changes) {
 		err = alloc_changes(changes);
 		if (err)
-			return err;
+			goto done;
 	}
-	err = got_diffreg(&res, f1, f2, flags, &args, &ds, outfile,
-	    changes ? *changes : NULL);
-	got_diff_state_free(&ds);
+	err = got_diffreg_mem(&res, data1, size1, data2, size2,
+	    flags, &args, ds, outfile, changes ? *changes : NULL);
+	if (err == NULL && outfile && res == D_BINARY)
+		fprintf(outfile, "Binary files %s and %s differ\n",
+		    args.label[0], args.label[1]);
 done:
-	if (f1 && fclose(f1) != 0 && err == NULL)
-		err = got_error_from_errno("fclose");
+	if (session == NULL)
+		got_diff_state_free(ds);
 	return err;
 }
 
@@ -253,16 +445,27 @@ got_diff_blob_file(struct got_blob_object *blob1, const char *label1,
     FILE *f2, size_t size2, const char *label2, int diff_context,
     int ignore_whitespace, FILE *outfile)
 {
-	return diff_blob_file(NULL, blob1, label1, f2, size2, label2,
-	    diff_context, ignore_whitespace, outfile);
+	const struct got_error *err;
+	uint8_t *data2 = NULL;
+
+	if (f2) {
+		err = got_diff_read_file(&data2, &size2, f2);
+		if (err)
+			return err;
+	}
+	err = diff_blob_mem(NULL, blob1, label1, data2, size2, label2,
+	    diff_context, ignore_whitespace, outfile, NULL);
+	free(data2);
+	return err;
 }
 
 const struct got_error *
-got_diff_blob_file_lines_changed(struct got_diff_changes **changes,
-    struct got_blob_object *blob1, FILE *f2, size_t size2)
+got_diff_blob_mem_lines_changed(struct got_diff_changes **changes,
+    struct got_blob_object *blob1, const uint8_t *data2, size_t size2,
+    struct got_diff_session *session)
 {
-	return diff_blob_file(changes, blob1, NULL, f2, size2, NULL,
-	    0, 0, NULL);
+	return diff_blob_mem(changes, blob1, NULL, data2, size2, NULL,
+	    0, 0, NULL, session);
 }
 
 const struct got_error *
@@ -275,7 +478,8 @@ got_diff_blob_lines_changed(struct got_diff_changes **changes,
 	if (err)
 		return err;
 
-	err = diff_blobs(blob1, blob2, NULL, NULL, 0, 0, 3, 0, NULL, *changes);
+	err = diff_blobs(blob1, blob2, NULL, NULL, 0, 0, 3, 0, NULL, NULL, NULL,
+	    *changes, NULL);
 	if (err) {
 		got_diff_free_changes(*changes);
 		*changes = NULL;
@@ -686,7 +890,8 @@ got_diff_tree(struct got_tree_object *tree1, struct got_tree_object *tree2,
 }
 
 const struct got_error *
-got_diff_objects_as_blobs(struct got_object_id *id1, struct got_object_id *id2,
+got_diff_objects_as_blobs(struct got_diff_output_line **lines, size_t *nlines,
+    struct got_object_id *id1, struct got_object_id *id2,
     const char *label1, const char *label2, int diff_context,
     int ignore_whitespace, struct got_repository *repo, FILE *outfile)
 {
@@ -706,8 +911,8 @@ got_diff_objects_as_blobs(struct got_object_id *id1, struct got_object_id *id2,
 		if (err)
 			goto done;
 	}
-	err = got_diff_blob(blob1, blob2, label1, label2, diff_context,
-	    ignore_whitespace, outfile);
+	err = diff_blobs(blob1, blob2, label1, label2, 0, 0, diff_context,
+	    ignore_whitespace, outfile, lines, nlines, NULL, NULL);
 done:
 	if (blob1)
 		got_object_blob_close(blob1);
@@ -717,13 +922,14 @@ done:
 }
 
 const struct got_error *
-got_diff_objects_as_trees(struct got_object_id *id1, struct got_object_id *id2,
+got_diff_objects_as_trees(struct got_diff_output_line **lines, size_t *nlines,
+    struct got_object_id *id1, struct got_object_id *id2,
     char *label1, char *label2, int diff_context, int ignore_whitespace,
     struct got_repository *repo, FILE *outfile)
 {
-	const struct got_error *err;
+	const struct got_error *err, *close_err;
 	struct got_tree_object *tree1 = NULL, *tree2 = NULL;
-	struct got_diff_blob_output_unidiff_arg arg;
+	struct got_diff_parallel *parallel;
 
 	if (id1 == NULL && id2 == NULL)
 		return got_error(GOT_ERR_NO_OBJ);
@@ -738,11 +944,15 @@ got_diff_objects_as_trees(struct got_object_id *id1, struct got_object_id *id2,
 		if (err)
 			goto done;
 	}
-	arg.diff_context = diff_context;
-	arg.ignore_whitespace = ignore_whitespace;
-	arg.outfile = outfile;
-	err = got_diff_tree(tree1, tree2, label1, label2, repo,
-	    got_diff_blob_output_unidiff, &arg, 1);
+	err = got_diff_parallel_open(&parallel, outfile, lines, nlines,
+	    diff_context, ignore_whitespace);
+	if (err)
+		goto done;
+	err = got_diff_tree_renames(tree1, tree2, label1, label2, repo,
+	    got_diff_blob_output_unidiff_parallel, parallel, 1);
+	close_err = got_diff_parallel_close(parallel);
+	if (err == NULL)
+		err = close_err;
 done:
 	if (tree1)
 		got_object_tree_close(tree1);
@@ -752,9 +962,10 @@ done:
 }
 
 const struct got_error *
-got_diff_objects_as_commits(struct got_object_id *id1,
-    struct got_object_id *id2, int diff_context, int ignore_whitespace,
-    struct got_repository *repo, FILE *outfile)
+got_diff_objects_as_commits(struct got_diff_output_line **lines,
+    size_t *nlines, struct got_object_id *id1, struct got_object_id *id2,
+    int diff_context, int ignore_whitespace, struct got_repository *repo,
+    FILE *outfile)
 {
 	const struct got_error *err;
 	struct got_commit_object *commit1 = NULL, *commit2 = NULL;
@@ -772,7 +983,7 @@ got_diff_objects_as_commits(struct got_object_id *id1,
 	if (err)
 		goto done;
 
-	err = got_diff_objects_as_trees(
+	err = got_diff_objects_as_trees(lines, nlines,
 	    commit1 ? got_object_commit_get_tree_id(commit1) : NULL,
 	    got_object_commit_get_tree_id(commit2), "", "", diff_context,
 	    ignore_whitespace, repo, outfile);
@@ -828,7 +1039,7 @@ got_diff_files(struct got_diff_changes **changes,
 	(*args)->label[0] = label1;
 	(*args)->label[1] = label2;
 	(*args)->diff_context = diff_context;
-	*flags |= D_PROTOTYPE;
+	*flags |= D_PROTOTYPE | D_HISTOGRAM;
 
 	if (outfile) {
 		fprintf(outfile, "file - %s\n",
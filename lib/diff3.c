@@ -240,7 +240,7 @@ diffreg(BUF **d, const char *path1, const char *path2)
 	args.label[1] = "";
 	args.diff_context = 0;
 
-	err = got_diffreg(&res, f1, f2, D_FORCEASCII, &args, &ds,
+	err = got_diffreg(&res, f1, f2, D_FORCEASCII | D_MYERS, &args, &ds,
 	    outfile, NULL);
 	if (err)
 		goto done;
@@ -0,0 +1,135 @@
+/*
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <sys/types.h>
+#include <sys/queue.h>
+
+#include <limits.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "got_error.h"
+#include "got_object.h"
+
+#include "got_lib_diff.h"
+
+#define ONES	0x0101010101010101ULL
+#define HIGHS	0x8080808080808080ULL
+#define NEWLINES (ONES * '\n')
+
+/* Non-zero if any byte of the word is a newline character. */
+#define HAS_NEWLINE(w) \
+	((((w) ^ NEWLINES) - ONES) & ~((w) ^ NEWLINES) & HIGHS)
+
+static uint64_t
+mix(uint64_t h, uint64_t w)
+{
+	h ^= w;
+	h *= 0xff51afd7ed558ccdULL;
+	h ^= h >> 33;
+	return h;
+}
+
+/*
+ * Lines are located and hashed a word at a time. Words which contain no
+ * newline character are hashed whole; the remainder of a line is found
+ * with memchr() within the word which contains its newline.
+ * The hash covers the line's content and length but not its newline,
+ * which matches the way got_diffreg() treats a missing newline at the
+ * end of a file.
+ */
+const struct got_error *
+got_diff_index_lines(struct got_diff_line **lines, size_t *nalloc,
+    int *nlines, const uint8_t *buf, size_t len)
+{
+	struct got_diff_line *line, *l;
+	const uint8_t *nl;
+	size_t off = 0, start, avail, n;
+	uint64_t h, w;
+
+	*nlines = 0;
+
+	if (*lines == NULL || *nalloc == 0) {
+		/* Guess the number of lines to avoid growing the array. */
+		free(*lines);
+		*nalloc = len / 32 + 16;
+		*lines = calloc(*nalloc, sizeof(**lines));
+		if (*lines == NULL) {
+			*nalloc = 0;
+			return got_error_from_errno("calloc");
+		}
+	}
+
+	while (off < len) {
+		start = off;
+		h = 0;
+
+		for (;;) {
+			avail = len - off;
+			if (avail >= sizeof(w)) {
+				memcpy(&w, buf + off, sizeof(w));
+				if (!HAS_NEWLINE(w)) {
+					h = mix(h, w);
+					off += sizeof(w);
+					continue;
+				}
+				avail = sizeof(w);
+			}
+			nl = memchr(buf + off, '\n', avail);
+			n = nl ? nl - (buf + off) : avail;
+			if (n > 0) {
+				w = 0;
+				memcpy(&w, buf + off, n);
+				h = mix(h, w);
+				off += n;
+			}
+			break;
+		}
+		h = mix(h, off - start);
+		if (off < len)
+			off++; /* newline */
+
+		if (*nlines == INT_MAX) {
+			free(*lines);
+			*lines = NULL;
+			*nalloc = 0;
+			*nlines = 0;
+			return got_error(GOT_ERR_RANGE);
+		}
+		if (*nlines == *nalloc) {
+			l = reallocarray(*lines, *nalloc, 2 * sizeof(**lines));
+			if (l == NULL) {
+				free(*lines);
+				*lines = NULL;
+				*nalloc = 0;
+				*nlines = 0;
+				return got_error_from_errno("reallocarray");
+			}
+			*lines = l;
+			*nalloc *= 2;
+		}
+		line = &(*lines)[(*nlines)++];
+		line->offset = start;
+		line->len = off - start;
+		line->hash = (uint32_t)(h ^ (h >> 32));
+		if (line->hash == 0)
+			line->hash = 1; /* diffreg uses zero as a marker */
+	}
+
+	return NULL;
+}
@@ -0,0 +1,418 @@
+/*
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Compute a match vector for got_diffreg() with the algorithm described in
+ * "An O(ND) Difference Algorithm and Its Variations" by Eugene W. Myers,
+ * Algorithmica 1 (1986). The "middle snake" of each region is found with
+ * forward and backward searches which need space linear in the size of the
+ * input, and the regions before and after the middle snake are compared
+ * recursively.
+ *
+ * The histogram algorithm instead splits regions at the longest common run
+ * of lines which contains a line that occurs the least number of times in
+ * the old file's region. Lines which occur only once make good anchors and
+ * keep repeated lines, such as blank lines and closing braces, from being
+ * matched across unrelated changes. Regions without a suitable anchor are
+ * compared with Myers' algorithm.
+ *
+ * Lines are represented by their hash values. Lines which are matched due
+ * to a hash collision are caught later by got_diffreg().
+ */
+
+#include <sys/types.h>
+#include <sys/queue.h>
+
+#include <limits.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "got_error.h"
+#include "got_object.h"
+
+#include "got_lib_diff.h"
+
+#define MINIMUM(a, b)	(((a) < (b)) ? (a) : (b))
+#define MAXIMUM(a, b)	(((a) > (b)) ? (a) : (b))
+
+/* Lines occurring more often than this are not used as histogram anchors. */
+#define HISTOGRAM_MAX_OCCURRENCES	64
+
+/* Beyond this nesting depth, histogram falls back to Myers' algorithm. */
+#define HISTOGRAM_MAX_DEPTH		1024
+
+struct histogram_slot {
+	int value;
+	int count;
+	int first;	/* first line in the region with this value */
+};
+
+struct myers_state {
+	int *a, *b;	/* hash values, indexed from 1 */
+	int *J;
+	int *kvdf;	/* furthest reaching forward paths, per diagonal */
+	int *kvdb;	/* furthest reaching backward paths, per diagonal */
+	int max_cost;
+
+	/* Hash table used by the histogram algorithm. */
+	struct histogram_slot *slots;
+	int nslots;	/* a power of two */
+	int *next;	/* next line with the same value, or zero */
+	int *used;	/* slots in use */
+	int nused;
+};
+
+struct myers_split {
+	int x, y;
+	int minimal_lo, minimal_hi;
+};
+
+/*
+ * Find the middle snake of the region which spans lines [xoff, xlim) of
+ * the old file and lines [yoff, ylim) of the new file. If the edit cost
+ * exceeds the cost limit, settle for the furthest reaching path found so
+ * far unless the result needs to be minimal.
+ */
+static void
+split(struct myers_state *ms, int xoff, int xlim, int yoff, int ylim,
+    int minimal, struct myers_split *spl)
+{
+	int *a = ms->a, *b = ms->b, *kvdf = ms->kvdf, *kvdb = ms->kvdb;
+	int dmin = xoff - ylim, dmax = xlim - yoff;
+	int fmid = xoff - yoff, bmid = xlim - ylim;
+	int fmin = fmid, fmax = fmid;
+	int bmin = bmid, bmax = bmid;
+	int odd = (fmid - bmid) & 1;
+	int cost, d, x, y, fbest, fbest_x, bbest, bbest_x;
+
+	kvdf[fmid] = xoff;
+	kvdb[bmid] = xlim;
+
+	for (cost = 1;; cost++) {
+		/* Extend the forward search by one edit. */
+		if (fmin > dmin)
+			kvdf[--fmin - 1] = -1;
+		else
+			fmin++;
+		if (fmax < dmax)
+			kvdf[++fmax + 1] = -1;
+		else
+			fmax--;
+
+		for (d = fmax; d >= fmin; d -= 2) {
+			if (kvdf[d - 1] >= kvdf[d + 1])
+				x = kvdf[d - 1] + 1;
+			else
+				x = kvdf[d + 1];
+			y = x - d;
+			while (x < xlim && y < ylim && a[x] == b[y]) {
+				x++;
+				y++;
+			}
+			kvdf[d] = x;
+			if (odd && bmin <= d && d <= bmax && kvdb[d] <= x) {
+				spl->x = x;
+				spl->y = y;
+				spl->minimal_lo = spl->minimal_hi = 1;
+				return;
+			}
+		}
+
+		/* Extend the backward search by one edit. */
+		if (bmin > dmin)
+			kvdb[--bmin - 1] = INT_MAX;
+		else
+			bmin++;
+		if (bmax < dmax)
+			kvdb[++bmax + 1] = INT_MAX;
+		else
+			bmax--;
+
+		for (d = bmax; d >= bmin; d -= 2) {
+			if (kvdb[d - 1] < kvdb[d + 1])
+				x = kvdb[d - 1];
+			else
+				x = kvdb[d + 1] - 1;
+			y = x - d;
+			while (x > xoff && y > yoff && a[x - 1] == b[y - 1]) {
+				x--;
+				y--;
+			}
+			kvdb[d] = x;
+			if (!odd && fmin <= d && d <= fmax && x <= kvdf[d]) {
+				spl->x = x;
+				spl->y = y;
+				spl->minimal_lo = spl->minimal_hi = 1;
+				return;
+			}
+		}
+
+		if (minimal || cost < ms->max_cost)
+			continue;
+
+		/*
+		 * Give up on a minimal result and split the region where
+		 * either the forward or the backward search got furthest.
+		 */
+		fbest = fbest_x = -1;
+		for (d = fmax; d >= fmin; d -= 2) {
+			x = MINIMUM(kvdf[d], xlim);
+			y = x - d;
+			if (y > ylim) {
+				x = ylim + d;
+				y = ylim;
+			}
+			if (fbest < x + y) {
+				fbest = x + y;
+				fbest_x = x;
+			}
+		}
+		bbest = bbest_x = INT_MAX;
+		for (d = bmax; d >= bmin; d -= 2) {
+			x = MAXIMUM(xoff, kvdb[d]);
+			y = x - d;
+			if (y < yoff) {
+				x = yoff + d;
+				y = yoff;
+			}
+			if (x + y < bbest) {
+				bbest = x + y;
+				bbest_x = x;
+			}
+		}
+		if ((xlim + ylim) - bbest < fbest - (xoff + yoff)) {
+			spl->x = fbest_x;
+			spl->y = fbest - fbest_x;
+			spl->minimal_lo = 1;
+			spl->minimal_hi = 0;
+		} else {
+			spl->x = bbest_x;
+			spl->y = bbest - bbest_x;
+			spl->minimal_lo = 0;
+			spl->minimal_hi = 1;
+		}
+		return;
+	}
+}
+
+static void
+compare(struct myers_state *ms, int xoff, int xlim, int yoff, int ylim,
+    int minimal)
+{
+	struct myers_split spl;
+
+	for (;;) {
+		/* Skip lines which are common to the start or the end. */
+		while (xoff < xlim && yoff < ylim &&
+		    ms->a[xoff] == ms->b[yoff])
+			ms->J[xoff++] = yoff++;
+		while (xoff < xlim && yoff < ylim &&
+		    ms->a[xlim - 1] == ms->b[ylim - 1]) {
+			ms->J[xlim - 1] = ylim - 1;
+			xlim--;
+			ylim--;
+		}
+
+		/* Remaining lines were added or deleted. */
+		if (xoff == xlim || yoff == ylim)
+			return;
+
+		split(ms, xoff, xlim, yoff, ylim, minimal, &spl);
+		compare(ms, xoff, spl.x, yoff, spl.y, spl.minimal_lo);
+		xoff = spl.x;
+		yoff = spl.y;
+		minimal = spl.minimal_hi;
+	}
+}
+
+static struct histogram_slot *
+histogram_lookup(struct myers_state *ms, int value)
+{
+	unsigned int h = (unsigned int)value * 0x9e3779b1U;
+	struct histogram_slot *slot;
+
+	for (;;) {
+		slot = &ms->slots[h & (ms->nslots - 1)];
+		if (slot->count == 0 || slot->value == value)
+			return slot;
+		h++;
+	}
+}
+
+static void
+histogram(struct myers_state *ms, int xoff, int xlim, int yoff, int ylim,
+    int depth)
+{
+	struct histogram_slot *slot;
+	int x, y, s, t, e, len;
+	int best_count, best_len, best_x, best_y;
+
+	for (;;) {
+		while (xoff < xlim && yoff < ylim &&
+		    ms->a[xoff] == ms->b[yoff])
+			ms->J[xoff++] = yoff++;
+		while (xoff < xlim && yoff < ylim &&
+		    ms->a[xlim - 1] == ms->b[ylim - 1]) {
+			ms->J[xlim - 1] = ylim - 1;
+			xlim--;
+			ylim--;
+		}
+		if (xoff == xlim || yoff == ylim)
+			return;
+
+		if (depth > HISTOGRAM_MAX_DEPTH) {
+			compare(ms, xoff, xlim, yoff, ylim, 0);
+			return;
+		}
+
+		/* Count occurrences of lines in the old file's region. */
+		for (x = xlim - 1; x >= xoff; x--) {
+			slot = histogram_lookup(ms, ms->a[x]);
+			if (slot->count == 0) {
+				slot->value = ms->a[x];
+				ms->used[ms->nused++] = slot - ms->slots;
+				ms->next[x] = 0;
+			} else
+				ms->next[x] = slot->first;
+			slot->first = x;
+			slot->count++;
+		}
+
+		/*
+		 * Find the longest common run of lines anchored at the
+		 * line with the lowest number of occurrences.
+		 */
+		best_count = HISTOGRAM_MAX_OCCURRENCES + 1;
+		best_len = 0;
+		best_x = best_y = 0;
+		for (y = yoff; y < ylim; y++) {
+			slot = histogram_lookup(ms, ms->b[y]);
+			if (slot->count == 0 || slot->count > best_count)
+				continue;
+			for (x = slot->first; x != 0; x = ms->next[x]) {
+				s = x;
+				t = y;
+				while (s > xoff && t > yoff &&
+				    ms->a[s - 1] == ms->b[t - 1]) {
+					s--;
+					t--;
+				}
+				e = x + 1;
+				while (e < xlim && e - s + t < ylim &&
+				    ms->a[e] == ms->b[e - s + t])
+					e++;
+				len = e - s;
+				if (slot->count < best_count ||
+				    len > best_len) {
+					best_count = slot->count;
+					best_len = len;
+					best_x = s;
+					best_y = t;
+				}
+			}
+		}
+
+		/* Clear the hash table for use by nested regions. */
+		while (ms->nused > 0)
+			ms->slots[ms->used[--ms->nused]].count = 0;
+
+		if (best_len == 0) {
+			compare(ms, xoff, xlim, yoff, ylim, 0);
+			return;
+		}
+
+		histogram(ms, xoff, best_x, yoff, best_y, depth + 1);
+		for (x = best_x; x < best_x + best_len; x++)
+			ms->J[x] = best_y + (x - best_x);
+		xoff = best_x + best_len;
+		yoff = best_y + best_len;
+		depth++;
+	}
+}
+
+/* Code taken from ping.c */
+static int
+isqrt(int n)
+{
+	int y, x = 1;
+
+	if (n == 0)
+		return (0);
+
+	do { /* newton was a stinker */
+		y = x;
+		x = n / x;
+		x += y;
+		x /= 2;
+	} while ((x - y) > 1 || (x - y) < -1);
+
+	return (x);
+}
+
+const struct got_error *
+got_diff_myers(int *J, int *a, int n, int *b, int m, int flags)
+{
+	const struct got_error *err = NULL;
+	struct myers_state ms;
+	int i, ndiags;
+
+	memset(&ms, 0, sizeof(ms));
+	ms.a = a;
+	ms.b = b;
+	ms.J = J;
+	for (i = 1; i <= n; i++)
+		J[i] = 0;
+
+	/* Diagonals range from -m to n, plus a sentinel on each side. */
+	ndiags = n + m + 3;
+	ms.kvdf = calloc(2 * ndiags, sizeof(*ms.kvdf));
+	if (ms.kvdf == NULL)
+		return got_error_from_errno("calloc");
+	ms.kvdb = ms.kvdf + ndiags;
+	ms.kvdf += m + 1;
+	ms.kvdb += m + 1;
+	ms.max_cost = MAXIMUM(256, isqrt(ndiags));
+
+	if (flags & D_HISTOGRAM) {
+		ms.nslots = 1;
+		while (ms.nslots < 2 * n)
+			ms.nslots <<= 1;
+		ms.slots = calloc(ms.nslots, sizeof(*ms.slots));
+		if (ms.slots == NULL) {
+			err = got_error_from_errno("calloc");
+			goto done;
+		}
+		ms.next = calloc(n + 1, sizeof(*ms.next));
+		if (ms.next == NULL) {
+			err = got_error_from_errno("calloc");
+			goto done;
+		}
+		ms.used = calloc(n + 1, sizeof(*ms.used));
+		if (ms.used == NULL) {
+			err = got_error_from_errno("calloc");
+			goto done;
+		}
+		histogram(&ms, 1, n + 1, 1, m + 1, 0);
+	} else
+		compare(&ms, 1, n + 1, 1, m + 1, flags & D_MINIMAL);
+done:
+	free(ms.kvdf - (m + 1));
+	free(ms.slots);
+	free(ms.next);
+	free(ms.used);
+	return err;
+}
@@ -0,0 +1,504 @@
+/*
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <sys/queue.h>
+#include <sys/stat.h>
+
+#include <errno.h>
+#include <pthread.h>
+#include <sha1.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <zlib.h>
+
+#include "got_error.h"
+#include "got_object.h"
+#include "got_diff.h"
+
+#include "got_lib_delta.h"
+#include "got_lib_inflate.h"
+#include "got_lib_object.h"
+#include "got_lib_diff.h"
+
+#define GOT_DIFF_PARALLEL_MAX_THREADS	8
+
+/*
+ * Upper bound on memory used by blob contents waiting to be diffed and
+ * by diff output waiting to be written. A pair of blobs which exceeds
+ * this limit on its own is diffed once all preceding output was written.
+ */
+#define GOT_DIFF_PARALLEL_MEMORY_BUDGET	(64 * 1024 * 1024)
+
+struct got_diff_parallel_job {
+	TAILQ_ENTRY(got_diff_parallel_job) entry;
+	int kind;		/* see got_diff_blob_check() */
+	uint8_t *data1;		/* NULL if blob does not exist */
+	size_t size1;
+	uint8_t *data2;		/* NULL if blob does not exist */
+	size_t size2;
+	/* Blob IDs are empty strings if the blob does not exist. */
+	char idstr1[SHA1_DIGEST_STRING_LENGTH];
+	char idstr2[SHA1_DIGEST_STRING_LENGTH];
+	char *label1;
+	char *label2;
+	mode_t mode1;
+	mode_t mode2;
+
+	int done;
+	char *out;		/* unidiff output */
+	size_t outlen;
+	struct got_diff_output_line *lines; /* offsets relative to out */
+	size_t nlines;
+
+	/*
+	 * Errors are formatted in static buffers which are shared between
+	 * threads. Only the error code and errno are recorded here, and the
+	 * error is reconstructed by the thread which writes the output.
+	 */
+	int errcode;
+	int errnum;		/* errno if errcode is GOT_ERR_ERRNO */
+};
+TAILQ_HEAD(got_diff_parallel_jobs, got_diff_parallel_job);
+
+struct got_diff_parallel_thread {
+	pthread_t thread;
+	struct got_diff_parallel *parallel;
+	struct got_diff_session session;
+};
+
+struct got_diff_parallel {
+	FILE *outfile;
+	struct got_diff_output_line **lines;
+	size_t *nlines;
+	int diff_context;
+	int ignore_whitespace;
+
+	struct got_diff_parallel_thread *threads;
+	int nthreads;
+	pthread_mutex_t mutex;
+	pthread_cond_t work_cond;
+	pthread_cond_t done_cond;
+	int quit;
+
+	/* Jobs in the order in which their output must be written. */
+	struct got_diff_parallel_jobs jobs;
+	struct got_diff_parallel_job *next; /* next job to be claimed */
+	size_t nbytes;		/* memory used by queued jobs */
+	int failed;		/* got_diff_tree() saw an error */
+
+	/* Used if no threads are available. */
+	struct got_diff_session session;
+};
+
+static void
+free_job(struct got_diff_parallel_job *job)
+{
+	free(job->data1);
+	free(job->data2);
+	free(job->label1);
+	free(job->label2);
+	free(job->out);
+	free(job->lines);
+	free(job);
+}
+
+/* Memory used by blob contents held by a job. */
+static size_t
+job_nbytes(struct got_diff_parallel_job *job)
+{
+	if (job->kind != GOT_DIFF_BLOBS_TEXT)
+		return 0;
+	return job->size1 + job->size2;
+}
+
+/* Record a failure of a job without touching shared error buffers. */
+static void
+set_job_error(struct got_diff_parallel_job *job, int code, int errnum)
+{
+	if (job->errcode != GOT_ERR_OK)
+		return;
+	job->errcode = code;
+	job->errnum = errnum;
+}
+
+static void
+run_job(struct got_diff_parallel *parallel, struct got_diff_parallel_job *job,
+    struct got_diff_session *session)
+{
+	const struct got_error *err;
+	FILE *f;
+
+	f = open_memstream(&job->out, &job->outlen);
+	if (f == NULL) {
+		set_job_error(job, GOT_ERR_ERRNO, errno);
+		return;
+	}
+
+	if (job->kind != GOT_DIFF_BLOBS_TEXT) {
+		err = got_diff_blob_summary(job->kind,
+		    job->idstr1[0] ? job->idstr1 : NULL, job->size1,
+		    job->idstr2[0] ? job->idstr2 : NULL, job->size2,
+		    job->label1, job->label2, job->mode1, job->mode2, f,
+		    parallel->lines ? &job->lines : NULL, &job->nlines);
+	} else {
+		err = got_diff_blob_data(job->data1, job->size1, job->idstr1,
+		    job->data2, job->size2, job->idstr2, job->label1,
+		    job->label2, job->mode1, job->mode2,
+		    parallel->diff_context, parallel->ignore_whitespace, f,
+		    parallel->lines ? &job->lines : NULL, &job->nlines,
+		    NULL, session);
+	}
+	if (err)
+		set_job_error(job, err->code, errno);
+	if (fclose(f) == EOF)
+		set_job_error(job, GOT_ERR_ERRNO, errno);
+}
+
+static void *
+diff_thread(void *arg)
+{
+	struct got_diff_parallel_thread *t = arg;
+	struct got_diff_parallel *parallel = t->parallel;
+	struct got_diff_parallel_job *job;
+
+	pthread_mutex_lock(&parallel->mutex);
+	for (;;) {
+		while (!parallel->quit && parallel->next == NULL)
+			pthread_cond_wait(&parallel->work_cond,
+			    &parallel->mutex);
+		if (parallel->quit)
+			break;
+
+		job = parallel->next;
+		parallel->next = TAILQ_NEXT(job, entry);
+		pthread_mutex_unlock(&parallel->mutex);
+
+		run_job(parallel, job, &t->session);
+		free(job->data1);
+		job->data1 = NULL;
+		free(job->data2);
+		job->data2 = NULL;
+
+		pthread_mutex_lock(&parallel->mutex);
+		job->done = 1;
+		parallel->nbytes -= job_nbytes(job);
+		parallel->nbytes += job->outlen;
+		pthread_cond_broadcast(&parallel->done_cond);
+	}
+	pthread_mutex_unlock(&parallel->mutex);
+
+	return NULL;
+}
+
+/*
+ * Wait for the first job in the queue to be done and write its output.
+ * Must be called with the mutex held.
+ */
+static const struct got_error *
+write_first_job(struct got_diff_parallel *parallel)
+{
+	const struct got_error *err;
+	struct got_diff_parallel_job *job;
+	off_t off = 0;
+	size_t i;
+
+	job = TAILQ_FIRST(&parallel->jobs);
+	while (!job->done)
+		pthread_cond_wait(&parallel->done_cond, &parallel->mutex);
+	TAILQ_REMOVE(&parallel->jobs, job, entry);
+	parallel->nbytes -= job->outlen;
+
+	pthread_mutex_unlock(&parallel->mutex);
+	if (job->errcode == GOT_ERR_ERRNO)
+		err = got_error_set_errno(job->errnum, "diff");
+	else if (job->errcode != GOT_ERR_OK)
+		err = got_error(job->errcode);
+	else
+		err = NULL;
+	if (err == NULL && parallel->lines && job->nlines > 0) {
+		off = ftello(parallel->outfile);
+		if (off == -1)
+			err = got_error_from_errno("ftello");
+	}
+	for (i = 0; err == NULL && i < job->nlines; i++) {
+		err = got_diff_add_line(parallel->lines, parallel->nlines,
+		    off + job->lines[i].offset, job->lines[i].type);
+	}
+	if (err == NULL && job->outlen > 0 &&
+	    fwrite(job->out, 1, job->outlen, parallel->outfile) != job->outlen)
+		err = got_ferror(parallel->outfile, GOT_ERR_IO);
+	free_job(job);
+	pthread_mutex_lock(&parallel->mutex);
+
+	return err;
+}
+
+static void
+stop_threads(struct got_diff_parallel *parallel)
+{
+	int i;
+
+	pthread_mutex_lock(&parallel->mutex);
+	parallel->quit = 1;
+	pthread_cond_broadcast(&parallel->work_cond);
+	pthread_mutex_unlock(&parallel->mutex);
+
+	for (i = 0; i < parallel->nthreads; i++) {
+		pthread_join(parallel->threads[i].thread, NULL);
+		got_diff_state_free(&parallel->threads[i].session.ds);
+	}
+	parallel->nthreads = 0;
+}
+
+const struct got_error *
+got_diff_parallel_open(struct got_diff_parallel **parallel, FILE *outfile,
+    struct got_diff_output_line **lines, size_t *nlines, int diff_context,
+    int ignore_whitespace)
+{
+	const struct got_error *err = NULL;
+	struct got_diff_parallel *p;
+	long ncpu;
+	int errcode, nthreads;
+
+	*parallel = NULL;
+
+	p = calloc(1, sizeof(*p));
+	if (p == NULL)
+		return got_error_from_errno("calloc");
+
+	p->outfile = outfile;
+	p->lines = lines;
+	p->nlines = nlines;
+	p->diff_context = diff_context;
+	p->ignore_whitespace = ignore_whitespace;
+	TAILQ_INIT(&p->jobs);
+
+	ncpu = sysconf(_SC_NPROCESSORS_ONLN);
+	if (ncpu <= 1) {
+		*parallel = p; /* diff blobs in the calling thread */
+		return NULL;
+	}
+	nthreads = ncpu < GOT_DIFF_PARALLEL_MAX_THREADS ?
+	    ncpu : GOT_DIFF_PARALLEL_MAX_THREADS;
+
+	p->threads = calloc(nthreads, sizeof(*p->threads));
+	if (p->threads == NULL) {
+		err = got_error_from_errno("calloc");
+		free(p);
+		return err;
+	}
+
+	errcode = pthread_mutex_init(&p->mutex, NULL);
+	if (errcode) {
+		err = got_error_set_errno(errcode, "pthread_mutex_init");
+		goto done;
+	}
+	errcode = pthread_cond_init(&p->work_cond, NULL);
+	if (errcode) {
+		pthread_mutex_destroy(&p->mutex);
+		err = got_error_set_errno(errcode, "pthread_cond_init");
+		goto done;
+	}
+	errcode = pthread_cond_init(&p->done_cond, NULL);
+	if (errcode) {
+		pthread_cond_destroy(&p->work_cond);
+		pthread_mutex_destroy(&p->mutex);
+		err = got_error_set_errno(errcode, "pthread_cond_init");
+		goto done;
+	}
+
+	while (p->nthreads < nthreads) {
+		struct got_diff_parallel_thread *t = &p->threads[p->nthreads];
+		t->parallel = p;
+		errcode = pthread_create(&t->thread, NULL, diff_thread, t);
+		if (errcode) {
+			err = got_error_set_errno(errcode, "pthread_create");
+			got_diff_parallel_close(p);
+			return err;
+		}
+		p->nthreads++;
+	}
+done:
+	if (err) {
+		free(p->threads);
+		free(p);
+	} else
+		*parallel = p;
+	return err;
+}
+
+static const struct got_error *
+queue_job(struct got_diff_parallel *parallel, struct got_blob_object *blob1,
+    struct got_blob_object *blob2, const char *label1, const char *label2,
+    mode_t mode1, mode_t mode2)
+{
+	const struct got_error *err = NULL;
+	struct got_diff_parallel_job *job;
+	const uint8_t *data1 = NULL, *data2 = NULL;
+	size_t size1 = 0, size2 = 0, nbytes = 0;
+	int kind;
+
+	err = got_diff_blob_check(&kind, &size1, &size2, blob1, blob2);
+	if (err)
+		return err;
+	if (kind == GOT_DIFF_BLOBS_TEXT) {
+		if (blob1) {
+			err = got_object_blob_get_data(&data1, &size1, blob1);
+			if (err)
+				return err;
+		}
+		if (blob2) {
+			err = got_object_blob_get_data(&data2, &size2, blob2);
+			if (err)
+				return err;
+		}
+		nbytes = size1 + size2;
+	}
+
+	/* Write output of earlier jobs until the new job fits the budget. */
+	pthread_mutex_lock(&parallel->mutex);
+	while (!TAILQ_EMPTY(&parallel->jobs) &&
+	    (TAILQ_FIRST(&parallel->jobs)->done ||
+	    parallel->nbytes + nbytes > GOT_DIFF_PARALLEL_MEMORY_BUDGET)) {
+		err = write_first_job(parallel);
+		if (err)
+			break;
+	}
+	pthread_mutex_unlock(&parallel->mutex);
+	if (err)
+		return err;
+
+	job = calloc(1, sizeof(*job));
+	if (job == NULL)
+		return got_error_from_errno("calloc");
+
+	/* Blobs will be closed once we return; keep copies of their data. */
+	job->kind = kind;
+	if (blob1) {
+		got_object_blob_id_str(blob1, job->idstr1,
+		    sizeof(job->idstr1));
+		job->size1 = size1;
+	}
+	if (data1) {
+		job->data1 = malloc(size1 > 0 ? size1 : 1);
+		if (job->data1 == NULL) {
+			err = got_error_from_errno("malloc");
+			goto done;
+		}
+		memcpy(job->data1, data1, size1);
+	}
+	if (blob2) {
+		got_object_blob_id_str(blob2, job->idstr2,
+		    sizeof(job->idstr2));
+		job->size2 = size2;
+	}
+	if (data2) {
+		job->data2 = malloc(size2 > 0 ? size2 : 1);
+		if (job->data2 == NULL) {
+			err = got_error_from_errno("malloc");
+			goto done;
+		}
+		memcpy(job->data2, data2, size2);
+	}
+	if (label1) {
+		job->label1 = strdup(label1);
+		if (job->label1 == NULL) {
+			err = got_error_from_errno("strdup");
+			goto done;
+		}
+	}
+	if (label2) {
+		job->label2 = strdup(label2);
+		if (job->label2 == NULL) {
+			err = got_error_from_errno("strdup");
+			goto done;
+		}
+	}
+	job->mode1 = mode1;
+	job->mode2 = mode2;
+
+	pthread_mutex_lock(&parallel->mutex);
+	TAILQ_INSERT_TAIL(&parallel->jobs, job, entry);
+	if (parallel->next == NULL)
+		parallel->next = job;
+	parallel->nbytes += job_nbytes(job);
+	pthread_cond_signal(&parallel->work_cond);
+	pthread_mutex_unlock(&parallel->mutex);
+done:
+	if (err)
+		free_job(job);
+	return err;
+}
+
+const struct got_error *
+got_diff_blob_output_unidiff_parallel(void *arg,
+    struct got_blob_object *blob1, struct got_blob_object *blob2,
+    struct got_object_id *id1, struct got_object_id *id2,
+    const char *label1, const char *label2, mode_t mode1, mode_t mode2,
+    struct got_repository *repo)
+{
+	const struct got_error *err;
+	struct got_diff_parallel *parallel = arg;
+	struct got_diff_blob_output_unidiff_arg a;
+
+	if (parallel->nthreads > 0) {
+		err = queue_job(parallel, blob1, blob2, label1, label2,
+		    mode1, mode2);
+	} else {
+		a.outfile = parallel->outfile;
+		a.diff_context = parallel->diff_context;
+		a.ignore_whitespace = parallel->ignore_whitespace;
+		a.session = &parallel->session;
+		a.lines = parallel->lines;
+		a.nlines = parallel->nlines;
+		err = got_diff_blob_output_unidiff(&a, blob1, blob2, id1, id2,
+		    label1, label2, mode1, mode2, repo);
+	}
+	if (err)
+		parallel->failed = 1;
+	return err;
+}
+
+const struct got_error *
+got_diff_parallel_close(struct got_diff_parallel *parallel)
+{
+	const struct got_error *err = NULL;
+	struct got_diff_parallel_job *job;
+
+	if (parallel->threads) {
+		pthread_mutex_lock(&parallel->mutex);
+		while (!parallel->failed && err == NULL &&
+		    !TAILQ_EMPTY(&parallel->jobs))
+			err = write_first_job(parallel);
+		pthread_mutex_unlock(&parallel->mutex);
+
+		stop_threads(parallel);
+		while ((job = TAILQ_FIRST(&parallel->jobs)) != NULL) {
+			TAILQ_REMOVE(&parallel->jobs, job, entry);
+			free_job(job);
+		}
+		pthread_cond_destroy(&parallel->done_cond);
+		pthread_cond_destroy(&parallel->work_cond);
+		pthread_mutex_destroy(&parallel->mutex);
+		free(parallel->threads);
+	}
+	got_diff_state_free(&parallel->session.ds);
+	free(parallel);
+	return err;
+}
@@ -0,0 +1,661 @@
+/*
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <sys/queue.h>
+#include <sys/stat.h>
+
+#include <sha1.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <zlib.h>
+
+#include "got_error.h"
+#include "got_object.h"
+#include "got_diff.h"
+
+#include "got_lib_delta.h"
+#include "got_lib_inflate.h"
+#include "got_lib_object.h"
+#include "got_lib_object_idset.h"
+#include "got_lib_diff.h"
+
+#ifndef MIN
+#define	MIN(_a,_b) ((_a) < (_b) ? (_a) : (_b))
+#endif
+
+#ifndef MAX
+#define	MAX(_a,_b) ((_a) > (_b) ? (_a) : (_b))
+#endif
+
+/* Minimum similarity, in percent, of files paired as a rename or copy. */
+#define GOT_DIFF_RENAME_MIN_SCORE	50
+
+/*
+ * Inexact rename detection is skipped if more files than this were added
+ * or deleted. Exact renames are always detected.
+ */
+#define GOT_DIFF_RENAME_MAX_FILES	4096
+
+/*
+ * Chunks which occur in more deleted files than this, such as empty lines,
+ * say little about which file an added file came from. They are ignored
+ * while looking for candidates, which bounds the work done per chunk.
+ */
+#define GOT_DIFF_RENAME_MAX_POSTINGS	64
+
+/* Number of best-scoring sources remembered per added file. */
+#define GOT_DIFF_RENAME_CANDIDATES	4
+
+/* Chunks end at a newline character or after this many bytes. */
+#define GOT_DIFF_RENAME_CHUNK_SIZE	64
+
+struct got_diff_rename_chunk {
+	uint64_t hash;
+	size_t len;		/* total length of chunks with this hash */
+};
+
+struct got_diff_rename_change {
+	TAILQ_ENTRY(got_diff_rename_change) entry;
+	struct got_object_id *id1;	/* NULL if the file was added */
+	struct got_object_id *id2;	/* NULL if the file was deleted */
+	char *label1;
+	char *label2;
+	mode_t mode1;
+	mode_t mode2;
+
+	/* File which an added file was renamed or copied from. */
+	struct got_diff_rename_change *source;
+	int renamed;		/* deleted file was renamed */
+
+	/* Fingerprint of the content of an added or deleted file. */
+	struct got_diff_rename_chunk *chunks;
+	int nchunks;
+	size_t size;
+};
+TAILQ_HEAD(got_diff_rename_changes, got_diff_rename_change);
+
+/* A chunk of a deleted file, in an index sorted by chunk hash. */
+struct got_diff_rename_posting {
+	uint64_t hash;
+	size_t len;
+	int src;
+};
+
+struct got_diff_rename_candidate {
+	int src;
+	int dst;
+	int score;
+};
+
+static void
+free_changes(struct got_diff_rename_changes *changes)
+{
+	struct got_diff_rename_change *c;
+
+	while (!TAILQ_EMPTY(changes)) {
+		c = TAILQ_FIRST(changes);
+		TAILQ_REMOVE(changes, c, entry);
+		free(c->id1);
+		free(c->id2);
+		free(c->label1);
+		free(c->label2);
+		free(c->chunks);
+		free(c);
+	}
+}
+
+static const struct got_error *
+collect_change(void *arg, struct got_blob_object *blob1,
+    struct got_blob_object *blob2, struct got_object_id *id1,
+    struct got_object_id *id2, const char *label1, const char *label2,
+    mode_t mode1, mode_t mode2, struct got_repository *repo)
+{
+	const struct got_error *err = NULL;
+	struct got_diff_rename_changes *changes = arg;
+	struct got_diff_rename_change *c;
+
+	c = calloc(1, sizeof(*c));
+	if (c == NULL)
+		return got_error_from_errno("calloc");
+
+	if (id1) {
+		c->id1 = got_object_id_dup(id1);
+		if (c->id1 == NULL) {
+			err = got_error_from_errno("got_object_id_dup");
+			goto done;
+		}
+	}
+	if (id2) {
+		c->id2 = got_object_id_dup(id2);
+		if (c->id2 == NULL) {
+			err = got_error_from_errno("got_object_id_dup");
+			goto done;
+		}
+	}
+	if (label1) {
+		c->label1 = strdup(label1);
+		if (c->label1 == NULL) {
+			err = got_error_from_errno("strdup");
+			goto done;
+		}
+	}
+	if (label2) {
+		c->label2 = strdup(label2);
+		if (c->label2 == NULL) {
+			err = got_error_from_errno("strdup");
+			goto done;
+		}
+	}
+	c->mode1 = mode1;
+	c->mode2 = mode2;
+done:
+	if (err) {
+		free(c->id1);
+		free(c->id2);
+		free(c->label1);
+		free(c->label2);
+		free(c);
+	} else
+		TAILQ_INSERT_TAIL(changes, c, entry);
+	return err;
+}
+
+static int
+is_deleted(struct got_diff_rename_change *c)
+{
+	return (c->id1 != NULL && c->id2 == NULL);
+}
+
+static int
+is_added(struct got_diff_rename_change *c)
+{
+	return (c->id1 == NULL && c->id2 != NULL);
+}
+
+static mode_t
+change_mode(struct got_diff_rename_change *c)
+{
+	return (c->id1 ? c->mode1 : c->mode2);
+}
+
+/* Files are only paired with files of the same kind. */
+static int
+same_kind(struct got_diff_rename_change *src,
+    struct got_diff_rename_change *dst)
+{
+	return (S_ISLNK(change_mode(src)) == S_ISLNK(change_mode(dst)));
+}
+
+/*
+ * Pair an added file with the file it was renamed or copied from.
+ * A deleted file is renamed to the first file paired with it, and copied
+ * to any other. A modified file can only be the source of a copy.
+ */
+static void
+pair(struct got_diff_rename_change *src, struct got_diff_rename_change *dst)
+{
+	dst->source = src;
+	if (is_deleted(src))
+		src->renamed = 1;
+}
+
+static const struct got_error *
+find_exact_renames(struct got_diff_rename_changes *changes)
+{
+	const struct got_error *err = NULL;
+	struct got_object_idset *sources;
+	struct got_diff_rename_change *c, *src;
+	int pass;
+
+	sources = got_object_idset_alloc();
+	if (sources == NULL)
+		return got_error_from_errno("got_object_idset_alloc");
+
+	/* Prefer deleted files over modified files as sources. */
+	for (pass = 0; pass < 2; pass++) {
+		TAILQ_FOREACH(c, changes, entry) {
+			if (c->id1 == NULL ||
+			    (pass == 0 && !is_deleted(c)) ||
+			    (pass == 1 && is_deleted(c)))
+				continue;
+			if (got_object_idset_contains(sources, c->id1))
+				continue;
+			err = got_object_idset_add(sources, c->id1, c);
+			if (err)
+				goto done;
+		}
+	}
+
+	TAILQ_FOREACH(c, changes, entry) {
+		if (!is_added(c))
+			continue;
+		src = got_object_idset_get(sources, c->id2);
+		if (src && same_kind(src, c))
+			pair(src, c);
+	}
+done:
+	got_object_idset_free(sources);
+	return err;
+}
+
+static uint64_t
+hash_chunk(const uint8_t *buf, size_t len)
+{
+	uint64_t h = 0xcbf29ce484222325ULL;
+	size_t i;
+
+	for (i = 0; i < len; i++) {
+		h ^= buf[i];
+		h *= 0x100000001b3ULL;
+	}
+	return h;
+}
+
+static int
+cmp_chunks(const void *a, const void *b)
+{
+	const struct got_diff_rename_chunk *c1 = a, *c2 = b;
+
+	if (c1->hash < c2->hash)
+		return -1;
+	if (c1->hash > c2->hash)
+		return 1;
+	return 0;
+}
+
+/*
+ * Split a file's content into chunks which end at newline characters,
+ * or after GOT_DIFF_RENAME_CHUNK_SIZE bytes, and record how many bytes of
+ * content each distinct chunk accounts for. Two files are similar to the
+ * extent that they share chunks.
+ */
+static const struct got_error *
+fingerprint(struct got_diff_rename_change *c, struct got_object_id *id,
+    struct got_repository *repo)
+{
+	const struct got_error *err = NULL;
+	struct got_blob_object *blob = NULL;
+	const uint8_t *data, *buf;
+	size_t len, size, off, n, nalloc = 0;
+	struct got_diff_rename_chunk *chunks = NULL, *p;
+	const uint8_t *nl;
+	int i, nchunks = 0;
+
+	err = got_object_open_as_blob(&blob, repo, id, 8192);
+	if (err)
+		return err;
+
+	/* Files which will not be diffed are not worth reading either. */
+	err = got_object_blob_peek(&buf, &len, &size, blob);
+	if (err || size == 0 || size > got_diff_max_blob_size())
+		goto done;
+	c->size = size;
+
+	err = got_object_blob_get_data(&data, &size, blob);
+	if (err)
+		goto done;
+
+	for (off = 0; off < size; off += n) {
+		n = size - off;
+		if (n > GOT_DIFF_RENAME_CHUNK_SIZE)
+			n = GOT_DIFF_RENAME_CHUNK_SIZE;
+		nl = memchr(data + off, '\n', n);
+		if (nl)
+			n = nl - (data + off) + 1;
+		if (nchunks == nalloc) {
+			nalloc = nalloc ? nalloc * 2 : size / 32 + 16;
+			p = reallocarray(chunks, nalloc, sizeof(*chunks));
+			if (p == NULL) {
+				err = got_error_from_errno("reallocarray");
+				goto done;
+			}
+			chunks = p;
+		}
+		chunks[nchunks].hash = hash_chunk(data + off, n);
+		chunks[nchunks].len = n;
+		nchunks++;
+	}
+
+	qsort(chunks, nchunks, sizeof(chunks[0]), cmp_chunks);
+	for (i = 0, n = 0; i < nchunks; i++) {
+		if (n > 0 && chunks[n - 1].hash == chunks[i].hash)
+			chunks[n - 1].len += chunks[i].len;
+		else
+			chunks[n++] = chunks[i];
+	}
+	c->chunks = chunks;
+	c->nchunks = n;
+	chunks = NULL;
+done:
+	free(chunks);
+	if (blob)
+		got_object_blob_close(blob);
+	return err;
+}
+
+static int
+cmp_postings(const void *a, const void *b)
+{
+	const struct got_diff_rename_posting *p1 = a, *p2 = b;
+
+	if (p1->hash < p2->hash)
+		return -1;
+	if (p1->hash > p2->hash)
+		return 1;
+	return p1->src - p2->src;
+}
+
+static int
+cmp_candidates(const void *a, const void *b)
+{
+	const struct got_diff_rename_candidate *c1 = a, *c2 = b;
+
+	if (c1->score != c2->score)
+		return c2->score - c1->score;
+	if (c1->dst != c2->dst)
+		return c1->dst - c2->dst;
+	return c1->src - c2->src;
+}
+
+/* Find the first posting with the given hash in a sorted index. */
+static size_t
+find_postings(struct got_diff_rename_posting *postings, size_t npostings,
+    uint64_t hash)
+{
+	size_t lo = 0, hi = npostings, mid;
+
+	while (lo < hi) {
+		mid = lo + (hi - lo) / 2;
+		if (postings[mid].hash < hash)
+			lo = mid + 1;
+		else
+			hi = mid;
+	}
+	return lo;
+}
+
+/* Remember one of the best-scoring sources of an added file. */
+static void
+add_candidate(struct got_diff_rename_candidate *best, int src, int dst,
+    int score)
+{
+	int i;
+
+	for (i = 0; i < GOT_DIFF_RENAME_CANDIDATES; i++) {
+		if (best[i].score < score ||
+		    (best[i].score == score && best[i].src > src))
+			break;
+	}
+	if (i == GOT_DIFF_RENAME_CANDIDATES)
+		return;
+	memmove(&best[i + 1], &best[i],
+	    (GOT_DIFF_RENAME_CANDIDATES - i - 1) * sizeof(best[0]));
+	best[i].src = src;
+	best[i].dst = dst;
+	best[i].score = score;
+}
+
+/*
+ * Pair remaining added and deleted files by similarity of their content.
+ * An index which maps chunk hashes to deleted files is used to find the
+ * deleted files which share chunks with an added file, so files which
+ * have nothing in common are never compared.
+ */
+static const struct got_error *
+find_inexact_renames(struct got_diff_rename_changes *changes,
+    struct got_repository *repo)
+{
+	const struct got_error *err = NULL;
+	struct got_diff_rename_change *c, **srcs = NULL, **dsts = NULL;
+	struct got_diff_rename_change *src, *dst;
+	struct got_diff_rename_posting *postings = NULL;
+	struct got_diff_rename_candidate *candidates = NULL, *best;
+	size_t npostings = 0, *shared = NULL, p, q, max, min;
+	int *touched = NULL, ntouched;
+	int nsrcs = 0, ndsts = 0, ncandidates = 0, i, j;
+
+	TAILQ_FOREACH(c, changes, entry) {
+		if (is_deleted(c) && !c->renamed)
+			nsrcs++;
+		else if (is_added(c) && c->source == NULL)
+			ndsts++;
+	}
+	if (nsrcs == 0 || ndsts == 0 ||
+	    nsrcs > GOT_DIFF_RENAME_MAX_FILES ||
+	    ndsts > GOT_DIFF_RENAME_MAX_FILES)
+		return NULL;
+
+	srcs = calloc(nsrcs, sizeof(*srcs));
+	dsts = calloc(ndsts, sizeof(*dsts));
+	shared = calloc(nsrcs, sizeof(*shared));
+	touched = calloc(nsrcs, sizeof(*touched));
+	candidates = calloc(ndsts * GOT_DIFF_RENAME_CANDIDATES,
+	    sizeof(*candidates));
+	if (srcs == NULL || dsts == NULL || shared == NULL ||
+	    touched == NULL || candidates == NULL) {
+		err = got_error_from_errno("calloc");
+		goto done;
+	}
+
+	nsrcs = 0;
+	ndsts = 0;
+	TAILQ_FOREACH(c, changes, entry) {
+		if (is_deleted(c) && !c->renamed) {
+			err = fingerprint(c, c->id1, repo);
+			if (err)
+				goto done;
+			srcs[nsrcs++] = c;
+			npostings += c->nchunks;
+		} else if (is_added(c) && c->source == NULL) {
+			err = fingerprint(c, c->id2, repo);
+			if (err)
+				goto done;
+			dsts[ndsts++] = c;
+		}
+	}
+
+	postings = calloc(npostings > 0 ? npostings : 1, sizeof(*postings));
+	if (postings == NULL) {
+		err = got_error_from_errno("calloc");
+		goto done;
+	}
+	npostings = 0;
+	for (i = 0; i < nsrcs; i++) {
+		for (j = 0; j < srcs[i]->nchunks; j++) {
+			postings[npostings].hash = srcs[i]->chunks[j].hash;
+			postings[npostings].len = srcs[i]->chunks[j].len;
+			postings[npostings].src = i;
+			npostings++;
+		}
+	}
+	qsort(postings, npostings, sizeof(postings[0]), cmp_postings);
+
+	for (i = 0; i < ndsts; i++) {
+		dst = dsts[i];
+		best = &candidates[i * GOT_DIFF_RENAME_CANDIDATES];
+		ntouched = 0;
+
+		/* Sum up the amount of content shared with deleted files. */
+		for (j = 0; j < dst->nchunks; j++) {
+			p = find_postings(postings, npostings,
+			    dst->chunks[j].hash);
+			for (q = p; q < npostings &&
+			    postings[q].hash == dst->chunks[j].hash; q++)
+				;
+			if (q - p > GOT_DIFF_RENAME_MAX_POSTINGS)
+				continue;
+			for (; p < q; p++) {
+				if (shared[postings[p].src] == 0)
+					touched[ntouched++] = postings[p].src;
+				shared[postings[p].src] +=
+				    MIN(postings[p].len, dst->chunks[j].len);
+			}
+		}
+
+		for (j = 0; j < ntouched; j++) {
+			src = srcs[touched[j]];
+			max = MAX(src->size, dst->size);
+			min = MIN(src->size, dst->size);
+			if (same_kind(src, dst) && min * 100 >=
+			    max * GOT_DIFF_RENAME_MIN_SCORE) {
+				add_candidate(best, touched[j], i,
+				    shared[touched[j]] * 100 / max);
+			}
+			shared[touched[j]] = 0;
+		}
+	}
+
+	/* Pair the most similar files first. */
+	for (i = 0; i < ndsts * GOT_DIFF_RENAME_CANDIDATES; i++) {
+		if (candidates[i].score >= GOT_DIFF_RENAME_MIN_SCORE)
+			candidates[ncandidates++] = candidates[i];
+	}
+	qsort(candidates, ncandidates, sizeof(candidates[0]), cmp_candidates);
+	for (i = 0; i < ncandidates; i++) {
+		dst = dsts[candidates[i].dst];
+		if (dst->source == NULL)
+			pair(srcs[candidates[i].src], dst);
+	}
+done:
+	free(srcs);
+	free(dsts);
+	free(shared);
+	free(touched);
+	free(postings);
+	free(candidates);
+	return err;
+}
+
+static const struct got_error *
+diff_tree_changes(struct got_diff_rename_changes *changes,
+    struct got_tree_object *tree1, struct got_tree_object *tree2,
+    const char *label1, const char *label2, struct got_repository *repo)
+{
+	const struct got_error *err;
+
+	err = got_diff_tree(tree1, tree2, label1, label2, repo,
+	    collect_change, changes, 0);
+	if (err)
+		return err;
+
+	err = find_exact_renames(changes);
+	if (err)
+		return err;
+
+	return find_inexact_renames(changes, repo);
+}
+
+static const struct got_error *
+report_change(struct got_object_id *id1, struct got_object_id *id2,
+    const char *label1, const char *label2, mode_t mode1, mode_t mode2,
+    struct got_repository *repo, got_diff_blob_cb cb, void *cb_arg,
+    int diff_content)
+{
+	const struct got_error *err = NULL;
+	struct got_blob_object *blob1 = NULL, *blob2 = NULL;
+
+	if (!diff_content)
+		return cb(cb_arg, NULL, NULL, id1, id2, label1, label2,
+		    mode1, mode2, repo);
+
+	if (id1) {
+		err = got_object_open_as_blob(&blob1, repo, id1, 8192);
+		if (err)
+			goto done;
+	}
+	if (id2) {
+		err = got_object_open_as_blob(&blob2, repo, id2, 8192);
+		if (err)
+			goto done;
+	}
+	err = cb(cb_arg, blob1, blob2, id1, id2, label1, label2, mode1, mode2,
+	    repo);
+done:
+	if (blob1)
+		got_object_blob_close(blob1);
+	if (blob2)
+		got_object_blob_close(blob2);
+	return err;
+}
+
+const struct got_error *
+got_diff_tree_renames(struct got_tree_object *tree1,
+    struct got_tree_object *tree2, const char *label1, const char *label2,
+    struct got_repository *repo, got_diff_blob_cb cb, void *cb_arg,
+    int diff_content)
+{
+	const struct got_error *err;
+	struct got_diff_rename_changes changes;
+	struct got_diff_rename_change *c, *src;
+
+	TAILQ_INIT(&changes);
+
+	err = diff_tree_changes(&changes, tree1, tree2, label1, label2, repo);
+	if (err)
+		goto done;
+
+	TAILQ_FOREACH(c, &changes, entry) {
+		src = c->source;
+		if (src) {
+			err = report_change(src->id1, c->id2, src->label1,
+			    c->label2, src->mode1, c->mode2, repo, cb, cb_arg,
+			    diff_content);
+		} else if (!c->renamed) {
+			err = report_change(c->id1, c->id2, c->label1,
+			    c->label2, c->mode1, c->mode2, repo, cb, cb_arg,
+			    diff_content);
+		}
+		if (err)
+			break;
+	}
+done:
+	free_changes(&changes);
+	return err;
+}
+
+const struct got_error *
+got_diff_find_rename_source(char **old_path, struct got_tree_object *tree1,
+    struct got_tree_object *tree2, const char *path,
+    struct got_repository *repo)
+{
+	const struct got_error *err;
+	struct got_diff_rename_changes changes;
+	struct got_diff_rename_change *c;
+
+	*old_path = NULL;
+	TAILQ_INIT(&changes);
+
+	/* We are expecting an absolute in-repository path. */
+	if (path[0] != '/')
+		return got_error(GOT_ERR_NOT_ABSPATH);
+
+	err = diff_tree_changes(&changes, tree1, tree2, "", "", repo);
+	if (err)
+		goto done;
+
+	TAILQ_FOREACH(c, &changes, entry) {
+		if (c->source == NULL || strcmp(c->label2, path + 1) != 0)
+			continue;
+		if (asprintf(old_path, "/%s", c->source->label1) == -1)
+			err = got_error_from_errno("asprintf");
+		break;
+	}
+done:
+	free_changes(&changes);
+	return err;
+}
@@ -173,30 +173,47 @@ struct line {
 	int	value;
 };
 
-static void	 diff_output(FILE *, const char *, ...);
-static int	 output(FILE *, struct got_diff_changes *, struct got_diff_state *, struct got_diff_args *, const char *, FILE *, const char *, FILE *, int);
-static void	 check(struct got_diff_state *, FILE *, FILE *, int);
-static void	 range(FILE *, int, int, char *);
-static void	 uni_range(FILE *, int, int);
-static void	 dump_unified_vec(FILE *, struct got_diff_changes *, struct got_diff_state *, struct got_diff_args *, FILE *, FILE *, int);
-static int	 prepare(struct got_diff_state *, int, FILE *, off_t, int);
+/* A file being compared, held in memory. */
+struct input {
+	const unsigned char *buf;
+	size_t	len;
+	size_t	pos;
+};
+
+
+static void	 diff_output(FILE *, struct got_diff_state *, const char *, ...);
+static void	 output_flush(FILE *, struct got_diff_state *);
+static void	 output_write(FILE *, struct got_diff_state *, const void *, size_t);
+static void	 output_putc(FILE *, struct got_diff_state *, int);
+static void	 output_line(FILE *, struct got_diff_state *, struct got_diff_args *, uint8_t);
+static int	 igetc(struct input *);
+static int	 output(FILE *, struct got_diff_changes *, struct got_diff_state *, struct got_diff_args *, const char *, struct input *, const char *, struct input *, int);
+static void	 check(struct got_diff_state *, struct input *, struct input *, int);
+static void	 check_lines(struct got_diff_state *);
+static void	 range(FILE *, struct got_diff_state *, int, int, char *);
+static void	 uni_range(FILE *, struct got_diff_state *, int, int);
+static void	 dump_unified_vec(FILE *, struct got_diff_changes *, struct got_diff_state *, struct got_diff_args *, struct input *, struct input *, int);
+static void	*grow_array(struct got_diff_state *, void *, size_t *, size_t, size_t);
+static int	 prepare(struct got_diff_state *, int, struct input *, int);
+static const struct got_error *prepare_lines(struct got_diff_state *, int, struct input *);
 static void	 prune(struct got_diff_state *);
 static void	 equiv(struct line *, int, struct line *, int, int *);
 static void	 unravel(struct got_diff_state *, int);
+static const struct got_error *myers(struct got_diff_state *, int);
 static int	 unsort(struct line *, int, int *);
-static int	 change(FILE *, struct got_diff_changes *, struct got_diff_state *, struct got_diff_args *, const char *, FILE *, const char *, FILE *, int, int, int, int, int *);
+static int	 change(FILE *, struct got_diff_changes *, struct got_diff_state *, struct got_diff_args *, const char *, struct input *, const char *, struct input *, int, int, int, int, int *);
 static void	 sort(struct line *, int);
 static void	 print_header(FILE *, struct got_diff_state *, struct got_diff_args *, const char *, const char *);
-static int	 asciifile(FILE *);
-static void	 fetch(FILE *, struct got_diff_state *, struct got_diff_args *, long *, int, int, FILE *, int, int);
+static int	 asciifile(struct input *);
+static void	 fetch(FILE *, struct got_diff_state *, struct got_diff_args *, long *, int, int, struct input *, int, int);
 static int	 newcand(struct got_diff_state *, int, int, int, int *);
 static int	 search(struct got_diff_state *, int *, int, int);
-static int	 skipline(FILE *);
+static int	 skipline(struct input *);
 static int	 isqrt(int);
 static int	 stone(struct got_diff_state *, int *, int, int *, int *, int);
-static int	 readhash(struct got_diff_state *, FILE *, int);
-static int	 files_differ(struct got_diff_state *, FILE *, FILE *, int);
-static char	*match_function(struct got_diff_state *, const long *, int, FILE *);
+static int	 readhash(struct got_diff_state *, struct input *, int);
+static int	 files_differ(struct got_diff_state *, struct input *, struct input *, int);
+static char	*match_function(struct got_diff_state *, const long *, int, struct input *);
 
 /*
  * chrtran points to one of 2 translation tables: cup2low if folding upper to
@@ -256,37 +273,252 @@ u_char cup2low[256] = {
 	0xfd, 0xfe, 0xff
 };
 
+/*
+ * Output is collected in the diff state's buffer and written to the output
+ * file with fwrite(3) when the buffer is full and once a diff is complete.
+ * Lines of input files are copied into the buffer whole.
+ */
+static void
+output_flush(FILE *outfile, struct got_diff_state *ds)
+{
+	if (outfile && ds->outlen > 0)
+		fwrite(ds->outbuf, 1, ds->outlen, outfile);
+	ds->outoff += ds->outlen;
+	ds->outlen = 0;
+}
+
 static void
-diff_output(FILE *outfile, const char *fmt, ...)
+output_write(FILE *outfile, struct got_diff_state *ds, const void *buf,
+    size_t len)
+{
+	if (outfile == NULL || len == 0)
+		return;
+
+	if (len > sizeof(ds->outbuf) - ds->outlen) {
+		output_flush(outfile, ds);
+		if (len > sizeof(ds->outbuf)) {
+			fwrite(buf, 1, len, outfile);
+			ds->outoff += len;
+			return;
+		}
+	}
+	memcpy(ds->outbuf + ds->outlen, buf, len);
+	ds->outlen += len;
+}
+
+static void
+output_putc(FILE *outfile, struct got_diff_state *ds, int c)
+{
+	if (outfile == NULL)
+		return;
+
+	if (ds->outlen == sizeof(ds->outbuf))
+		output_flush(outfile, ds);
+	ds->outbuf[ds->outlen++] = c;
+}
+
+static void
+diff_output(FILE *outfile, struct got_diff_state *ds, const char *fmt, ...)
 {
 	va_list ap;
+	size_t avail;
+	int n;
 
 	if (outfile == NULL)
 		return;
 
+	avail = sizeof(ds->outbuf) - ds->outlen;
 	va_start(ap, fmt);
-	vfprintf(outfile, fmt, ap);
+	n = vsnprintf(ds->outbuf + ds->outlen, avail, fmt, ap);
 	va_end(ap);
+	if (n < 0)
+		return;
+	if (n < avail) {
+		ds->outlen += n;
+		return;
+	}
+
+	/* Output did not fit; try again with an empty buffer. */
+	output_flush(outfile, ds);
+	va_start(ap, fmt);
+	if (n < sizeof(ds->outbuf)) {
+		vsnprintf(ds->outbuf, sizeof(ds->outbuf), fmt, ap);
+		ds->outlen = n;
+	} else {
+		vfprintf(outfile, fmt, ap);
+		ds->outoff += n;
+	}
+	va_end(ap);
+}
+
+/* Record the start of an output line if the caller asked for lines. */
+static void
+output_line(FILE *outfile, struct got_diff_state *ds,
+    struct got_diff_args *args, uint8_t type)
+{
+	if (outfile == NULL || args->lines == NULL || ds->outerr)
+		return;
+
+	ds->outerr = got_diff_add_line(args->lines, args->nlines,
+	    ds->outoff + ds->outlen, type);
+}
+
+/*
+ * The array's allocated length is the smallest power of two which is not
+ * less than the number of lines, so it only needs to grow if the number of
+ * lines is a power of two.
+ */
+const struct got_error *
+got_diff_add_line(struct got_diff_output_line **lines, size_t *nlines,
+    off_t offset, uint8_t type)
+{
+	struct got_diff_output_line *l;
+	size_t n = *nlines;
+
+	if (n == 0 || (n & (n - 1)) == 0) {
+		l = reallocarray(*lines, n ? 2 * n : 1, sizeof(**lines));
+		if (l == NULL)
+			return got_error_from_errno("reallocarray");
+		*lines = l;
+	}
+	(*lines)[n].offset = offset;
+	(*lines)[n].type = type;
+	(*nlines)++;
+	return NULL;
 }
 
 void
 got_diff_state_free(struct got_diff_state *ds)
 {
 	free(ds->J);
-	free(ds->member);
-	free(ds->class);
+	free(ds->file[0]);	/* overlaid by class */
+	free(ds->file[1]);	/* overlaid by member */
 	free(ds->clist);
 	free(ds->klist);
 	free(ds->ixold);
 	free(ds->ixnew);
+	free(ds->data_alloc[0]);
+	free(ds->data_alloc[1]);
+	free(ds->lines[0]);
+	free(ds->lines[1]);
+	free(ds->context_vec_start);
+}
+
+/*
+ * Ensure that an array in the diff state has room for n elements.
+ * Arrays are never shrunk, such that reusing a diff state for files
+ * of similar size requires no further allocations.
+ */
+static void *
+grow_array(struct got_diff_state *ds, void *p, size_t *nalloc, size_t n,
+    size_t size)
+{
+	if (n <= *nalloc)
+		return p;
+	p = reallocarray(p, n, size);
+	if (p == NULL)
+		return NULL;
+	*nalloc = n;
+	ds->nallocations++;
+	return p;
+}
+
+static int
+igetc(struct input *in)
+{
+	if (in->pos >= in->len)
+		return EOF;
+	return in->buf[in->pos++];
+}
+
+const struct got_error *
+got_diff_read_file(uint8_t **buf, size_t *len, FILE *f)
+{
+	const struct got_error *err = NULL;
+	struct stat sb;
+	size_t size, n;
+	uint8_t *p;
+
+	*buf = NULL;
+	*len = 0;
+
+	size = BUFSIZ;
+	if (fstat(fileno(f), &sb) == 0 && sb.st_size > 0 &&
+	    sb.st_size < SIZE_MAX)
+		size = sb.st_size + 1; /* detect EOF without growing */
+
+	*buf = malloc(size);
+	if (*buf == NULL)
+		return got_error_from_errno("malloc");
+
+	rewind(f);
+	for (;;) {
+		if (*len == size) {
+			p = reallocarray(*buf, size, 2);
+			if (p == NULL) {
+				err = got_error_from_errno("reallocarray");
+				goto done;
+			}
+			*buf = p;
+			size *= 2;
+		}
+		n = fread(*buf + *len, 1, size - *len, f);
+		if (n == 0) {
+			if (ferror(f))
+				err = got_ferror(f, GOT_ERR_IO);
+			break;
+		}
+		*len += n;
+	}
+done:
+	if (err) {
+		free(*buf);
+		*buf = NULL;
+		*len = 0;
+	}
+	return err;
 }
 
 const struct got_error *
 got_diffreg(int *rval, FILE *f1, FILE *f2, int flags,
     struct got_diff_args *args, struct got_diff_state *ds, FILE *outfile,
     struct got_diff_changes *changes)
+{
+	const struct got_error *err;
+	size_t len1 = 0, len2 = 0;
+
+	*rval = D_SAME;
+	if ((f1 == NULL && (flags & D_EMPTY1) == 0) ||
+	    (f2 == NULL && (flags & D_EMPTY2) == 0)) {
+		args->status |= 2;
+		return NULL;
+	}
+
+	free(ds->data_alloc[0]);
+	free(ds->data_alloc[1]);
+	ds->data_alloc[0] = ds->data_alloc[1] = NULL;
+	if ((flags & D_EMPTY1) == 0) {
+		err = got_diff_read_file(&ds->data_alloc[0], &len1, f1);
+		if (err)
+			return err;
+	}
+	if ((flags & D_EMPTY2) == 0) {
+		err = got_diff_read_file(&ds->data_alloc[1], &len2, f2);
+		if (err)
+			return err;
+	}
+
+	return got_diffreg_mem(rval, ds->data_alloc[0], len1,
+	    ds->data_alloc[1], len2, flags, args, ds, outfile, changes);
+}
+
+const struct got_error *
+got_diffreg_mem(int *rval, const uint8_t *buf1, size_t len1,
+    const uint8_t *buf2, size_t len2, int flags, struct got_diff_args *args,
+    struct got_diff_state *ds, FILE *outfile, struct got_diff_changes *changes)
 {
 	const struct got_error *err = NULL;
+	struct input in1, in2;
 	int i, *p;
 	long *lp;
 
@@ -294,8 +526,17 @@ got_diffreg(int *rval, FILE *f1, FILE *f2, int flags,
 	ds->anychange = 0;
 	ds->lastline = 0;
 	ds->lastmatchline = 0;
+	ds->outlen = 0;
+	ds->outoff = 0;
+	ds->outerr = NULL;
+	if (outfile && args->lines) {
+		ds->outoff = ftello(outfile);
+		if (ds->outoff == -1)
+			return got_error_from_errno("ftello");
+	}
 	ds->context_vec_ptr = ds->context_vec_start - 1;
-	ds->max_context = GOT_DIFF_MAX_CONTEXT;
+	if (ds->context_vec_start == NULL)
+		ds->max_context = GOT_DIFF_MAX_CONTEXT;
 	if (flags & D_IGNORECASE)
 		ds->chrtran = cup2low;
 	else
@@ -305,29 +546,26 @@ got_diffreg(int *rval, FILE *f1, FILE *f2, int flags,
 		return NULL;
 	}
 	if (flags & D_EMPTY1) {
-		f1 = fopen(_PATH_DEVNULL, "r");
-		if (f1 == NULL) {
-			err = got_error_from_errno2("fopen", _PATH_DEVNULL);
-			goto closem;
-		}
-	}
-	else if (f1 == NULL) {
-		args->status |= 2;
-		goto closem;
+		buf1 = NULL;
+		len1 = 0;
 	}
-
 	if (flags & D_EMPTY2) {
-		f2 = fopen(_PATH_DEVNULL, "r");
-		if (f2 == NULL) {
-			err = got_error_from_errno2("fopen", _PATH_DEVNULL);
-			goto closem;
-		}
-	} else if (f2 == NULL) {
-		args->status |= 2;
-		goto closem;
+		buf2 = NULL;
+		len2 = 0;
 	}
 
-	switch (files_differ(ds, f1, f2, flags)) {
+	ds->data[0] = buf1;
+	ds->datalen[0] = len1;
+	ds->data[1] = buf2;
+	ds->datalen[1] = len2;
+	in1.buf = buf1;
+	in1.len = len1;
+	in1.pos = 0;
+	in2.buf = buf2;
+	in2.len = len2;
+	in2.pos = 0;
+
+	switch (files_differ(ds, &in1, &in2, flags)) {
 	case 0:
 		goto closem;
 	case 1:
@@ -339,166 +577,199 @@ got_diffreg(int *rval, FILE *f1, FILE *f2, int flags,
 	}
 
 	if ((flags & D_FORCEASCII) == 0 &&
-	    (!asciifile(f1) || !asciifile(f2))) {
+	    (!asciifile(&in1) || !asciifile(&in2))) {
 		*rval = D_BINARY;
 		args->status |= 1;
 		goto closem;
 	}
-	if (prepare(ds, 0, f1, ds->stb1.st_size, flags)) {
-		err = got_error_from_errno("prepare");
-		goto closem;
-	}
-	if (prepare(ds, 1, f2, ds->stb2.st_size, flags)) {
-		err = got_error_from_errno("prepare");
-		goto closem;
+	if ((flags & (D_FOLDBLANKS|D_IGNOREBLANKS|D_IGNORECASE)) == 0) {
+		err = prepare_lines(ds, 0, &in1);
+		if (err)
+			goto closem;
+		err = prepare_lines(ds, 1, &in2);
+		if (err)
+			goto closem;
+	} else {
+		if (prepare(ds, 0, &in1, flags)) {
+			err = got_error_from_errno("prepare");
+			goto closem;
+		}
+		if (prepare(ds, 1, &in2, flags)) {
+			err = got_error_from_errno("prepare");
+			goto closem;
+		}
 	}
 
 	prune(ds);
-	sort(ds->sfile[0], ds->slen[0]);
-	sort(ds->sfile[1], ds->slen[1]);
 
-	ds->member = (int *)ds->file[1];
-	equiv(ds->sfile[0], ds->slen[0], ds->sfile[1], ds->slen[1], ds->member);
-	p = reallocarray(ds->member, ds->slen[1] + 2, sizeof(*ds->member));
+	p = grow_array(ds, ds->J, &ds->J_nalloc, ds->len[0] + 2,
+	    sizeof(*ds->J));
 	if (p == NULL) {
 		err = got_error_from_errno("reallocarray");
 		goto closem;
 	}
-	ds->member = p;
+	ds->J = p;
 
-	ds->class = (int *)ds->file[0];
-	if (unsort(ds->sfile[0], ds->slen[0], ds->class)) {
-		err = got_error_from_errno("unsort");
-		goto closem;
-	}
-	p = reallocarray(ds->class, ds->slen[0] + 2, sizeof(*ds->class));
-	if (p == NULL) {
-		err = got_error_from_errno("reallocarray");
-		goto closem;
-	}
-	ds->class = p;
+	if (flags & (D_MYERS | D_HISTOGRAM)) {
+		err = myers(ds, flags);
+		if (err)
+			goto closem;
+	} else {
+		sort(ds->sfile[0], ds->slen[0]);
+		sort(ds->sfile[1], ds->slen[1]);
 
-	ds->klist = calloc(ds->slen[0] + 2, sizeof(*ds->klist));
-	if (ds->klist == NULL) {
-		err = got_error_from_errno("calloc");
-		goto closem;
-	}
-	ds->clen = 0;
-	ds->clistlen = 100;
-	ds->clist = calloc(ds->clistlen, sizeof(*ds->clist));
-	if (ds->clist == NULL) {
-		err = got_error_from_errno("calloc");
-		goto closem;
-	}
-	i = stone(ds, ds->class, ds->slen[0], ds->member, ds->klist, flags);
-	if (i < 0) {
-		err = got_error_from_errno("stone");
-		goto closem;
-	}
+		ds->member = (int *)ds->file[1];
+		equiv(ds->sfile[0], ds->slen[0], ds->sfile[1], ds->slen[1],
+		    ds->member);
 
-	p = reallocarray(ds->J, ds->len[0] + 2, sizeof(*ds->J));
-	if (p == NULL) {
-		err = got_error_from_errno("reallocarray");
-		goto closem;
+		ds->class = (int *)ds->file[0];
+		if (unsort(ds->sfile[0], ds->slen[0], ds->class)) {
+			err = got_error_from_errno("unsort");
+			goto closem;
+		}
+
+		p = grow_array(ds, ds->klist, &ds->klist_nalloc,
+		    ds->slen[0] + 2, sizeof(*ds->klist));
+		if (p == NULL) {
+			err = got_error_from_errno("reallocarray");
+			goto closem;
+		}
+		ds->klist = p;
+		memset(ds->klist, 0, (ds->slen[0] + 2) * sizeof(*ds->klist));
+		ds->clen = 0;
+		if (ds->clist == NULL) {
+			ds->clistlen = 100;
+			ds->clist = calloc(ds->clistlen, sizeof(*ds->clist));
+			if (ds->clist == NULL) {
+				err = got_error_from_errno("calloc");
+				goto closem;
+			}
+			ds->nallocations++;
+		}
+		i = stone(ds, ds->class, ds->slen[0], ds->member, ds->klist,
+		    flags);
+		if (i < 0) {
+			err = got_error_from_errno("stone");
+			goto closem;
+		}
+		unravel(ds, ds->klist[i]);
 	}
-	ds->J = p;
-	unravel(ds, ds->klist[i]);
 
-	lp = reallocarray(ds->ixold, ds->len[0] + 2, sizeof(*ds->ixold));
+	lp = grow_array(ds, ds->ixold, &ds->ixold_nalloc, ds->len[0] + 2,
+	    sizeof(*ds->ixold));
 	if (lp == NULL) {
 		err = got_error_from_errno("reallocarray");
 		goto closem;
 	}
 	ds->ixold = lp;
-	lp = reallocarray(ds->ixnew, ds->len[1] + 2, sizeof(*ds->ixnew));
+	lp = grow_array(ds, ds->ixnew, &ds->ixnew_nalloc, ds->len[1] + 2,
+	    sizeof(*ds->ixnew));
 	if (lp == NULL) {
 		err = got_error_from_errno("reallocarray");
 		goto closem;
 	}
 	ds->ixnew = lp;
-	check(ds, f1, f2, flags);
-	if (output(outfile, changes, ds, args, args->label[0], f1,
-	    args->label[1], f2, flags))
+	check(ds, &in1, &in2, flags);
+	if (output(outfile, changes, ds, args, args->label[0], &in1,
+	    args->label[1], &in2, flags))
 		err = got_error_from_errno("output");
 closem:
+	output_flush(outfile, ds);
+	if (err == NULL)
+		err = ds->outerr;
 	if (ds->anychange) {
 		args->status |= 1;
 		if (*rval == D_SAME)
 			*rval = D_DIFFER;
 	}
-	if ((flags & D_EMPTY1) && f1) {
-		if (fclose(f1) != 0 && err == NULL)
-			err = got_error_from_errno("fclose");
-	}
-	if ((flags & D_EMPTY2) && f2) {
-		if (fclose(f2) != 0 && err == NULL)
-			err = got_error_from_errno("fclose");
-	}
 	return (err);
 }
 
 /*
  * Check to see if the given files differ.
  * Returns 0 if they are the same, 1 if different, and -1 on error.
- * XXX - could use code from cmp(1) [faster]
  */
 static int
-files_differ(struct got_diff_state *ds, FILE *f1, FILE *f2, int flags)
+files_differ(struct got_diff_state *ds, struct input *f1, struct input *f2,
+    int flags)
 {
-	char buf1[BUFSIZ], buf2[BUFSIZ];
-	size_t i, j;
-
-	if ((flags & (D_EMPTY1|D_EMPTY2)) || ds->stb1.st_size != ds->stb2.st_size ||
+	if ((flags & (D_EMPTY1|D_EMPTY2)) || f1->len != f2->len ||
 	    (ds->stb1.st_mode & S_IFMT) != (ds->stb2.st_mode & S_IFMT))
 		return (1);
-	for (;;) {
-		i = fread(buf1, 1, sizeof(buf1), f1);
-		j = fread(buf2, 1, sizeof(buf2), f2);
-		if ((!i && ferror(f1)) || (!j && ferror(f2)))
-			return (-1);
-		if (i != j)
-			return (1);
-		if (i == 0)
-			return (0);
-		if (memcmp(buf1, buf2, i) != 0)
-			return (1);
-	}
+	if (f1->len == 0)
+		return (0);
+	return (memcmp(f1->buf, f2->buf, f1->len) != 0);
 }
 
 static int
-prepare(struct got_diff_state *ds, int i, FILE *fd, off_t filesize, int flags)
+prepare(struct got_diff_state *ds, int i, struct input *fd, int flags)
 {
-	struct line *p, *q;
+	struct line *p;
 	int j, h;
 	size_t sz;
 
-	rewind(fd);
+	fd->pos = 0;
 
-	sz = (filesize <= SIZE_MAX ? filesize : SIZE_MAX) / 25;
+	sz = fd->len / 25;
 	if (sz < 100)
 		sz = 100;
 
-	p = calloc(sz + 3, sizeof(*p));
+	p = grow_array(ds, ds->file[i], &ds->file_nalloc[i], sz + 3,
+	    sizeof(*p));
 	if (p == NULL)
 		return (-1);
+	ds->file[i] = p;
+	memset(&p[0], 0, sizeof(p[0]));
 	for (j = 0; (h = readhash(ds, fd, flags));) {
-		if (j == sz) {
-			sz = sz * 3 / 2;
-			q = reallocarray(p, sz + 3, sizeof(*p));
-			if (q == NULL) {
-				free(p);
+		if (j + 3 == ds->file_nalloc[i]) {
+			p = grow_array(ds, p, &ds->file_nalloc[i],
+			    ds->file_nalloc[i] * 3 / 2, sizeof(*p));
+			if (p == NULL)
 				return (-1);
-			}
-			p = q;
+			ds->file[i] = p;
 		}
 		p[++j].value = h;
+		p[j].serial = 0;
 	}
+	memset(&p[j + 1], 0, 2 * sizeof(p[0]));
 	ds->len[i] = j;
-	ds->file[i] = p;
 
 	return (0);
 }
 
+/*
+ * Like prepare(), but hash lines with got_diff_index_lines() and keep the
+ * line index for check(). Only usable if lines are compared byte by byte.
+ */
+static const struct got_error *
+prepare_lines(struct got_diff_state *ds, int i, struct input *fd)
+{
+	const struct got_error *err;
+	struct line *p;
+	size_t nalloc;
+	int j, n;
+
+	nalloc = ds->lines_nalloc[i];
+	err = got_diff_index_lines(&ds->lines[i], &ds->lines_nalloc[i], &n,
+	    fd->buf, fd->len);
+	if (err)
+		return err;
+	if (ds->lines_nalloc[i] != nalloc)
+		ds->nallocations++;
+
+	p = grow_array(ds, ds->file[i], &ds->file_nalloc[i], n + 3,
+	    sizeof(*p));
+	if (p == NULL)
+		return got_error_from_errno("reallocarray");
+	ds->file[i] = p;
+	memset(p, 0, (n + 3) * sizeof(*p));
+	for (j = 1; j <= n; j++)
+		p[j].value = ds->lines[i][j - 1].hash;
+	ds->len[i] = n;
+
+	return NULL;
+}
+
 static void
 prune(struct got_diff_state *ds)
 {
@@ -637,6 +908,7 @@ newcand(struct got_diff_state *ds, int x, int y, int pred, int *errorp)
 			return 0;
 		}
 		ds->clist = q;
+		ds->nallocations++;
 	}
 	q = ds->clist + ds->clen;
 	q->x = x;
@@ -683,6 +955,41 @@ unravel(struct got_diff_state *ds, int p)
 		ds->J[q->x + ds->pref] = q->y + ds->pref;
 }
 
+/*
+ * Compute the match vector J with Myers' algorithm or the histogram
+ * algorithm, instead of stone() and unravel(). Hash values of the lines
+ * between the common prefix and suffix are overlaid on file[0] and file[1].
+ */
+static const struct got_error *
+myers(struct got_diff_state *ds, int flags)
+{
+	const struct got_error *err;
+	int i, j, *v;
+
+	for (j = 0; j < 2; j++) {
+		v = (int *)ds->file[j];
+		for (i = 1; i <= ds->slen[j]; i++)
+			v[i] = ds->sfile[j][i].value;
+	}
+	ds->class = (int *)ds->file[0];
+	ds->member = (int *)ds->file[1];
+
+	err = got_diff_myers(ds->J + ds->pref, ds->class, ds->slen[0],
+	    ds->member, ds->slen[1], flags);
+	if (err)
+		return err;
+
+	for (i = 0; i <= ds->len[0]; i++) {
+		if (i <= ds->pref)
+			ds->J[i] = i;
+		else if (i > ds->len[0] - ds->suff)
+			ds->J[i] = i + ds->len[1] - ds->len[0];
+		else if (ds->J[i] != 0)
+			ds->J[i] += ds->pref;
+	}
+	return NULL;
+}
+
 /*
  * Check does double duty:
  *  1.	ferret out any fortuitous correspondences due
@@ -690,13 +997,19 @@ unravel(struct got_diff_state *ds, int p)
  *  2.  collect random access indexes to the two files
  */
 static void
-check(struct got_diff_state *ds, FILE *f1, FILE *f2, int flags)
+check(struct got_diff_state *ds, struct input *f1, struct input *f2,
+    int flags)
 {
 	int i, j, jackpot, c, d;
 	long ctold, ctnew;
 
-	rewind(f1);
-	rewind(f2);
+	if ((flags & (D_FOLDBLANKS|D_IGNOREBLANKS|D_IGNORECASE)) == 0) {
+		check_lines(ds);
+		return;
+	}
+
+	f1->pos = 0;
+	f2->pos = 0;
 	j = 1;
 	ds->ixold[0] = ds->ixnew[0] = 0;
 	jackpot = 0;
@@ -712,8 +1025,8 @@ check(struct got_diff_state *ds, FILE *f1, FILE *f2, int flags)
 		}
 		if (flags & (D_FOLDBLANKS|D_IGNOREBLANKS|D_IGNORECASE)) {
 			for (;;) {
-				c = getc(f1);
-				d = getc(f2);
+				c = igetc(f1);
+				d = igetc(f2);
 				/*
 				 * GNU diff ignores a missing newline
 				 * in one file for -b or -w.
@@ -735,19 +1048,19 @@ check(struct got_diff_state *ds, FILE *f1, FILE *f2, int flags)
 						if (c == '\n')
 							break;
 						ctold++;
-					} while (isspace(c = getc(f1)));
+					} while (isspace(c = igetc(f1)));
 					do {
 						if (d == '\n')
 							break;
 						ctnew++;
-					} while (isspace(d = getc(f2)));
+					} while (isspace(d = igetc(f2)));
 				} else if ((flags & D_IGNOREBLANKS)) {
 					while (isspace(c) && c != '\n') {
-						c = getc(f1);
+						c = igetc(f1);
 						ctold++;
 					}
 					while (isspace(d) && d != '\n') {
-						d = getc(f2);
+						d = igetc(f2);
 						ctnew++;
 					}
 				}
@@ -767,7 +1080,7 @@ check(struct got_diff_state *ds, FILE *f1, FILE *f2, int flags)
 			for (;;) {
 				ctold++;
 				ctnew++;
-				if ((c = getc(f1)) != (d = getc(f2))) {
+				if ((c = igetc(f1)) != (d = igetc(f2))) {
 					/* jackpot++; */
 					ds->J[i] = 0;
 					if (c != '\n' && c != EOF)
@@ -792,6 +1105,38 @@ check(struct got_diff_state *ds, FILE *f1, FILE *f2, int flags)
 	 */
 }
 
+/*
+ * Variant of check() which uses the line indexes built by prepare_lines().
+ * A final line without newline extends one byte past the end of the file,
+ * as with skipline(), so that fetch() notices the missing newline.
+ */
+static void
+check_lines(struct got_diff_state *ds)
+{
+	struct got_diff_line *l0, *l1;
+	int i, j;
+
+	ds->ixold[0] = ds->ixnew[0] = 0;
+	for (i = 1; i <= ds->len[0]; i++) {
+		l0 = &ds->lines[0][i - 1];
+		ds->ixold[i] = l0->offset + l0->len;
+		if (ds->data[0][ds->ixold[i] - 1] != '\n')
+			ds->ixold[i]++;
+		if (ds->J[i] == 0)
+			continue;
+		l1 = &ds->lines[1][ds->J[i] - 1];
+		if (l0->len != l1->len || memcmp(ds->data[0] + l0->offset,
+		    ds->data[1] + l1->offset, l0->len) != 0)
+			ds->J[i] = 0;
+	}
+	for (j = 1; j <= ds->len[1]; j++) {
+		l1 = &ds->lines[1][j - 1];
+		ds->ixnew[j] = l1->offset + l1->len;
+		if (ds->data[1][ds->ixnew[j] - 1] != '\n')
+			ds->ixnew[j]++;
+	}
+}
+
 /* shellsort CACM #201 */
 static void
 sort(struct line *a, int n)
@@ -843,11 +1188,11 @@ unsort(struct line *f, int l, int *b)
 }
 
 static int
-skipline(FILE *f)
+skipline(struct input *f)
 {
 	int i, c;
 
-	for (i = 1; (c = getc(f)) != '\n' && c != EOF; i++)
+	for (i = 1; (c = igetc(f)) != '\n' && c != EOF; i++)
 		continue;
 	return (i);
 }
@@ -855,13 +1200,14 @@ skipline(FILE *f)
 static int
 output(FILE *outfile, struct got_diff_changes *changes,
     struct got_diff_state *ds, struct got_diff_args *args,
-    const char *file1, FILE *f1, const char *file2, FILE *f2, int flags)
+    const char *file1, struct input *f1, const char *file2, struct input *f2,
+    int flags)
 {
 	int m, i0, i1, j0, j1;
 	int error = 0;
 
-	rewind(f1);
-	rewind(f2);
+	f1->pos = 0;
+	f2->pos = 0;
 	m = ds->len[0];
 	ds->J[0] = 0;
 	ds->J[m + 1] = ds->len[1] + 1;
@@ -892,22 +1238,22 @@ output(FILE *outfile, struct got_diff_changes *changes,
 }
 
 static void
-range(FILE *outfile, int a, int b, char *separator)
+range(FILE *outfile, struct got_diff_state *ds, int a, int b, char *separator)
 {
-	diff_output(outfile, "%d", a > b ? b : a);
+	diff_output(outfile, ds, "%d", a > b ? b : a);
 	if (a < b)
-		diff_output(outfile, "%s%d", separator, b);
+		diff_output(outfile, ds, "%s%d", separator, b);
 }
 
 static void
-uni_range(FILE *outfile, int a, int b)
+uni_range(FILE *outfile, struct got_diff_state *ds, int a, int b)
 {
 	if (a < b)
-		diff_output(outfile, "%d,%d", a, b - a + 1);
+		diff_output(outfile, ds, "%d,%d", a, b - a + 1);
 	else if (a == b)
-		diff_output(outfile, "%d", b);
+		diff_output(outfile, ds, "%d", b);
 	else
-		diff_output(outfile, "%d,0", b);
+		diff_output(outfile, ds, "%d,0", b);
 }
 
 /*
@@ -920,14 +1266,16 @@ uni_range(FILE *outfile, int a, int b)
 static int
 change(FILE *outfile, struct got_diff_changes *changes,
     struct got_diff_state *ds, struct got_diff_args *args,
-    const char *file1, FILE *f1, const char *file2, FILE *f2,
+    const char *file1, struct input *f1, const char *file2, struct input *f2,
     int a, int b, int c, int d, int *pflags)
 {
 	if (a > b && c > d)
 		return (0);
 
 	if (*pflags & D_HEADER) {
-		diff_output(outfile, "%s %s %s\n", args->diffargs, file1, file2);
+		output_line(outfile, ds, args, GOT_DIFF_LINE_INFO);
+		diff_output(outfile, ds, "%s %s %s\n", args->diffargs, file1,
+		    file2);
 		*pflags &= ~D_HEADER;
 	}
 	if (args->diff_format == D_UNIFIED) {
@@ -943,9 +1291,11 @@ change(FILE *outfile, struct got_diff_changes *changes,
 			    ds->max_context, sizeof(*ds->context_vec_start));
 			if (cvp == NULL) {
 				free(ds->context_vec_start);
+				ds->context_vec_start = NULL;
 				return (-1);
 			}
 			ds->context_vec_start = cvp;
+			ds->nallocations++;
 			ds->context_vec_end = ds->context_vec_start +
 			    ds->max_context;
 			ds->context_vec_ptr = ds->context_vec_start + offset;
@@ -977,13 +1327,16 @@ change(FILE *outfile, struct got_diff_changes *changes,
 	if (args->diff_format == D_BRIEF)
 		return (0);
 	if (args->diff_format == D_NORMAL) {
-		range(outfile, a, b, ",");
-		diff_output(outfile, "%c", a > b ? 'a' : c > d ? 'd' : 'c');
-		range(outfile, c, d, ",");
-		diff_output(outfile, "\n");
+		output_line(outfile, ds, args, GOT_DIFF_LINE_HUNK);
+		range(outfile, ds, a, b, ",");
+		output_putc(outfile, ds, a > b ? 'a' : c > d ? 'd' : 'c');
+		range(outfile, ds, c, d, ",");
+		output_putc(outfile, ds, '\n');
 		fetch(outfile, ds, args, ds->ixold, a, b, f1, '<', *pflags);
-		if (a <= b && c <= d)
-			diff_output(outfile, "---\n");
+		if (a <= b && c <= d) {
+			output_line(outfile, ds, args, GOT_DIFF_LINE_INFO);
+			output_write(outfile, ds, "---\n", 4);
+		}
 	}
 	fetch(outfile, ds, args, ds->ixnew, c, d, f2,
 	    args->diff_format == D_NORMAL ? '>' : '\0', *pflags);
@@ -992,36 +1345,75 @@ change(FILE *outfile, struct got_diff_changes *changes,
 
 static void
 fetch(FILE *outfile, struct got_diff_state *ds, struct got_diff_args *args,
-    long *f, int a, int b, FILE *lb, int ch, int flags)
+    long *f, int a, int b, struct input *lb, int ch, int flags)
 {
+	const char nonl[] = "\\ No newline at end of file\n";
 	int i, j, c, col, nc;
+	uint8_t type;
+	size_t n;
 
-	if (a > b)
+	if (a > b || outfile == NULL)
 		return;
+
+	switch (ch) {
+	case '-':
+	case '<':
+		type = GOT_DIFF_LINE_MINUS;
+		break;
+	case '+':
+	case '>':
+		type = GOT_DIFF_LINE_PLUS;
+		break;
+	case ' ':
+		type = GOT_DIFF_LINE_CONTEXT;
+		break;
+	default:
+		type = GOT_DIFF_LINE_NONE;
+		break;
+	}
+
 	for (i = a; i <= b; i++) {
-		fseek(lb, f[i - 1], SEEK_SET);
+		lb->pos = f[i - 1];
 		nc = f[i] - f[i - 1];
+		output_line(outfile, ds, args, type);
 		if (ch != '\0') {
-			diff_output(outfile, "%c", ch);
+			output_putc(outfile, ds, ch);
 			if (args->Tflag && (args->diff_format == D_UNIFIED ||
 			    args->diff_format == D_NORMAL))
-				diff_output(outfile, "\t");
+				output_putc(outfile, ds, '\t');
 			else if (args->diff_format != D_UNIFIED)
-				diff_output(outfile, " ");
+				output_putc(outfile, ds, ' ');
+		}
+		if ((flags & D_EXPANDTABS) == 0) {
+			/* The last line lacks a newline if it ends early. */
+			n = MINIMUM(nc, lb->len - lb->pos);
+			output_write(outfile, ds, lb->buf + lb->pos, n);
+			if (n < nc) {
+				output_putc(outfile, ds, '\n');
+				output_line(outfile, ds, args,
+				    GOT_DIFF_LINE_INFO);
+				output_write(outfile, ds, nonl,
+				    sizeof(nonl) - 1);
+				return;
+			}
+			continue;
 		}
 		col = 0;
 		for (j = 0; j < nc; j++) {
-			if ((c = getc(lb)) == EOF) {
-				diff_output(outfile, "\n\\ No newline at end of "
-				    "file\n");
+			if ((c = igetc(lb)) == EOF) {
+				output_putc(outfile, ds, '\n');
+				output_line(outfile, ds, args,
+				    GOT_DIFF_LINE_INFO);
+				output_write(outfile, ds, nonl,
+				    sizeof(nonl) - 1);
 				return;
 			}
-			if (c == '\t' && (flags & D_EXPANDTABS)) {
+			if (c == '\t') {
 				do {
-					diff_output(outfile, " ");
+					output_putc(outfile, ds, ' ');
 				} while (++col & 7);
 			} else {
-				diff_output(outfile, "%c", c);
+				output_putc(outfile, ds, c);
 				col++;
 			}
 		}
@@ -1032,7 +1424,7 @@ fetch(FILE *outfile, struct got_diff_state *ds, struct got_diff_args *args,
  * Hash function taken from Robert Sedgewick, Algorithms in C, 3d ed., p 578.
  */
 static int
-readhash(struct got_diff_state *ds, FILE *f, int flags)
+readhash(struct got_diff_state *ds, struct input *f, int flags)
 {
 	int i, t, space;
 	int sum;
@@ -1041,7 +1433,7 @@ readhash(struct got_diff_state *ds, FILE *f, int flags)
 	space = 0;
 	if ((flags & (D_FOLDBLANKS|D_IGNOREBLANKS)) == 0) {
 		if (flags & D_IGNORECASE)
-			for (i = 0; (t = getc(f)) != '\n'; i++) {
+			for (i = 0; (t = igetc(f)) != '\n'; i++) {
 				if (t == EOF) {
 					if (i == 0)
 						return (0);
@@ -1050,7 +1442,7 @@ readhash(struct got_diff_state *ds, FILE *f, int flags)
 				sum = sum * 127 + ds->chrtran[t];
 			}
 		else
-			for (i = 0; (t = getc(f)) != '\n'; i++) {
+			for (i = 0; (t = igetc(f)) != '\n'; i++) {
 				if (t == EOF) {
 					if (i == 0)
 						return (0);
@@ -1060,7 +1452,7 @@ readhash(struct got_diff_state *ds, FILE *f, int flags)
 			}
 	} else {
 		for (i = 0;;) {
-			switch (t = getc(f)) {
+			switch (t = igetc(f)) {
 			case '\t':
 			case '\r':
 			case '\v':
@@ -1094,23 +1486,28 @@ readhash(struct got_diff_state *ds, FILE *f, int flags)
 }
 
 static int
-asciifile(FILE *f)
+asciifile(struct input *f)
 {
-	unsigned char buf[BUFSIZ];
-	size_t cnt;
-
-	if (f == NULL)
+	if (f->buf == NULL)
 		return (1);
 
-	rewind(f);
-	cnt = fread(buf, 1, sizeof(buf), f);
-	return (memchr(buf, '\0', cnt) == NULL);
+	return (!got_diff_is_binary(f->buf, f->len));
+}
+
+int
+got_diff_is_binary(const uint8_t *buf, size_t len)
+{
+	size_t cnt;
+
+	cnt = MINIMUM(len, BUFSIZ);
+	return (memchr(buf, '\0', cnt) != NULL);
 }
 
 #define begins_with(s, pre) (strncmp(s, pre, sizeof(pre)-1) == 0)
 
 static char *
-match_function(struct got_diff_state *ds, const long *f, int pos, FILE *fp)
+match_function(struct got_diff_state *ds, const long *f, int pos,
+    struct input *fp)
 {
 	unsigned char buf[FUNCTION_CONTEXT_SIZE];
 	size_t nc;
@@ -1119,11 +1516,12 @@ match_function(struct got_diff_state *ds, const long *f, int pos, FILE *fp)
 
 	ds->lastline = pos;
 	while (pos > last) {
-		fseek(fp, f[pos - 1], SEEK_SET);
 		nc = f[pos] - f[pos - 1];
 		if (nc >= sizeof(buf))
 			nc = sizeof(buf) - 1;
-		nc = fread(buf, 1, nc, fp);
+		if (nc > fp->len - f[pos - 1])
+			nc = fp->len - f[pos - 1];
+		memcpy(buf, fp->buf + f[pos - 1], nc);
 		if (nc > 0) {
 			buf[nc] = '\0';
 			buf[strcspn(buf, "\n")] = '\0';
@@ -1156,7 +1554,7 @@ match_function(struct got_diff_state *ds, const long *f, int pos, FILE *fp)
 static void
 dump_unified_vec(FILE *outfile, struct got_diff_changes *changes,
     struct got_diff_state *ds, struct got_diff_args *args,
-    FILE *f1, FILE *f2, int flags)
+    struct input *f1, struct input *f2, int flags)
 {
 	struct context_vec *cvp = ds->context_vec_start;
 	int lowa, upb, lowc, upd;
@@ -1172,17 +1570,18 @@ dump_unified_vec(FILE *outfile, struct got_diff_changes *changes,
 	lowc = MAXIMUM(1, cvp->c - args->diff_context);
 	upd = MINIMUM(ds->len[1], ds->context_vec_ptr->d + args->diff_context);
 
-	diff_output(outfile, "@@ -");
-	uni_range(outfile, lowa, upb);
-	diff_output(outfile, " +");
-	uni_range(outfile, lowc, upd);
-	diff_output(outfile, " @@");
+	output_line(outfile, ds, args, GOT_DIFF_LINE_HUNK);
+	output_write(outfile, ds, "@@ -", 4);
+	uni_range(outfile, ds, lowa, upb);
+	output_write(outfile, ds, " +", 2);
+	uni_range(outfile, ds, lowc, upd);
+	output_write(outfile, ds, " @@", 3);
 	if ((flags & D_PROTOTYPE)) {
 		f = match_function(ds, ds->ixold, lowa-1, f1);
 		if (f != NULL)
-			diff_output(outfile, " %s", f);
+			diff_output(outfile, ds, " %s", f);
 	}
-	diff_output(outfile, "\n");
+	output_putc(outfile, ds, '\n');
 
 	/*
 	 * Output changes in "unified" diff format--the old and new lines
@@ -1240,29 +1639,49 @@ dump_unified_vec(FILE *outfile, struct got_diff_changes *changes,
 
 void
 got_diff_dump_change(FILE *outfile, struct got_diff_change *change,
-    struct got_diff_state *ds, struct got_diff_args *args,
-    FILE *f1, FILE *f2, int diff_flags)
+    struct got_diff_state *ds, struct got_diff_args *args, int diff_flags)
 {
+	struct context_vec *vec_start, *vec_end, *vec_ptr;
+	struct input in1, in2;
+
+	in1.buf = ds->data[0];
+	in1.len = ds->datalen[0];
+	in1.pos = 0;
+	in2.buf = ds->data[1];
+	in2.len = ds->datalen[1];
+	in2.pos = 0;
+
+	vec_start = ds->context_vec_start;
+	vec_end = ds->context_vec_end;
+	vec_ptr = ds->context_vec_ptr;
+
 	ds->context_vec_ptr = &change->cv;
 	ds->context_vec_start = &change->cv;
 	ds->context_vec_end = &change->cv;
 
 	/* XXX TODO needs error checking */
-	dump_unified_vec(outfile, NULL, ds, args, f1, f2, diff_flags);
+	dump_unified_vec(outfile, NULL, ds, args, &in1, &in2, diff_flags);
+	output_flush(outfile, ds);
+
+	ds->context_vec_start = vec_start;
+	ds->context_vec_end = vec_end;
+	ds->context_vec_ptr = vec_ptr;
 }
 
 static void
 print_header(FILE *outfile, struct got_diff_state *ds, struct got_diff_args *args,
     const char *file1, const char *file2)
 {
+	output_line(outfile, ds, args, GOT_DIFF_LINE_LABEL1);
 	if (args->label[0] != NULL)
-		diff_output(outfile, "--- %s\n", args->label[0]);
+		diff_output(outfile, ds, "--- %s\n", args->label[0]);
 	else
-		diff_output(outfile, "--- %s\t%s", file1,
+		diff_output(outfile, ds, "--- %s\t%s", file1,
 		    ctime(&ds->stb1.st_mtime));
+	output_line(outfile, ds, args, GOT_DIFF_LINE_LABEL2);
 	if (args->label[1] != NULL)
-		diff_output(outfile, "+++ %s\n", args->label[1]);
+		diff_output(outfile, ds, "+++ %s\n", args->label[1]);
 	else
-		diff_output(outfile, "+++ %s\t%s", file2,
+		diff_output(outfile, ds, "+++ %s\t%s", file2,
 		    ctime(&ds->stb2.st_mtime));
 }
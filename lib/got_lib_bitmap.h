@@ -0,0 +1,105 @@
+/*
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Reachability bitmaps, as written by git-repack(1) with the -b option.
+ * A .bitmap file accompanies a pack file which contains all objects in the
+ * repository. For a selection of commits it stores the set of objects which
+ * are reachable from the commit, with one bit per object in the pack file.
+ * Bits are numbered in the order in which objects appear in the pack file.
+ */
+
+#define GOT_BITMAP_SUFFIX		".bitmap"
+
+#define GOT_BITMAP_SIGNATURE		0x4249544d /* "BITM" */
+#define GOT_BITMAP_VERSION		1
+
+struct got_bitmap_file_hdr {
+	uint32_t signature;		/* big endian */
+	uint16_t version;		/* big endian */
+	uint16_t options;		/* big endian */
+#define GOT_BITMAP_OPT_FULL_DAG		0x0001
+#define GOT_BITMAP_OPT_HASH_CACHE	0x0004
+#define GOT_BITMAP_OPT_LOOKUP_TABLE	0x0010
+	uint32_t nentries;		/* big endian */
+	uint8_t pack_sha1[SHA1_DIGEST_LENGTH];
+} __attribute__((__packed__));
+
+/*
+ * Each entry in a bitmap file is followed by an EWAH-compressed bitmap.
+ * If xor_offset is non-zero, the entry's bitmap must be XORed with the
+ * bitmap of the entry which appears xor_offset entries earlier in the file.
+ */
+struct got_bitmap_file_entry {
+	uint32_t idx;			/* big endian */
+	uint8_t xor_offset;
+	uint8_t flags;
+} __attribute__((__packed__));
+
+#define GOT_BITMAP_MAX_XOR_OFFSET	160
+
+/* An uncompressed bitmap. */
+struct got_bitmap {
+	uint64_t *words;
+	size_t nwords;
+};
+
+const struct got_error *got_bitmap_alloc(struct got_bitmap **, uint32_t);
+void got_bitmap_free(struct got_bitmap *);
+void got_bitmap_set(struct got_bitmap *, uint32_t);
+int got_bitmap_test(struct got_bitmap *, uint32_t);
+
+/* A commit for which a bitmap file provides a reachability bitmap. */
+struct got_bitmap_entry {
+	uint32_t idx;			/* position in pack index */
+	size_t ewah_offset;		/* offset of EWAH data in file */
+	int has_xor;
+	uint32_t xor_idx;		/* entry to XOR with, if has_xor */
+};
+
+struct got_bitmap_index {
+	char *path;
+	uint8_t *map;
+	size_t len;
+	int mapped;
+
+	/* The pack index of the pack file this bitmap file belongs to. */
+	struct got_packidx *packidx;
+	uint32_t nobjects;
+
+	/* Map pack index positions to bit numbers. */
+	uint32_t *bits;
+
+	/* Entries sorted by pack index position. */
+	struct got_bitmap_entry *entries;
+	int nentries;
+};
+
+const struct got_error *got_bitmap_index_open(struct got_bitmap_index **,
+    const char *, const char *);
+void got_bitmap_index_close(struct got_bitmap_index *);
+
+/* Look up the bit which represents an object. Return 0 if not found. */
+int got_bitmap_index_get_bit(uint32_t *, struct got_bitmap_index *,
+    struct got_object_id *);
+
+/*
+ * Add the objects reachable from the specified commit to a bitmap.
+ * Set the int output argument to zero if the bitmap file provides no
+ * bitmap for this commit.
+ */
+const struct got_error *got_bitmap_index_add_reachable(int *,
+    struct got_bitmap *, struct got_bitmap_index *, struct got_object_id *);
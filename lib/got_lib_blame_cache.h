@@ -0,0 +1,64 @@
+/*
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * The blame cache stores the result of blaming a version of a file.
+ * A result is keyed by the commit which introduced the version of the
+ * file, the file's in-repository path, and the file's blob ID. Such a
+ * result never changes and is valid for every commit which contains
+ * this version of the file, and for every blame which traverses history
+ * past the commit which introduced it.
+ */
+
+#define GOT_BLAME_CACHE_DIR		"got-blame-cache"
+
+#define GOT_BLAME_CACHE_SIGNATURE	0x47424c4d /* "GBLM" */
+#define GOT_BLAME_CACHE_VERSION		1
+
+/*
+ * A cache file begins with this header and the in-repository path of
+ * the file, without a terminating NUL. The path is followed by the IDs
+ * of commits which lines are annotated with, and by one index into this
+ * list of commit IDs per line. Indices are 1, 2, or 4 bytes in size,
+ * whichever is smallest to fit the number of commit IDs.
+ */
+struct got_blame_cache_hdr {
+	uint32_t signature;		/* big endian */
+	uint32_t version;		/* big endian */
+	uint8_t commit_id[SHA1_DIGEST_LENGTH];
+	uint8_t blob_id[SHA1_DIGEST_LENGTH];
+	uint32_t pathlen;		/* big endian */
+	uint32_t nids;			/* big endian */
+	uint32_t nlines;		/* big endian */
+} __attribute__((__packed__));
+
+/*
+ * Look up a cached blame result. If no result is cached for the specified
+ * commit, path, and blob ID, return NULL in the first argument. Otherwise,
+ * return one commit ID per line, which the caller must free(3), and the
+ * number of lines.
+ */
+const struct got_error *got_blame_cache_get(struct got_object_id **, int *,
+    struct got_repository *, struct got_object_id *, const char *,
+    struct got_object_id *);
+
+/*
+ * Store a blame result with one commit ID per line under the specified
+ * commit, path, and blob ID. The cache file is replaced atomically.
+ */
+const struct got_error *got_blame_cache_put(struct got_repository *,
+    struct got_object_id *, const char *, struct got_object_id *,
+    struct got_object_id *, int);
@@ -0,0 +1,170 @@
+/*
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * Git's commit-graph file caches the tree ID, parents, commit time, and
+ * generation number of commits. See Documentation/technical/
+ * commit-graph-format.txt in Git.
+ */
+
+#define GOT_COMMIT_GRAPH_FILE		"objects/info/commit-graph"
+#define GOT_COMMIT_GRAPH_CHAIN_DIR	"objects/info/commit-graphs"
+#define GOT_COMMIT_GRAPH_CHAIN_FILE	"commit-graph-chain"
+#define GOT_COMMIT_GRAPH_LAYER_PREFIX	"graph-"
+#define GOT_COMMIT_GRAPH_LAYER_SUFFIX	".graph"
+
+#define GOT_COMMIT_GRAPH_SIGNATURE	0x43475048 /* "CGPH" */
+#define GOT_COMMIT_GRAPH_VERSION	1
+#define GOT_COMMIT_GRAPH_HASH_SHA1	1
+
+struct got_commit_graph_file_hdr {
+	uint32_t signature;		/* big endian */
+	uint8_t version;
+	uint8_t hash_version;
+	uint8_t nchunks;
+	uint8_t nbase_graphs;
+} __attribute__((__packed__));
+
+struct got_commit_graph_file_chunk {
+	uint32_t id;			/* big endian */
+	uint64_t offset;		/* big endian */
+} __attribute__((__packed__));
+
+#define GOT_COMMIT_GRAPH_CHUNK_OIDF	0x4f494446 /* OID fanout */
+#define GOT_COMMIT_GRAPH_CHUNK_OIDL	0x4f49444c /* OID lookup */
+#define GOT_COMMIT_GRAPH_CHUNK_CDAT	0x43444154 /* commit data */
+#define GOT_COMMIT_GRAPH_CHUNK_EDGE	0x45444745 /* extra edge list */
+#define GOT_COMMIT_GRAPH_CHUNK_BASE	0x42415345 /* base graphs list */
+#define GOT_COMMIT_GRAPH_CHUNK_BIDX	0x42494458 /* Bloom filter index */
+#define GOT_COMMIT_GRAPH_CHUNK_BDAT	0x42444154 /* Bloom filter data */
+
+/* Fixed-size commit data record in the CDAT chunk. */
+struct got_commit_graph_file_cdat {
+	uint8_t tree_id[SHA1_DIGEST_LENGTH];
+	uint32_t parent1;		/* big endian */
+	uint32_t parent2;		/* big endian */
+#define GOT_COMMIT_GRAPH_PARENT_NONE	0x70000000
+#define GOT_COMMIT_GRAPH_PARENT_EDGE	0x80000000 /* in parent2 only */
+#define GOT_COMMIT_GRAPH_EDGE_LAST	0x80000000
+#define GOT_COMMIT_GRAPH_POS_MASK	0x7fffffff
+	/* Upper 30 bits: generation; lower 2 bits: commit time bits 32-33 */
+	uint32_t generation_time;	/* big endian */
+	uint32_t time;			/* big endian */
+} __attribute__((__packed__));
+
+#define GOT_COMMIT_GRAPH_GENERATION_MAX	0x3fffffff
+
+/*
+ * Changed-path Bloom filters. The BIDX chunk contains the end offset of
+ * each commit's filter within the BDAT chunk, counted from the end of the
+ * BDAT header. Each filter contains the paths which changed between the
+ * commit and its first parent, and all leading directories of such paths.
+ */
+struct got_commit_graph_bloom_hdr {
+	uint32_t version;		/* big endian */
+	uint32_t nhashes;		/* big endian */
+	uint32_t bits_per_entry;	/* big endian */
+} __attribute__((__packed__));
+
+#define GOT_COMMIT_GRAPH_BLOOM_VERSION		2
+#define GOT_COMMIT_GRAPH_BLOOM_NHASHES		7
+#define GOT_COMMIT_GRAPH_BLOOM_BITS_PER_ENTRY	10
+
+/* Commits which change more paths get a filter which matches any path. */
+#define GOT_COMMIT_GRAPH_BLOOM_MAX_PATHS	512
+
+struct got_commit_graph_bloom_key {
+	uint32_t hashes[GOT_COMMIT_GRAPH_BLOOM_NHASHES];
+};
+
+/* A single commit-graph file, which may be a layer of a chain. */
+struct got_commit_graph_layer {
+	char *path;
+	uint8_t *map;
+	size_t len;
+	int mapped;	/* map was obtained from mmap(2), not malloc(3) */
+	uint32_t ncommits;
+	uint32_t base_pos; /* global position of first commit in this layer */
+	uint32_t *fanout;			/* big endian */
+	struct got_object_id *oids;
+	size_t oids_len;
+	struct got_commit_graph_file_cdat *cdat;
+	size_t cdat_len;
+	uint32_t *edges;			/* big endian */
+	uint32_t nedges;
+
+	/* Changed-path Bloom filters; NULL if not present or unusable. */
+	uint32_t *bloom_idx;			/* big endian */
+	uint8_t *bloom_data;
+	size_t bloom_len;
+	int bloom_version;
+};
+
+/*
+ * A commit-graph file, or a chain of commit-graph files. Commits are
+ * identified by their global position across all layers of a chain.
+ */
+struct got_commit_graph_file {
+	struct got_commit_graph_layer *layers; /* base layer first */
+	int nlayers;
+	uint32_t ncommits;
+};
+
+/* Commit data obtained from a commit-graph file. */
+struct got_commit_graph_file_commit {
+	uint32_t pos;
+	struct got_object_id *id;
+	struct got_object_id *tree_id;
+	time_t committer_time;
+	uint32_t generation;
+	int nparents;
+
+	/* Use got_commit_graph_file_get_parent() to access parents. */
+	struct got_commit_graph_layer *layer;
+	uint32_t parent1;
+	uint32_t parent2;
+};
+
+const struct got_error *got_commit_graph_file_open(
+    struct got_commit_graph_file **, const char *);
+void got_commit_graph_file_close(struct got_commit_graph_file *);
+int got_commit_graph_file_lookup(uint32_t *, struct got_commit_graph_file *,
+    struct got_object_id *);
+struct got_object_id *got_commit_graph_file_get_id(
+    struct got_commit_graph_file *, uint32_t);
+const struct got_error *got_commit_graph_file_get_commit(
+    struct got_commit_graph_file_commit *, struct got_commit_graph_file *,
+    uint32_t);
+const struct got_error *got_commit_graph_file_get_parent(uint32_t *,
+    struct got_commit_graph_file *, struct got_commit_graph_file_commit *,
+    int);
+
+/*
+ * Check whether a path may have been changed by the commit at the given
+ * position, relative to its first parent, according to the commit's
+ * changed-path Bloom filter. The path is relative to the repository root;
+ * leading slashes are ignored. Return 0 if the path was not changed,
+ * 1 if the path may have been changed, and -1 if no filter is available.
+ */
+int got_commit_graph_file_bloom_check(struct got_commit_graph_file *,
+    uint32_t, const char *);
+
+/* Compute the Bloom filter key of a path. */
+void got_commit_graph_bloom_key(struct got_commit_graph_bloom_key *,
+    const char *, size_t);
+/* Add a key to a Bloom filter of the given size in bytes. */
+void got_commit_graph_bloom_add(uint8_t *, size_t,
+    struct got_commit_graph_bloom_key *);
@@ -58,6 +58,8 @@
 #define D_PROTOTYPE	0x080	/* Display C function prototype */
 #define D_EXPANDTABS	0x100	/* Expand tabs to spaces */
 #define D_IGNOREBLANKS	0x200	/* Ignore white space changes */
+#define D_MYERS		0x400	/* Use Myers' diff algorithm */
+#define D_HISTOGRAM	0x800	/* Use histogram diff algorithm */
 
 /*
  * Status values for got_diffreg() return values
@@ -123,15 +125,66 @@ struct got_diff_state {
 	int lastmatchline;
 	struct stat stb1, stb2;
 	size_t max_context;
+	const uint8_t *data[2];	/* contents of files being compared */
+	size_t datalen[2];
+	uint8_t *data_alloc[2];	/* contents read by got_diffreg() */
+	struct got_diff_line *lines[2]; /* line index of data[0] and data[1] */
+
+	/*
+	 * Arrays above only grow, so that a diff state can be reused for
+	 * diffing many pairs of files. These are their allocated lengths.
+	 */
+	size_t file_nalloc[2];
+	size_t lines_nalloc[2];
+	size_t J_nalloc;
+	size_t klist_nalloc;
+	size_t ixold_nalloc;
+	size_t ixnew_nalloc;
+	int nallocations;	/* number of allocations made, for testing */
+
+	/*
+	 * Output is collected here and written with fwrite(3) once the
+	 * buffer is full, rather than with a stdio call per character.
+	 */
+#define GOT_DIFF_OUTBUF_SIZE	8192
+	char outbuf[GOT_DIFF_OUTBUF_SIZE];
+	size_t outlen;
+	off_t outoff;		/* output offset of outbuf[0] */
+	const struct got_error *outerr; /* error from recording lines */
 };
 
 void got_diff_state_free(struct got_diff_state *);
 
+struct got_diff_session {
+	struct got_diff_state ds;	/* reused for every pair of files */
+};
+
+/* A line found by got_diff_index_lines(). */
+struct got_diff_line {
+	size_t offset;	/* offset of the line within the buffer */
+	size_t len;	/* length of the line, including any newline */
+	uint32_t hash;	/* non-zero hash of the line, without newline */
+};
+
+/*
+ * Find all lines in a buffer and hash them in a single pass. Return an
+ * array of lines, which must be freed by the caller, and the number of
+ * lines in the array. A final line which lacks a newline is counted.
+ * If the array pointer is not NULL, it must point to an array with room
+ * for the given number of lines, which is reused and grown as needed.
+ */
+const struct got_error *got_diff_index_lines(struct got_diff_line **,
+    size_t *, int *, const uint8_t *, size_t);
+
 struct got_diff_args {
 	int	 Tflag;
 	int	 diff_format, diff_context, status;
 	char	 *diffargs;
 	const char *label[2];
+
+	/* If not NULL, output lines are appended here. See got_diff.h. */
+	struct got_diff_output_line **lines;
+	size_t	*nlines;
 };
 
 #define GOT_DIFF_CONFLICT_MARKER_BEGIN	"<<<<<<<"
@@ -139,14 +192,91 @@ struct got_diff_args {
 #define GOT_DIFF_CONFLICT_MARKER_SEP	"======="
 #define GOT_DIFF_CONFLICT_MARKER_END	">>>>>>>"
 
+/*
+ * Compute the match vector J for lines represented by hash values in
+ * a[1..n] and b[1..m], with Myers' algorithm or, if D_HISTOGRAM is set in
+ * flags, with the histogram algorithm. J[i] is set to the index of the
+ * line in b matched with a[i], or to 0 if a[i] has no match.
+ */
+const struct got_error *got_diff_myers(int *, int *, int, int *, int, int);
+
 const struct got_error *got_diffreg(int *, FILE *,
     FILE *, int, struct got_diff_args *, struct got_diff_state *, FILE *,
     struct got_diff_changes *);
 
+/*
+ * Like got_diffreg(), but compare contents held in memory, such as the
+ * data of blob objects. The buffers must remain valid while the diff state
+ * is in use, e.g. by got_diff_dump_change().
+ */
+const struct got_error *got_diffreg_mem(int *, const uint8_t *, size_t,
+    const uint8_t *, size_t, int, struct got_diff_args *,
+    struct got_diff_state *, FILE *, struct got_diff_changes *);
+
+/*
+ * Return non-zero if data which begins with the given buffer should be
+ * treated as binary. Only the first BUFSIZ bytes are inspected.
+ */
+int got_diff_is_binary(const uint8_t *, size_t);
+
+/* Read the entire contents of a file into a newly allocated buffer. */
+const struct got_error *got_diff_read_file(uint8_t **, size_t *, FILE *);
+
+/*
+ * Diff blob contents held in buffers, and write unidiff output with
+ * a header which shows blob IDs and modes, like got_diff_blob() does.
+ * A NULL buffer stands for a blob which does not exist.
+ * Output lines are recorded if an array of lines is passed.
+ */
+const struct got_error *got_diff_blob_data(const uint8_t *, size_t,
+    const char *, const uint8_t *, size_t, const char *, const char *,
+    const char *, mode_t, mode_t, int, int, FILE *,
+    struct got_diff_output_line **, size_t *, struct got_diff_changes *,
+    struct got_diff_session *);
+
+/*
+ * Return the size above which blobs are not diffed, which may be set with
+ * the GOT_DIFF_MAX_BLOB_SIZE environment variable.
+ */
+size_t got_diff_max_blob_size(void);
+
+/* How got_diff_blob_check() decided a pair of blobs should be shown. */
+#define GOT_DIFF_BLOBS_TEXT	0	/* diff the contents */
+#define GOT_DIFF_BLOBS_BINARY	1	/* binary contents; summary only */
+#define GOT_DIFF_BLOBS_LARGE	2	/* exceeds size limit; summary only */
+
+/*
+ * Look at the sizes and the first block of data of a pair of blobs, either
+ * of which may be NULL, to decide whether their contents must be loaded and
+ * diffed. Blob sizes are returned in the size_t output arguments.
+ */
+const struct got_error *got_diff_blob_check(int *, size_t *, size_t *,
+    struct got_blob_object *, struct got_blob_object *);
+
+/*
+ * Write the header shown by got_diff_blob_data() and a one-line summary
+ * instead of a diff, for blobs which got_diff_blob_check() decided not to
+ * diff. A NULL blob ID stands for a blob which does not exist.
+ */
+const struct got_error *got_diff_blob_summary(int, const char *, size_t,
+    const char *, size_t, const char *, const char *, mode_t, mode_t,
+    FILE *, struct got_diff_output_line **, size_t *);
+
+/*
+ * Find the path a file at the specified absolute path in the second tree
+ * was renamed or copied from, if any, in the first tree. Set the output
+ * path to NULL if no such path was found. Otherwise, the caller must free
+ * the path.
+ */
+const struct got_error *got_diff_find_rename_source(char **,
+    struct got_tree_object *, struct got_tree_object *, const char *,
+    struct got_repository *);
+
 const struct got_error *got_diff_blob_lines_changed(struct got_diff_changes **,
     struct got_blob_object *, struct got_blob_object *);
-const struct got_error *got_diff_blob_file_lines_changed(struct got_diff_changes **,
-    struct got_blob_object *, FILE *, size_t);
+const struct got_error *got_diff_blob_mem_lines_changed(
+    struct got_diff_changes **, struct got_blob_object *, const uint8_t *,
+    size_t, struct got_diff_session *);
 void got_diff_free_changes(struct got_diff_changes *);
 
 const struct got_error *got_merge_diff3(int *, int, const char *, const char *,
@@ -157,4 +287,4 @@ const struct got_error *got_diff_files(struct got_diff_changes **,
     const char *, FILE *, size_t, const char *, int, FILE *);
 
 void got_diff_dump_change(FILE *, struct got_diff_change *,
-    struct got_diff_state *, struct got_diff_args *, FILE *, FILE *, int);
+    struct got_diff_state *, struct got_diff_args *, int);
@@ -47,6 +47,19 @@ struct got_commit_object {
 	time_t committer_gmtoff;
 	char *logmsg;
 	int refcnt;		/* > 0 if open and/or cached */
+
+	/* Generation number from the commit-graph file, or 0 if unknown. */
+	uint32_t generation;
+
+	int flags;
+#define GOT_COMMIT_FLAG_COMPACT	0x01	/* see got_object_commit_alloc_compact */
+#define GOT_COMMIT_FLAG_HEADER_ONLY 0x02 /* author, committer, logmsg empty */
+
+	/*
+	 * If author, committer, and logmsg were read after the header of
+	 * this commit, they point into this fully read copy of the commit.
+	 */
+	struct got_commit_object *details;
 };
 
 struct got_tree_entry {
@@ -65,6 +78,7 @@ struct got_tree_object {
 struct got_blob_object {
 	FILE *f;
 	uint8_t *data;
+	size_t size;	/* size of data, including the object header */
 	size_t hdrlen;
 	size_t blocksize;
 	uint8_t *read_buf;
@@ -93,11 +107,45 @@ const struct got_error *got_object_open_by_id_str(struct got_object **,
 void got_object_close(struct got_object *);
 const struct got_error *got_object_commit_open(struct got_commit_object **,
     struct got_repository *, struct got_object *);
+
+/*
+ * Open commits for traversal of commit history. Only the tree ID, parent
+ * IDs, and committer time of such commits are guaranteed to be available.
+ * These are read from Git's commit-graph file if possible.
+ * The author, committer, and log message are read later if the commit
+ * is opened again with got_object_open_as_commit().
+ */
+const struct got_error *got_object_open_commit_header(
+    struct got_commit_object **, struct got_repository *,
+    struct got_object_id *);
+const struct got_error *got_object_open_commit_headers(
+    struct got_commit_object **, struct got_repository *,
+    struct got_object_id **, int);
+const struct got_error *got_object_async_request_commit_header(uint32_t *,
+    struct got_object_async *, struct got_object_id *,
+    got_object_async_commit_cb, void *);
 const struct got_error *got_object_tree_open(struct got_tree_object **,
     struct got_repository *, struct got_object *);
 const struct got_error *got_object_blob_open(struct got_blob_object **,
     struct got_repository *, struct got_object *, size_t);
 char *got_object_blob_id_str(struct got_blob_object*, char *, size_t);
+
+/*
+ * Obtain the contents of a blob, without the object header, in memory.
+ * Blob contents which are not yet held in memory are read from the blob's
+ * temporary file. The contents remain valid until the blob is closed.
+ */
+const struct got_error *got_object_blob_get_data(const uint8_t **, size_t *,
+    struct got_blob_object *);
+
+/*
+ * Obtain the size of a blob's contents and up to one block of data from
+ * the beginning of its contents, without reading the entire blob into
+ * memory. The data may be held in the blob's read buffer, and remains
+ * valid until the buffer is filled again or the blob is closed.
+ */
+const struct got_error *got_object_blob_peek(const uint8_t **, size_t *,
+    size_t *, struct got_blob_object *);
 const struct got_error *got_object_tag_open(struct got_tag_object **,
     struct got_repository *, struct got_object *);
 const struct got_error *got_object_tree_entry_dup(struct got_tree_entry **,
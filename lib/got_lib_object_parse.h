@@ -18,6 +18,8 @@ struct got_pathlist_head;
 
 const struct got_error *got_object_qid_alloc_partial(struct got_object_qid **);
 struct got_commit_object *got_object_commit_alloc_partial(void);
+struct got_commit_object *got_object_commit_alloc_compact(int, size_t, size_t,
+    size_t);
 struct got_tree_entry *got_alloc_tree_entry_partial(void);
 
 const struct got_error *got_object_parse_commit(struct got_commit_object **,
@@ -68,6 +68,14 @@ struct got_privsep_child {
 	struct imsgbuf *ibuf;
 };
 
+/*
+ * Maximum number of requests which may be queued for a child process
+ * before its replies are read. Each queued request carries an open file
+ * descriptor, and requests must never fill up the socket buffer while
+ * the child process is blocked writing replies.
+ */
+#define GOT_PRIVSEP_MAX_QUEUED_REQUESTS	16
+
 enum got_imsg_type {
 	/* An error occured while processing a request. */
 	GOT_IMSG_ERROR,
@@ -88,6 +96,8 @@ enum got_imsg_type {
 	GOT_IMSG_COMMIT_REQUEST,
 	GOT_IMSG_COMMIT,
 	GOT_IMSG_COMMIT_LOGMSG,
+	GOT_IMSG_COMMIT_HEADER_REQUEST,
+	GOT_IMSG_COMMIT_HEADER,
 	GOT_IMSG_TREE_REQUEST,
 	GOT_IMSG_TREE,
 	GOT_IMSG_TREE_ENTRY,
@@ -139,7 +149,11 @@ struct got_imsg_object {
 	int pack_idx;
 }  __attribute__((__packed__));
 
-/* Structure for GOT_IMSG_COMMIT data. */
+/*
+ * Structure for GOT_IMSG_COMMIT and GOT_IMSG_COMMIT_HEADER data.
+ * A GOT_IMSG_COMMIT_HEADER message omits the author, committer, and log
+ * message, and their lengths are zero.
+ */
 struct got_imsg_commit_object {
 	uint8_t tree_id[SHA1_DIGEST_LENGTH];
 	size_t author_len;
@@ -158,8 +172,9 @@ struct got_imsg_commit_object {
 	/* Followed by 'nparents' SHA1_DIGEST_LENGTH length strings */
 
 	/*
-	 * Followed by 'logmsg_len' bytes of commit log message data in
-	 * one or more GOT_IMSG_COMMIT_LOGMSG messages.
+	 * Followed by as much of the 'logmsg_len' bytes of commit log
+	 * message data as fits into this message. The remainder, if any,
+	 * follows in one or more GOT_IMSG_COMMIT_LOGMSG messages.
 	 */
 } __attribute__((__packed__));
 
@@ -262,8 +277,21 @@ void got_privsep_send_error(struct imsgbuf *, const struct got_error *);
 const struct got_error *got_privsep_send_obj_req(struct imsgbuf *, int);
 const struct got_error *got_privsep_send_commit_req(struct imsgbuf *, int,
     struct got_object_id *, int);
+const struct got_error *got_privsep_send_commit_header_req(struct imsgbuf *,
+    int, struct got_object_id *, int);
+const struct got_error *got_privsep_queue_commit_req(struct imsgbuf *, int);
+const struct got_error *got_privsep_queue_commit_header_req(struct imsgbuf *,
+    int);
+const struct got_error *got_privsep_queue_packed_commit_req(struct imsgbuf *,
+    struct got_object_id *, int);
+const struct got_error *got_privsep_queue_packed_commit_header_req(
+    struct imsgbuf *, struct got_object_id *, int);
 const struct got_error *got_privsep_send_tree_req(struct imsgbuf *, int,
     struct got_object_id *, int);
+const struct got_error *got_privsep_queue_tree_req(struct imsgbuf *, int);
+const struct got_error *got_privsep_queue_packed_tree_req(struct imsgbuf *,
+    struct got_object_id *, int);
+const struct got_error *got_privsep_flush_imsg(struct imsgbuf *);
 const struct got_error *got_privsep_send_tag_req(struct imsgbuf *, int,
     struct got_object_id *, int);
 const struct got_error *got_privsep_send_blob_req(struct imsgbuf *, int,
@@ -278,8 +306,14 @@ const struct got_error *got_privsep_recv_obj(struct got_object **,
     struct imsgbuf *);
 const struct got_error *got_privsep_send_commit(struct imsgbuf *,
     struct got_commit_object *);
+const struct got_error *got_privsep_send_commit_header(struct imsgbuf *,
+    struct got_commit_object *);
+const struct got_error *got_privsep_get_imsg_commit(
+    struct got_commit_object **, struct imsg *, struct imsgbuf *);
 const struct got_error *got_privsep_recv_commit(struct got_commit_object **,
     struct imsgbuf *);
+const struct got_error *got_privsep_get_imsg_tree(struct got_tree_object **,
+    struct imsg *, struct imsgbuf *);
 const struct got_error *got_privsep_recv_tree(struct got_tree_object **,
     struct imsgbuf *);
 const struct got_error *got_privsep_send_tree(struct imsgbuf *,
@@ -320,3 +354,60 @@ const struct got_error *got_privsep_recv_gitconfig_remotes(
     struct got_remote_repo **, int *, struct imsgbuf *);
 
 void got_privsep_exec_child(int[2], const char *, const char *);
+
+/*
+ * Associate an imsg buffer with a helper program for IPC statistics, which
+ * are collected if GOT_PRIVSEP_STATS is set in the environment. Only the
+ * process which starts helpers, and thus calls this function, collects them.
+ */
+void got_privsep_stats_register(struct imsgbuf *, const char *);
+
+/* Print IPC statistics to stderr, if they are being collected. */
+void got_privsep_stats_print(void);
+
+/*
+ * Asynchronous requests.
+ *
+ * A request message is sent to a child process as usual, and a reply
+ * callback is then registered with got_privsep_async_add(). Several
+ * requests may be outstanding at a time, possibly involving several
+ * child processes which will process requests concurrently.
+ * got_privsep_async_dispatch() waits for replies and invokes the reply
+ * callback of each request once the first message of its reply has
+ * arrived. The callback receives this message and is expected to parse
+ * the reply with the matching got_privsep_get_imsg_*() function, which
+ * reads any remaining messages of the reply from the imsg buffer.
+ *
+ * A child process replies to requests in the order they were received,
+ * so replies are matched to requests in FIFO order per imsg buffer.
+ * An imsg buffer with outstanding asynchronous requests must not be used
+ * for synchronous requests until all its replies have been dispatched.
+ */
+typedef const struct got_error *(*got_privsep_reply_cb)(void *, uint32_t,
+    struct imsg *, struct imsgbuf *);
+
+struct got_privsep_async_req {
+	TAILQ_ENTRY(got_privsep_async_req) entry;
+	uint32_t id;
+	struct imsgbuf *ibuf;
+	got_privsep_reply_cb reply_cb;
+	void *reply_arg;
+};
+
+TAILQ_HEAD(got_privsep_async_req_list, got_privsep_async_req);
+
+struct got_privsep_async {
+	struct got_privsep_async_req_list reqs; /* in order of submission */
+	int nreqs;
+	uint32_t next_id;
+};
+
+void got_privsep_async_init(struct got_privsep_async *);
+const struct got_error *got_privsep_async_add(uint32_t *,
+    struct got_privsep_async *, struct imsgbuf *, got_privsep_reply_cb,
+    void *);
+int got_privsep_async_nreqs(struct got_privsep_async *, struct imsgbuf *);
+const struct got_error *got_privsep_async_dispatch(int *,
+    struct got_privsep_async *, int);
+const struct got_error *got_privsep_async_wait(struct got_privsep_async *);
+void got_privsep_async_free(struct got_privsep_async *);
@@ -17,6 +17,12 @@
 #define GOT_PACKIDX_CACHE_SIZE	16
 #define GOT_PACK_CACHE_SIZE	GOT_PACKIDX_CACHE_SIZE
 
+/* Number of child processes per type of loose object. */
+#define GOT_REPO_PRIVSEP_POOL_SIZE	4
+
+struct got_commit_graph_file;
+struct got_bitmap_index;
+
 struct got_repository {
 	char *path;
 	char *path_git_dir;
@@ -27,8 +33,12 @@ struct got_repository {
 	/* Open file handles for pack files. */
 	struct got_pack packs[GOT_PACK_CACHE_SIZE];
 
-	/* Handles to child processes for reading loose objects. */
-	 struct got_privsep_child privsep_children[5];
+	/*
+	 * Handles to child processes for reading loose objects.
+	 * Batched requests are spread across a pool of children per type.
+	 */
+	struct got_privsep_child
+	    privsep_children[5][GOT_REPO_PRIVSEP_POOL_SIZE];
 #define GOT_REPO_PRIVSEP_CHILD_OBJECT	0
 #define GOT_REPO_PRIVSEP_CHILD_COMMIT	1
 #define GOT_REPO_PRIVSEP_CHILD_TREE	2
@@ -41,6 +51,14 @@ struct got_repository {
 	struct got_object_cache commitcache;
 	struct got_object_cache tagcache;
 
+	/* Git's commit-graph file, opened on first use; may be NULL. */
+	struct got_commit_graph_file *commit_graph_file;
+	int commit_graph_file_checked;
+
+	/* Reachability bitmaps, opened on first use; may be NULL. */
+	struct got_bitmap_index *bitmap_index;
+	int bitmap_index_checked;
+
 	/* Settings read from Git configuration files. */
 	int gitconfig_repository_format_version;
 	char *gitconfig_author_name;
@@ -71,5 +89,8 @@ const struct got_error *got_repo_cache_packidx(struct got_repository *,
     struct got_packidx *);
 const struct got_error *got_repo_search_packidx(struct got_packidx **, int *,
     struct got_repository *, struct got_object_id *);
+struct got_commit_graph_file *got_repo_get_commit_graph_file(
+    struct got_repository *);
+struct got_bitmap_index *got_repo_get_bitmap_index(struct got_repository *);
 const struct got_error *got_repo_cache_pack(struct got_pack **,
     struct got_repository *, const char *, struct got_packidx *);
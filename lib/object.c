@@ -35,6 +35,7 @@
 #include <limits.h>
 #include <imsg.h>
 #include <time.h>
+#include <unistd.h>
 
 #include "got_error.h"
 #include "got_object.h"
@@ -51,12 +52,21 @@
 #include "got_lib_object_cache.h"
 #include "got_lib_object_parse.h"
 #include "got_lib_pack.h"
+#include "got_lib_commit_graph_file.h"
 #include "got_lib_repository.h"
 
 #ifndef MIN
 #define	MIN(_a,_b) ((_a) < (_b) ? (_a) : (_b))
 #endif
 
+#ifndef nitems
+#define nitems(_a)	(sizeof((_a)) / sizeof((_a)[0]))
+#endif
+
+/* Maximum number of loose objects requested from child processes at once. */
+#define GOT_OBJECT_BATCH_SIZE \
+	(GOT_REPO_PRIVSEP_POOL_SIZE * GOT_PRIVSEP_MAX_QUEUED_REQUESTS)
+
 struct got_object_id *
 got_object_id_dup(struct got_object_id *id1)
 {
@@ -213,6 +223,128 @@ set_max_datasize(void)
 	setrlimit(RLIMIT_DATA, &rl);
 }
 
+static const struct got_error *
+start_child(struct got_privsep_child *child, int type,
+    struct got_repository *repo)
+{
+	const struct got_error *err = NULL;
+	int imsg_fds[2];
+	pid_t pid;
+	struct imsgbuf *ibuf;
+	const char *prog_path;
+
+	switch (type) {
+	case GOT_REPO_PRIVSEP_CHILD_OBJECT:
+		prog_path = GOT_PATH_PROG_READ_OBJECT;
+		break;
+	case GOT_REPO_PRIVSEP_CHILD_COMMIT:
+		prog_path = GOT_PATH_PROG_READ_COMMIT;
+		break;
+	case GOT_REPO_PRIVSEP_CHILD_TREE:
+		prog_path = GOT_PATH_PROG_READ_TREE;
+		break;
+	case GOT_REPO_PRIVSEP_CHILD_BLOB:
+		prog_path = GOT_PATH_PROG_READ_BLOB;
+		break;
+	case GOT_REPO_PRIVSEP_CHILD_TAG:
+		prog_path = GOT_PATH_PROG_READ_TAG;
+		break;
+	default:
+		return got_error(GOT_ERR_OBJ_TYPE);
+	}
+
+	ibuf = calloc(1, sizeof(*ibuf));
+	if (ibuf == NULL)
+		return got_error_from_errno("calloc");
+
+	if (socketpair(AF_UNIX, SOCK_STREAM, PF_UNSPEC, imsg_fds) == -1) {
+		err = got_error_from_errno("socketpair");
+		free(ibuf);
+		return err;
+	}
+
+	pid = fork();
+	if (pid == -1) {
+		err = got_error_from_errno("fork");
+		free(ibuf);
+		return err;
+	}
+	else if (pid == 0) {
+		got_privsep_exec_child(imsg_fds, prog_path, repo->path);
+		/* not reached */
+	}
+
+	if (close(imsg_fds[1]) != 0) {
+		err = got_error_from_errno("close");
+		free(ibuf);
+		return err;
+	}
+
+	child->imsg_fd = imsg_fds[0];
+	child->pid = pid;
+	imsg_init(ibuf, imsg_fds[0]);
+	got_privsep_stats_register(ibuf, prog_path);
+	child->ibuf = ibuf;
+
+	return NULL;
+}
+
+/*
+ * Return the imsg buffer of a child process for reading loose objects,
+ * starting the child process if it is not running yet. Slot zero is used
+ * for single requests. Other slots are only used for batched requests.
+ */
+static const struct got_error *
+get_child_ibuf(struct imsgbuf **ibuf, struct got_repository *repo, int type,
+    int slot)
+{
+	const struct got_error *err;
+
+	*ibuf = NULL;
+
+	if (slot < 0 || slot >= GOT_REPO_PRIVSEP_POOL_SIZE)
+		return got_error(GOT_ERR_RANGE);
+
+	if (repo->privsep_children[type][slot].imsg_fd == -1) {
+		err = start_child(&repo->privsep_children[type][slot], type,
+		    repo);
+		if (err)
+			return err;
+	}
+
+	*ibuf = repo->privsep_children[type][slot].ibuf;
+	return NULL;
+}
+
+/*
+ * Stop a child process whose replies can no longer be matched to requests
+ * because not all requests could be sent. Closing the imsg socket first
+ * ensures the child exits even if it is blocked writing replies.
+ * The child will be started again when it is needed.
+ */
+static const struct got_error *
+stop_pool_child(struct got_repository *repo, int type, int slot)
+{
+	const struct got_error *err = NULL, *child_err;
+	struct got_privsep_child *child;
+
+	child = &repo->privsep_children[type][slot];
+	if (child->imsg_fd == -1)
+		return NULL;
+
+	imsg_clear(child->ibuf);
+	free(child->ibuf);
+	child->ibuf = NULL;
+	if (close(child->imsg_fd) != 0)
+		err = got_error_from_errno("close");
+	child->imsg_fd = -1;
+	child_err = got_privsep_wait_for_child(child->pid);
+	if (child_err && err == NULL)
+		err = child_err;
+	child->pid = 0;
+	return err;
+}
+
 static const struct got_error *
 start_pack_privsep_child(struct got_pack *pack, struct got_packidx *packidx)
 {
@@ -253,6 +385,7 @@ start_pack_privsep_child(struct got_pack *pack, struct got_packidx *packidx)
 	pack->privsep_child->imsg_fd = imsg_fds[0];
 	pack->privsep_child->pid = pid;
 	imsg_init(ibuf, imsg_fds[0]);
+	got_privsep_stats_register(ibuf, GOT_PATH_PROG_READ_PACK);
 	pack->privsep_child->ibuf = ibuf;
 
 	err = got_privsep_init_pack_child(ibuf, pack, packidx);
@@ -327,12 +460,9 @@ done:
 }
 
 static const struct got_error *
-request_object(struct got_object **obj, struct got_repository *repo, int fd)
+request_object(struct got_object **obj, struct imsgbuf *ibuf, int fd)
 {
 	const struct got_error *err = NULL;
-	struct imsgbuf *ibuf;
-
-	ibuf = repo->privsep_children[GOT_REPO_PRIVSEP_CHILD_OBJECT].ibuf;
 
 	err = got_privsep_send_obj_req(ibuf, fd);
 	if (err)
@@ -346,47 +476,13 @@ read_object_header_privsep(struct got_object **obj, struct got_repository *repo,
     int obj_fd)
 {
 	const struct got_error *err;
-	int imsg_fds[2];
-	pid_t pid;
 	struct imsgbuf *ibuf;
 
-	if (repo->privsep_children[GOT_REPO_PRIVSEP_CHILD_OBJECT].imsg_fd != -1)
-		return request_object(obj, repo, obj_fd);
-
-	ibuf = calloc(1, sizeof(*ibuf));
-	if (ibuf == NULL)
-		return got_error_from_errno("calloc");
-
-	if (socketpair(AF_UNIX, SOCK_STREAM, PF_UNSPEC, imsg_fds) == -1) {
-		err = got_error_from_errno("socketpair");
-		free(ibuf);
-		return err;
-	}
-
-	pid = fork();
-	if (pid == -1) {
-		err = got_error_from_errno("fork");
-		free(ibuf);
-		return err;
-	}
-	else if (pid == 0) {
-		got_privsep_exec_child(imsg_fds, GOT_PATH_PROG_READ_OBJECT,
-		    repo->path);
-		/* not reached */
-	}
-
-	if (close(imsg_fds[1]) != 0) {
-		err = got_error_from_errno("close");
-		free(ibuf);
+	err = get_child_ibuf(&ibuf, repo, GOT_REPO_PRIVSEP_CHILD_OBJECT, 0);
+	if (err)
 		return err;
-	}
-	repo->privsep_children[GOT_REPO_PRIVSEP_CHILD_OBJECT].imsg_fd =
-	    imsg_fds[0];
-	repo->privsep_children[GOT_REPO_PRIVSEP_CHILD_OBJECT].pid = pid;
-	imsg_init(ibuf, imsg_fds[0]);
-	repo->privsep_children[GOT_REPO_PRIVSEP_CHILD_OBJECT].ibuf = ibuf;
 
-	return request_object(obj, repo, obj_fd);
+	return request_object(obj, ibuf, obj_fd);
 }
 
 
@@ -471,12 +567,16 @@ got_object_resolve_id_str(struct got_object_id **id,
 
 static const struct got_error *
 request_packed_commit(struct got_commit_object **commit, struct got_pack *pack,
-    int pack_idx, struct got_object_id *id)
+    int pack_idx, struct got_object_id *id, int header_only)
 {
 	const struct got_error *err = NULL;
 
-	err = got_privsep_send_commit_req(pack->privsep_child->ibuf, -1, id,
-	    pack_idx);
+	if (header_only)
+		err = got_privsep_send_commit_header_req(
+		    pack->privsep_child->ibuf, -1, id, pack_idx);
+	else
+		err = got_privsep_send_commit_req(pack->privsep_child->ibuf,
+		    -1, id, pack_idx);
 	if (err)
 		return err;
 
@@ -486,30 +586,31 @@ request_packed_commit(struct got_commit_object **commit, struct got_pack *pack,
 static const struct got_error *
 read_packed_commit_privsep(struct got_commit_object **commit,
     struct got_pack *pack, struct got_packidx *packidx, int idx,
-    struct got_object_id *id)
+    struct got_object_id *id, int header_only)
 {
 	const struct got_error *err = NULL;
 
 	if (pack->privsep_child)
-		return request_packed_commit(commit, pack, idx, id);
+		return request_packed_commit(commit, pack, idx, id,
+		    header_only);
 
 	err = start_pack_privsep_child(pack, packidx);
 	if (err)
 		return err;
 
-	return request_packed_commit(commit, pack, idx, id);
+	return request_packed_commit(commit, pack, idx, id, header_only);
 }
 
 static const struct got_error *
-request_commit(struct got_commit_object **commit, struct got_repository *repo,
-    int fd)
+request_commit(struct got_commit_object **commit, struct imsgbuf *ibuf,
+    int fd, int header_only)
 {
 	const struct got_error *err = NULL;
-	struct imsgbuf *ibuf;
 
-	ibuf = repo->privsep_children[GOT_REPO_PRIVSEP_CHILD_COMMIT].ibuf;
-
-	err = got_privsep_send_commit_req(ibuf, fd, NULL, -1);
+	if (header_only)
+		err = got_privsep_send_commit_header_req(ibuf, fd, NULL, -1);
+	else
+		err = got_privsep_send_commit_req(ibuf, fd, NULL, -1);
 	if (err)
 		return err;
 
@@ -518,56 +619,127 @@ request_commit(struct got_commit_object **commit, struct got_repository *repo,
 
 static const struct got_error *
 read_commit_privsep(struct got_commit_object **commit, int obj_fd,
-    struct got_repository *repo)
+    struct got_repository *repo, int header_only)
 {
 	const struct got_error *err;
-	int imsg_fds[2];
-	pid_t pid;
 	struct imsgbuf *ibuf;
 
-	if (repo->privsep_children[GOT_REPO_PRIVSEP_CHILD_COMMIT].imsg_fd != -1)
-		return request_commit(commit, repo, obj_fd);
+	err = get_child_ibuf(&ibuf, repo, GOT_REPO_PRIVSEP_CHILD_COMMIT, 0);
+	if (err)
+		return err;
 
-	ibuf = calloc(1, sizeof(*ibuf));
-	if (ibuf == NULL)
-		return got_error_from_errno("calloc");
+	return request_commit(commit, ibuf, obj_fd, header_only);
+}
 
-	if (socketpair(AF_UNIX, SOCK_STREAM, PF_UNSPEC, imsg_fds) == -1) {
-		err = got_error_from_errno("socketpair");
-		free(ibuf);
-		return err;
-	}
+/*
+ * Create a header-only commit from Git's commit-graph file, without any
+ * help from a child process. Return NULL if the commit-graph file does not
+ * cover the commit.
+ */
+static const struct got_error *
+read_commit_graph_header(struct got_commit_object **commit,
+    struct got_repository *repo, struct got_object_id *id)
+{
+	const struct got_error *err;
+	struct got_commit_graph_file *cgf;
+	struct got_commit_graph_file_commit c;
+	struct got_object_qid *qid;
+	struct got_object_id *pid;
+	uint32_t pos, ppos;
+	int i = 0;
 
-	pid = fork();
-	if (pid == -1) {
-		err = got_error_from_errno("fork");
-		free(ibuf);
+	*commit = NULL;
+
+	cgf = got_repo_get_commit_graph_file(repo);
+	if (cgf == NULL || !got_commit_graph_file_lookup(&pos, cgf, id))
+		return NULL;
+
+	err = got_commit_graph_file_get_commit(&c, cgf, pos);
+	if (err)
 		return err;
+
+	*commit = got_object_commit_alloc_compact(c.nparents, 0, 0, 0);
+	if (*commit == NULL)
+		return got_error_from_errno("got_object_commit_alloc_compact");
+
+	memcpy((*commit)->tree_id, c.tree_id, sizeof(*(*commit)->tree_id));
+	(*commit)->committer_time = c.committer_time;
+	(*commit)->generation = c.generation;
+	(*commit)->flags |= GOT_COMMIT_FLAG_HEADER_ONLY;
+
+	SIMPLEQ_FOREACH(qid, &(*commit)->parent_ids, entry) {
+		err = got_commit_graph_file_get_parent(&ppos, cgf, &c, i++);
+		if (err)
+			break;
+		pid = got_commit_graph_file_get_id(cgf, ppos);
+		if (pid == NULL) {
+			err = got_error(GOT_ERR_BAD_COMMIT_GRAPH);
+			break;
+		}
+		memcpy(qid->id, pid, sizeof(*qid->id));
 	}
-	else if (pid == 0) {
-		got_privsep_exec_child(imsg_fds, GOT_PATH_PROG_READ_COMMIT,
-		    repo->path);
-		/* not reached */
+	if (err) {
+		got_object_commit_close(*commit);
+		*commit = NULL;
 	}
+	return err;
+}
 
-	if (close(imsg_fds[1]) != 0) {
-		err = got_error_from_errno("close");
-		free(ibuf);
-		return err;
-	}
-	repo->privsep_children[GOT_REPO_PRIVSEP_CHILD_COMMIT].imsg_fd =
-	    imsg_fds[0];
-	repo->privsep_children[GOT_REPO_PRIVSEP_CHILD_COMMIT].pid = pid;
-	imsg_init(ibuf, imsg_fds[0]);
-	repo->privsep_children[GOT_REPO_PRIVSEP_CHILD_COMMIT].ibuf = ibuf;
+/*
+ * Return a cached commit, unless the cached commit lacks details which
+ * the caller needs.
+ */
+static struct got_commit_object *
+get_cached_commit(struct got_repository *repo, struct got_object_id *id,
+    int header_only)
+{
+	struct got_commit_object *commit;
 
-	return request_commit(commit, repo, obj_fd);
+	commit = got_repo_get_cached_commit(repo, id);
+	if (commit == NULL)
+		return NULL;
+	if (!header_only && (commit->flags & GOT_COMMIT_FLAG_HEADER_ONLY))
+		return NULL;
+	return commit;
 }
 
+/*
+ * Add a newly read commit to the cache and take a reference for the caller.
+ * If only the header of this commit was cached so far, the new commit's
+ * details and timestamps are attached to the cached commit, which replaces
+ * the new one.
+ */
+static const struct got_error *
+cache_commit(struct got_commit_object **commit, struct got_repository *repo,
+    struct got_object_id *id)
+{
+	struct got_commit_object *cached;
+
+	cached = got_repo_get_cached_commit(repo, id);
+	if (cached && (cached->flags & GOT_COMMIT_FLAG_HEADER_ONLY) &&
+	    ((*commit)->flags & GOT_COMMIT_FLAG_HEADER_ONLY) == 0) {
+		cached->author = (*commit)->author;
+		cached->author_time = (*commit)->author_time;
+		cached->author_gmtoff = (*commit)->author_gmtoff;
+		cached->committer = (*commit)->committer;
+		cached->committer_time = (*commit)->committer_time;
+		cached->committer_gmtoff = (*commit)->committer_gmtoff;
+		cached->logmsg = (*commit)->logmsg;
+		cached->details = *commit;
+		cached->flags &= ~GOT_COMMIT_FLAG_HEADER_ONLY;
+		cached->refcnt++;
+		*commit = cached;
+		return NULL;
+	}
+
+	(*commit)->refcnt++;
+	return got_repo_cache_commit(repo, id, *commit);
+}
 
 static const struct got_error *
 open_commit(struct got_commit_object **commit,
-    struct got_repository *repo, struct got_object_id *id, int check_cache)
+    struct got_repository *repo, struct got_object_id *id, int check_cache,
+    int header_only)
 {
 	const struct got_error *err = NULL;
 	struct got_packidx *packidx = NULL;
@@ -575,7 +747,7 @@ open_commit(struct got_commit_object **commit,
 	char *path_packfile = NULL;
 
 	if (check_cache) {
-		*commit = got_repo_get_cached_commit(repo, id);
+		*commit = get_cached_commit(repo, id, header_only);
 		if (*commit != NULL) {
 			(*commit)->refcnt++;
 			return NULL;
@@ -583,6 +755,14 @@ open_commit(struct got_commit_object **commit,
 	} else
 		*commit = NULL;
 
+	if (header_only) {
+		err = read_commit_graph_header(commit, repo, id);
+		if (err)
+			return err;
+		if (*commit)
+			return cache_commit(commit, repo, id);
+	}
+
 	err = got_repo_search_packidx(&packidx, &idx, repo, id);
 	if (err == NULL) {
 		struct got_pack *pack = NULL;
@@ -599,20 +779,18 @@ open_commit(struct got_commit_object **commit,
 				goto done;
 		}
 		err = read_packed_commit_privsep(commit, pack,
-		    packidx, idx, id);
+		    packidx, idx, id, header_only);
 	} else if (err->code == GOT_ERR_NO_OBJ) {
 		int fd;
 
 		err = open_loose_object(&fd, id, repo);
 		if (err)
 			return err;
-		err = read_commit_privsep(commit, fd, repo);
+		err = read_commit_privsep(commit, fd, repo, header_only);
 	}
 
-	if (err == NULL) {
-		(*commit)->refcnt++;
-		err = got_repo_cache_commit(repo, id, *commit);
-	}
+	if (err == NULL)
+		err = cache_commit(commit, repo, id);
 done:
 	free(path_packfile);
 	return err;
@@ -622,20 +800,322 @@ const struct got_error *
 got_object_open_as_commit(struct got_commit_object **commit,
     struct got_repository *repo, struct got_object_id *id)
 {
-	*commit = got_repo_get_cached_commit(repo, id);
+	*commit = get_cached_commit(repo, id, 0);
 	if (*commit != NULL) {
 		(*commit)->refcnt++;
 		return NULL;
 	}
 
-	return open_commit(commit, repo, id, 0);
+	return open_commit(commit, repo, id, 0, 0);
+}
+
+const struct got_error *
+got_object_open_commit_header(struct got_commit_object **commit,
+    struct got_repository *repo, struct got_object_id *id)
+{
+	return open_commit(commit, repo, id, 1, 1);
 }
 
 const struct got_error *
 got_object_commit_open(struct got_commit_object **commit,
     struct got_repository *repo, struct got_object *obj)
 {
-	return open_commit(commit, repo, got_object_get_id(obj), 1);
+	return open_commit(commit, repo, got_object_get_id(obj), 1, 0);
+}
+
+/*
+ * Packed objects are read by one got-read-pack child process per pack file.
+ * Requests for packed objects are queued and sent in one go, like requests
+ * for loose objects. This lets child processes for different pack files
+ * work concurrently, and avoids a round trip per packed object.
+ */
+struct got_packed_object_req {
+	struct got_pack *pack;
+	int pack_idx;
+	int idx;		/* position in caller's array of IDs */
+};
+
+/*
+ * Look up the pack file which contains an object. Return GOT_ERR_NO_OBJ
+ * if the object is not packed. Set the pack to NULL if no got-read-pack
+ * child process is running for this pack file yet.
+ */
+static const struct got_error *
+find_running_pack(struct got_pack **pack, int *pack_idx,
+    struct got_repository *repo, struct got_object_id *id)
+{
+	const struct got_error *err;
+	struct got_packidx *packidx;
+	char *path_packfile;
+
+	*pack = NULL;
+
+	err = got_repo_search_packidx(&packidx, pack_idx, repo, id);
+	if (err)
+		return err;
+
+	err = get_packfile_path(&path_packfile, packidx);
+	if (err)
+		return err;
+
+	*pack = got_repo_get_cached_pack(repo, path_packfile);
+	if (*pack && (*pack)->privsep_child == NULL)
+		*pack = NULL;
+	free(path_packfile);
+	return NULL;
+}
+
+static const struct got_error *
+send_packed_commit_reqs(int *nqueued, struct got_packed_object_req *reqs,
+    int nreqs, struct got_object_id **ids, int header_only)
+{
+	const struct got_error *err = NULL, *flush_err;
+	struct imsgbuf *ibuf;
+	int i;
+
+	*nqueued = 0;
+
+	for (i = 0; i < nreqs; i++) {
+		ibuf = reqs[i].pack->privsep_child->ibuf;
+		if (header_only)
+			err = got_privsep_queue_packed_commit_header_req(ibuf,
+			    ids[reqs[i].idx], reqs[i].pack_idx);
+		else
+			err = got_privsep_queue_packed_commit_req(ibuf,
+			    ids[reqs[i].idx], reqs[i].pack_idx);
+		if (err)
+			break;
+		(*nqueued)++;
+	}
+	for (i = 0; i < nreqs; i++) {
+		flush_err = got_privsep_flush_imsg(
+		    reqs[i].pack->privsep_child->ibuf);
+		if (flush_err && err == NULL)
+			err = flush_err;
+	}
+	return err;
+}
+
+static const struct got_error *
+recv_packed_commits(struct got_commit_object **commits,
+    struct got_packed_object_req *reqs, int nqueued)
+{
+	const struct got_error *err = NULL, *recv_err;
+	int i;
+
+	/* Each child replies to its requests in the order they were sent. */
+	for (i = 0; i < nqueued; i++) {
+		recv_err = got_privsep_recv_commit(&commits[i],
+		    reqs[i].pack->privsep_child->ibuf);
+		if (recv_err && err == NULL)
+			err = recv_err;
+	}
+	return err;
+}
+
+static const struct got_error *
+request_commits(struct got_commit_object **commits, int *fds, int nfds,
+    struct got_repository *repo, int header_only)
+{
+	const struct got_error *err = NULL, *flush_err, *recv_err, *child_err;
+	struct imsgbuf *ibufs[GOT_REPO_PRIVSEP_POOL_SIZE];
+	int unsent[GOT_REPO_PRIVSEP_POOL_SIZE];
+	int i, nchildren, nqueued = 0;
+
+	nchildren = MIN(nfds, GOT_REPO_PRIVSEP_POOL_SIZE);
+	for (i = 0; i < nchildren; i++) {
+		err = get_child_ibuf(&ibufs[i], repo,
+		    GOT_REPO_PRIVSEP_CHILD_COMMIT, i);
+		if (err)
+			goto done;
+	}
+
+	/* Queue requests across the pool, then send them in one go. */
+	for (i = 0; i < nfds; i++) {
+		if (header_only)
+			err = got_privsep_queue_commit_header_req(
+			    ibufs[i % nchildren], fds[i]);
+		else
+			err = got_privsep_queue_commit_req(
+			    ibufs[i % nchildren], fds[i]);
+		fds[i] = -1; /* closed by imsg */
+		if (err)
+			break;
+		nqueued++;
+	}
+	for (i = 0; i < nchildren; i++) {
+		flush_err = got_privsep_flush_imsg(ibufs[i]);
+		unsent[i] = (flush_err != NULL);
+		if (flush_err && err == NULL)
+			err = flush_err;
+	}
+
+	/* Each child replies to its requests in the order they were sent. */
+	for (i = 0; i < nqueued; i++) {
+		if (unsent[i % nchildren])
+			continue;
+		recv_err = got_privsep_recv_commit(&commits[i],
+		    ibufs[i % nchildren]);
+		if (recv_err && err == NULL)
+			err = recv_err;
+	}
+	for (i = 0; i < nchildren; i++) {
+		if (!unsent[i])
+			continue;
+		child_err = stop_pool_child(repo,
+		    GOT_REPO_PRIVSEP_CHILD_COMMIT, i);
+		if (child_err && err == NULL)
+			err = child_err;
+	}
+done:
+	for (i = 0; i < nfds; i++) {
+		if (fds[i] != -1 && close(fds[i]) != 0 && err == NULL)
+			err = got_error_from_errno("close");
+	}
+	return err;
+}
+
+static const struct got_error *
+open_commits(struct got_commit_object **commits, struct got_repository *repo,
+    struct got_object_id **ids, int nids, int header_only)
+{
+	const struct got_error *err = NULL, *recv_err;
+	struct got_commit_object *batch[GOT_OBJECT_BATCH_SIZE];
+	struct got_commit_object *packed[GOT_PRIVSEP_MAX_QUEUED_REQUESTS];
+	struct got_packed_object_req reqs[GOT_PRIVSEP_MAX_QUEUED_REQUESTS];
+	int fds[GOT_OBJECT_BATCH_SIZE], batch_idx[GOT_OBJECT_BATCH_SIZE];
+	int i = 0, j, nfds = 0, nreqs, nqueued;
+
+	memset(commits, 0, nids * sizeof(commits[0]));
+
+	while (i < nids) {
+		nfds = 0;
+		nreqs = 0;
+		for (; i < nids && nfds < nitems(fds) &&
+		    nreqs < nitems(reqs); i++) {
+			struct got_pack *pack;
+			int idx;
+
+			commits[i] = get_cached_commit(repo, ids[i],
+			    header_only);
+			if (commits[i] != NULL) {
+				commits[i]->refcnt++;
+				continue;
+			}
+
+			if (header_only) {
+				err = read_commit_graph_header(&commits[i],
+				    repo, ids[i]);
+				if (err)
+					goto done;
+				if (commits[i]) {
+					err = cache_commit(&commits[i], repo,
+					    ids[i]);
+					if (err)
+						goto done;
+					continue;
+				}
+			}
+
+			err = find_running_pack(&pack, &idx, repo, ids[i]);
+			if (err == NULL) {
+				if (pack) {
+					reqs[nreqs].pack = pack;
+					reqs[nreqs].pack_idx = idx;
+					reqs[nreqs].idx = i;
+					nreqs++;
+					continue;
+				}
+				/*
+				 * Starting a child process for another pack
+				 * file may evict a pack file with queued
+				 * requests from the pack cache.
+				 */
+				if (nreqs > 0)
+					break;
+				err = open_commit(&commits[i], repo, ids[i], 0,
+				    header_only);
+				if (err)
+					goto done;
+				continue;
+			}
+			if (err->code != GOT_ERR_NO_OBJ)
+				goto done;
+
+			err = open_loose_object(&fds[nfds], ids[i], repo);
+			if (err)
+				goto done;
+			batch_idx[nfds++] = i;
+		}
+
+		/* Packed and loose commits are read concurrently. */
+		memset(packed, 0, sizeof(packed));
+		err = send_packed_commit_reqs(&nqueued, reqs, nreqs, ids,
+		    header_only);
+		memset(batch, 0, sizeof(batch));
+		if (err == NULL)
+			err = request_commits(batch, fds, nfds, repo,
+			    header_only);
+		else {
+			for (j = 0; j < nfds; j++)
+				close(fds[j]);
+		}
+		recv_err = recv_packed_commits(packed, reqs, nqueued);
+		if (recv_err && err == NULL)
+			err = recv_err;
+
+		for (j = 0; j < nqueued; j++) {
+			const struct got_error *cache_err;
+
+			if (packed[j] == NULL)
+				continue;
+			commits[reqs[j].idx] = packed[j];
+			cache_err = cache_commit(&commits[reqs[j].idx], repo,
+			    ids[reqs[j].idx]);
+			if (cache_err && err == NULL)
+				err = cache_err;
+		}
+		for (j = 0; j < nfds; j++) {
+			const struct got_error *cache_err;
+
+			if (batch[j] == NULL)
+				continue;
+			commits[batch_idx[j]] = batch[j];
+			cache_err = cache_commit(&commits[batch_idx[j]], repo,
+			    ids[batch_idx[j]]);
+			if (cache_err && err == NULL)
+				err = cache_err;
+		}
+		nfds = 0;
+		if (err)
+			goto done;
+	}
+done:
+	for (j = 0; j < nfds; j++)
+		close(fds[j]);
+	if (err) {
+		for (j = 0; j < nids; j++) {
+			if (commits[j] == NULL)
+				continue;
+			got_object_commit_close(commits[j]);
+			commits[j] = NULL;
+		}
+	}
+	return err;
+}
+
+const struct got_error *
+got_object_open_as_commits(struct got_commit_object **commits,
+    struct got_repository *repo, struct got_object_id **ids, int nids)
+{
+	return open_commits(commits, repo, ids, nids, 0);
+}
+
+const struct got_error *
+got_object_open_commit_headers(struct got_commit_object **commits,
+    struct got_repository *repo, struct got_object_id **ids, int nids)
+{
+	return open_commits(commits, repo, ids, nids, 1);
 }
 
 const struct got_error *
@@ -690,13 +1170,9 @@ read_packed_tree_privsep(struct got_tree_object **tree,
 }
 
 static const struct got_error *
-request_tree(struct got_tree_object **tree, struct got_repository *repo,
-    int fd)
+request_tree(struct got_tree_object **tree, struct imsgbuf *ibuf, int fd)
 {
 	const struct got_error *err = NULL;
-	struct imsgbuf *ibuf;
-
-	ibuf = repo->privsep_children[GOT_REPO_PRIVSEP_CHILD_TREE].ibuf;
 
 	err = got_privsep_send_tree_req(ibuf, fd, NULL, -1);
 	if (err)
@@ -705,53 +1181,18 @@ request_tree(struct got_tree_object **tree, struct got_repository *repo,
 	return got_privsep_recv_tree(tree, ibuf);
 }
 
-const struct got_error *
+static const struct got_error *
 read_tree_privsep(struct got_tree_object **tree, int obj_fd,
     struct got_repository *repo)
 {
 	const struct got_error *err;
-	int imsg_fds[2];
-	pid_t pid;
 	struct imsgbuf *ibuf;
 
-	if (repo->privsep_children[GOT_REPO_PRIVSEP_CHILD_TREE].imsg_fd != -1)
-		return request_tree(tree, repo, obj_fd);
-
-	ibuf = calloc(1, sizeof(*ibuf));
-	if (ibuf == NULL)
-		return got_error_from_errno("calloc");
-
-	if (socketpair(AF_UNIX, SOCK_STREAM, PF_UNSPEC, imsg_fds) == -1) {
-		err = got_error_from_errno("socketpair");
-		free(ibuf);
-		return err;
-	}
-
-	pid = fork();
-	if (pid == -1) {
-		err = got_error_from_errno("fork");
-		free(ibuf);
-		return err;
-	}
-	else if (pid == 0) {
-		got_privsep_exec_child(imsg_fds, GOT_PATH_PROG_READ_TREE,
-		    repo->path);
-		/* not reached */
-	}
-
-	if (close(imsg_fds[1]) != 0) {
-		err = got_error_from_errno("close");
-		free(ibuf);
+	err = get_child_ibuf(&ibuf, repo, GOT_REPO_PRIVSEP_CHILD_TREE, 0);
+	if (err)
 		return err;
-	}
-	repo->privsep_children[GOT_REPO_PRIVSEP_CHILD_TREE].imsg_fd =
-	    imsg_fds[0];
-	repo->privsep_children[GOT_REPO_PRIVSEP_CHILD_TREE].pid = pid;
-	imsg_init(ibuf, imsg_fds[0]);
-	repo->privsep_children[GOT_REPO_PRIVSEP_CHILD_TREE].ibuf = ibuf;
-
 
-	return request_tree(tree, repo, obj_fd);
+	return request_tree(tree, ibuf, obj_fd);
 }
 
 static const struct got_error *
@@ -827,6 +1268,214 @@ got_object_tree_open(struct got_tree_object **tree,
 	return open_tree(tree, repo, got_object_get_id(obj), 1);
 }
 
+static const struct got_error *
+send_packed_tree_reqs(int *nqueued, struct got_packed_object_req *reqs,
+    int nreqs, struct got_object_id **ids)
+{
+	const struct got_error *err = NULL, *flush_err;
+	int i;
+
+	*nqueued = 0;
+
+	for (i = 0; i < nreqs; i++) {
+		err = got_privsep_queue_packed_tree_req(
+		    reqs[i].pack->privsep_child->ibuf, ids[reqs[i].idx],
+		    reqs[i].pack_idx);
+		if (err)
+			break;
+		(*nqueued)++;
+	}
+	for (i = 0; i < nreqs; i++) {
+		flush_err = got_privsep_flush_imsg(
+		    reqs[i].pack->privsep_child->ibuf);
+		if (flush_err && err == NULL)
+			err = flush_err;
+	}
+	return err;
+}
+
+static const struct got_error *
+recv_packed_trees(struct got_tree_object **trees,
+    struct got_packed_object_req *reqs, int nqueued)
+{
+	const struct got_error *err = NULL, *recv_err;
+	int i;
+
+	for (i = 0; i < nqueued; i++) {
+		recv_err = got_privsep_recv_tree(&trees[i],
+		    reqs[i].pack->privsep_child->ibuf);
+		if (recv_err && err == NULL)
+			err = recv_err;
+	}
+	return err;
+}
+
+static const struct got_error *
+request_trees(struct got_tree_object **trees, int *fds, int nfds,
+    struct got_repository *repo)
+{
+	const struct got_error *err = NULL, *flush_err, *recv_err, *child_err;
+	struct imsgbuf *ibufs[GOT_REPO_PRIVSEP_POOL_SIZE];
+	int unsent[GOT_REPO_PRIVSEP_POOL_SIZE];
+	int i, nchildren, nqueued = 0;
+
+	nchildren = MIN(nfds, GOT_REPO_PRIVSEP_POOL_SIZE);
+	for (i = 0; i < nchildren; i++) {
+		err = get_child_ibuf(&ibufs[i], repo,
+		    GOT_REPO_PRIVSEP_CHILD_TREE, i);
+		if (err)
+			goto done;
+	}
+
+	/* Queue requests across the pool, then send them in one go. */
+	for (i = 0; i < nfds; i++) {
+		err = got_privsep_queue_tree_req(ibufs[i % nchildren],
+		    fds[i]);
+		fds[i] = -1; /* closed by imsg */
+		if (err)
+			break;
+		nqueued++;
+	}
+	for (i = 0; i < nchildren; i++) {
+		flush_err = got_privsep_flush_imsg(ibufs[i]);
+		unsent[i] = (flush_err != NULL);
+		if (flush_err && err == NULL)
+			err = flush_err;
+	}
+
+	/* Each child replies to its requests in the order they were sent. */
+	for (i = 0; i < nqueued; i++) {
+		if (unsent[i % nchildren])
+			continue;
+		recv_err = got_privsep_recv_tree(&trees[i],
+		    ibufs[i % nchildren]);
+		if (recv_err && err == NULL)
+			err = recv_err;
+	}
+	for (i = 0; i < nchildren; i++) {
+		if (!unsent[i])
+			continue;
+		child_err = stop_pool_child(repo,
+		    GOT_REPO_PRIVSEP_CHILD_TREE, i);
+		if (child_err && err == NULL)
+			err = child_err;
+	}
+done:
+	for (i = 0; i < nfds; i++) {
+		if (fds[i] != -1 && close(fds[i]) != 0 && err == NULL)
+			err = got_error_from_errno("close");
+	}
+	return err;
+}
+
+const struct got_error *
+got_object_open_as_trees(struct got_tree_object **trees,
+    struct got_repository *repo, struct got_object_id **ids, int nids)
+{
+	const struct got_error *err = NULL, *recv_err;
+	struct got_tree_object *batch[GOT_OBJECT_BATCH_SIZE];
+	struct got_tree_object *packed[GOT_PRIVSEP_MAX_QUEUED_REQUESTS];
+	struct got_packed_object_req reqs[GOT_PRIVSEP_MAX_QUEUED_REQUESTS];
+	int fds[GOT_OBJECT_BATCH_SIZE], batch_idx[GOT_OBJECT_BATCH_SIZE];
+	int i = 0, j, nfds = 0, nreqs, nqueued;
+
+	memset(trees, 0, nids * sizeof(trees[0]));
+
+	while (i < nids) {
+		nfds = 0;
+		nreqs = 0;
+		for (; i < nids && nfds < nitems(fds) &&
+		    nreqs < nitems(reqs); i++) {
+			struct got_pack *pack;
+			int idx;
+
+			trees[i] = got_repo_get_cached_tree(repo, ids[i]);
+			if (trees[i] != NULL) {
+				trees[i]->refcnt++;
+				continue;
+			}
+
+			err = find_running_pack(&pack, &idx, repo, ids[i]);
+			if (err == NULL) {
+				if (pack) {
+					reqs[nreqs].pack = pack;
+					reqs[nreqs].pack_idx = idx;
+					reqs[nreqs].idx = i;
+					nreqs++;
+					continue;
+				}
+				if (nreqs > 0)
+					break;
+				err = open_tree(&trees[i], repo, ids[i], 0);
+				if (err)
+					goto done;
+				continue;
+			}
+			if (err->code != GOT_ERR_NO_OBJ)
+				goto done;
+
+			err = open_loose_object(&fds[nfds], ids[i], repo);
+			if (err)
+				goto done;
+			batch_idx[nfds++] = i;
+		}
+
+		/* Packed and loose trees are read concurrently. */
+		memset(packed, 0, sizeof(packed));
+		err = send_packed_tree_reqs(&nqueued, reqs, nreqs, ids);
+		memset(batch, 0, sizeof(batch));
+		if (err == NULL)
+			err = request_trees(batch, fds, nfds, repo);
+		else {
+			for (j = 0; j < nfds; j++)
+				close(fds[j]);
+		}
+		recv_err = recv_packed_trees(packed, reqs, nqueued);
+		if (recv_err && err == NULL)
+			err = recv_err;
+
+		for (j = 0; j < nqueued; j++) {
+			const struct got_error *cache_err;
+
+			if (packed[j] == NULL)
+				continue;
+			trees[reqs[j].idx] = packed[j];
+			packed[j]->refcnt++;
+			cache_err = got_repo_cache_tree(repo,
+			    ids[reqs[j].idx], packed[j]);
+			if (cache_err && err == NULL)
+				err = cache_err;
+		}
+		for (j = 0; j < nfds; j++) {
+			const struct got_error *cache_err;
+
+			if (batch[j] == NULL)
+				continue;
+			trees[batch_idx[j]] = batch[j];
+			batch[j]->refcnt++;
+			cache_err = got_repo_cache_tree(repo,
+			    ids[batch_idx[j]], batch[j]);
+			if (cache_err && err == NULL)
+				err = cache_err;
+		}
+		nfds = 0;
+		if (err)
+			goto done;
+	}
+done:
+	for (j = 0; j < nfds; j++)
+		close(fds[j]);
+	if (err) {
+		for (j = 0; j < nids; j++) {
+			if (trees[j] == NULL)
+				continue;
+			got_object_tree_close(trees[j]);
+			trees[j] = NULL;
+		}
+	}
+	return err;
+}
+
 int
 got_object_tree_get_nentries(struct got_tree_object *tree)
 {
@@ -997,47 +1646,11 @@ read_blob_privsep(uint8_t **outbuf, size_t *size, size_t *hdrlen,
     int outfd, int infd, struct got_repository *repo)
 {
 	const struct got_error *err;
-	int imsg_fds[2];
-	pid_t pid;
 	struct imsgbuf *ibuf;
 
-	if (repo->privsep_children[GOT_REPO_PRIVSEP_CHILD_BLOB].imsg_fd != -1) {
-		ibuf = repo->privsep_children[GOT_REPO_PRIVSEP_CHILD_BLOB].ibuf;
-		return request_blob(outbuf, size, hdrlen, outfd, infd, ibuf);
-	}
-
-	ibuf = calloc(1, sizeof(*ibuf));
-	if (ibuf == NULL)
-		return got_error_from_errno("calloc");
-
-	if (socketpair(AF_UNIX, SOCK_STREAM, PF_UNSPEC, imsg_fds) == -1) {
-		err = got_error_from_errno("socketpair");
-		free(ibuf);
-		return err;
-	}
-
-	pid = fork();
-	if (pid == -1) {
-		err = got_error_from_errno("fork");
-		free(ibuf);
-		return err;
-	}
-	else if (pid == 0) {
-		got_privsep_exec_child(imsg_fds, GOT_PATH_PROG_READ_BLOB,
-		    repo->path);
-		/* not reached */
-	}
-
-	if (close(imsg_fds[1]) != 0) {
-		err = got_error_from_errno("close");
-		free(ibuf);
+	err = get_child_ibuf(&ibuf, repo, GOT_REPO_PRIVSEP_CHILD_BLOB, 0);
+	if (err)
 		return err;
-	}
-	repo->privsep_children[GOT_REPO_PRIVSEP_CHILD_BLOB].imsg_fd =
-	    imsg_fds[0];
-	repo->privsep_children[GOT_REPO_PRIVSEP_CHILD_BLOB].pid = pid;
-	imsg_init(ibuf, imsg_fds[0]);
-	repo->privsep_children[GOT_REPO_PRIVSEP_CHILD_BLOB].ibuf = ibuf;
 
 	return request_blob(outbuf, size, hdrlen, outfd, infd, ibuf);
 }
@@ -1114,6 +1727,7 @@ open_blob(struct got_blob_object **blob, struct got_repository *repo,
 			goto done;
 		}
 		(*blob)->data = outbuf;
+		(*blob)->size = size;
 	} else {
 		if (fstat(outfd, &sb) == -1) {
 			err = got_error_from_errno("fstat");
@@ -1177,22 +1791,102 @@ got_object_blob_close(struct got_blob_object *blob)
 	return err;
 }
 
-char *
-got_object_blob_id_str(struct got_blob_object *blob, char *buf, size_t size)
+char *
+got_object_blob_id_str(struct got_blob_object *blob, char *buf, size_t size)
+{
+	return got_sha1_digest_to_str(blob->id.sha1, buf, size);
+}
+
+size_t
+got_object_blob_get_hdrlen(struct got_blob_object *blob)
+{
+	return blob->hdrlen;
+}
+
+const uint8_t *
+got_object_blob_get_read_buf(struct got_blob_object *blob)
+{
+	return blob->read_buf;
+}
+
+const struct got_error *
+got_object_blob_get_data(const uint8_t **data, size_t *len,
+    struct got_blob_object *blob)
+{
+	const struct got_error *err = NULL;
+	struct stat sb;
+	size_t n;
+	ssize_t r;
+
+	*data = NULL;
+	*len = 0;
+
+	if (blob->data == NULL) {
+		if (fstat(fileno(blob->f), &sb) == -1)
+			return got_error_from_errno("fstat");
+		if (sb.st_size < blob->hdrlen)
+			return got_error(GOT_ERR_BAD_OBJ_HDR);
+		blob->data = malloc(sb.st_size > 0 ? sb.st_size : 1);
+		if (blob->data == NULL)
+			return got_error_from_errno("malloc");
+		/* Use pread(2) to leave the file position alone. */
+		for (n = 0; n < sb.st_size; n += r) {
+			r = pread(fileno(blob->f), blob->data + n,
+			    sb.st_size - n, n);
+			if (r == -1) {
+				err = got_error_from_errno("pread");
+				break;
+			}
+			if (r == 0) {
+				err = got_error(GOT_ERR_EOF);
+				break;
+			}
+		}
+		if (err) {
+			free(blob->data);
+			blob->data = NULL;
+			return err;
+		}
+		blob->size = sb.st_size;
+	}
+
+	*data = blob->data + blob->hdrlen;
+	*len = blob->size - blob->hdrlen;
+	return NULL;
+}
+
+const struct got_error *
+got_object_blob_peek(const uint8_t **buf, size_t *len, size_t *size,
+    struct got_blob_object *blob)
 {
-	return got_sha1_digest_to_str(blob->id.sha1, buf, size);
-}
+	struct stat sb;
+	ssize_t r;
 
-size_t
-got_object_blob_get_hdrlen(struct got_blob_object *blob)
-{
-	return blob->hdrlen;
-}
+	*buf = NULL;
+	*len = 0;
+	*size = 0;
 
-const uint8_t *
-got_object_blob_get_read_buf(struct got_blob_object *blob)
-{
-	return blob->read_buf;
+	if (blob->data) {
+		*buf = blob->data + blob->hdrlen;
+		*size = blob->size - blob->hdrlen;
+		*len = MIN(*size, blob->blocksize);
+		return NULL;
+	}
+
+	if (fstat(fileno(blob->f), &sb) == -1)
+		return got_error_from_errno("fstat");
+	if (sb.st_size < blob->hdrlen)
+		return got_error(GOT_ERR_BAD_OBJ_HDR);
+	*size = sb.st_size - blob->hdrlen;
+
+	/* Use pread(2) to leave the file position alone. */
+	r = pread(fileno(blob->f), blob->read_buf, MIN(*size, blob->blocksize),
+	    blob->hdrlen);
+	if (r == -1)
+		return got_error_from_errno("pread");
+	*buf = blob->read_buf;
+	*len = r;
+	return NULL;
 }
 
 const struct got_error *
@@ -1325,13 +2019,9 @@ read_packed_tag_privsep(struct got_tag_object **tag,
 }
 
 static const struct got_error *
-request_tag(struct got_tag_object **tag, struct got_repository *repo,
-    int fd)
+request_tag(struct got_tag_object **tag, struct imsgbuf *ibuf, int fd)
 {
 	const struct got_error *err = NULL;
-	struct imsgbuf *ibuf;
-
-	ibuf = repo->privsep_children[GOT_REPO_PRIVSEP_CHILD_TAG].ibuf;
 
 	err = got_privsep_send_tag_req(ibuf, fd, NULL, -1);
 	if (err)
@@ -1345,47 +2035,13 @@ read_tag_privsep(struct got_tag_object **tag, int obj_fd,
     struct got_repository *repo)
 {
 	const struct got_error *err;
-	int imsg_fds[2];
-	pid_t pid;
 	struct imsgbuf *ibuf;
 
-	if (repo->privsep_children[GOT_REPO_PRIVSEP_CHILD_TAG].imsg_fd != -1)
-		return request_tag(tag, repo, obj_fd);
-
-	ibuf = calloc(1, sizeof(*ibuf));
-	if (ibuf == NULL)
-		return got_error_from_errno("calloc");
-
-	if (socketpair(AF_UNIX, SOCK_STREAM, PF_UNSPEC, imsg_fds) == -1) {
-		err = got_error_from_errno("socketpair");
-		free(ibuf);
-		return err;
-	}
-
-	pid = fork();
-	if (pid == -1) {
-		err = got_error_from_errno("fork");
-		free(ibuf);
-		return err;
-	}
-	else if (pid == 0) {
-		got_privsep_exec_child(imsg_fds, GOT_PATH_PROG_READ_TAG,
-		    repo->path);
-		/* not reached */
-	}
-
-	if (close(imsg_fds[1]) != 0) {
-		err = got_error_from_errno("close");
-		free(ibuf);
+	err = get_child_ibuf(&ibuf, repo, GOT_REPO_PRIVSEP_CHILD_TAG, 0);
+	if (err)
 		return err;
-	}
-	repo->privsep_children[GOT_REPO_PRIVSEP_CHILD_TAG].imsg_fd =
-	    imsg_fds[0];
-	repo->privsep_children[GOT_REPO_PRIVSEP_CHILD_TAG].pid = pid;
-	imsg_init(ibuf, imsg_fds[0]);
-	repo->privsep_children[GOT_REPO_PRIVSEP_CHILD_TAG].ibuf = ibuf;
 
-	return request_tag(tag, repo, obj_fd);
+	return request_tag(tag, ibuf, obj_fd);
 }
 
 static const struct got_error *
@@ -1749,3 +2405,445 @@ got_object_tree_entry_is_submodule(struct got_tree_entry *te)
 {
 	return (te->mode & S_IFMT) == (S_IFDIR | S_IFLNK);
 }
+
+/*
+ * Asynchronous object requests are served by child processes which belong
+ * to the got_object_async context. These children are never used for
+ * synchronous requests, which would otherwise read replies meant for us.
+ */
+struct got_object_async_pack {
+	char *path_packfile;
+	struct got_privsep_child *child;
+};
+
+struct got_object_async {
+	struct got_repository *repo;
+	struct got_privsep_async privsep;
+	int closing;
+
+	/* Children which read loose commits and trees. */
+	struct got_privsep_child commit_children[GOT_REPO_PRIVSEP_POOL_SIZE];
+	struct got_privsep_child tree_children[GOT_REPO_PRIVSEP_POOL_SIZE];
+	int next_commit_child;
+	int next_tree_child;
+
+	/* Children which read packed objects, one per pack file. */
+	struct got_object_async_pack packs[GOT_PACK_CACHE_SIZE];
+	int npacks;
+};
+
+struct got_object_async_req {
+	struct got_object_async *async;
+	struct got_object_id id;
+	int obj_type;
+	int header_only;
+	got_object_async_commit_cb commit_cb;
+	got_object_async_tree_cb tree_cb;
+	void *cb_arg;
+};
+
+static const struct got_error *
+stop_child(struct got_privsep_child *child)
+{
+	const struct got_error *err, *child_err;
+
+	if (child->imsg_fd == -1)
+		return NULL;
+
+	imsg_clear(child->ibuf);
+	free(child->ibuf);
+	child->ibuf = NULL;
+	err = got_privsep_send_stop(child->imsg_fd);
+	child_err = got_privsep_wait_for_child(child->pid);
+	if (child_err && err == NULL)
+		err = child_err;
+	if (close(child->imsg_fd) != 0 && err == NULL)
+		err = got_error_from_errno("close");
+	child->imsg_fd = -1;
+	return err;
+}
+
+const struct got_error *
+got_object_async_open(struct got_object_async **async,
+    struct got_repository *repo)
+{
+	int i;
+
+	*async = calloc(1, sizeof(**async));
+	if (*async == NULL)
+		return got_error_from_errno("calloc");
+
+	(*async)->repo = repo;
+	got_privsep_async_init(&(*async)->privsep);
+	for (i = 0; i < nitems((*async)->commit_children); i++)
+		(*async)->commit_children[i].imsg_fd = -1;
+	for (i = 0; i < nitems((*async)->tree_children); i++)
+		(*async)->tree_children[i].imsg_fd = -1;
+
+	return NULL;
+}
+
+const struct got_error *
+got_object_async_close(struct got_object_async *async)
+{
+	const struct got_error *err, *child_err;
+	int i;
+
+	/* Read and discard any replies which are still outstanding. */
+	async->closing = 1;
+	err = got_privsep_async_wait(&async->privsep);
+	got_privsep_async_free(&async->privsep);
+
+	for (i = 0; i < nitems(async->commit_children); i++) {
+		child_err = stop_child(&async->commit_children[i]);
+		if (child_err && err == NULL)
+			err = child_err;
+	}
+	for (i = 0; i < nitems(async->tree_children); i++) {
+		child_err = stop_child(&async->tree_children[i]);
+		if (child_err && err == NULL)
+			err = child_err;
+	}
+	for (i = 0; i < async->npacks; i++) {
+		child_err = stop_child(async->packs[i].child);
+		if (child_err && err == NULL)
+			err = child_err;
+		free(async->packs[i].child);
+		free(async->packs[i].path_packfile);
+	}
+
+	free(async);
+	return err;
+}
+
+int
+got_object_async_pending(struct got_object_async *async)
+{
+	return got_privsep_async_nreqs(&async->privsep, NULL);
+}
+
+const struct got_error *
+got_object_async_dispatch(int *ndone, struct got_object_async *async,
+    int timeout)
+{
+	return got_privsep_async_dispatch(ndone, &async->privsep, timeout);
+}
+
+static const struct got_error *
+async_reply(void *arg, uint32_t id, struct imsg *imsg, struct imsgbuf *ibuf)
+{
+	const struct got_error *err = NULL;
+	struct got_object_async_req *req = arg;
+	struct got_object_async *async = req->async;
+	struct got_commit_object *commit = NULL;
+	struct got_tree_object *tree = NULL;
+
+	switch (req->obj_type) {
+	case GOT_OBJ_TYPE_COMMIT:
+		err = got_privsep_get_imsg_commit(&commit, imsg, ibuf);
+		if (err)
+			break;
+		err = cache_commit(&commit, async->repo, &req->id);
+		if (err)
+			break;
+		if (async->closing)
+			break;
+		err = req->commit_cb(req->cb_arg, id, &req->id, commit);
+		commit = NULL; /* now owned by the callback */
+		break;
+	case GOT_OBJ_TYPE_TREE:
+		err = got_privsep_get_imsg_tree(&tree, imsg, ibuf);
+		if (err)
+			break;
+		tree->refcnt++;
+		err = got_repo_cache_tree(async->repo, &req->id, tree);
+		if (err)
+			break;
+		if (async->closing)
+			break;
+		err = req->tree_cb(req->cb_arg, id, &req->id, tree);
+		tree = NULL; /* now owned by the callback */
+		break;
+	default:
+		err = got_error(GOT_ERR_OBJ_TYPE);
+		break;
+	}
+
+	if (commit)
+		got_object_commit_close(commit);
+	if (tree)
+		got_object_tree_close(tree);
+	free(req);
+	return err;
+}
+
+/*
+ * Find or start a got-read-pack child for the pack file which contains
+ * the specified object. This child does not share file offsets with any
+ * other process reading the same pack file.
+ */
+static const struct got_error *
+get_async_pack_child(struct imsgbuf **ibuf, int *pack_idx,
+    struct got_object_async *async, struct got_object_id *id)
+{
+	const struct got_error *err = NULL;
+	struct got_repository *repo = async->repo;
+	struct got_packidx *packidx, packidx_copy;
+	struct got_pack *pack, pack_copy;
+	struct got_object_async_pack *apack;
+	char *path_packfile = NULL;
+	int i;
+
+	*ibuf = NULL;
+
+	err = got_repo_search_packidx(&packidx, pack_idx, repo, id);
+	if (err)
+		return err;
+
+	err = get_packfile_path(&path_packfile, packidx);
+	if (err)
+		return err;
+
+	for (i = 0; i < async->npacks; i++) {
+		apack = &async->packs[i];
+		if (strcmp(apack->path_packfile, path_packfile) == 0) {
+			*ibuf = apack->child->ibuf;
+			goto done;
+		}
+	}
+	if (async->npacks >= nitems(async->packs)) {
+		err = got_error(GOT_ERR_NO_SPACE);
+		goto done;
+	}
+
+	pack = got_repo_get_cached_pack(repo, path_packfile);
+	if (pack == NULL) {
+		err = got_repo_cache_pack(&pack, repo, path_packfile, packidx);
+		if (err)
+			goto done;
+	}
+
+	memcpy(&pack_copy, pack, sizeof(pack_copy));
+	memcpy(&packidx_copy, packidx, sizeof(packidx_copy));
+	pack_copy.privsep_child = NULL;
+	pack_copy.fd = open(pack->path_packfile, O_RDONLY | O_NOFOLLOW);
+	if (pack_copy.fd == -1) {
+		err = got_error_from_errno2("open", pack->path_packfile);
+		goto done;
+	}
+	packidx_copy.fd = open(packidx->path_packidx, O_RDONLY | O_NOFOLLOW);
+	if (packidx_copy.fd == -1) {
+		err = got_error_from_errno2("open", packidx->path_packidx);
+		close(pack_copy.fd);
+		goto done;
+	}
+
+	err = start_pack_privsep_child(&pack_copy, &packidx_copy);
+	if (close(pack_copy.fd) != 0 && err == NULL)
+		err = got_error_from_errno("close");
+	if (close(packidx_copy.fd) != 0 && err == NULL)
+		err = got_error_from_errno("close");
+	if (err)
+		goto done;
+
+	apack = &async->packs[async->npacks++];
+	apack->child = pack_copy.privsep_child;
+	apack->path_packfile = path_packfile;
+	path_packfile = NULL;
+	*ibuf = apack->child->ibuf;
+done:
+	free(path_packfile);
+	return err;
+}
+
+/*
+ * Pick a child for reading a loose object, avoiding children which have
+ * too many requests queued already. Wait for replies if all are busy.
+ */
+static const struct got_error *
+get_async_loose_child(struct imsgbuf **ibuf, struct got_object_async *async,
+    int type)
+{
+	const struct got_error *err;
+	struct got_privsep_child *children, *child;
+	int *next, i, ndone;
+
+	*ibuf = NULL;
+
+	if (type == GOT_REPO_PRIVSEP_CHILD_COMMIT) {
+		children = async->commit_children;
+		next = &async->next_commit_child;
+	} else {
+		children = async->tree_children;
+		next = &async->next_tree_child;
+	}
+
+	for (;;) {
+		for (i = 0; i < GOT_REPO_PRIVSEP_POOL_SIZE; i++) {
+			child = &children[*next];
+			*next = (*next + 1) % GOT_REPO_PRIVSEP_POOL_SIZE;
+			if (child->imsg_fd == -1) {
+				err = start_child(child, type, async->repo);
+				if (err)
+					return err;
+			}
+			if (got_privsep_async_nreqs(&async->privsep,
+			    child->ibuf) < GOT_PRIVSEP_MAX_QUEUED_REQUESTS) {
+				*ibuf = child->ibuf;
+				return NULL;
+			}
+		}
+
+		err = got_privsep_async_dispatch(&ndone, &async->privsep,
+		    INFTIM);
+		if (err)
+			return err;
+	}
+}
+
+static const struct got_error *
+async_request(uint32_t *id, struct got_object_async *async,
+    struct got_object_async_req *req)
+{
+	const struct got_error *err;
+	struct imsgbuf *ibuf;
+	int pack_idx, fd, ndone;
+
+	err = get_async_pack_child(&ibuf, &pack_idx, async, &req->id);
+	if (err == NULL) {
+		while (got_privsep_async_nreqs(&async->privsep, ibuf) >=
+		    GOT_PRIVSEP_MAX_QUEUED_REQUESTS) {
+			err = got_privsep_async_dispatch(&ndone,
+			    &async->privsep, INFTIM);
+			if (err)
+				return err;
+		}
+		if (req->obj_type == GOT_OBJ_TYPE_COMMIT && req->header_only)
+			err = got_privsep_send_commit_header_req(ibuf, -1,
+			    &req->id, pack_idx);
+		else if (req->obj_type == GOT_OBJ_TYPE_COMMIT)
+			err = got_privsep_send_commit_req(ibuf, -1, &req->id,
+			    pack_idx);
+		else
+			err = got_privsep_send_tree_req(ibuf, -1, &req->id,
+			    pack_idx);
+	} else if (err->code == GOT_ERR_NO_OBJ) {
+		err = get_async_loose_child(&ibuf, async,
+		    req->obj_type == GOT_OBJ_TYPE_COMMIT ?
+		    GOT_REPO_PRIVSEP_CHILD_COMMIT : GOT_REPO_PRIVSEP_CHILD_TREE);
+		if (err)
+			return err;
+		err = open_loose_object(&fd, &req->id, async->repo);
+		if (err)
+			return err;
+		/* Queued requests are sent by got_privsep_async_dispatch(). */
+		if (req->obj_type == GOT_OBJ_TYPE_COMMIT && req->header_only)
+			err = got_privsep_queue_commit_header_req(ibuf, fd);
+		else if (req->obj_type == GOT_OBJ_TYPE_COMMIT)
+			err = got_privsep_queue_commit_req(ibuf, fd);
+		else
+			err = got_privsep_queue_tree_req(ibuf, fd);
+	}
+	if (err)
+		return err;
+
+	return got_privsep_async_add(id, &async->privsep, ibuf, async_reply,
+	    req);
+}
+
+static const struct got_error *
+async_request_commit(uint32_t *id, struct got_object_async *async,
+    struct got_object_id *commit_id, int header_only,
+    got_object_async_commit_cb cb, void *cb_arg)
+{
+	const struct got_error *err;
+	struct got_object_async_req *req;
+	struct got_commit_object *commit;
+
+	if (id)
+		*id = 0;
+
+	commit = get_cached_commit(async->repo, commit_id, header_only);
+	if (commit) {
+		commit->refcnt++;
+		return cb(cb_arg, 0, commit_id, commit);
+	}
+
+	if (header_only) {
+		err = read_commit_graph_header(&commit, async->repo,
+		    commit_id);
+		if (err)
+			return err;
+		if (commit) {
+			err = cache_commit(&commit, async->repo, commit_id);
+			if (err) {
+				got_object_commit_close(commit);
+				return err;
+			}
+			return cb(cb_arg, 0, commit_id, commit);
+		}
+	}
+
+	req = calloc(1, sizeof(*req));
+	if (req == NULL)
+		return got_error_from_errno("calloc");
+	req->async = async;
+	memcpy(&req->id, commit_id, sizeof(req->id));
+	req->obj_type = GOT_OBJ_TYPE_COMMIT;
+	req->header_only = header_only;
+	req->commit_cb = cb;
+	req->cb_arg = cb_arg;
+
+	err = async_request(id, async, req);
+	if (err)
+		free(req);
+	return err;
+}
+
+const struct got_error *
+got_object_async_request_commit(uint32_t *id, struct got_object_async *async,
+    struct got_object_id *commit_id, got_object_async_commit_cb cb,
+    void *cb_arg)
+{
+	return async_request_commit(id, async, commit_id, 0, cb, cb_arg);
+}
+
+const struct got_error *
+got_object_async_request_commit_header(uint32_t *id,
+    struct got_object_async *async, struct got_object_id *commit_id,
+    got_object_async_commit_cb cb, void *cb_arg)
+{
+	return async_request_commit(id, async, commit_id, 1, cb, cb_arg);
+}
+
+const struct got_error *
+got_object_async_request_tree(uint32_t *id, struct got_object_async *async,
+    struct got_object_id *tree_id, got_object_async_tree_cb cb, void *cb_arg)
+{
+	const struct got_error *err;
+	struct got_object_async_req *req;
+	struct got_tree_object *tree;
+
+	if (id)
+		*id = 0;
+
+	tree = got_repo_get_cached_tree(async->repo, tree_id);
+	if (tree) {
+		tree->refcnt++;
+		return cb(cb_arg, 0, tree_id, tree);
+	}
+
+	req = calloc(1, sizeof(*req));
+	if (req == NULL)
+		return got_error_from_errno("calloc");
+	req->async = async;
+	memcpy(&req->id, tree_id, sizeof(req->id));
+	req->obj_type = GOT_OBJ_TYPE_TREE;
+	req->tree_cb = cb;
+	req->cb_arg = cb_arg;
+
+	err = async_request(id, async, req);
+	if (err)
+		free(req);
+	return err;
+}
@@ -261,6 +261,67 @@ got_object_commit_alloc_partial(void)
 	return commit;
 }
 
+/*
+ * Allocate a commit object which stores its tree ID, parent IDs, and the
+ * author, committer, and log message strings in the same allocation as
+ * the commit object itself. The strings have room for the given number
+ * of bytes plus a terminating NUL, which has already been written.
+ * All other data must be filled in by the caller.
+ */
+struct got_commit_object *
+got_object_commit_alloc_compact(int nparents, size_t author_len,
+    size_t committer_len, size_t logmsg_len)
+{
+	struct got_commit_object *commit;
+	struct got_object_qid *qids;
+	struct got_object_id *ids;
+	size_t len, slen;
+	char *s;
+	int i;
+
+	if (nparents < 0) {
+		errno = EINVAL;
+		return NULL;
+	}
+
+	len = sizeof(*commit) + nparents * sizeof(*qids) +
+	    (nparents + 1) * sizeof(*ids);
+	slen = author_len + committer_len + logmsg_len + 3;
+	if (slen < logmsg_len || len + slen < slen) {
+		errno = ENOMEM;
+		return NULL;
+	}
+
+	commit = malloc(len + slen);
+	if (commit == NULL)
+		return NULL;
+	memset(commit, 0, sizeof(*commit));
+
+	/* The parent queue comes first since it must be properly aligned. */
+	qids = (struct got_object_qid *)(commit + 1);
+	ids = (struct got_object_id *)(qids + nparents);
+	commit->tree_id = &ids[0];
+	SIMPLEQ_INIT(&commit->parent_ids);
+	for (i = 0; i < nparents; i++) {
+		qids[i].id = &ids[i + 1];
+		SIMPLEQ_INSERT_TAIL(&commit->parent_ids, &qids[i], entry);
+	}
+	commit->nparents = nparents;
+
+	s = (char *)(ids + nparents + 1);
+	commit->author = s;
+	s[author_len] = '\0';
+	s += author_len + 1;
+	commit->committer = s;
+	s[committer_len] = '\0';
+	s += committer_len + 1;
+	commit->logmsg = s;
+	s[logmsg_len] = '\0';
+
+	commit->flags = GOT_COMMIT_FLAG_COMPACT;
+	return commit;
+}
+
 const struct got_error *
 got_object_commit_add_parent(struct got_commit_object *commit,
     const char *id_str)
@@ -268,6 +329,10 @@ got_object_commit_add_parent(struct got_commit_object *commit,
 	const struct got_error *err = NULL;
 	struct got_object_qid *qid;
 
+	/* A compact commit has no room for additional parents. */
+	if (commit->flags & GOT_COMMIT_FLAG_COMPACT)
+		return got_error(GOT_ERR_NOT_IMPL);
+
 	err = got_object_qid_alloc_partial(&qid);
 	if (err)
 		return err;
@@ -356,6 +421,13 @@ got_object_commit_close(struct got_commit_object *commit)
 			return;
 	}
 
+	if (commit->flags & GOT_COMMIT_FLAG_COMPACT) {
+		if (commit->details)
+			got_object_commit_close(commit->details);
+		free(commit);
+		return;
+	}
+
 	got_object_id_queue_free(&commit->parent_ids);
 	free(commit->tree_id);
 	free(commit->author);
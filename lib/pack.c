@@ -413,8 +413,8 @@ got_packidx_close(struct got_packidx *packidx)
 	return err;
 }
 
-static off_t
-get_object_offset(struct got_packidx *packidx, int idx)
+off_t
+got_packidx_get_object_offset(struct got_packidx *packidx, int idx)
 {
 	uint32_t offset = betoh32(packidx->hdr.offsets[idx]);
 	if (offset & GOT_PACKIDX_OFFSET_VAL_IS_LARGE_IDX) {
@@ -841,7 +841,7 @@ resolve_ref_delta(struct got_delta_chain *deltas, struct got_packidx *packidx,
 	if (idx == -1)
 		return got_error(GOT_ERR_BAD_PACKFILE);
 
-	base_offset = get_object_offset(packidx, idx);
+	base_offset = got_packidx_get_object_offset(packidx, idx);
 	if (base_offset == (uint64_t)-1)
 		return got_error(GOT_ERR_BAD_PACKIDX);
 
@@ -943,7 +943,7 @@ got_packfile_open_object(struct got_object **obj, struct got_pack *pack,
 
 	*obj = NULL;
 
-	offset = get_object_offset(packidx, idx);
+	offset = got_packidx_get_object_offset(packidx, idx);
 	if (offset == (uint64_t)-1)
 		return got_error(GOT_ERR_BAD_PACKIDX);
 
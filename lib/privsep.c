@@ -52,6 +52,280 @@
 #define nitems(_a)	(sizeof((_a)) / sizeof((_a)[0]))
 #endif
 
+/*
+ * IPC statistics. These are collected if got was compiled with
+ * -DGOT_PRIVSEP_DEBUG, or if GOT_PRIVSEP_STATS is set in the environment,
+ * and are printed to stderr when a repository is closed.
+ */
+#define GOT_PRIVSEP_STATS_MAX_TYPE	64
+#define GOT_PRIVSEP_STATS_MAX_HELPERS	16
+#define GOT_PRIVSEP_STATS_MAX_CHANNELS	64
+#define GOT_PRIVSEP_STATS_NBUCKETS	24
+
+struct got_privsep_msg_stats {
+	unsigned long nsent;
+	unsigned long nrecv;
+	unsigned long long bytes_sent;
+	unsigned long long bytes_recv;
+};
+
+struct got_privsep_helper_stats {
+	const char *prog_path;
+	unsigned long nsamples;
+	unsigned long long total_usec;
+	unsigned long long max_usec;
+	/* Bucket i counts round trips of less than 2^i microseconds. */
+	unsigned long hist[GOT_PRIVSEP_STATS_NBUCKETS];
+};
+
+/* A connection to a helper process, and the time of an unanswered send. */
+struct got_privsep_channel {
+	struct imsgbuf *ibuf;
+	int helper;
+	int pending;
+	struct timespec sent;
+};
+
+/*
+ * Statistics are only collected by processes which start helpers.
+ * Helpers inherit GOT_PRIVSEP_STATS but have nobody to report to.
+ */
+static int privsep_stats_enabled = -1; /* -1 until a helper is started */
+static struct got_privsep_msg_stats msg_stats[GOT_PRIVSEP_STATS_MAX_TYPE + 1];
+static struct got_privsep_helper_stats
+    helper_stats[GOT_PRIVSEP_STATS_MAX_HELPERS];
+static int nhelpers;
+static struct got_privsep_channel channels[GOT_PRIVSEP_STATS_MAX_CHANNELS];
+static int nchannels, next_channel;
+
+static const char *imsg_type_names[GOT_PRIVSEP_STATS_MAX_TYPE] = {
+	[GOT_IMSG_ERROR] = "ERROR",
+	[GOT_IMSG_STOP] = "STOP",
+	[GOT_IMSG_OBJECT_REQUEST] = "OBJECT_REQUEST",
+	[GOT_IMSG_OBJECT] = "OBJECT",
+	[GOT_IMSG_COMMIT_REQUEST] = "COMMIT_REQUEST",
+	[GOT_IMSG_COMMIT] = "COMMIT",
+	[GOT_IMSG_COMMIT_LOGMSG] = "COMMIT_LOGMSG",
+	[GOT_IMSG_COMMIT_HEADER_REQUEST] = "COMMIT_HEADER_REQUEST",
+	[GOT_IMSG_COMMIT_HEADER] = "COMMIT_HEADER",
+	[GOT_IMSG_TREE_REQUEST] = "TREE_REQUEST",
+	[GOT_IMSG_TREE] = "TREE",
+	[GOT_IMSG_TREE_ENTRY] = "TREE_ENTRY",
+	[GOT_IMSG_BLOB_REQUEST] = "BLOB_REQUEST",
+	[GOT_IMSG_BLOB_OUTFD] = "BLOB_OUTFD",
+	[GOT_IMSG_BLOB] = "BLOB",
+	[GOT_IMSG_TAG_REQUEST] = "TAG_REQUEST",
+	[GOT_IMSG_TAG] = "TAG",
+	[GOT_IMSG_TAG_TAGMSG] = "TAG_TAGMSG",
+	[GOT_IMSG_PACKIDX] = "PACKIDX",
+	[GOT_IMSG_PACK] = "PACK",
+	[GOT_IMSG_PACKED_OBJECT_REQUEST] = "PACKED_OBJECT_REQUEST",
+	[GOT_IMSG_TMPFD] = "TMPFD",
+	[GOT_IMSG_GITCONFIG_PARSE_REQUEST] = "GITCONFIG_PARSE_REQUEST",
+	[GOT_IMSG_GITCONFIG_REPOSITORY_FORMAT_VERSION_REQUEST] =
+	    "GITCONFIG_REPOSITORY_FORMAT_VERSION_REQUEST",
+	[GOT_IMSG_GITCONFIG_AUTHOR_NAME_REQUEST] =
+	    "GITCONFIG_AUTHOR_NAME_REQUEST",
+	[GOT_IMSG_GITCONFIG_AUTHOR_EMAIL_REQUEST] =
+	    "GITCONFIG_AUTHOR_EMAIL_REQUEST",
+	[GOT_IMSG_GITCONFIG_REMOTES_REQUEST] = "GITCONFIG_REMOTES_REQUEST",
+	[GOT_IMSG_GITCONFIG_INT_VAL] = "GITCONFIG_INT_VAL",
+	[GOT_IMSG_GITCONFIG_STR_VAL] = "GITCONFIG_STR_VAL",
+	[GOT_IMSG_GITCONFIG_REMOTES] = "GITCONFIG_REMOTES",
+	[GOT_IMSG_GITCONFIG_REMOTE] = "GITCONFIG_REMOTE",
+};
+
+static int
+privsep_stats(void)
+{
+	return (privsep_stats_enabled == 1);
+}
+
+static struct got_privsep_channel *
+find_channel(struct imsgbuf *ibuf)
+{
+	int i;
+
+	for (i = 0; i < nchannels; i++) {
+		if (channels[i].ibuf == ibuf)
+			return &channels[i];
+	}
+	return NULL;
+}
+
+void
+got_privsep_stats_register(struct imsgbuf *ibuf, const char *prog_path)
+{
+	struct got_privsep_channel *chan;
+	int i;
+
+	if (privsep_stats_enabled == -1) {
+#ifdef GOT_PRIVSEP_DEBUG
+		privsep_stats_enabled = 1;
+#else
+		privsep_stats_enabled = (getenv("GOT_PRIVSEP_STATS") != NULL);
+#endif
+	}
+	if (!privsep_stats())
+		return;
+
+	for (i = 0; i < nhelpers; i++) {
+		if (strcmp(helper_stats[i].prog_path, prog_path) == 0)
+			break;
+	}
+	if (i >= nhelpers) {
+		if (nhelpers >= nitems(helper_stats))
+			return;
+		helper_stats[nhelpers++].prog_path = prog_path;
+	}
+
+	/* The imsgbuf may have been freed and reallocated by now. */
+	chan = find_channel(ibuf);
+	if (chan == NULL) {
+		if (nchannels < nitems(channels))
+			chan = &channels[nchannels++];
+		else {
+			/* Recycle the oldest slot; it is likely stale. */
+			chan = &channels[next_channel];
+			next_channel = (next_channel + 1) % nitems(channels);
+		}
+	}
+	chan->ibuf = ibuf;
+	chan->helper = i;
+	chan->pending = 0;
+}
+
+static void
+count_msg(uint32_t type, size_t len, int sent)
+{
+	struct got_privsep_msg_stats *ms;
+
+	if (type >= GOT_PRIVSEP_STATS_MAX_TYPE)
+		type = GOT_PRIVSEP_STATS_MAX_TYPE; /* "other" */
+	ms = &msg_stats[type];
+	if (sent) {
+		ms->nsent++;
+		ms->bytes_sent += len;
+	} else {
+		ms->nrecv++;
+		ms->bytes_recv += len;
+	}
+}
+
+/* Account for messages about to be written by flush_imsg(). */
+static void
+stats_sent(struct imsgbuf *ibuf)
+{
+	struct got_privsep_channel *chan;
+	struct ibuf *buf;
+	struct imsg_hdr hdr;
+
+	TAILQ_FOREACH(buf, &ibuf->w.bufs, entry) {
+		if (buf->rpos > 0 || buf->wpos < sizeof(hdr))
+			continue; /* not the start of a message */
+		memcpy(&hdr, buf->buf, sizeof(hdr));
+		count_msg(hdr.type, hdr.len, 1);
+	}
+
+	/* Pipelined requests are timed from the first send. */
+	chan = find_channel(ibuf);
+	if (chan && !chan->pending) {
+		if (clock_gettime(CLOCK_MONOTONIC, &chan->sent) == 0)
+			chan->pending = 1;
+	}
+}
+
+/* Account for a message received, and time the round trip if any. */
+static void
+stats_recv(struct imsgbuf *ibuf, struct imsg *imsg)
+{
+	struct got_privsep_channel *chan;
+	struct got_privsep_helper_stats *hs;
+	struct timespec now;
+	unsigned long long usec;
+	int i;
+
+	count_msg(imsg->hdr.type, imsg->hdr.len, 0);
+
+	chan = find_channel(ibuf);
+	if (chan == NULL || !chan->pending)
+		return;
+	chan->pending = 0;
+	if (clock_gettime(CLOCK_MONOTONIC, &now) == -1)
+		return;
+
+	usec = (now.tv_sec - chan->sent.tv_sec) * 1000000ULL;
+	usec += now.tv_nsec / 1000;
+	usec -= chan->sent.tv_nsec / 1000;
+
+	hs = &helper_stats[chan->helper];
+	hs->nsamples++;
+	hs->total_usec += usec;
+	if (usec > hs->max_usec)
+		hs->max_usec = usec;
+	for (i = 0; i < nitems(hs->hist) - 1; i++) {
+		if (usec < (1ULL << i))
+			break;
+	}
+	hs->hist[i]++;
+}
+
+void
+got_privsep_stats_print(void)
+{
+	struct got_privsep_msg_stats *ms;
+	struct got_privsep_helper_stats *hs;
+	const char *name;
+	int i, j;
+
+	if (!privsep_stats())
+		return;
+
+	for (i = 0; i < nitems(msg_stats); i++) {
+		ms = &msg_stats[i];
+		if (ms->nsent == 0 && ms->nrecv == 0)
+			continue;
+		name = i < nitems(imsg_type_names) ? imsg_type_names[i] :
+		    "other";
+		fprintf(stderr, "%s: imsg %s (%d): %lu sent (%llu bytes), "
+		    "%lu received (%llu bytes)\n", getprogname(),
+		    name ? name : "unknown", i, ms->nsent, ms->bytes_sent,
+		    ms->nrecv, ms->bytes_recv);
+	}
+
+	for (i = 0; i < nhelpers; i++) {
+		hs = &helper_stats[i];
+		if (hs->nsamples == 0)
+			continue;
+		fprintf(stderr, "%s: %s: %lu round trips, %llu us average, "
+		    "%llu us max\n", getprogname(), hs->prog_path,
+		    hs->nsamples, hs->total_usec / hs->nsamples, hs->max_usec);
+		for (j = 0; j < nitems(hs->hist); j++) {
+			if (hs->hist[j] == 0)
+				continue;
+			if (j == nitems(hs->hist) - 1)
+				fprintf(stderr, "%s:   >= %llu us: %lu\n",
+				    getprogname(), 1ULL << (j - 1),
+				    hs->hist[j]);
+			else
+				fprintf(stderr, "%s:   < %llu us: %lu\n",
+				    getprogname(), 1ULL << j, hs->hist[j]);
+		}
+	}
+}
+
+/* Like imsg_get(3), but keep statistics if requested. */
+static ssize_t
+get_imsg(struct imsgbuf *ibuf, struct imsg *imsg)
+{
+	ssize_t n;
+
+	n = imsg_get(ibuf, imsg);
+	if (n > 0 && privsep_stats())
+		stats_recv(ibuf, imsg);
+	return n;
+}
+
 static const struct got_error *
 poll_fd(int fd, int events, int timeout)
 {
@@ -74,6 +348,23 @@ poll_fd(int fd, int events, int timeout)
 	return got_error(GOT_ERR_INTERRUPT);
 }
 
+static const struct got_error *
+read_imsg_ready(struct imsgbuf *ibuf)
+{
+	ssize_t n;
+
+	n = imsg_read(ibuf);
+	if (n == -1) {
+		if (errno == EAGAIN) /* Could be a file-descriptor leak. */
+			return got_error(GOT_ERR_PRIVSEP_NO_FD);
+		return got_error(GOT_ERR_PRIVSEP_READ);
+	}
+	if (n == 0)
+		return got_error(GOT_ERR_PRIVSEP_PIPE);
+
+	return NULL;
+}
+
 static const struct got_error *
 read_imsg(struct imsgbuf *ibuf)
 {
@@ -139,7 +430,7 @@ got_privsep_recv_imsg(struct imsg *imsg, struct imsgbuf *ibuf,
 	const struct got_error *err;
 	ssize_t n;
 
-	n = imsg_get(ibuf, imsg);
+	n = get_imsg(ibuf, imsg);
 	if (n == -1)
 		return got_error_from_errno("imsg_get");
 
@@ -147,7 +438,7 @@ got_privsep_recv_imsg(struct imsg *imsg, struct imsgbuf *ibuf,
 		err = read_imsg(ibuf);
 		if (err)
 			return err;
-		n = imsg_get(ibuf, imsg);
+		n = get_imsg(ibuf, imsg);
 	}
 
 	if (imsg->hdr.len < IMSG_HEADER_SIZE + min_datalen)
@@ -205,6 +496,9 @@ flush_imsg(struct imsgbuf *ibuf)
 	if (err)
 		return err;
 
+	if (privsep_stats())
+		stats_sent(ibuf);
+
 	if (imsg_flush(ibuf) == -1)
 		return got_error_from_errno("imsg_flush");
 
@@ -238,8 +532,14 @@ got_privsep_send_obj_req(struct imsgbuf *ibuf, int fd)
 }
 
 const struct got_error *
-got_privsep_send_commit_req(struct imsgbuf *ibuf, int fd,
-    struct got_object_id *id, int pack_idx)
+got_privsep_flush_imsg(struct imsgbuf *ibuf)
+{
+	return flush_imsg(ibuf);
+}
+
+static const struct got_error *
+compose_commit_req(struct imsgbuf *ibuf, int fd, struct got_object_id *id,
+    int pack_idx, int header_only)
 {
 	const struct got_error *err = NULL;
 	struct got_imsg_packed_object iobj, *iobjp;
@@ -255,19 +555,71 @@ got_privsep_send_commit_req(struct imsgbuf *ibuf, int fd,
 		len = 0;
 	}
 
-	if (imsg_compose(ibuf, GOT_IMSG_COMMIT_REQUEST, 0, 0, fd, iobjp, len)
-	    == -1) {
+	if (imsg_compose(ibuf, header_only ? GOT_IMSG_COMMIT_HEADER_REQUEST :
+	    GOT_IMSG_COMMIT_REQUEST, 0, 0, fd, iobjp, len) == -1) {
 		err = got_error_from_errno("imsg_compose COMMIT_REQUEST");
 		close(fd);
 		return err;
 	}
 
+	return NULL;
+}
+
+const struct got_error *
+got_privsep_send_commit_req(struct imsgbuf *ibuf, int fd,
+    struct got_object_id *id, int pack_idx)
+{
+	const struct got_error *err;
+
+	err = compose_commit_req(ibuf, fd, id, pack_idx, 0);
+	if (err)
+		return err;
+
 	return flush_imsg(ibuf);
 }
 
 const struct got_error *
-got_privsep_send_tree_req(struct imsgbuf *ibuf, int fd,
+got_privsep_send_commit_header_req(struct imsgbuf *ibuf, int fd,
+    struct got_object_id *id, int pack_idx)
+{
+	const struct got_error *err;
+
+	err = compose_commit_req(ibuf, fd, id, pack_idx, 1);
+	if (err)
+		return err;
+
+	return flush_imsg(ibuf);
+}
+
+const struct got_error *
+got_privsep_queue_commit_req(struct imsgbuf *ibuf, int fd)
+{
+	return compose_commit_req(ibuf, fd, NULL, -1, 0);
+}
+
+const struct got_error *
+got_privsep_queue_commit_header_req(struct imsgbuf *ibuf, int fd)
+{
+	return compose_commit_req(ibuf, fd, NULL, -1, 1);
+}
+
+const struct got_error *
+got_privsep_queue_packed_commit_req(struct imsgbuf *ibuf,
     struct got_object_id *id, int pack_idx)
+{
+	return compose_commit_req(ibuf, -1, id, pack_idx, 0);
+}
+
+const struct got_error *
+got_privsep_queue_packed_commit_header_req(struct imsgbuf *ibuf,
+    struct got_object_id *id, int pack_idx)
+{
+	return compose_commit_req(ibuf, -1, id, pack_idx, 1);
+}
+
+static const struct got_error *
+compose_tree_req(struct imsgbuf *ibuf, int fd, struct got_object_id *id,
+    int pack_idx)
 {
 	const struct got_error *err = NULL;
 	struct ibuf *wbuf;
@@ -294,9 +646,35 @@ got_privsep_send_tree_req(struct imsgbuf *ibuf, int fd,
 	wbuf->fd = fd;
 	imsg_close(ibuf, wbuf);
 
+	return NULL;
+}
+
+const struct got_error *
+got_privsep_send_tree_req(struct imsgbuf *ibuf, int fd,
+    struct got_object_id *id, int pack_idx)
+{
+	const struct got_error *err;
+
+	err = compose_tree_req(ibuf, fd, id, pack_idx);
+	if (err)
+		return err;
+
 	return flush_imsg(ibuf);
 }
 
+const struct got_error *
+got_privsep_queue_tree_req(struct imsgbuf *ibuf, int fd)
+{
+	return compose_tree_req(ibuf, fd, NULL, -1);
+}
+
+const struct got_error *
+got_privsep_queue_packed_tree_req(struct imsgbuf *ibuf,
+    struct got_object_id *id, int pack_idx)
+{
+	return compose_tree_req(ibuf, -1, id, pack_idx);
+}
+
 const struct got_error *
 got_privsep_send_tag_req(struct imsgbuf *ibuf, int fd,
     struct got_object_id *id, int pack_idx)
@@ -461,13 +839,12 @@ got_privsep_recv_obj(struct got_object **obj, struct imsgbuf *ibuf)
 
 static const struct got_error *
 send_commit_logmsg(struct imsgbuf *ibuf, struct got_commit_object *commit,
-    size_t logmsg_len)
+    size_t offset, size_t logmsg_len)
 {
 	const struct got_error *err = NULL;
-	size_t offset, remain;
+	size_t remain;
 
-	offset = 0;
-	remain = logmsg_len;
+	remain = logmsg_len - offset;
 	while (remain > 0) {
 		size_t n = MIN(MAX_IMSGSIZE - IMSG_HEADER_SIZE, remain);
 
@@ -489,20 +866,31 @@ send_commit_logmsg(struct imsgbuf *ibuf, struct got_commit_object *commit,
 	return err;
 }
 
-const struct got_error *
-got_privsep_send_commit(struct imsgbuf *ibuf, struct got_commit_object *commit)
+static const struct got_error *
+send_commit(struct imsgbuf *ibuf, struct got_commit_object *commit,
+    int header_only)
 {
 	const struct got_error *err = NULL;
 	struct got_imsg_commit_object *icommit;
 	uint8_t *buf;
-	size_t len, total;
+	size_t len, total, inline_len;
 	struct got_object_qid *qid;
-	size_t author_len = strlen(commit->author);
-	size_t committer_len = strlen(commit->committer);
-	size_t logmsg_len = strlen(commit->logmsg);
+	size_t author_len = 0, committer_len = 0, logmsg_len = 0;
+
+	if (!header_only) {
+		author_len = strlen(commit->author);
+		committer_len = strlen(commit->committer);
+		logmsg_len = strlen(commit->logmsg);
+	}
 
 	total = sizeof(*icommit) + author_len + committer_len +
 	    commit->nparents * SHA1_DIGEST_LENGTH;
+	if (total > MAX_IMSGSIZE - IMSG_HEADER_SIZE)
+		return got_error(GOT_ERR_NO_SPACE);
+
+	/* Send as much of the log message as fits along with the commit. */
+	inline_len = MIN(logmsg_len, MAX_IMSGSIZE - IMSG_HEADER_SIZE - total);
+	total += inline_len;
 
 	buf = malloc(total);
 	if (buf == NULL)
@@ -529,68 +917,101 @@ got_privsep_send_commit(struct imsgbuf *ibuf, struct got_commit_object *commit)
 		memcpy(buf + len, qid->id, SHA1_DIGEST_LENGTH);
 		len += SHA1_DIGEST_LENGTH;
 	}
+	memcpy(buf + len, commit->logmsg, inline_len);
+	len += inline_len;
 
-	if (imsg_compose(ibuf, GOT_IMSG_COMMIT, 0, 0, -1, buf, len) == -1) {
+	if (imsg_compose(ibuf, header_only ? GOT_IMSG_COMMIT_HEADER :
+	    GOT_IMSG_COMMIT, 0, 0, -1, buf, len) == -1) {
 		err = got_error_from_errno("imsg_compose COMMIT");
 		goto done;
 	}
 
-	if (logmsg_len == 0 ||
-	    logmsg_len + len > MAX_IMSGSIZE - IMSG_HEADER_SIZE) {
-		err = flush_imsg(ibuf);
-		if (err)
-			goto done;
-	}
-	err = send_commit_logmsg(ibuf, commit, logmsg_len);
+	err = flush_imsg(ibuf);
+	if (err)
+		goto done;
+
+	err = send_commit_logmsg(ibuf, commit, inline_len, logmsg_len);
 done:
 	free(buf);
 	return err;
 }
 
 const struct got_error *
-got_privsep_recv_commit(struct got_commit_object **commit, struct imsgbuf *ibuf)
+got_privsep_send_commit(struct imsgbuf *ibuf, struct got_commit_object *commit)
+{
+	return send_commit(ibuf, commit, 0);
+}
+
+/* Send a commit without its author, committer, and log message. */
+const struct got_error *
+got_privsep_send_commit_header(struct imsgbuf *ibuf,
+    struct got_commit_object *commit)
+{
+	return send_commit(ibuf, commit, 1);
+}
+
+/*
+ * Parse a commit from the first message of a reply, which the caller has
+ * received already and must free. Any remaining messages are read from ibuf.
+ */
+const struct got_error *
+got_privsep_get_imsg_commit(struct got_commit_object **commit,
+    struct imsg *imsg, struct imsgbuf *ibuf)
 {
 	const struct got_error *err = NULL;
-	struct imsg imsg;
 	struct got_imsg_commit_object *icommit;
-	size_t len, datalen;
-	int i;
-	const size_t min_datalen =
-	    MIN(sizeof(struct got_imsg_error),
-	    sizeof(struct got_imsg_commit_object));
+	struct got_object_qid *qid;
+	size_t len, datalen, inline_len;
 
 	*commit = NULL;
 
-	err = got_privsep_recv_imsg(&imsg, ibuf, min_datalen);
-	if (err)
-		return err;
-
-	datalen = imsg.hdr.len - IMSG_HEADER_SIZE;
+	datalen = imsg->hdr.len - IMSG_HEADER_SIZE;
 	len = 0;
 
-	switch (imsg.hdr.type) {
+	switch (imsg->hdr.type) {
+	case GOT_IMSG_ERROR:
+		err = recv_imsg_error(imsg, datalen);
+		break;
 	case GOT_IMSG_COMMIT:
+	case GOT_IMSG_COMMIT_HEADER:
 		if (datalen < sizeof(*icommit)) {
 			err = got_error(GOT_ERR_PRIVSEP_LEN);
 			break;
 		}
-		icommit = imsg.data;
-		if (datalen != sizeof(*icommit) + icommit->author_len +
+		icommit = imsg->data;
+		if (icommit->nparents < 0 ||
+		    icommit->author_len > datalen ||
+		    icommit->committer_len > datalen ||
+		    icommit->nparents > datalen / SHA1_DIGEST_LENGTH) {
+			err = got_error(GOT_ERR_PRIVSEP_LEN);
+			break;
+		}
+		len = sizeof(*icommit) + icommit->author_len +
 		    icommit->committer_len +
-		    icommit->nparents * SHA1_DIGEST_LENGTH) {
+		    icommit->nparents * SHA1_DIGEST_LENGTH;
+		if (datalen < len) {
 			err = got_error(GOT_ERR_PRIVSEP_LEN);
 			break;
 		}
-		if (icommit->nparents < 0) {
+		inline_len = datalen - len;
+		if (inline_len > icommit->logmsg_len) {
+			err = got_error(GOT_ERR_PRIVSEP_LEN);
+			break;
+		}
+		if (imsg->hdr.type == GOT_IMSG_COMMIT_HEADER &&
+		    (icommit->author_len != 0 || icommit->committer_len != 0 ||
+		    icommit->logmsg_len != 0)) {
 			err = got_error(GOT_ERR_PRIVSEP_LEN);
 			break;
 		}
-		len += sizeof(*icommit);
 
-		*commit = got_object_commit_alloc_partial();
+		/* All commit data is stored in a single allocation. */
+		*commit = got_object_commit_alloc_compact(icommit->nparents,
+		    icommit->author_len, icommit->committer_len,
+		    icommit->logmsg_len);
 		if (*commit == NULL) {
 			err = got_error_from_errno(
-			    "got_object_commit_alloc_partial");
+			    "got_object_commit_alloc_compact");
 			break;
 		}
 
@@ -600,89 +1021,43 @@ got_privsep_recv_commit(struct got_commit_object **commit, struct imsgbuf *ibuf)
 		(*commit)->author_gmtoff = icommit->author_gmtoff;
 		(*commit)->committer_time = icommit->committer_time;
 		(*commit)->committer_gmtoff = icommit->committer_gmtoff;
+		if (imsg->hdr.type == GOT_IMSG_COMMIT_HEADER)
+			(*commit)->flags |= GOT_COMMIT_FLAG_HEADER_ONLY;
 
-		if (icommit->author_len == 0) {
-			(*commit)->author = strdup("");
-			if ((*commit)->author == NULL) {
-				err = got_error_from_errno("strdup");
-				break;
-			}
-		} else {
-			(*commit)->author = malloc(icommit->author_len + 1);
-			if ((*commit)->author == NULL) {
-				err = got_error_from_errno("malloc");
-				break;
-			}
-			memcpy((*commit)->author, imsg.data + len,
-			    icommit->author_len);
-			(*commit)->author[icommit->author_len] = '\0';
-		}
+		len = sizeof(*icommit);
+		memcpy((*commit)->author, imsg->data + len,
+		    icommit->author_len);
 		len += icommit->author_len;
-
-		if (icommit->committer_len == 0) {
-			(*commit)->committer = strdup("");
-			if ((*commit)->committer == NULL) {
-				err = got_error_from_errno("strdup");
-				break;
-			}
-		} else {
-			(*commit)->committer =
-			    malloc(icommit->committer_len + 1);
-			if ((*commit)->committer == NULL) {
-				err = got_error_from_errno("malloc");
-				break;
-			}
-			memcpy((*commit)->committer, imsg.data + len,
-			    icommit->committer_len);
-			(*commit)->committer[icommit->committer_len] = '\0';
-		}
+		memcpy((*commit)->committer, imsg->data + len,
+		    icommit->committer_len);
 		len += icommit->committer_len;
+		SIMPLEQ_FOREACH(qid, &(*commit)->parent_ids, entry) {
+			memcpy(qid->id->sha1, imsg->data + len,
+			    SHA1_DIGEST_LENGTH);
+			len += SHA1_DIGEST_LENGTH;
+		}
+		memcpy((*commit)->logmsg, imsg->data + len, inline_len);
 
-		if (icommit->logmsg_len == 0) {
-			(*commit)->logmsg = strdup("");
-			if ((*commit)->logmsg == NULL) {
-				err = got_error_from_errno("strdup");
-				break;
-			}
-		} else {
-			size_t offset = 0, remain = icommit->logmsg_len;
+		/* Long log messages are continued in separate messages. */
+		len = inline_len;
+		while (len < icommit->logmsg_len) {
+			struct imsg imsg_log;
+			size_t n = MIN(MAX_IMSGSIZE - IMSG_HEADER_SIZE,
+			    icommit->logmsg_len - len);
 
-			(*commit)->logmsg = malloc(icommit->logmsg_len + 1);
-			if ((*commit)->logmsg == NULL) {
-				err = got_error_from_errno("malloc");
+			err = got_privsep_recv_imsg(&imsg_log, ibuf, n);
+			if (err)
 				break;
-			}
-			while (remain > 0) {
-				struct imsg imsg_log;
-				size_t n = MIN(MAX_IMSGSIZE - IMSG_HEADER_SIZE,
-				    remain);
 
-				err = got_privsep_recv_imsg(&imsg_log, ibuf, n);
-				if (err)
-					return err;
-
-				if (imsg_log.hdr.type != GOT_IMSG_COMMIT_LOGMSG)
-					return got_error(GOT_ERR_PRIVSEP_MSG);
-
-				memcpy((*commit)->logmsg + offset,
-				    imsg_log.data, n);
+			if (imsg_log.hdr.type != GOT_IMSG_COMMIT_LOGMSG) {
 				imsg_free(&imsg_log);
-				offset += n;
-				remain -= n;
+				err = got_error(GOT_ERR_PRIVSEP_MSG);
+				break;
 			}
-			(*commit)->logmsg[icommit->logmsg_len] = '\0';
-		}
-
-		for (i = 0; i < icommit->nparents; i++) {
-			struct got_object_qid *qid;
 
-			err = got_object_qid_alloc_partial(&qid);
-			if (err)
-				break;
-			memcpy(qid->id, imsg.data + len +
-			    i * SHA1_DIGEST_LENGTH, sizeof(*qid->id));
-			SIMPLEQ_INSERT_TAIL(&(*commit)->parent_ids, qid, entry);
-			(*commit)->nparents++;
+			memcpy((*commit)->logmsg + len, imsg_log.data, n);
+			imsg_free(&imsg_log);
+			len += n;
 		}
 		break;
 	default:
@@ -690,8 +1065,30 @@ got_privsep_recv_commit(struct got_commit_object **commit, struct imsgbuf *ibuf)
 		break;
 	}
 
-	imsg_free(&imsg);
+	if (err && *commit) {
+		got_object_commit_close(*commit);
+		*commit = NULL;
+	}
+	return err;
+}
+
+const struct got_error *
+got_privsep_recv_commit(struct got_commit_object **commit, struct imsgbuf *ibuf)
+{
+	const struct got_error *err;
+	struct imsg imsg;
+	const size_t min_datalen =
+	    MIN(sizeof(struct got_imsg_error),
+	    sizeof(struct got_imsg_commit_object));
+
+	*commit = NULL;
 
+	err = got_privsep_recv_imsg(&imsg, ibuf, min_datalen);
+	if (err)
+		return err;
+
+	err = got_privsep_get_imsg_commit(commit, &imsg, ibuf);
+	imsg_free(&imsg);
 	return err;
 }
 
@@ -761,110 +1158,119 @@ got_privsep_send_tree(struct imsgbuf *ibuf, struct got_pathlist_head *entries,
 	return flush_imsg(ibuf);
 }
 
-const struct got_error *
-got_privsep_recv_tree(struct got_tree_object **tree, struct imsgbuf *ibuf)
+/* Add the contents of one message of a tree reply to a tree object. */
+static const struct got_error *
+recv_tree_imsg(struct got_tree_object **tree, int *nentries,
+    struct imsg *imsg)
 {
-	const struct got_error *err = NULL;
 	const size_t min_datalen =
 	    MIN(sizeof(struct got_imsg_error),
 	    sizeof(struct got_imsg_tree_object));
 	struct got_imsg_tree_object *itree;
-	int nentries = 0;
+	struct got_imsg_tree_entry *ite;
+	struct got_tree_entry *te;
+	size_t datalen;
 
-	*tree = NULL;
-get_more:
-	err = read_imsg(ibuf);
-	if (err)
-		goto done;
+	if (imsg->hdr.len < IMSG_HEADER_SIZE + min_datalen)
+		return got_error(GOT_ERR_PRIVSEP_LEN);
 
-	for (;;) {
-		struct imsg imsg;
-		size_t n;
-		size_t datalen;
-		struct got_imsg_tree_entry *ite;
-		struct got_tree_entry *te = NULL;
+	datalen = imsg->hdr.len - IMSG_HEADER_SIZE;
 
-		n = imsg_get(ibuf, &imsg);
-		if (n == 0) {
-			if (*tree && (*tree)->nentries != nentries)
-				goto get_more;
-			break;
+	switch (imsg->hdr.type) {
+	case GOT_IMSG_ERROR:
+		return recv_imsg_error(imsg, datalen);
+	case GOT_IMSG_TREE:
+		/* This message should only appear once. */
+		if (*tree != NULL)
+			return got_error(GOT_ERR_PRIVSEP_MSG);
+		if (datalen != sizeof(*itree))
+			return got_error(GOT_ERR_PRIVSEP_LEN);
+		itree = imsg->data;
+		*tree = malloc(sizeof(**tree));
+		if (*tree == NULL)
+			return got_error_from_errno("malloc");
+		(*tree)->entries = calloc(itree->nentries,
+		    sizeof(struct got_tree_entry));
+		if ((*tree)->entries == NULL) {
+			const struct got_error *err;
+			err = got_error_from_errno("calloc");
+			free(*tree);
+			*tree = NULL;
+			return err;
 		}
+		(*tree)->nentries = itree->nentries;
+		(*tree)->refcnt = 0;
+		break;
+	case GOT_IMSG_TREE_ENTRY:
+		/* This message should be preceeded by GOT_IMSG_TREE. */
+		if (*tree == NULL)
+			return got_error(GOT_ERR_PRIVSEP_MSG);
+		if (datalen < sizeof(*ite) || datalen > MAX_IMSGSIZE)
+			return got_error(GOT_ERR_PRIVSEP_LEN);
 
-		if (imsg.hdr.len < IMSG_HEADER_SIZE + min_datalen)
+		/* Remaining data contains the entry's name. */
+		datalen -= sizeof(*ite);
+		if (datalen == 0 || datalen > MAX_IMSGSIZE)
 			return got_error(GOT_ERR_PRIVSEP_LEN);
+		ite = imsg->data;
 
-		datalen = imsg.hdr.len - IMSG_HEADER_SIZE;
+		if (*nentries >= (*tree)->nentries)
+			return got_error(GOT_ERR_PRIVSEP_MSG);
+		te = &(*tree)->entries[*nentries];
+		if (datalen + 1 > sizeof(te->name))
+			return got_error(GOT_ERR_NO_SPACE);
+		memcpy(te->name, imsg->data + sizeof(*ite), datalen);
+		te->name[datalen] = '\0';
 
-		switch (imsg.hdr.type) {
-		case GOT_IMSG_ERROR:
-			err = recv_imsg_error(&imsg, datalen);
-			break;
-		case GOT_IMSG_TREE:
-			/* This message should only appear once. */
-			if (*tree != NULL) {
-				err = got_error(GOT_ERR_PRIVSEP_MSG);
-				break;
-			}
-			if (datalen != sizeof(*itree)) {
-				err = got_error(GOT_ERR_PRIVSEP_LEN);
-				break;
-			}
-			itree = imsg.data;
-			*tree = malloc(sizeof(**tree));
-			if (*tree == NULL) {
-				err = got_error_from_errno("malloc");
-				break;
-			}
-			(*tree)->entries = calloc(itree->nentries,
-			    sizeof(struct got_tree_entry));
-			if ((*tree)->entries == NULL) {
-				err = got_error_from_errno("malloc");
-				break;
-			}
-			(*tree)->nentries = itree->nentries;
-			(*tree)->refcnt = 0;
-			break;
-		case GOT_IMSG_TREE_ENTRY:
-			/* This message should be preceeded by GOT_IMSG_TREE. */
-			if (*tree == NULL) {
-				err = got_error(GOT_ERR_PRIVSEP_MSG);
-				break;
-			}
-			if (datalen < sizeof(*ite) || datalen > MAX_IMSGSIZE) {
-				err = got_error(GOT_ERR_PRIVSEP_LEN);
-				break;
-			}
+		memcpy(te->id.sha1, ite->id, SHA1_DIGEST_LENGTH);
+		te->mode = ite->mode;
+		te->idx = *nentries;
+		(*nentries)++;
+		break;
+	default:
+		return got_error(GOT_ERR_PRIVSEP_MSG);
+	}
 
-			/* Remaining data contains the entry's name. */
-			datalen -= sizeof(*ite);
-			if (datalen == 0 || datalen > MAX_IMSGSIZE) {
-				err = got_error(GOT_ERR_PRIVSEP_LEN);
-				break;
-			}
-			ite = imsg.data;
+	return NULL;
+}
 
-			if (datalen + 1 > sizeof(te->name)) {
-				err = got_error(GOT_ERR_NO_SPACE);
-				break;
-			}
-			te = &(*tree)->entries[nentries];
-			memcpy(te->name, imsg.data + sizeof(*ite), datalen);
-			te->name[datalen] = '\0';
-
-			memcpy(te->id.sha1, ite->id, SHA1_DIGEST_LENGTH);
-			te->mode = ite->mode;
-			te->idx = nentries;
-			nentries++;
-			break;
-		default:
-			err = got_error(GOT_ERR_PRIVSEP_MSG);
+/*
+ * Parse a tree from the first message of a reply, which the caller has
+ * received already and must free. Any remaining messages are read from ibuf.
+ */
+const struct got_error *
+got_privsep_get_imsg_tree(struct got_tree_object **tree, struct imsg *imsg,
+    struct imsgbuf *ibuf)
+{
+	const struct got_error *err;
+	int nentries = 0;
+
+	*tree = NULL;
+
+	err = recv_tree_imsg(tree, &nentries, imsg);
+
+	/*
+	 * Replies to pipelined requests may already be buffered. Only read
+	 * more data if necessary and stop once this tree is complete.
+	 */
+	while (err == NULL && *tree && (*tree)->nentries != nentries) {
+		struct imsg imsg_entry;
+		ssize_t n;
+
+		n = get_imsg(ibuf, &imsg_entry);
+		if (n == -1) {
+			err = got_error_from_errno("imsg_get");
 			break;
 		}
+		if (n == 0) {
+			err = read_imsg(ibuf);
+			continue;
+		}
 
-		imsg_free(&imsg);
+		err = recv_tree_imsg(tree, &nentries, &imsg_entry);
+		imsg_free(&imsg_entry);
 	}
-done:
+
 	if (*tree && (*tree)->nentries != nentries) {
 		if (err == NULL)
 			err = got_error(GOT_ERR_PRIVSEP_LEN);
@@ -875,6 +1281,23 @@ done:
 	return err;
 }
 
+const struct got_error *
+got_privsep_recv_tree(struct got_tree_object **tree, struct imsgbuf *ibuf)
+{
+	const struct got_error *err;
+	struct imsg imsg;
+
+	*tree = NULL;
+
+	err = got_privsep_recv_imsg(&imsg, ibuf, 0);
+	if (err)
+		return err;
+
+	err = got_privsep_get_imsg_tree(tree, &imsg, ibuf);
+	imsg_free(&imsg);
+	return err;
+}
+
 const struct got_error *
 got_privsep_send_blob(struct imsgbuf *ibuf, size_t size, size_t hdrlen,
     const uint8_t *data)
@@ -1591,3 +2014,209 @@ got_privsep_exec_child(int imsg_fds[2], const char *path, const char *repo_path)
 		_exit(1);
 	}
 }
+
+void
+got_privsep_async_init(struct got_privsep_async *async)
+{
+	TAILQ_INIT(&async->reqs);
+	async->nreqs = 0;
+	async->next_id = 1;
+}
+
+const struct got_error *
+got_privsep_async_add(uint32_t *id, struct got_privsep_async *async,
+    struct imsgbuf *ibuf, got_privsep_reply_cb reply_cb, void *reply_arg)
+{
+	struct got_privsep_async_req *req;
+
+	req = calloc(1, sizeof(*req));
+	if (req == NULL)
+		return got_error_from_errno("calloc");
+
+	req->id = async->next_id++;
+	if (async->next_id == 0)
+		async->next_id = 1;
+	req->ibuf = ibuf;
+	req->reply_cb = reply_cb;
+	req->reply_arg = reply_arg;
+	TAILQ_INSERT_TAIL(&async->reqs, req, entry);
+	async->nreqs++;
+
+	if (id)
+		*id = req->id;
+	return NULL;
+}
+
+int
+got_privsep_async_nreqs(struct got_privsep_async *async, struct imsgbuf *ibuf)
+{
+	struct got_privsep_async_req *req;
+	int n = 0;
+
+	if (ibuf == NULL)
+		return async->nreqs;
+
+	TAILQ_FOREACH(req, &async->reqs, entry) {
+		if (req->ibuf == ibuf)
+			n++;
+	}
+	return n;
+}
+
+/*
+ * Invoke reply callbacks for requests sent via ibuf whose replies have
+ * arrived. Child processes reply in the order in which requests were
+ * received, so each message read here begins a reply to the oldest
+ * outstanding request.
+ */
+static const struct got_error *
+dispatch_replies(int *ndone, struct got_privsep_async *async,
+    struct imsgbuf *ibuf)
+{
+	const struct got_error *err;
+	struct got_privsep_async_req *req;
+	struct imsg imsg;
+	ssize_t n;
+
+	*ndone = 0;
+
+	for (;;) {
+		TAILQ_FOREACH(req, &async->reqs, entry) {
+			if (req->ibuf == ibuf)
+				break;
+		}
+		if (req == NULL)
+			return NULL;
+
+		n = get_imsg(ibuf, &imsg);
+		if (n == -1)
+			return got_error_from_errno("imsg_get");
+		if (n == 0)
+			return NULL;
+
+		TAILQ_REMOVE(&async->reqs, req, entry);
+		async->nreqs--;
+		err = req->reply_cb(req->reply_arg, req->id, &imsg, ibuf);
+		imsg_free(&imsg);
+		free(req);
+		if (err)
+			return err;
+		(*ndone)++;
+	}
+}
+
+const struct got_error *
+got_privsep_async_dispatch(int *ndone, struct got_privsep_async *async,
+    int timeout)
+{
+	const struct got_error *err = NULL;
+	struct got_privsep_async_req *req;
+	struct pollfd *pfd = NULL;
+	struct imsgbuf **ibufs = NULL;
+	int i, n, nchan = 0, npoll = 0;
+
+	*ndone = 0;
+
+	if (TAILQ_EMPTY(&async->reqs))
+		return NULL;
+
+	pfd = calloc(async->nreqs, sizeof(*pfd));
+	if (pfd == NULL)
+		return got_error_from_errno("calloc");
+	ibufs = calloc(async->nreqs, sizeof(*ibufs));
+	if (ibufs == NULL) {
+		err = got_error_from_errno("calloc");
+		goto done;
+	}
+
+	/* Collect child processes which owe us replies. */
+	TAILQ_FOREACH(req, &async->reqs, entry) {
+		for (i = 0; i < nchan; i++) {
+			if (ibufs[i] == req->ibuf)
+				break;
+		}
+		if (i == nchan)
+			ibufs[nchan++] = req->ibuf;
+	}
+
+	/*
+	 * Send any requests which are still queued, and dispatch replies
+	 * which were buffered while reading an earlier reply.
+	 */
+	for (i = 0; i < nchan; i++) {
+		if (ibufs[i]->w.queued > 0) {
+			err = flush_imsg(ibufs[i]);
+			if (err)
+				goto done;
+		}
+		err = dispatch_replies(&n, async, ibufs[i]);
+		if (err)
+			goto done;
+		*ndone += n;
+	}
+
+	/* Wait for children which still owe us replies. */
+	for (i = 0; i < nchan; i++) {
+		if (got_privsep_async_nreqs(async, ibufs[i]) == 0)
+			continue;
+		ibufs[npoll] = ibufs[i];
+		pfd[npoll].fd = ibufs[i]->fd;
+		pfd[npoll].events = POLLIN;
+		npoll++;
+	}
+	if (npoll == 0)
+		goto done;
+
+	n = poll(pfd, npoll, *ndone > 0 ? 0 : timeout);
+	if (n == -1) {
+		err = got_error_from_errno("poll");
+		goto done;
+	}
+
+	for (i = 0; i < npoll; i++) {
+		if (pfd[i].revents & (POLLERR | POLLNVAL)) {
+			err = got_error_from_errno("poll error");
+			goto done;
+		}
+		if ((pfd[i].revents & (POLLIN | POLLHUP)) == 0)
+			continue;
+		err = read_imsg_ready(ibufs[i]);
+		if (err)
+			goto done;
+		err = dispatch_replies(&n, async, ibufs[i]);
+		if (err)
+			goto done;
+		*ndone += n;
+	}
+done:
+	free(ibufs);
+	free(pfd);
+	return err;
+}
+
+const struct got_error *
+got_privsep_async_wait(struct got_privsep_async *async)
+{
+	const struct got_error *err;
+	int ndone;
+
+	while (!TAILQ_EMPTY(&async->reqs)) {
+		err = got_privsep_async_dispatch(&ndone, async, INFTIM);
+		if (err)
+			return err;
+	}
+
+	return NULL;
+}
+
+void
+got_privsep_async_free(struct got_privsep_async *async)
+{
+	struct got_privsep_async_req *req;
+
+	while ((req = TAILQ_FIRST(&async->reqs))) {
+		TAILQ_REMOVE(&async->reqs, req, entry);
+		free(req);
+	}
+	async->nreqs = 0;
+}
@@ -57,6 +57,9 @@
 #include "got_lib_worktree.h"
 #include "got_lib_sha1.h"
 #include "got_lib_object_cache.h"
+#include "got_lib_commit_graph_file.h"
+#include "got_lib_bitmap.h"
+#include "got_lib_blame_cache.h"
 #include "got_lib_repository.h"
 
 #ifndef nitems
@@ -155,6 +158,12 @@ got_repo_get_path_packed_refs(struct got_repository *repo)
 	return get_path_git_child(repo, GOT_PACKED_REFS_FILE);
 }
 
+char *
+got_repo_get_path_blame_cache(struct got_repository *repo)
+{
+	return get_path_git_child(repo, GOT_BLAME_CACHE_DIR);
+}
+
 static char *
 get_path_head(struct got_repository *repo)
 {
@@ -420,6 +429,7 @@ parse_gitconfig_file(int *gitconfig_repository_format_version,
 	}
 	imsg_fds[1] = -1;
 	imsg_init(ibuf, imsg_fds[0]);
+	got_privsep_stats_register(ibuf, GOT_PATH_PROG_READ_GITCONFIG);
 
 	err = got_privsep_send_gitconfig_parse_req(ibuf, fd);
 	if (err)
@@ -518,7 +528,7 @@ got_repo_open(struct got_repository **repop, const char *path,
 	struct got_repository *repo = NULL;
 	const struct got_error *err = NULL;
 	char *abspath;
-	int i, tried_root = 0;
+	int i, j, tried_root = 0;
 
 	*repop = NULL;
 
@@ -536,9 +546,11 @@ got_repo_open(struct got_repository **repop, const char *path,
 	}
 
 	for (i = 0; i < nitems(repo->privsep_children); i++) {
-		memset(&repo->privsep_children[i], 0,
-		    sizeof(repo->privsep_children[0]));
-		repo->privsep_children[i].imsg_fd = -1;
+		for (j = 0; j < nitems(repo->privsep_children[0]); j++) {
+			memset(&repo->privsep_children[i][j], 0,
+			    sizeof(repo->privsep_children[0][0]));
+			repo->privsep_children[i][j].imsg_fd = -1;
+		}
 	}
 
 	err = got_object_cache_init(&repo->objcache,
@@ -602,7 +614,7 @@ const struct got_error *
 got_repo_close(struct got_repository *repo)
 {
 	const struct got_error *err = NULL, *child_err;
-	int i;
+	int i, j;
 
 	for (i = 0; i < nitems(repo->packidx_cache); i++) {
 		if (repo->packidx_cache[i] == NULL)
@@ -616,6 +628,11 @@ got_repo_close(struct got_repository *repo)
 		got_pack_close(&repo->packs[i]);
 	}
 
+	if (repo->commit_graph_file)
+		got_commit_graph_file_close(repo->commit_graph_file);
+	if (repo->bitmap_index)
+		got_bitmap_index_close(repo->bitmap_index);
+
 	free(repo->path);
 	free(repo->path_git_dir);
 
@@ -624,19 +641,24 @@ got_repo_close(struct got_repository *repo)
 	got_object_cache_close(&repo->commitcache);
 	got_object_cache_close(&repo->tagcache);
 
+	got_privsep_stats_print();
+
 	for (i = 0; i < nitems(repo->privsep_children); i++) {
-		if (repo->privsep_children[i].imsg_fd == -1)
-			continue;
-		imsg_clear(repo->privsep_children[i].ibuf);
-		free(repo->privsep_children[i].ibuf);
-		err = got_privsep_send_stop(repo->privsep_children[i].imsg_fd);
-		child_err = got_privsep_wait_for_child(
-		    repo->privsep_children[i].pid);
-		if (child_err && err == NULL)
-			err = child_err;
-		if (close(repo->privsep_children[i].imsg_fd) != 0 &&
-		    err == NULL)
-			err = got_error_from_errno("close");
+		for (j = 0; j < nitems(repo->privsep_children[0]); j++) {
+			struct got_privsep_child *child;
+
+			child = &repo->privsep_children[i][j];
+			if (child->imsg_fd == -1)
+				continue;
+			imsg_clear(child->ibuf);
+			free(child->ibuf);
+			err = got_privsep_send_stop(child->imsg_fd);
+			child_err = got_privsep_wait_for_child(child->pid);
+			if (child_err && err == NULL)
+				err = child_err;
+			if (close(child->imsg_fd) != 0 && err == NULL)
+				err = got_error_from_errno("close");
+		}
 	}
 
 	free(repo->gitconfig_author_name);
@@ -1013,6 +1035,112 @@ done:
 	return err;
 }
 
+/*
+ * Return the repository's commit-graph file, or NULL if there is none.
+ * A commit-graph file which cannot be read is ignored since all of its
+ * information can be obtained from commit objects as well.
+ */
+struct got_commit_graph_file *
+got_repo_get_commit_graph_file(struct got_repository *repo)
+{
+	const struct got_error *err;
+
+	if (!repo->commit_graph_file_checked) {
+		repo->commit_graph_file_checked = 1;
+		err = got_commit_graph_file_open(&repo->commit_graph_file,
+		    repo->path_git_dir);
+		if (err)
+			repo->commit_graph_file = NULL;
+	}
+
+	return repo->commit_graph_file;
+}
+
+/*
+ * Open the bitmap file of the first pack file which has one.
+ * git-repack(1) writes a bitmap file only for a pack file which contains
+ * all objects in the repository, so there is at most one such file.
+ */
+static const struct got_error *
+open_bitmap_index(struct got_bitmap_index **bidx,
+    struct got_repository *repo)
+{
+	const struct got_error *err = NULL;
+	char *path_packdir;
+	DIR *packdir;
+	struct dirent *dent;
+	char *path_packidx = NULL, *path_bitmap = NULL;
+
+	*bidx = NULL;
+
+	path_packdir = got_repo_get_path_objects_pack(repo);
+	if (path_packdir == NULL)
+		return got_error_from_errno("got_repo_get_path_objects_pack");
+
+	packdir = opendir(path_packdir);
+	if (packdir == NULL) {
+		if (errno != ENOENT)
+			err = got_error_from_errno2("opendir", path_packdir);
+		goto done;
+	}
+
+	while ((dent = readdir(packdir)) != NULL) {
+		if (!is_packidx_filename(dent->d_name, dent->d_namlen))
+			continue;
+
+		if (asprintf(&path_packidx, "%s/%s", path_packdir,
+		    dent->d_name) == -1) {
+			err = got_error_from_errno("asprintf");
+			path_packidx = NULL;
+			goto done;
+		}
+		if (asprintf(&path_bitmap, "%s/%.*s%s", path_packdir,
+		    (int)(dent->d_namlen - strlen(GOT_PACKIDX_SUFFIX)),
+		    dent->d_name, GOT_BITMAP_SUFFIX) == -1) {
+			err = got_error_from_errno("asprintf");
+			path_bitmap = NULL;
+			goto done;
+		}
+
+		if (access(path_bitmap, R_OK) == 0) {
+			err = got_bitmap_index_open(bidx, path_bitmap,
+			    path_packidx);
+			goto done;
+		}
+		if (errno != ENOENT) {
+			err = got_error_from_errno2("access", path_bitmap);
+			goto done;
+		}
+
+		free(path_packidx);
+		path_packidx = NULL;
+		free(path_bitmap);
+		path_bitmap = NULL;
+	}
+done:
+	free(path_packdir);
+	free(path_packidx);
+	free(path_bitmap);
+	if (packdir && closedir(packdir) != 0 && err == NULL)
+		err = got_error_from_errno("closedir");
+	return err;
+}
+
+struct got_bitmap_index *
+got_repo_get_bitmap_index(struct got_repository *repo)
+{
+	const struct got_error *err;
+
+	if (!repo->bitmap_index_checked) {
+		repo->bitmap_index_checked = 1;
+		err = open_bitmap_index(&repo->bitmap_index, repo);
+		if (err)
+			repo->bitmap_index = NULL;
+	}
+
+	return repo->bitmap_index;
+}
+
 struct got_pack *
 got_repo_get_cached_pack(struct got_repository *repo, const char *path_packfile)
 {
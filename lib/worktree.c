@@ -3108,7 +3108,6 @@ apply_or_reject_change(int *choice, struct got_diff_change *change, int n,
 	int end_old = change->cv.b;
 	int start_new = change->cv.c;
 	int end_new = change->cv.d;
-	long pos1, pos2;
 	FILE *hunkfile;
 
 	*choice = GOT_PATCH_CHOICE_NONE;
@@ -3117,20 +3116,9 @@ apply_or_reject_change(int *choice, struct got_diff_change *change, int n,
 	if (hunkfile == NULL)
 		return got_error_from_errno("got_opentemp");
 
-	pos1 = ftell(f1);
-	pos2 = ftell(f2);
-
 	/* XXX TODO needs error checking */
-	got_diff_dump_change(hunkfile, change, ds, args, f1, f2, diff_flags);
+	got_diff_dump_change(hunkfile, change, ds, args, diff_flags);
 
-	if (fseek(f1, pos1, SEEK_SET) == -1) {
-		err = got_ferror(f1, GOT_ERR_IO);
-		goto done;
-	}
-	if (fseek(f2, pos2, SEEK_SET) == -1) {
-		err = got_ferror(f1, GOT_ERR_IO);
-		goto done;
-	}
 	if (fseek(hunkfile, 0L, SEEK_SET) == -1) {
 		err = got_ferror(hunkfile, GOT_ERR_IO);
 		goto done;
@@ -121,7 +121,8 @@ main(int argc, char *argv[])
 		if (imsg.hdr.type == GOT_IMSG_STOP)
 			break;
 
-		if (imsg.hdr.type != GOT_IMSG_COMMIT_REQUEST) {
+		if (imsg.hdr.type != GOT_IMSG_COMMIT_REQUEST &&
+		    imsg.hdr.type != GOT_IMSG_COMMIT_HEADER_REQUEST) {
 			err = got_error(GOT_ERR_PRIVSEP_MSG);
 			goto done;
 		}
@@ -142,7 +143,10 @@ main(int argc, char *argv[])
 		if (err)
 			goto done;
 
-		err = got_privsep_send_commit(&ibuf, commit);
+		if (imsg.hdr.type == GOT_IMSG_COMMIT_HEADER_REQUEST)
+			err = got_privsep_send_commit_header(&ibuf, commit);
+		else
+			err = got_privsep_send_commit(&ibuf, commit);
 done:
 		if (f) {
 			if (fclose(f) != 0 && err == NULL)
@@ -144,7 +144,10 @@ commit_request(struct imsg *imsg, struct imsgbuf *ibuf, struct got_pack *pack,
 	if (err)
 		goto done;
 
-	err = got_privsep_send_commit(ibuf, commit);
+	if (imsg->hdr.type == GOT_IMSG_COMMIT_HEADER_REQUEST)
+		err = got_privsep_send_commit_header(ibuf, commit);
+	else
+		err = got_privsep_send_commit(ibuf, commit);
 done:
 	free(buf);
 	got_object_close(obj);
@@ -591,6 +594,7 @@ main(int argc, char *argv[])
 			    &objcache);
 			break;
 		case GOT_IMSG_COMMIT_REQUEST:
+		case GOT_IMSG_COMMIT_HEADER_REQUEST:
 			err = commit_request(&imsg, &ibuf, pack, packidx,
 			    &objcache);
 			break;
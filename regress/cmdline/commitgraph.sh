@@ -0,0 +1,224 @@
+#!/bin/sh
+#
+# Copyright (c) 2026 agent <agent@local>
+#
+# Permission to use, copy, modify, and distribute this software for any
+# purpose with or without fee is hereby granted, provided that the above
+# copyright notice and this permission notice appear in all copies.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+# WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+# MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+# ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+# WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+# ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+# OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+. ./common.sh
+
+function make_test_history
+{
+	local repo="$1"
+
+	echo "modified alpha" > $repo/alpha
+	git_commit $repo -m "modified alpha"
+	(cd $repo && git checkout -q -b newbranch)
+	echo "modified zeta" > $repo/epsilon/zeta
+	git_commit $repo -m "modified zeta"
+	(cd $repo && git checkout -q master)
+	echo "modified delta" > $repo/gamma/delta
+	git_commit $repo -m "modified delta"
+	(cd $repo && git merge -q -m "merge newbranch" newbranch)
+	(cd $repo && git tag -a -m "test" 1.0)
+}
+
+function test_commitgraph_basic {
+	local testroot=`test_init commitgraph_basic`
+
+	make_test_history $testroot/repo
+
+	for p in "" alpha epsilon/zeta gamma; do
+		got log -r $testroot/repo $p > $testroot/stdout.expected.$p
+	done
+
+	got commitgraph -r $testroot/repo > $testroot/stdout
+	ret="$?"
+	if [ "$ret" != "0" ]; then
+		echo "got commitgraph command failed unexpectedly"
+		test_done "$testroot" "$ret"
+		return 1
+	fi
+
+	echo "Wrote commit-graph file with 5 commits" > $testroot/stdout.expected
+	cmp -s $testroot/stdout.expected $testroot/stdout
+	ret="$?"
+	if [ "$ret" != "0" ]; then
+		diff -u $testroot/stdout.expected $testroot/stdout
+		test_done "$testroot" "$ret"
+		return 1
+	fi
+
+	# Ensure that Git accepts the commit-graph file Got has written
+	(cd $testroot/repo && git commit-graph verify)
+	ret="$?"
+	if [ "$ret" != "0" ]; then
+		echo "git commit-graph verify failed unexpectedly"
+		test_done "$testroot" "$ret"
+		return 1
+	fi
+
+	for p in "" alpha epsilon/zeta gamma; do
+		got log -r $testroot/repo $p > $testroot/stdout
+		cmp -s $testroot/stdout.expected.$p $testroot/stdout
+		ret="$?"
+		if [ "$ret" != "0" ]; then
+			diff -u $testroot/stdout.expected.$p $testroot/stdout
+			test_done "$testroot" "$ret"
+			return 1
+		fi
+	done
+
+	test_done "$testroot" "0"
+}
+
+function test_commitgraph_bloom {
+	local testroot=`test_init commitgraph_bloom`
+	local graph=$testroot/repo/.git/objects/info/commit-graph
+
+	make_test_history $testroot/repo
+
+	got commitgraph -b -r $testroot/repo > /dev/null
+	ret="$?"
+	if [ "$ret" != "0" ]; then
+		echo "got commitgraph command failed unexpectedly"
+		test_done "$testroot" "$ret"
+		return 1
+	fi
+
+	(cd $testroot/repo && git commit-graph verify)
+	ret="$?"
+	if [ "$ret" != "0" ]; then
+		echo "git commit-graph verify failed unexpectedly"
+		test_done "$testroot" "$ret"
+		return 1
+	fi
+
+	# Commits made after the commit-graph was written must still appear
+	echo "modified beta" > $testroot/repo/beta
+	git_commit $testroot/repo -m "modified beta"
+
+	for p in "" alpha beta epsilon epsilon/zeta gamma/delta; do
+		got log -r $testroot/repo $p > $testroot/stdout.$p
+	done
+
+	mv $graph $testroot/commit-graph
+
+	for p in "" alpha beta epsilon epsilon/zeta gamma/delta; do
+		got log -r $testroot/repo $p > $testroot/stdout.expected
+		cmp -s $testroot/stdout.expected $testroot/stdout.$p
+		ret="$?"
+		if [ "$ret" != "0" ]; then
+			diff -u $testroot/stdout.expected $testroot/stdout.$p
+			test_done "$testroot" "$ret"
+			return 1
+		fi
+	done
+
+	test_done "$testroot" "0"
+}
+
+function test_commitgraph_log_author_order {
+	local testroot=`test_init commitgraph_log_author_order`
+	local commit_id0=`git_show_head $testroot/repo`
+
+	# Author times are not stored in the commit-graph file.
+	(cd $testroot/repo && git checkout -q -b newbranch)
+	echo "modified zeta" > $testroot/repo/epsilon/zeta
+	(cd $testroot/repo && env GIT_AUTHOR_DATE="2000-01-01T00:00:00" \
+		git commit --author="$GOT_AUTHOR" -q -a -m "modified zeta")
+	local commit_id1=`git_show_head $testroot/repo`
+
+	(cd $testroot/repo && git checkout -q master)
+	echo "new file" > $testroot/repo/epsilon/new
+	(cd $testroot/repo && git add epsilon/new)
+	(cd $testroot/repo && env GIT_AUTHOR_DATE="2000-01-02T00:00:00" \
+		git commit --author="$GOT_AUTHOR" -q -a -m "added epsilon/new")
+	local commit_id2=`git_show_head $testroot/repo`
+
+	(cd $testroot/repo && git merge -q -m "merge newbranch" newbranch)
+	local commit_id3=`git_show_head $testroot/repo`
+
+	echo "commit $commit_id3 (master)" > $testroot/stdout.expected
+	echo "commit $commit_id2" >> $testroot/stdout.expected
+	echo "commit $commit_id1 (newbranch)" >> $testroot/stdout.expected
+	echo "commit $commit_id0" >> $testroot/stdout.expected
+
+	got commitgraph -r $testroot/repo > /dev/null
+	ret="$?"
+	if [ "$ret" != "0" ]; then
+		echo "got commitgraph command failed unexpectedly"
+		test_done "$testroot" "$ret"
+		return 1
+	fi
+
+	# Parents read while looking for changes must not lose author times.
+	got log -a -r $testroot/repo epsilon | grep ^commit > $testroot/stdout
+	cmp -s $testroot/stdout.expected $testroot/stdout
+	ret="$?"
+	if [ "$ret" != "0" ]; then
+		diff -u $testroot/stdout.expected $testroot/stdout
+	fi
+	test_done "$testroot" "$ret"
+}
+
+function test_commitgraph_corrupt {
+	local testroot=`test_init commitgraph_corrupt`
+	local graph=$testroot/repo/.git/objects/info/commit-graph
+
+	make_test_history $testroot/repo
+
+	for p in "" alpha epsilon/zeta gamma; do
+		got log -r $testroot/repo $p > $testroot/stdout.expected.$p
+	done
+
+	got commitgraph -r $testroot/repo > /dev/null
+	ret="$?"
+	if [ "$ret" != "0" ]; then
+		echo "got commitgraph command failed unexpectedly"
+		test_done "$testroot" "$ret"
+		return 1
+	fi
+
+	# Overwrite the last byte before the checksum trailer.
+	local size=`ls -l $graph | awk '{print $5}'`
+	chmod u+w $graph
+	printf '\377' | dd of=$graph bs=1 seek=$((size - 21)) \
+		conv=notrunc 2> /dev/null
+
+	(cd $testroot/repo && git commit-graph verify 2> /dev/null)
+	ret="$?"
+	if [ "$ret" = "0" ]; then
+		echo "git commit-graph verify succeeded unexpectedly"
+		test_done "$testroot" "1"
+		return 1
+	fi
+
+	# A commit-graph file with a bad checksum must be ignored.
+	for p in "" alpha epsilon/zeta gamma; do
+		got log -r $testroot/repo $p > $testroot/stdout
+		cmp -s $testroot/stdout.expected.$p $testroot/stdout
+		ret="$?"
+		if [ "$ret" != "0" ]; then
+			diff -u $testroot/stdout.expected.$p $testroot/stdout
+			test_done "$testroot" "$ret"
+			return 1
+		fi
+	done
+
+	test_done "$testroot" "0"
+}
+
+run_test test_commitgraph_basic
+run_test test_commitgraph_bloom
+run_test test_commitgraph_log_author_order
+run_test test_commitgraph_corrupt
@@ -267,7 +267,130 @@ function test_diff_ignore_whitespace {
 	test_done "$testroot" "$ret"
 }
 
+function test_diff_many_files {
+	local testroot=`test_init diff_many_files`
+
+	mkdir $testroot/repo/many
+	for i in `jot -w %02d 40`; do
+		echo "$i" > $testroot/repo/many/$i
+	done
+	(cd $testroot/repo && git add many)
+	git_commit $testroot/repo -m "add many files"
+	local commit_id0=`git_show_head $testroot/repo`
+
+	for i in `jot -w %02d 40`; do
+		echo "modified $i" > $testroot/repo/many/$i
+	done
+	git_commit $testroot/repo -m "modify many files"
+	local commit_id1=`git_show_head $testroot/repo`
+
+	# Output must appear in tree order even if files are diffed in parallel.
+	echo "diff $commit_id0 $commit_id1" > $testroot/stdout.expected
+	for i in `jot -w %02d 40`; do
+		echo -n 'blob - ' >> $testroot/stdout.expected
+		got tree -r $testroot/repo -c $commit_id0 -i many | \
+			grep "[ /]$i\$" | cut -d' ' -f 1 >> $testroot/stdout.expected
+		echo -n 'blob + ' >> $testroot/stdout.expected
+		got tree -r $testroot/repo -c $commit_id1 -i many | \
+			grep "[ /]$i\$" | cut -d' ' -f 1 >> $testroot/stdout.expected
+		echo "--- many/$i" >> $testroot/stdout.expected
+		echo "+++ many/$i" >> $testroot/stdout.expected
+		echo '@@ -1 +1 @@' >> $testroot/stdout.expected
+		echo "-$i" >> $testroot/stdout.expected
+		echo "+modified $i" >> $testroot/stdout.expected
+	done
+
+	got diff -r $testroot/repo $commit_id0 $commit_id1 > $testroot/stdout
+	cmp -s $testroot/stdout.expected $testroot/stdout
+	ret="$?"
+	if [ "$ret" != "0" ]; then
+		diff -u $testroot/stdout.expected $testroot/stdout
+	fi
+	test_done "$testroot" "$ret"
+}
+
+function test_diff_binary_and_large_files {
+	local testroot=`test_init diff_binary_and_large_files`
+	local commit_id0=`git_show_head $testroot/repo`
+
+	printf 'binary\000data\n' > $testroot/repo/binary
+	(cd $testroot/repo && git add binary)
+	git_commit $testroot/repo -m "add binary file"
+	local commit_id1=`git_show_head $testroot/repo`
+
+	echo "diff $commit_id0 $commit_id1" > $testroot/stdout.expected
+	echo "blob - /dev/null" >> $testroot/stdout.expected
+	echo -n 'blob + ' >> $testroot/stdout.expected
+	got tree -r $testroot/repo -i -c $commit_id1 | grep 'binary$' | \
+		cut -d' ' -f 1 | tr -d '\n' >> $testroot/stdout.expected
+	echo " (mode 644)" >> $testroot/stdout.expected
+	echo 'Binary files /dev/null and binary differ' \
+		>> $testroot/stdout.expected
+
+	got diff -r $testroot/repo $commit_id0 $commit_id1 > $testroot/stdout
+	cmp -s $testroot/stdout.expected $testroot/stdout
+	ret="$?"
+	if [ "$ret" != "0" ]; then
+		diff -u $testroot/stdout.expected $testroot/stdout
+		test_done "$testroot" "$ret"
+		return 1
+	fi
+
+	echo "modified alpha" > $testroot/repo/alpha
+	git_commit $testroot/repo -m "changed alpha"
+	local commit_id2=`git_show_head $testroot/repo`
+
+	echo "diff $commit_id1 $commit_id2" > $testroot/stdout.expected
+	echo -n 'blob - ' >> $testroot/stdout.expected
+	got tree -r $testroot/repo -c $commit_id1 -i | grep 'alpha$' | \
+		cut -d' ' -f 1 >> $testroot/stdout.expected
+	echo -n 'blob + ' >> $testroot/stdout.expected
+	got tree -r $testroot/repo -c $commit_id2 -i | grep 'alpha$' | \
+		cut -d' ' -f 1 >> $testroot/stdout.expected
+	echo 'Large files alpha and alpha differ (6 and 15 bytes)' \
+		>> $testroot/stdout.expected
+
+	env GOT_DIFF_MAX_BLOB_SIZE=10 got diff -r $testroot/repo \
+		$commit_id1 $commit_id2 > $testroot/stdout
+	cmp -s $testroot/stdout.expected $testroot/stdout
+	ret="$?"
+	if [ "$ret" != "0" ]; then
+		diff -u $testroot/stdout.expected $testroot/stdout
+	fi
+	test_done "$testroot" "$ret"
+}
+
+function test_diff_renamed_file {
+	local testroot=`test_init diff_renamed_file`
+	local commit_id0=`git_show_head $testroot/repo`
+
+	(cd $testroot/repo && git mv alpha alpha2)
+	git_commit $testroot/repo -m "renamed alpha"
+	local commit_id1=`git_show_head $testroot/repo`
+
+	echo "diff $commit_id0 $commit_id1" > $testroot/stdout.expected
+	echo -n 'blob - ' >> $testroot/stdout.expected
+	got tree -r $testroot/repo -c $commit_id0 -i | grep 'alpha$' | \
+		cut -d' ' -f 1 >> $testroot/stdout.expected
+	echo -n 'blob + ' >> $testroot/stdout.expected
+	got tree -r $testroot/repo -c $commit_id1 -i | grep 'alpha2$' | \
+		cut -d' ' -f 1 >> $testroot/stdout.expected
+	echo '--- alpha' >> $testroot/stdout.expected
+	echo '+++ alpha2' >> $testroot/stdout.expected
+
+	got diff -r $testroot/repo $commit_id0 $commit_id1 > $testroot/stdout
+	cmp -s $testroot/stdout.expected $testroot/stdout
+	ret="$?"
+	if [ "$ret" != "0" ]; then
+		diff -u $testroot/stdout.expected $testroot/stdout
+	fi
+	test_done "$testroot" "$ret"
+}
+
 run_test test_diff_basic
 run_test test_diff_shows_conflict
 run_test test_diff_tag
 run_test test_diff_ignore_whitespace
+run_test test_diff_many_files
+run_test test_diff_binary_and_large_files
+run_test test_diff_renamed_file
@@ -265,9 +265,220 @@ function test_log_limit {
 	test_done "$testroot" "0"
 }
 
+function test_log_topo_order {
+	local testroot=`test_init log_topo_order`
+	local commit_id0=`git_show_head $testroot/repo`
+
+	# Commit on a branch with a clock set far into the future.
+	(cd $testroot/repo && git checkout -q -b newbranch)
+	echo "modified zeta" > $testroot/repo/epsilon/zeta
+	(cd $testroot/repo && env GIT_COMMITTER_DATE="2100-01-01T00:00:00" \
+		git commit --author="$GOT_AUTHOR" -q -a -m "modified zeta")
+	local commit_id1=`git_show_head $testroot/repo`
+
+	(cd $testroot/repo && git checkout -q master)
+	echo "modified alpha" > $testroot/repo/alpha
+	git_commit $testroot/repo -m "modified alpha"
+	local commit_id2=`git_show_head $testroot/repo`
+
+	(cd $testroot/repo && env GIT_COMMITTER_DATE="2100-01-02T00:00:00" \
+		git merge -q -m "merge newbranch" newbranch)
+	local commit_id3=`git_show_head $testroot/repo`
+
+	# By default, the skewed commit is shown before its sibling.
+	echo "commit $commit_id3 (master)" > $testroot/stdout.expected
+	echo "commit $commit_id1 (newbranch)" >> $testroot/stdout.expected
+	echo "commit $commit_id2" >> $testroot/stdout.expected
+	echo "commit $commit_id0" >> $testroot/stdout.expected
+	got log -r $testroot/repo | grep ^commit > $testroot/stdout
+	cmp -s $testroot/stdout.expected $testroot/stdout
+	ret="$?"
+	if [ "$ret" != "0" ]; then
+		diff -u $testroot/stdout.expected $testroot/stdout
+		test_done "$testroot" "$ret"
+		return 1
+	fi
+
+	# In topological order, the first parent's line is shown first.
+	echo "commit $commit_id3 (master)" > $testroot/stdout.expected
+	echo "commit $commit_id2" >> $testroot/stdout.expected
+	echo "commit $commit_id1 (newbranch)" >> $testroot/stdout.expected
+	echo "commit $commit_id0" >> $testroot/stdout.expected
+	got log -t -r $testroot/repo | grep ^commit > $testroot/stdout
+	cmp -s $testroot/stdout.expected $testroot/stdout
+	ret="$?"
+	if [ "$ret" != "0" ]; then
+		diff -u $testroot/stdout.expected $testroot/stdout
+		test_done "$testroot" "$ret"
+		return 1
+	fi
+
+	# Same result with generation numbers from a commit-graph file.
+	got commitgraph -r $testroot/repo > /dev/null
+	got log -t -r $testroot/repo | grep ^commit > $testroot/stdout
+	cmp -s $testroot/stdout.expected $testroot/stdout
+	ret="$?"
+	if [ "$ret" != "0" ]; then
+		diff -u $testroot/stdout.expected $testroot/stdout
+	fi
+	test_done "$testroot" "$ret"
+}
+
+function test_log_search {
+	local testroot=`test_init log_search`
+	local commit_id0=`git_show_head $testroot/repo`
+
+	echo "modified alpha" > $testroot/repo/alpha
+	git_commit $testroot/repo -m "fix alpha"
+	local commit_id1=`git_show_head $testroot/repo`
+
+	echo "modified beta" > $testroot/repo/beta
+	git_commit $testroot/repo -m "change beta"
+	local commit_id2=`git_show_head $testroot/repo`
+
+	echo "modified alpha again" > $testroot/repo/alpha
+	git_commit $testroot/repo -m "fix alpha again"
+	local commit_id3=`git_show_head $testroot/repo`
+
+	# Matching commits are shown in log order.
+	echo "commit $commit_id3 (master)" > $testroot/stdout.expected
+	echo "commit $commit_id1" >> $testroot/stdout.expected
+	got log -s 'fix.*alpha' -r $testroot/repo | grep ^commit \
+		> $testroot/stdout
+	cmp -s $testroot/stdout.expected $testroot/stdout
+	ret="$?"
+	if [ "$ret" != "0" ]; then
+		diff -u $testroot/stdout.expected $testroot/stdout
+		test_done "$testroot" "$ret"
+		return 1
+	fi
+
+	# The log limit counts matching commits only.
+	echo "commit $commit_id3 (master)" > $testroot/stdout.expected
+	got log -l1 -s 'fix.*alpha' -r $testroot/repo | grep ^commit \
+		> $testroot/stdout
+	cmp -s $testroot/stdout.expected $testroot/stdout
+	ret="$?"
+	if [ "$ret" != "0" ]; then
+		diff -u $testroot/stdout.expected $testroot/stdout
+	fi
+	test_done "$testroot" "$ret"
+}
+
+function test_log_follow_renames {
+	local testroot=`test_init log_follow_renames`
+	local commit_id0=`git_show_head $testroot/repo`
+
+	(cd $testroot/repo && git mv alpha alpha2)
+	git_commit $testroot/repo -m "renamed alpha"
+	local commit_id1=`git_show_head $testroot/repo`
+
+	echo "modified alpha" >> $testroot/repo/alpha2
+	git_commit $testroot/repo -m "modified alpha2"
+	local commit_id2=`git_show_head $testroot/repo`
+
+	echo "commit $commit_id2 (master)" > $testroot/stdout.expected
+	echo "commit $commit_id1" >> $testroot/stdout.expected
+
+	got log -r $testroot/repo alpha2 | grep ^commit > $testroot/stdout
+	cmp -s $testroot/stdout.expected $testroot/stdout
+	ret="$?"
+	if [ "$ret" != "0" ]; then
+		diff -u $testroot/stdout.expected $testroot/stdout
+		test_done "$testroot" "$ret"
+		return 1
+	fi
+
+	echo "commit $commit_id0" >> $testroot/stdout.expected
+
+	got log -r $testroot/repo -M alpha2 | grep ^commit > $testroot/stdout
+	cmp -s $testroot/stdout.expected $testroot/stdout
+	ret="$?"
+	if [ "$ret" != "0" ]; then
+		diff -u $testroot/stdout.expected $testroot/stdout
+		test_done "$testroot" "$ret"
+		return 1
+	fi
+
+	# Patches are limited to the path the file had in each commit.
+	echo "--- alpha2" > $testroot/stdout.expected
+	echo "+++ alpha2" >> $testroot/stdout.expected
+	echo "--- alpha" >> $testroot/stdout.expected
+	echo "+++ alpha2" >> $testroot/stdout.expected
+
+	got log -r $testroot/repo -M -p -l 2 alpha2 | \
+		grep '^[-+][-+][-+] ' > $testroot/stdout
+	cmp -s $testroot/stdout.expected $testroot/stdout
+	ret="$?"
+	if [ "$ret" != "0" ]; then
+		diff -u $testroot/stdout.expected $testroot/stdout
+	fi
+	test_done "$testroot" "$ret"
+}
+
+function test_log_path_in_merged_branches {
+	local testroot=`test_init log_path_in_merged_branches`
+	local commit_id0=`git_show_head $testroot/repo`
+
+	(cd $testroot/repo && git checkout -q -b one)
+	echo "modified zeta" > $testroot/repo/epsilon/zeta
+	git_commit $testroot/repo -m "modified zeta"
+	local commit_id1=`git_show_head $testroot/repo`
+
+	(cd $testroot/repo && git checkout -q -b two master)
+	echo "new file" > $testroot/repo/epsilon/new
+	(cd $testroot/repo && git add epsilon/new)
+	git_commit $testroot/repo -m "added epsilon/new"
+
+	(cd $testroot/repo && git checkout -q -b three master)
+	echo "modified alpha" > $testroot/repo/alpha
+	git_commit $testroot/repo -m "modified alpha"
+
+	(cd $testroot/repo && git checkout -q master)
+	(cd $testroot/repo && git merge -q -m "merge" one two three)
+	local commit_id4=`git_show_head $testroot/repo`
+
+	(echo "commit $commit_id0"; echo "commit $commit_id1 (one)"; \
+		echo "commit $commit_id4 (master)") | sort \
+		> $testroot/stdout.expected
+
+	# Branches are traversed side by side, with loose and packed objects.
+	for i in 1 2; do
+		got log -r $testroot/repo epsilon/zeta | grep ^commit | \
+			sort > $testroot/stdout
+		cmp -s $testroot/stdout.expected $testroot/stdout
+		ret="$?"
+		if [ "$ret" != "0" ]; then
+			diff -u $testroot/stdout.expected $testroot/stdout
+			test_done "$testroot" "$ret"
+			return 1
+		fi
+
+		# Freed commits must not be shown twice.
+		(cd $testroot/repo && git rev-list master | sort) \
+			> $testroot/stdout.expected.all
+		got log -r $testroot/repo | grep ^commit | \
+			cut -d ' ' -f 2 | sort > $testroot/stdout
+		cmp -s $testroot/stdout.expected.all $testroot/stdout
+		ret="$?"
+		if [ "$ret" != "0" ]; then
+			diff -u $testroot/stdout.expected.all $testroot/stdout
+			test_done "$testroot" "$ret"
+			return 1
+		fi
+		(cd $testroot/repo && git repack -a -d -q)
+	done
+
+	test_done "$testroot" "0"
+}
+
 run_test test_log_in_repo
 run_test test_log_in_bare_repo
 run_test test_log_in_worktree
 run_test test_log_in_worktree_with_path_prefix
 run_test test_log_tag
 run_test test_log_limit
+run_test test_log_topo_order
+run_test test_log_search
+run_test test_log_follow_renames
+run_test test_log_path_in_merged_branches
@@ -1647,6 +1647,53 @@ function test_update_toggles_xbit {
 	test_done "$testroot" "$ret"
 }
 
+function test_update_to_merged_branch {
+	local testroot=`test_init update_to_merged_branch`
+
+	(cd $testroot/repo && git checkout -q -b newbranch)
+	echo "modified alpha on new branch" > $testroot/repo/alpha
+	git_commit $testroot/repo -m "modified alpha on new branch"
+	local branch_commit=`git_show_head $testroot/repo`
+
+	(cd $testroot/repo && git checkout -q master)
+	echo "modified beta on master" > $testroot/repo/beta
+	git_commit $testroot/repo -m "modified beta on master"
+	(cd $testroot/repo && git merge -q -m "merge newbranch" newbranch)
+	local merge_commit=`git_show_head $testroot/repo`
+
+	echo "U  beta" > $testroot/stdout.expected
+	echo "Updated to commit $merge_commit" >> $testroot/stdout.expected
+
+	# The merge commit's second parent is the work tree's base commit.
+	# Ancestry is checked without and with a reachability bitmap.
+	for i in 1 2; do
+		(cd $testroot/repo && git update-ref refs/heads/newbranch \
+			$branch_commit)
+		got checkout -b newbranch $testroot/repo $testroot/wt$i \
+			> /dev/null
+		ret="$?"
+		if [ "$ret" != "0" ]; then
+			test_done "$testroot" "$ret"
+			return 1
+		fi
+
+		(cd $testroot/repo && git update-ref refs/heads/newbranch \
+			$merge_commit)
+		(cd $testroot/wt$i && got update > $testroot/stdout)
+
+		cmp -s $testroot/stdout.expected $testroot/stdout
+		ret="$?"
+		if [ "$ret" != "0" ]; then
+			diff -u $testroot/stdout.expected $testroot/stdout
+			test_done "$testroot" "$ret"
+			return 1
+		fi
+		(cd $testroot/repo && git repack -a -d -b -q)
+	done
+
+	test_done "$testroot" "0"
+}
+
 run_test test_update_basic
 run_test test_update_adds_file
 run_test test_update_deletes_file
@@ -1678,3 +1725,4 @@ run_test test_update_to_commit_on_wrong_branch
 run_test test_update_bumps_base_commit_id
 run_test test_update_tag
 run_test test_update_toggles_xbit
+run_test test_update_to_merged_branch
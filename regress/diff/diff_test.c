@@ -0,0 +1,335 @@
+/*
+ * Copyright (c) 2026 agent <agent@local>
+ *
+ * Permission to use, copy, modify, and distribute this software for any
+ * purpose with or without fee is hereby granted, provided that the above
+ * copyright notice and this permission notice appear in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL WARRANTIES
+ * WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED WARRANTIES OF
+ * MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE AUTHOR BE LIABLE FOR
+ * ANY SPECIAL, DIRECT, INDIRECT, OR CONSEQUENTIAL DAMAGES OR ANY DAMAGES
+ * WHATSOEVER RESULTING FROM LOSS OF USE, DATA OR PROFITS, WHETHER IN AN
+ * ACTION OF CONTRACT, NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF
+ * OR IN CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include <sys/queue.h>
+#include <sys/stat.h>
+
+#include <stdarg.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <err.h>
+#include <unistd.h>
+
+#include "got_error.h"
+#include "got_object.h"
+#include "got_diff.h"
+
+#include "got_lib_diff.h"
+
+#ifndef nitems
+#define nitems(_a) (sizeof(_a) / sizeof((_a)[0]))
+#endif
+
+static int verbose;
+
+void
+test_printf(char *fmt, ...)
+{
+	va_list ap;
+
+	if (!verbose)
+		return;
+
+	va_start(ap, fmt);
+	vprintf(fmt, ap);
+	va_end(ap);
+}
+
+struct diff_test {
+	const char *old;
+	const char *new;
+} diff_tests[] = {
+	{ "a\nb\nc\nd\ne\nf\ng\nh\ni\nj\nk\nl\nm\nn\no\np\n",
+	  "a\nB\nc\nd\ne\nf\nG\nh\ni\nj\nk\nl\nm\nn\np\nq\n" },
+	{ "", "a\nb\n" },
+	{ "a\nb\n", "" },
+	{ "a\nb\nc", "a\nb\nc\n" },
+	{ "x\ny\n", "x\n  y\nz\n" },
+	{ "same\nsame\nsame\n", "same\nsame\nsame\n" },
+	{ "1\n2\n3\n4\n5\n6\n7\n8\n9\n", "9\n8\n7\n6\n5\n4\n3\n2\n1\n" },
+};
+
+static void
+free_changes(struct got_diff_changes *changes)
+{
+	struct got_diff_change *change;
+
+	while (!SIMPLEQ_EMPTY(&changes->entries)) {
+		change = SIMPLEQ_FIRST(&changes->entries);
+		SIMPLEQ_REMOVE_HEAD(&changes->entries, entry);
+		free(change);
+	}
+	free(changes);
+}
+
+static const struct got_error *
+diff(struct got_diff_changes **changes, struct got_diff_state *ds,
+    struct diff_test *dt, int flags)
+{
+	const struct got_error *err;
+	struct got_diff_args args;
+	int res;
+
+	*changes = calloc(1, sizeof(**changes));
+	if (*changes == NULL)
+		return got_error_from_errno("calloc");
+	SIMPLEQ_INIT(&(*changes)->entries);
+
+	ds->stb1.st_mode = S_IFREG;
+	ds->stb1.st_size = strlen(dt->old);
+	ds->stb2.st_mode = S_IFREG;
+	ds->stb2.st_size = strlen(dt->new);
+
+	memset(&args, 0, sizeof(args));
+	args.diff_format = D_UNIFIED;
+	args.diff_context = 3;
+	args.label[0] = "old";
+	args.label[1] = "new";
+
+	err = got_diffreg_mem(&res, (const uint8_t *)dt->old, strlen(dt->old),
+	    (const uint8_t *)dt->new, strlen(dt->new), flags | D_FORCEASCII,
+	    &args, ds, NULL, *changes);
+	if (err) {
+		free_changes(*changes);
+		*changes = NULL;
+	}
+	return err;
+}
+
+static int
+changes_equal(struct got_diff_changes *c1, struct got_diff_changes *c2)
+{
+	struct got_diff_change *ch1, *ch2;
+
+	if (c1->nchanges != c2->nchanges)
+		return 0;
+
+	ch2 = SIMPLEQ_FIRST(&c2->entries);
+	SIMPLEQ_FOREACH(ch1, &c1->entries, entry) {
+		if (memcmp(&ch1->cv, &ch2->cv, sizeof(ch1->cv)) != 0)
+			return 0;
+		ch2 = SIMPLEQ_NEXT(ch2, entry);
+	}
+	return 1;
+}
+
+/* A diff state reused for many diffs must yield the same results. */
+static int
+diff_state_reuse(void)
+{
+	const struct got_error *err = NULL;
+	struct got_diff_state reused, fresh;
+	struct got_diff_changes *c1, *c2;
+	int flags[] = { 0, D_MYERS, D_HISTOGRAM, D_IGNOREBLANKS };
+	int i, j;
+
+	memset(&reused, 0, sizeof(reused));
+	for (i = 0; i < nitems(flags); i++) {
+		for (j = 0; j < nitems(diff_tests); j++) {
+			memset(&fresh, 0, sizeof(fresh));
+			err = diff(&c1, &fresh, &diff_tests[j], flags[i]);
+			got_diff_state_free(&fresh);
+			if (err)
+				goto done;
+			err = diff(&c2, &reused, &diff_tests[j], flags[i]);
+			if (err) {
+				free_changes(c1);
+				goto done;
+			}
+			if (!changes_equal(c1, c2)) {
+				test_printf("test %d with flags 0x%x differs\n",
+				    j, flags[i]);
+				err = got_error(GOT_ERR_EXPECTED);
+			}
+			free_changes(c1);
+			free_changes(c2);
+			if (err)
+				goto done;
+		}
+	}
+done:
+	got_diff_state_free(&reused);
+	return (err == NULL);
+}
+
+/* Diffing files again must not allocate more memory for the diff state. */
+static int
+diff_state_nallocations(void)
+{
+	const struct got_error *err = NULL;
+	struct got_diff_state ds;
+	struct got_diff_changes *changes;
+	int i, pass, nallocations = 0;
+
+	memset(&ds, 0, sizeof(ds));
+	for (pass = 0; pass < 2; pass++) {
+		for (i = 0; i < nitems(diff_tests); i++) {
+			err = diff(&changes, &ds, &diff_tests[i], 0);
+			if (err)
+				goto done;
+			free_changes(changes);
+		}
+		test_printf("pass %d: %d allocations\n", pass,
+		    ds.nallocations);
+		if (pass == 0)
+			nallocations = ds.nallocations;
+		else if (ds.nallocations != nallocations)
+			err = got_error(GOT_ERR_EXPECTED);
+	}
+done:
+	got_diff_state_free(&ds);
+	return (err == NULL);
+}
+
+static int
+line_has_type(const char *line, uint8_t type)
+{
+	switch (type) {
+	case GOT_DIFF_LINE_LABEL1:
+		return strncmp(line, "--- ", 4) == 0;
+	case GOT_DIFF_LINE_LABEL2:
+		return strncmp(line, "+++ ", 4) == 0;
+	case GOT_DIFF_LINE_HUNK:
+		return strncmp(line, "@@ ", 3) == 0;
+	case GOT_DIFF_LINE_MINUS:
+		return line[0] == '-';
+	case GOT_DIFF_LINE_PLUS:
+		return line[0] == '+';
+	case GOT_DIFF_LINE_CONTEXT:
+		return line[0] == ' ';
+	case GOT_DIFF_LINE_INFO:
+		return line[0] == '\\';
+	default:
+		return 0;
+	}
+}
+
+/* Recorded output lines must match the lines of diff output. */
+static int
+diff_output_lines(void)
+{
+	const struct got_error *err = NULL;
+	struct got_diff_state ds;
+	struct got_diff_args args;
+	struct got_diff_output_line *lines;
+	struct diff_test *dt;
+	char *out;
+	size_t len, nlines, n, i;
+	FILE *f;
+	int j, res;
+
+	for (j = 0; j < nitems(diff_tests); j++) {
+		dt = &diff_tests[j];
+		memset(&ds, 0, sizeof(ds));
+		memset(&args, 0, sizeof(args));
+		args.diff_format = D_UNIFIED;
+		args.diff_context = 3;
+		args.label[0] = "old";
+		args.label[1] = "new";
+		lines = NULL;
+		nlines = 0;
+		args.lines = &lines;
+		args.nlines = &nlines;
+		out = NULL;
+		len = 0;
+
+		f = open_memstream(&out, &len);
+		if (f == NULL)
+			return 0;
+		err = got_diffreg_mem(&res, (const uint8_t *)dt->old,
+		    strlen(dt->old), (const uint8_t *)dt->new,
+		    strlen(dt->new), D_FORCEASCII, &args, &ds, f, NULL);
+		got_diff_state_free(&ds);
+		if (fclose(f) == EOF && err == NULL)
+			err = got_error_from_errno("fclose");
+		if (err)
+			goto done;
+
+		n = 0;
+		for (i = 0; i < len; i++) {
+			if (i == 0 || out[i - 1] == '\n')
+				n++;
+		}
+		if (n != nlines) {
+			test_printf("test %d: %zu lines, %zu recorded\n",
+			    j, n, nlines);
+			err = got_error(GOT_ERR_EXPECTED);
+			goto done;
+		}
+		for (i = 0; i < nlines; i++) {
+			if (lines[i].offset >= len ||
+			    (lines[i].offset > 0 &&
+			    out[lines[i].offset - 1] != '\n') ||
+			    !line_has_type(out + lines[i].offset,
+			    lines[i].type)) {
+				test_printf("test %d: bad line %zu\n", j, i);
+				err = got_error(GOT_ERR_EXPECTED);
+				goto done;
+			}
+		}
+		free(lines);
+		free(out);
+	}
+	return 1;
+done:
+	free(lines);
+	free(out);
+	return (err == NULL);
+}
+
+#define RUN_TEST(expr, name) \
+	{ test_ok = (expr);  \
+	printf("test_%s %s\n", (name), test_ok ? "ok" : "failed"); \
+	failure = (failure || !test_ok); }
+
+void
+usage(void)
+{
+	fprintf(stderr, "usage: diff_test [-v]\n");
+}
+
+int
+main(int argc, char *argv[])
+{
+	int test_ok = 0, failure = 0;
+	int ch;
+
+#ifndef PROFILE
+	if (pledge("stdio", NULL) == -1)
+		err(1, "pledge");
+#endif
+
+	while ((ch = getopt(argc, argv, "v")) != -1) {
+		switch (ch) {
+		case 'v':
+			verbose = 1;
+			break;
+		default:
+			usage();
+			return 1;
+		}
+	}
+	argc -= optind;
+	argv += optind;
+
+	RUN_TEST(diff_state_reuse(), "diff_state_reuse");
+	RUN_TEST(diff_state_nallocations(), "diff_state_nallocations");
+	RUN_TEST(diff_output_lines(), "diff_output_lines");
+
+	return failure ? 1 : 0;
+}
@@ -48,6 +48,7 @@
 #include "got_utf8.h"
 #include "got_cancel.h"
 #include "got_commit_graph.h"
+#include "got_commit_search.h"
 #include "got_blame.h"
 #include "got_privsep.h"
 #include "got_path.h"
@@ -242,6 +243,8 @@ get_color_value(const char *envvar)
 struct tog_diff_view_state {
 	struct got_object_id *id1, *id2;
 	FILE *f;
+	struct got_diff_output_line *lines;
+	size_t nlines;
 	int first_displayed_line;
 	int last_displayed_line;
 	int eof;
@@ -284,6 +287,7 @@ struct tog_log_view_state {
 	struct got_repository *repo;
 	struct got_reflist_head *refs;
 	struct got_object_id *start_id;
+	int order;
 	sig_atomic_t quit;
 	pthread_t thread;
 	struct tog_log_thread_args thread_args;
@@ -441,7 +445,7 @@ static const struct got_error* close_diff_view(struct tog_view *);
 
 static const struct got_error *open_log_view(struct tog_view *,
     struct got_object_id *, struct got_reflist_head *,
-    struct got_repository *, const char *, const char *, int);
+    struct got_repository *, const char *, const char *, int, int);
 static const struct got_error * show_log_view(struct tog_view *);
 static const struct got_error *input_log_view(struct tog_view **,
     struct tog_view **, struct tog_view **, struct tog_view *, int);
@@ -1021,7 +1025,7 @@ usage_log(void)
 {
 	endwin();
 	fprintf(stderr,
-	    "usage: %s log [-c commit] [-r repository-path] [path]\n",
+	    "usage: %s log [-a | -t] [-c commit] [-r repository-path] [path]\n",
 	    getprogname());
 	exit(1);
 }
@@ -1382,74 +1386,125 @@ queue_commits(struct got_commit_graph *graph, struct commit_queue *commits,
     int minqueue, struct got_repository *repo, const char *path,
     int *searching, int *search_next_done, regex_t *regex)
 {
-	const struct got_error *err = NULL;
-	int nqueued = 0, have_match = 0;
+	const struct got_error *err = NULL, *iter_err = NULL;
+	struct got_commit_search *search = NULL;
+	struct got_object_id *ids[GOT_COMMIT_SEARCH_BATCH_SIZE];
+	struct got_commit_object *batch[GOT_COMMIT_SEARCH_BATCH_SIZE];
+	int matches[GOT_COMMIT_SEARCH_BATCH_SIZE];
+	int nqueued = 0, have_match = 0, end = 0, nids, maxids, i;
 
 	/*
 	 * We keep all commits open throughout the lifetime of the log
 	 * view in order to avoid having to re-fetch commits from disk
 	 * while updating the display.
 	 */
-	while (nqueued < minqueue ||
-	    (*searching == TOG_SEARCH_FORWARD && !*search_next_done)) {
-		struct got_object_id *id;
-		struct got_commit_object *commit;
+	while (!have_match && !end && iter_err == NULL &&
+	    (nqueued < minqueue ||
+	    (*searching == TOG_SEARCH_FORWARD && !*search_next_done))) {
 		struct commit_queue_entry *entry;
 		int errcode;
 
-		err = got_commit_graph_iter_next(&id, graph);
-		if (err) {
-			if (err->code != GOT_ERR_ITER_NEED_MORE)
-				break;
-			err = got_commit_graph_fetch_commits(graph,
-			    minqueue, repo, NULL, NULL);
-			if (err)
-				return err;
-			continue;
+		/*
+		 * While searching, read and match a batch of commits at a
+		 * time. A match is located by search_next_log_view() once
+		 * the batch has been queued.
+		 */
+		if (*searching == TOG_SEARCH_FORWARD && !*search_next_done) {
+			if (search == NULL) {
+				err = got_commit_search_open(&search, regex,
+				    GOT_COMMIT_SEARCH_LOGMSG |
+				    GOT_COMMIT_SEARCH_AUTHOR |
+				    GOT_COMMIT_SEARCH_ID);
+				if (err)
+					break;
+			}
+			maxids = GOT_COMMIT_SEARCH_BATCH_SIZE;
+		} else {
+			maxids = MIN(minqueue - nqueued,
+			    GOT_COMMIT_SEARCH_BATCH_SIZE);
 		}
 
-		if (id == NULL)
-			break;
+		nids = 0;
+		while (nids < maxids) {
+			struct got_object_id *id;
 
-		err = got_object_open_as_commit(&commit, repo, id);
-		if (err)
+			err = got_commit_graph_iter_next(&id, graph);
+			if (err) {
+				if (err->code != GOT_ERR_ITER_NEED_MORE) {
+					iter_err = err;
+					err = NULL;
+					break;
+				}
+				err = got_commit_graph_fetch_commits(graph,
+				    minqueue, repo, NULL, NULL);
+				if (err)
+					goto done;
+				continue;
+			}
+			if (id == NULL) {
+				end = 1;
+				break;
+			}
+			ids[nids++] = id;
+		}
+		if (nids == 0)
 			break;
-		entry = alloc_commit_queue_entry(commit, id);
-		if (entry == NULL) {
-			err = got_error_from_errno("alloc_commit_queue_entry");
+
+		err = got_object_open_as_commits(batch, repo, ids, nids);
+		if (err) {
+			for (i = 0; i < nids; i++) {
+				if (batch[i])
+					got_object_commit_close(batch[i]);
+			}
 			break;
 		}
 
+		if (search) {
+			err = got_commit_search_match(matches, search, ids,
+			    batch, nids);
+			for (i = 0; i < nids && err == NULL; i++) {
+				if (matches[i])
+					have_match = 1;
+			}
+		}
+
 		errcode = pthread_mutex_lock(&tog_mutex);
 		if (errcode) {
-			err = got_error_set_errno(errcode,
-			    "pthread_mutex_lock");
+			if (err == NULL)
+				err = got_error_set_errno(errcode,
+				    "pthread_mutex_lock");
+			for (i = 0; i < nids; i++)
+				got_object_commit_close(batch[i]);
 			break;
 		}
 
-		entry->idx = commits->ncommits;
-		TAILQ_INSERT_TAIL(&commits->head, entry, entry);
-		nqueued++;
-		commits->ncommits++;
-
-		if (*searching == TOG_SEARCH_FORWARD && !*search_next_done) {
-			err = match_commit(&have_match, id, commit, regex);
-			if (err) {
-				pthread_mutex_lock(&tog_mutex);
+		for (i = 0; i < nids; i++) {
+			entry = alloc_commit_queue_entry(batch[i], ids[i]);
+			if (entry == NULL) {
+				if (err == NULL)
+					err = got_error_from_errno(
+					    "alloc_commit_queue_entry");
+				for (; i < nids; i++)
+					got_object_commit_close(batch[i]);
 				break;
 			}
+			entry->idx = commits->ncommits;
+			TAILQ_INSERT_TAIL(&commits->head, entry, entry);
+			nqueued++;
+			commits->ncommits++;
 		}
 
 		errcode = pthread_mutex_unlock(&tog_mutex);
 		if (errcode && err == NULL)
 			err = got_error_set_errno(errcode,
 			    "pthread_mutex_unlock");
-
-		if (have_match)
+		if (err)
 			break;
 	}
-
-	return err;
+done:
+	if (search)
+		got_commit_search_close(search);
+	return err ? err : iter_err;
 }
 
 static const struct got_error *
@@ -2109,7 +2164,7 @@ search_next_log_view(struct tog_view *view)
 static const struct got_error *
 open_log_view(struct tog_view *view, struct got_object_id *start_id,
     struct got_reflist_head *refs, struct got_repository *repo,
-    const char *head_ref_name, const char *path, int check_disk)
+    const char *head_ref_name, const char *path, int check_disk, int order)
 {
 	const struct got_error *err = NULL;
 	struct tog_log_view_state *s = &view->state.log;
@@ -2128,6 +2183,7 @@ open_log_view(struct tog_view *view, struct got_object_id *start_id,
 	s->refs = refs;
 	s->repo = repo;
 	s->head_ref_name = head_ref_name;
+	s->order = order;
 	s->start_id = got_object_id_dup(start_id);
 	if (s->start_id == NULL) {
 		err = got_error_from_errno("got_object_id_dup");
@@ -2164,7 +2220,7 @@ open_log_view(struct tog_view *view, struct got_object_id *start_id,
 	if (err)
 		goto done;
 	err = got_commit_graph_open(&thread_graph, start_id, s->in_repo_path,
-	    0, thread_repo);
+	    0, order, thread_repo);
 	if (err)
 		goto done;
 
@@ -2359,7 +2415,8 @@ input_log_view(struct tog_view **new_view, struct tog_view **dead_view,
 				return got_error_from_errno(
 				    "view_open");
 			err = open_log_view(lv, s->start_id, s->refs,
-			    s->repo, s->head_ref_name, parent_path, 0);
+			    s->repo, s->head_ref_name, parent_path, 0,
+			    s->order);
 			if (err)
 				return err;;
 			if (view_is_parent_view(view))
@@ -2400,7 +2457,7 @@ input_log_view(struct tog_view **new_view, struct tog_view **dead_view,
 			return err;
 		}
 		err = open_log_view(lv, start_id, s->refs, s->repo,
-		    s->head_ref_name, in_repo_path, 0);
+		    s->head_ref_name, in_repo_path, 0, s->order);
 		if (err) {
 			free(start_id);
 			view_close(lv);
@@ -2416,6 +2473,22 @@ input_log_view(struct tog_view **new_view, struct tog_view **dead_view,
 	return err;
 }
 
+/* Allow blame results to be written to the repository's blame cache. */
+static const struct got_error *
+unveil_blame_cache(struct got_repository *repo)
+{
+	const struct got_error *err = NULL;
+	char *path;
+
+	path = got_repo_get_path_blame_cache(repo);
+	if (path == NULL)
+		return got_error_from_errno("got_repo_get_path_blame_cache");
+	if (unveil(path, "rwc") != 0)
+		err = got_error_from_errno2("unveil", path);
+	free(path);
+	return err;
+}
+
 static const struct got_error *
 apply_unveil(const char *repo_path, const char *worktree_path)
 {
@@ -2473,7 +2546,7 @@ cmd_log(int argc, char *argv[])
 	struct got_object_id *start_id = NULL;
 	char *path = NULL, *repo_path = NULL, *cwd = NULL;
 	char *start_commit = NULL, *head_ref_name = NULL;
-	int ch;
+	int ch, order = GOT_COMMIT_GRAPH_ORDER_DATE;
 	struct tog_view *view;
 
 	SIMPLEQ_INIT(&refs);
@@ -2484,8 +2557,11 @@ cmd_log(int argc, char *argv[])
 		err(1, "pledge");
 #endif
 
-	while ((ch = getopt(argc, argv, "c:r:")) != -1) {
+	while ((ch = getopt(argc, argv, "ac:r:t")) != -1) {
 		switch (ch) {
+		case 'a':
+			order = GOT_COMMIT_GRAPH_ORDER_AUTHOR_DATE;
+			break;
 		case 'c':
 			start_commit = optarg;
 			break;
@@ -2495,6 +2571,9 @@ cmd_log(int argc, char *argv[])
 				return got_error_from_errno2("realpath",
 				    optarg);
 			break;
+		case 't':
+			order = GOT_COMMIT_GRAPH_ORDER_TOPO;
+			break;
 		default:
 			usage_log();
 			/* NOTREACHED */
@@ -2554,6 +2633,10 @@ cmd_log(int argc, char *argv[])
 	if (error != NULL)
 		goto done;
 
+	error = unveil_blame_cache(repo);
+	if (error)
+		goto done;
+
 	error = apply_unveil(got_repo_get_path(repo),
 	    worktree ? got_worktree_get_root_path(worktree) : NULL);
 	if (error)
@@ -2593,7 +2676,7 @@ cmd_log(int argc, char *argv[])
 		}
 	}
 	error = open_log_view(view, start_id, &refs, repo, head_ref_name,
-	    path, 1);
+	    path, 1, order);
 	if (error)
 		goto done;
 	if (worktree) {
@@ -2660,10 +2743,35 @@ match_color(struct tog_colors *colors, const char *line)
 	return NULL;
 }
 
+static struct tog_color *
+match_diff_color(struct tog_colors *colors, struct got_diff_output_line *lines,
+    size_t nlines, int lineno, const char *line)
+{
+	if (lineno < 1 || lineno > nlines)
+		return match_color(colors, line);
+
+	switch (lines[lineno - 1].type) {
+	case GOT_DIFF_LINE_MINUS:
+	case GOT_DIFF_LINE_LABEL1:
+		return get_color(colors, TOG_COLOR_DIFF_MINUS);
+	case GOT_DIFF_LINE_PLUS:
+	case GOT_DIFF_LINE_LABEL2:
+		return get_color(colors, TOG_COLOR_DIFF_PLUS);
+	case GOT_DIFF_LINE_HUNK:
+		return get_color(colors, TOG_COLOR_DIFF_CHUNK_HEADER);
+	case GOT_DIFF_LINE_META:
+		return get_color(colors, TOG_COLOR_DIFF_META);
+	case GOT_DIFF_LINE_NONE:
+		return match_color(colors, line);
+	default:
+		return NULL;
+	}
+}
+
 static const struct got_error *
-draw_file(struct tog_view *view, FILE *f, int *first_displayed_line,
-    int *last_displayed_line, int *eof, int max_lines, char *header,
-    struct tog_colors *colors)
+draw_file(struct tog_view *view, FILE *f, struct got_diff_output_line *lines,
+    size_t nlines_total, int *first_displayed_line, int *last_displayed_line,
+    int *eof, int max_lines, char *header, struct tog_colors *colors)
 {
 	const struct got_error *err;
 	int nlines = 0, nprinted = 0;
@@ -2673,7 +2781,14 @@ draw_file(struct tog_view *view, FILE *f, int *first_displayed_line,
 	wchar_t *wline;
 	int width;
 
-	rewind(f);
+	/* Skip lines above the view without reading them. */
+	if (*first_displayed_line > 1 &&
+	    *first_displayed_line <= nlines_total) {
+		nlines = *first_displayed_line - 1;
+		if (fseeko(f, lines[nlines].offset, SEEK_SET) == -1)
+			return got_error_from_errno("fseeko");
+	} else
+		rewind(f);
 	werase(view->window);
 
 	if (header) {
@@ -2713,7 +2828,8 @@ draw_file(struct tog_view *view, FILE *f, int *first_displayed_line,
 			return err;
 		}
 
-		tc = match_color(colors, line);
+		tc = match_diff_color(colors, lines, nlines_total, nlines,
+		    line);
 		if (tc)
 			wattr_on(view->window,
 			    COLOR_PAIR(tc->colorpair), NULL);
@@ -2770,14 +2886,28 @@ get_datestr(time_t *time, char *datebuf)
 	return s;
 }
 
+/* Record the line about to be written to a diff view's file. */
 static const struct got_error *
-write_commit_info(struct got_object_id *commit_id,
-    struct got_reflist_head *refs, struct got_repository *repo, FILE *outfile)
+add_line(struct tog_diff_view_state *s, FILE *f)
+{
+	off_t off;
+
+	off = ftello(f);
+	if (off == -1)
+		return got_error_from_errno("ftello");
+	return got_diff_add_line(&s->lines, &s->nlines, off,
+	    GOT_DIFF_LINE_NONE);
+}
+
+static const struct got_error *
+write_commit_info(struct tog_diff_view_state *s,
+    struct got_object_id *commit_id, struct got_reflist_head *refs,
+    struct got_repository *repo, FILE *outfile)
 {
 	const struct got_error *err = NULL;
 	char datebuf[26], *datestr;
 	struct got_commit_object *commit;
-	char *id_str = NULL, *logmsg = NULL;
+	char *id_str = NULL, *logmsg = NULL, *line, *nl;
 	time_t committer_time;
 	const char *author, *committer;
 	char *refs_str = NULL;
@@ -2798,11 +2928,17 @@ write_commit_info(struct got_object_id *commit_id,
 		goto done;
 	}
 
+	err = add_line(s, outfile);
+	if (err)
+		goto done;
 	if (fprintf(outfile, "commit %s%s%s%s\n", id_str, refs_str ? " (" : "",
 	    refs_str ? refs_str : "", refs_str ? ")" : "") < 0) {
 		err = got_error_from_errno("fprintf");
 		goto done;
 	}
+	err = add_line(s, outfile);
+	if (err)
+		goto done;
 	if (fprintf(outfile, "from: %s\n",
 	    got_object_commit_get_author(commit)) < 0) {
 		err = got_error_from_errno("fprintf");
@@ -2810,24 +2946,43 @@ write_commit_info(struct got_object_id *commit_id,
 	}
 	committer_time = got_object_commit_get_committer_time(commit);
 	datestr = get_datestr(&committer_time, datebuf);
-	if (datestr && fprintf(outfile, "date: %s UTC\n", datestr) < 0) {
-		err = got_error_from_errno("fprintf");
-		goto done;
+	if (datestr) {
+		err = add_line(s, outfile);
+		if (err)
+			goto done;
+		if (fprintf(outfile, "date: %s UTC\n", datestr) < 0) {
+			err = got_error_from_errno("fprintf");
+			goto done;
+		}
 	}
 	author = got_object_commit_get_author(commit);
 	committer = got_object_commit_get_committer(commit);
-	if (strcmp(author, committer) != 0 &&
-	    fprintf(outfile, "via: %s\n", committer) < 0) {
-		err = got_error_from_errno("fprintf");
-		goto done;
+	if (strcmp(author, committer) != 0) {
+		err = add_line(s, outfile);
+		if (err)
+			goto done;
+		if (fprintf(outfile, "via: %s\n", committer) < 0) {
+			err = got_error_from_errno("fprintf");
+			goto done;
+		}
 	}
 	err = got_object_commit_get_logmsg(&logmsg, commit);
 	if (err)
 		goto done;
-	if (fprintf(outfile, "%s\n", logmsg) < 0) {
-		err = got_error_from_errno("fprintf");
-		goto done;
-	}
+	line = logmsg;
+	do {
+		err = add_line(s, outfile);
+		if (err)
+			goto done;
+		nl = strchr(line, '\n');
+		if (nl)
+			*nl = '\0';
+		if (fprintf(outfile, "%s\n", line) < 0) {
+			err = got_error_from_errno("fprintf");
+			goto done;
+		}
+		line = nl ? nl + 1 : NULL;
+	} while (line);
 done:
 	free(id_str);
 	free(logmsg);
@@ -2853,6 +3008,9 @@ create_diff(struct tog_diff_view_state *s)
 		goto done;
 	}
 	s->f = f;
+	free(s->lines);
+	s->lines = NULL;
+	s->nlines = 0;
 
 	if (s->id1)
 		err = got_object_get_type(&obj_type, s->repo, s->id1);
@@ -2863,12 +3021,12 @@ create_diff(struct tog_diff_view_state *s)
 
 	switch (obj_type) {
 	case GOT_OBJ_TYPE_BLOB:
-		err = got_diff_objects_as_blobs(s->id1, s->id2, NULL, NULL,
-		    s->diff_context, 0, s->repo, f);
+		err = got_diff_objects_as_blobs(&s->lines, &s->nlines,
+		    s->id1, s->id2, NULL, NULL, s->diff_context, 0, s->repo, f);
 		break;
 	case GOT_OBJ_TYPE_TREE:
-		err = got_diff_objects_as_trees(s->id1, s->id2, "", "",
-		    s->diff_context, 0, s->repo, f);
+		err = got_diff_objects_as_trees(&s->lines, &s->nlines,
+		    s->id1, s->id2, "", "", s->diff_context, 0, s->repo, f);
 		break;
 	case GOT_OBJ_TYPE_COMMIT: {
 		const struct got_object_id_queue *parent_ids;
@@ -2880,21 +3038,24 @@ create_diff(struct tog_diff_view_state *s)
 			break;
 		/* Show commit info if we're diffing to a parent/root commit. */
 		if (s->id1 == NULL)
-			write_commit_info(s->id2, s->refs, s->repo, f);
+			err = write_commit_info(s, s->id2, s->refs, s->repo,
+			    f);
 		else {
 			parent_ids = got_object_commit_get_parent_ids(commit2);
 			SIMPLEQ_FOREACH(pid, parent_ids, entry) {
 				if (got_object_id_cmp(s->id1, pid->id) == 0) {
-					write_commit_info(s->id2, s->refs,
-					    s->repo, f);
+					err = write_commit_info(s, s->id2,
+					    s->refs, s->repo, f);
 					break;
 				}
 			}
 		}
 		got_object_commit_close(commit2);
+		if (err)
+			break;
 
-		err = got_diff_objects_as_commits(s->id1, s->id2,
-		    s->diff_context, 0, s->repo, f);
+		err = got_diff_objects_as_commits(&s->lines, &s->nlines,
+		    s->id1, s->id2, s->diff_context, 0, s->repo, f);
 		break;
 	}
 	default:
@@ -2949,6 +3110,8 @@ open_diff_view(struct tog_view *view, struct got_object_id *id1,
 		return got_error_from_errno("got_object_id_dup");
 	}
 	view->state.diff.f = NULL;
+	view->state.diff.lines = NULL;
+	view->state.diff.nlines = 0;
 	view->state.diff.first_displayed_line = 1;
 	view->state.diff.last_displayed_line = view->nlines;
 	view->state.diff.diff_context = 3;
@@ -3034,6 +3197,8 @@ close_diff_view(struct tog_view *view)
 	view->state.diff.id2 = NULL;
 	if (view->state.diff.f && fclose(view->state.diff.f) == EOF)
 		err = got_error_from_errno("fclose");
+	free(view->state.diff.lines);
+	view->state.diff.lines = NULL;
 	free_colors(&view->state.diff.colors);
 	return err;
 }
@@ -3064,9 +3229,9 @@ show_diff_view(struct tog_view *view)
 	free(id_str1);
 	free(id_str2);
 
-	return draw_file(view, s->f, &s->first_displayed_line,
-	    &s->last_displayed_line, &s->eof, view->nlines,
-	    header, &s->colors);
+	return draw_file(view, s->f, s->lines, s->nlines,
+	    &s->first_displayed_line, &s->last_displayed_line, &s->eof,
+	    view->nlines, header, &s->colors);
 }
 
 static const struct got_error *
@@ -3129,14 +3294,9 @@ input_diff_view(struct tog_view **new_view, struct tog_view **dead_view,
 	case ' ':
 		if (s->eof)
 			break;
-		i = 0;
-		while (!s->eof && i++ < view->nlines - 1) {
-			char *line;
-			line = parse_next_line(s->f, NULL);
-			s->first_displayed_line++;
-			if (line == NULL)
-				break;
-		}
+		s->first_displayed_line += view->nlines - 1;
+		if (s->first_displayed_line > s->nlines)
+			s->first_displayed_line = MAX(s->nlines, 1);
 		break;
 	case '[':
 		if (s->diff_context > 0) {
@@ -4183,6 +4343,10 @@ cmd_blame(int argc, char *argv[])
 	if (error != NULL)
 		goto done;
 
+	error = unveil_blame_cache(repo);
+	if (error)
+		goto done;
+
 	error = apply_unveil(got_repo_get_path(repo), NULL);
 	if (error)
 		goto done;
@@ -4548,7 +4712,8 @@ log_tree_entry(struct tog_view **new_view, int begin_x,
 	if (err)
 		return err;
 
-	err = open_log_view(log_view, commit_id, refs, repo, NULL, path, 0);
+	err = open_log_view(log_view, commit_id, refs, repo, NULL, path, 0,
+	    GOT_COMMIT_GRAPH_ORDER_DATE);
 	if (err)
 		view_close(log_view);
 	else
@@ -5003,6 +5168,10 @@ cmd_tree(int argc, char *argv[])
 	if (error != NULL)
 		goto done;
 
+	error = unveil_blame_cache(repo);
+	if (error)
+		goto done;
+
 	error = apply_unveil(got_repo_get_path(repo), NULL);
 	if (error)
 		goto done;